@@ -32,6 +32,12 @@
     - LZ4 source repository : https://github.com/lz4/lz4
 */
 
+/* Local change of the sequence frame plugin to lz4 1.8.3 :
+ * LZ4_decompress_generic() copies the last literals of a block with memmove() instead of memcpy(),
+ * as lz4 1.9.2 and later do, so that a block can be decoded in place (see decompressor.cpp).
+ * LZ4_DECOMPRESS_INPLACE_MEMMOVE in lz4.h marks the change. Keep both when updating to an lz4
+ * older than 1.9.2, newer versions need neither. */
+
 
 /*-************************************
 *  Tuning parameters
@@ -1546,7 +1552,7 @@ LZ4_decompress_generic(
                     if ((!endOnInput) && (cpy != oend)) goto _output_error;       /* Error : block decoding must stop exactly there */
                     if ((endOnInput) && ((ip+length != iend) || (cpy > oend))) goto _output_error;   /* Error : input must be consumed */
                 }
-                memcpy(op, ip, length);
+                memmove(op, ip, length);   /* local change : the buffers overlap when decoding in place */
                 ip += length;
                 op += length;
                 if (!partialDecoding || (cpy == oend)) {
@@ -97,6 +97,9 @@ extern "C" {
 
 #define LZ4_VERSION_NUMBER (LZ4_VERSION_MAJOR *100*100 + LZ4_VERSION_MINOR *100 + LZ4_VERSION_RELEASE)
 
+/* Local change of the sequence frame plugin : lz4.c decodes blocks in place like lz4 1.9.2, see the top of lz4.c */
+#define LZ4_DECOMPRESS_INPLACE_MEMMOVE 1
+
 #define LZ4_LIB_VERSION LZ4_VERSION_MAJOR.LZ4_VERSION_MINOR.LZ4_VERSION_RELEASE
 #define LZ4_QUOTE(str) #str
 #define LZ4_EXPAND_AND_QUOTE(str) LZ4_QUOTE(str)
@@ -0,0 +1,122 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "codecregistry.h"
+
+#include <string.h>
+
+#include "decompressor.h"
+#include "texturepackage.h"
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+#include "zstd.h"
+#endif
+
+namespace
+{
+    int decodeNone(Decompressor&, const void*, size_t compressedSize, const void* compressedBuffer,
+                   size_t decompressedSize, void* decompressedBuffer_o)
+    {
+        // Frames may be followed by alignment padding.
+        if (compressedSize < decompressedSize) {
+            return -1;
+        }
+
+        memcpy(decompressedBuffer_o, compressedBuffer, decompressedSize);
+        return 0;
+    }
+
+    int decodeLZ4(Decompressor& decompressor, const void*, size_t compressedSize, const void* compressedBuffer,
+                  size_t decompressedSize, void* decompressedBuffer_o)
+    {
+        return decompressor.decompressLZ4(compressedSize, compressedBuffer, decompressedSize, decompressedBuffer_o);
+    }
+
+    int decodeLZ4InPlace(Decompressor& decompressor, const void*, size_t compressedSize, size_t decompressedSize,
+                         void* buffer_io, size_t bufferSize)
+    {
+        return decompressor.decompressLZ4InPlace(compressedSize, decompressedSize, buffer_io, bufferSize);
+    }
+
+    int decodeLZ4Block(Decompressor& decompressor, const void*, size_t compressedSize, const void* compressedBuffer,
+                       size_t decompressedSize, void* decompressedBuffer_o)
+    {
+        return decompressor.decompressLZ4Block(compressedSize, compressedBuffer, decompressedSize,
+                                               decompressedBuffer_o);
+    }
+
+    int decodeLZ4BlockInPlace(Decompressor& decompressor, const void*, size_t compressedSize, size_t decompressedSize,
+                              void* buffer_io, size_t bufferSize)
+    {
+        return decompressor.decompressLZ4BlockInPlace(compressedSize, decompressedSize, buffer_io, bufferSize);
+    }
+
+    int decodeZLIB(Decompressor& decompressor, const void*, size_t compressedSize, const void* compressedBuffer,
+                   size_t decompressedSize, void* decompressedBuffer_o)
+    {
+        return decompressor.decompressZLIB(compressedSize, compressedBuffer, decompressedSize, decompressedBuffer_o);
+    }
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    int decodeZSTD(Decompressor& decompressor, const void* dictionary, size_t compressedSize,
+                   const void* compressedBuffer, size_t decompressedSize, void* decompressedBuffer_o)
+    {
+        return decompressor.decompressZSTD(static_cast<const ZSTD_DDict*>(dictionary), compressedSize,
+                                           compressedBuffer, decompressedSize, decompressedBuffer_o);
+    }
+
+    void* createZSTDDictionary(const void* data, size_t size)
+    {
+        // The digested dictionary is shared by the decoding threads, which only read it.
+        return ZSTD_createDDict(data, size);
+    }
+
+    void freeZSTDDictionary(void* dictionary)
+    {
+        ZSTD_freeDDict(static_cast<ZSTD_DDict*>(dictionary));
+    }
+#endif
+}
+
+CodecRegistry& CodecRegistry::getInstance()
+{
+    static CodecRegistry registry;
+    return registry;
+}
+
+CodecRegistry::CodecRegistry()
+{
+    const FrameCodec builtInCodecs[] = {
+        { TexturePackageCodec_None, "none", decodeNone, nullptr, nullptr, nullptr, nullptr },
+        { TexturePackageCodec_LZ4, "lz4", decodeLZ4, decodeLZ4InPlace, GetBufferSizeLZ4InPlace, nullptr, nullptr },
+        { TexturePackageCodec_ZLIB, "zlib", decodeZLIB, nullptr, nullptr, nullptr, nullptr },
+        { TexturePackageCodec_LZ4Block, "lz4block", decodeLZ4Block, decodeLZ4BlockInPlace,
+          GetBufferSizeLZ4BlockInPlace, nullptr, nullptr },
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+        { TexturePackageCodec_ZSTD, "zstd", decodeZSTD, nullptr, nullptr, createZSTDDictionary, freeZSTDDictionary }
+#endif
+    };
+
+    m_codecs.assign(builtInCodecs, builtInCodecs + sizeof(builtInCodecs) / sizeof(builtInCodecs[0]));
+}
+
+void CodecRegistry::registerCodec(const FrameCodec& codec)
+{
+    for (FrameCodec& registeredCodec : m_codecs) {
+        if (registeredCodec.codec == codec.codec) {
+            registeredCodec = codec;
+            return;
+        }
+    }
+
+    m_codecs.push_back(codec);
+}
+
+const FrameCodec* CodecRegistry::findCodec(uint32_t codec) const
+{
+    for (const FrameCodec& registeredCodec : m_codecs) {
+        if (registeredCodec.codec == codec) {
+            return &registeredCodec;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,62 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_CODECREGISTRY_H_
+#define PLUGIN_SRC_CODECREGISTRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class Decompressor;
+
+// Decodes a frame payload into a texture, the decompressor holds the contexts of the calling thread. The
+// dictionary is the one created from the package for the codec, or null.
+typedef int (*FrameDecodeFunction)(Decompressor& decompressor, const void* dictionary, size_t compressedSize,
+                                   const void* compressedBuffer, size_t decompressedSize, void* decompressedBuffer_o);
+// Decodes a frame payload stored at the end of the buffer to the start of the same buffer.
+typedef int (*FrameDecodeInPlaceFunction)(Decompressor& decompressor, const void* dictionary, size_t compressedSize,
+                                          size_t decompressedSize, void* buffer_io, size_t bufferSize);
+// Gets the buffer size the in place decode of a frame payload needs, the margin follows the compressed size.
+typedef size_t (*FrameInPlaceBufferSizeFunction)(size_t compressedSize, size_t decompressedSize);
+// Prepares the dictionary bytes of a package for decoding, the data need not outlive the call.
+typedef void* (*FrameDictionaryCreateFunction)(const void* data, size_t size);
+typedef void (*FrameDictionaryFreeFunction)(void* dictionary);
+
+struct FrameCodec {
+    // codec id of the package index, see TexturePackageCodec
+    uint16_t codec;
+    const char* name;
+    FrameDecodeFunction decode;
+    // null when the codec cannot decode in place
+    FrameDecodeInPlaceFunction decodeInPlace;
+    FrameInPlaceBufferSizeFunction getInPlaceBufferSize;
+    // null when the codec does not use the dictionary of a package
+    FrameDictionaryCreateFunction createDictionary;
+    FrameDictionaryFreeFunction freeDictionary;
+};
+
+// The codecs frames can be decoded with, keyed by the codec id in the package. The built-in codecs
+// are registered when the registry is first used, more can be added with registerCodec before a
+// package that uses them is loaded.
+class CodecRegistry
+{
+public:
+
+    static CodecRegistry& getInstance();
+
+    // add a codec, or replace the codec of the same id
+    void registerCodec(const FrameCodec& codec);
+    // get the codec of an id, null when there is none
+    const FrameCodec* findCodec(uint32_t codec) const;
+
+private:
+
+    CodecRegistry();
+    CodecRegistry(const CodecRegistry&);
+    CodecRegistry& operator=(const CodecRegistry&);
+
+    std::vector<FrameCodec> m_codecs;
+};
+
+#endif // PLUGIN_SRC_CODECREGISTRY_H_
@@ -0,0 +1,68 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "decodeloadmonitor.h"
+
+namespace
+{
+    // weight of the newest decode time in the moving average
+    const double AverageWeight = 1.0 / 8.0;
+    // decode times added before the average is trusted, also after every switch
+    const uint32_t SettleFrameCount = 16;
+    // share of the frame interval the average may take before a smaller track is used; the rest is
+    // left for the upload and for the other work of the device
+    const double StepDownLoad = 0.75;
+    // share of the frame interval below which a larger track is used, a quarter of StepDownLoad with
+    // some margin, since every larger track holds about four times the blocks
+    const double StepUpLoad = 0.15;
+}
+
+DecodeLoadMonitor::DecodeLoadMonitor()
+    : m_frameInterval(0.0)
+    , m_averageDecodeTime(0.0)
+    , m_frameCount(0)
+{
+}
+
+void DecodeLoadMonitor::setFrameInterval(double frameInterval)
+{
+    m_frameInterval = frameInterval;
+    reset();
+}
+
+double DecodeLoadMonitor::getFrameInterval() const
+{
+    return m_frameInterval;
+}
+
+void DecodeLoadMonitor::reset()
+{
+    m_averageDecodeTime = 0.0;
+    m_frameCount = 0;
+}
+
+int DecodeLoadMonitor::addDecodeTime(double decodeTime)
+{
+    if (0 == m_frameCount) {
+        m_averageDecodeTime = decodeTime;
+    } else {
+        m_averageDecodeTime += (decodeTime - m_averageDecodeTime) * AverageWeight;
+    }
+    ++m_frameCount;
+
+    if (m_frameCount < SettleFrameCount || m_frameInterval <= 0.0) {
+        return 0;
+    }
+
+    int step = 0;
+    if (m_averageDecodeTime > m_frameInterval * StepDownLoad) {
+        step = 1;
+    } else if (m_averageDecodeTime < m_frameInterval * StepUpLoad) {
+        step = -1;
+    }
+    return step;
+}
+
+double DecodeLoadMonitor::getAverageDecodeTime() const
+{
+    return m_averageDecodeTime;
+}
@@ -0,0 +1,37 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_DECODELOADMONITOR_H_
+#define PLUGIN_SRC_DECODELOADMONITOR_H_
+
+#include <stdint.h>
+
+// Watches the decode time of the frames against the frame interval of the animation. When the moving
+// average comes close to the interval the frames are about to be shown late, the monitor asks for the
+// next smaller resolution track. It asks for the next larger track only when the average is so low
+// that the larger track, about four times the blocks, still fits, so that it does not switch back and
+// forth between two tracks.
+class DecodeLoadMonitor
+{
+public:
+
+    DecodeLoadMonitor();
+
+    // time between two frames of the animation, in milliseconds
+    void setFrameInterval(double frameInterval);
+    double getFrameInterval() const;
+    // forget the decode times, after the track changed
+    void reset();
+    // add the decode time of a frame in milliseconds, returns the change of the track index that the
+    // load asks for: 1 for the next smaller track, -1 for the next larger one, 0 to stay
+    int addDecodeTime(double decodeTime);
+
+    double getAverageDecodeTime() const;
+
+private:
+
+    double m_frameInterval;
+    double m_averageDecodeTime;
+    uint32_t m_frameCount;
+};
+
+#endif // PLUGIN_SRC_DECODELOADMONITOR_H_
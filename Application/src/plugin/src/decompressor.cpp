@@ -1,68 +1,351 @@
 // Copyright 2022-2023 by Rightware. All rights reserved.
 
 #include "decompressor.h"
+#include "lz4.h"
 #include "lz4frame_static.h"
+#include "xxhash.h"
 #include "zlib.h"
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+#include "zstd.h"
+#include "zstd_errors.h"
+#endif
 
-#if defined (__cplusplus)
-extern "C" {
+#include <string.h>
+
+#include <algorithm>
+
+// lz4 decodes a block in place from 1.9.2 on, which also defines the margin in lz4.h. The vendored lz4 1.8.3
+// has the memmove of 1.9.2 as a local change, see lz4/lz4.c.
+#if LZ4_VERSION_NUMBER < 10902 && !defined(LZ4_DECOMPRESS_INPLACE_MEMMOVE)
+#error "lz4 before 1.9.2 needs the in place change of lz4/lz4.c"
+#endif
+#ifndef LZ4_DECOMPRESS_INPLACE_MARGIN
+#define LZ4_DECOMPRESS_INPLACE_MARGIN(compressedSize) (((compressedSize) >> 8) + 32)
 #endif
 
-    int DecompressBufferLZ4(size_t compressedSize, void* compressedBuffer, size_t decompressedSize,
-                            void* decompressedBuffer_o)
+namespace
+{
+    // Every LZ4 frame block starts with its size, the high bit marks a block stored uncompressed.
+    const unsigned int LZ4FrameBlockHeaderSize = 4;
+    const unsigned int LZ4FrameChecksumSize = 4;
+    const unsigned int LZ4FrameUncompressedBit = 0x80000000U;
+    // Linked blocks reference up to 64 KB of the previously decoded data.
+    const size_t LZ4FrameMaxDictionarySize = 64 * 1024;
+    // Blocks of a frame are at least 64 KB, each adds a size and an optional checksum to the input.
+    const size_t LZ4FrameMinBlockSize = 64 * 1024;
+
+    unsigned int readLittleEndian32(const unsigned char* data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<unsigned int>(data[3]) << 24);
+    }
+
+    // largest block of an LZ4 frame, 0 for an invalid block size id
+    size_t getLZ4FrameMaxBlockSize(LZ4F_blockSizeID_t blockSizeID)
     {
-        size_t ret;
-        LZ4F_dctx* dctx;
+        switch (blockSizeID) {
+        case LZ4F_default:
+        case LZ4F_max64KB:
+            return 64 * 1024;
+        case LZ4F_max256KB:
+            return 256 * 1024;
+        case LZ4F_max1MB:
+            return 1024 * 1024;
+        case LZ4F_max4MB:
+            return 4 * 1024 * 1024;
+        default:
+            return 0;
+        }
+    }
+}
+
+Decompressor::Decompressor()
+    : m_lz4Context(nullptr)
+    , m_zlibStream(nullptr)
+    , m_isZlibStreamInitialized(false)
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    , m_zstdContext(nullptr)
+#endif
+{
+    LZ4F_dctx* dctx = nullptr;
+    if (!LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+        m_lz4Context = dctx;
+    }
+}
+
+Decompressor::~Decompressor()
+{
+    if (nullptr != m_lz4Context) {
+        LZ4F_freeDecompressionContext(m_lz4Context);
+    }
+
+    if (m_isZlibStreamInitialized) {
+        inflateEnd(m_zlibStream);
+    }
+    delete m_zlibStream;
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    ZSTD_freeDCtx(m_zstdContext);
+#endif
+}
 
-        ret = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
-        if (LZ4F_isError(ret)) {
-            return LZ4F_getErrorCode(ret);
+Decompressor& Decompressor::getThreadDecompressor()
+{
+    static thread_local Decompressor decompressor;
+    return decompressor;
+}
+
+int Decompressor::decompressLZ4(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                                void* decompressedBuffer_o)
+{
+    if (nullptr == m_lz4Context) {
+        return LZ4F_ERROR_allocation_failed;
+    }
+
+    // A context left in the middle of a frame by a failed frame would continue it.
+    LZ4F_resetDecompressionContext(m_lz4Context);
+
+    size_t ret = LZ4F_decompress(m_lz4Context, decompressedBuffer_o, &decompressedSize, compressedBuffer,
+                                 &compressedSize, NULL);
+    if (LZ4F_isError(ret)) {
+        return LZ4F_getErrorCode(ret);
+    }
+
+    return 0;
+}
+
+int Decompressor::decompressLZ4InPlace(size_t compressedSize, size_t decompressedSize, void* buffer_io,
+                                       size_t bufferSize)
+{
+    if (compressedSize > bufferSize || bufferSize < GetBufferSizeLZ4InPlace(compressedSize, decompressedSize)) {
+        return LZ4F_ERROR_dstMaxSize_tooSmall;
+    }
+
+    unsigned char* output = static_cast<unsigned char*>(buffer_io);
+    const unsigned char* input = output + bufferSize - compressedSize;
+    const unsigned char* inputEnd = output + bufferSize;
+    size_t decodedSize = 0;
+
+    // The frame header is parsed by LZ4F, the blocks are decoded here so that every block is
+    // written to its final place right behind the previous one. The frame is checked like
+    // LZ4F_decompress does: block sizes, block and content checksums and the content size.
+    if (nullptr == m_lz4Context) {
+        return LZ4F_ERROR_allocation_failed;
+    }
+    LZ4F_resetDecompressionContext(m_lz4Context);
+
+    LZ4F_frameInfo_t frameInfo;
+    size_t headerSize = compressedSize;
+    size_t ret = LZ4F_getFrameInfo(m_lz4Context, &frameInfo, input, &headerSize);
+    if (LZ4F_isError(ret)) {
+        return LZ4F_getErrorCode(ret);
+    }
+    input += headerSize;
+
+    const bool isLinked = (LZ4F_blockLinked == frameInfo.blockMode);
+    const bool hasBlockChecksum = (LZ4F_blockChecksumEnabled == frameInfo.blockChecksumFlag);
+    const size_t blockChecksumSize = hasBlockChecksum ? LZ4FrameChecksumSize : 0;
+    const size_t maxBlockSize = getLZ4FrameMaxBlockSize(frameInfo.blockSizeID);
+
+    while (true) {
+        if (inputEnd - input < static_cast<ptrdiff_t>(LZ4FrameBlockHeaderSize)) {
+            return LZ4F_ERROR_srcPtr_wrong;
         }
 
-        ret = LZ4F_decompress(dctx, decompressedBuffer_o, &decompressedSize, compressedBuffer,
-                              &compressedSize, NULL);
-        if (LZ4F_isError(ret)) {
-            LZ4F_freeDecompressionContext(dctx);
-            return LZ4F_getErrorCode(ret);
+        unsigned int blockHeader = readLittleEndian32(input);
+        input += LZ4FrameBlockHeaderSize;
+        if (0 == blockHeader) {
+            break;
         }
 
-        LZ4F_freeDecompressionContext(dctx);
+        size_t blockSize = blockHeader & ~LZ4FrameUncompressedBit;
+        if (blockSize > maxBlockSize) {
+            return LZ4F_ERROR_maxBlockSize_invalid;
+        }
+        if (static_cast<size_t>(inputEnd - input) < blockSize + blockChecksumSize) {
+            return LZ4F_ERROR_srcPtr_wrong;
+        }
+        // The decoded block overwrites the input before it, never the block itself before it is read.
+        if (hasBlockChecksum && XXH32(input, blockSize, 0) != readLittleEndian32(input + blockSize)) {
+            return LZ4F_ERROR_blockChecksum_invalid;
+        }
 
-        return 0;
+        unsigned char* blockOutput = output + decodedSize;
+        size_t capacity = decompressedSize - decodedSize;
+        if (blockHeader & LZ4FrameUncompressedBit) {
+            if (blockSize > capacity) {
+                return LZ4F_ERROR_dstMaxSize_tooSmall;
+            }
+            memmove(blockOutput, input, blockSize);
+            decodedSize += blockSize;
+        } else {
+            int blockDecodedSize;
+            if (isLinked && decodedSize > 0) {
+                size_t dictionarySize = decodedSize < LZ4FrameMaxDictionarySize ? decodedSize : LZ4FrameMaxDictionarySize;
+                blockDecodedSize = LZ4_decompress_safe_usingDict(reinterpret_cast<const char*>(input),
+                    reinterpret_cast<char*>(blockOutput), static_cast<int>(blockSize), static_cast<int>(capacity),
+                    reinterpret_cast<const char*>(blockOutput - dictionarySize), static_cast<int>(dictionarySize));
+            } else {
+                blockDecodedSize = LZ4_decompress_safe(reinterpret_cast<const char*>(input),
+                    reinterpret_cast<char*>(blockOutput), static_cast<int>(blockSize), static_cast<int>(capacity));
+            }
+            if (blockDecodedSize < 0) {
+                return LZ4F_ERROR_decompressionFailed;
+            }
+            decodedSize += blockDecodedSize;
+        }
+
+        input += blockSize + blockChecksumSize;
     }
 
+    if (decodedSize != decompressedSize || (0 != frameInfo.contentSize && frameInfo.contentSize != decodedSize)) {
+        return LZ4F_ERROR_frameSize_wrong;
+    }
+    if (LZ4F_contentChecksumEnabled == frameInfo.contentChecksumFlag) {
+        if (inputEnd - input < static_cast<ptrdiff_t>(LZ4FrameChecksumSize)) {
+            return LZ4F_ERROR_srcPtr_wrong;
+        }
+        if (XXH32(output, decodedSize, 0) != readLittleEndian32(input)) {
+            return LZ4F_ERROR_contentChecksum_invalid;
+        }
+    }
 
-    int DecompressBufferZLIB(size_t compressedSize, void* compressedBuffer, size_t decompressedSize,
-                             void* decompressedBuffer_o)
-    {
+    return 0;
+}
 
-        int ret;
-        z_stream strm;
+int Decompressor::decompressLZ4Block(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                                     void* decompressedBuffer_o)
+{
+    if (compressedSize > LZ4_MAX_INPUT_SIZE || decompressedSize > LZ4_MAX_INPUT_SIZE) {
+        return LZ4F_ERROR_maxBlockSize_invalid;
+    }
+
+    int blockDecodedSize = LZ4_decompress_safe(static_cast<const char*>(compressedBuffer),
+        static_cast<char*>(decompressedBuffer_o), static_cast<int>(compressedSize), static_cast<int>(decompressedSize));
+    if (blockDecodedSize < 0) {
+        return LZ4F_ERROR_decompressionFailed;
+    }
+
+    return static_cast<size_t>(blockDecodedSize) == decompressedSize ? 0 : LZ4F_ERROR_frameSize_wrong;
+}
+
+int Decompressor::decompressLZ4BlockInPlace(size_t compressedSize, size_t decompressedSize, void* buffer_io,
+                                            size_t bufferSize)
+{
+    if (compressedSize > bufferSize || bufferSize < GetBufferSizeLZ4BlockInPlace(compressedSize, decompressedSize)) {
+        return LZ4F_ERROR_dstMaxSize_tooSmall;
+    }
+
+    unsigned char* buffer = static_cast<unsigned char*>(buffer_io);
+    return decompressLZ4Block(compressedSize, buffer + bufferSize - compressedSize, decompressedSize, buffer);
+}
 
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
+int Decompressor::decompressZLIB(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                                 void* decompressedBuffer_o)
+{
+    int ret;
 
-        strm.avail_in = compressedSize;
-        strm.next_in = reinterpret_cast<Bytef*>(compressedBuffer);
+    // The stream and its 32 KB window are allocated by the first frame and reset for the next ones.
+    if (!m_isZlibStreamInitialized) {
+        if (nullptr == m_zlibStream) {
+            m_zlibStream = new z_stream();
+        }
 
-        strm.avail_out = decompressedSize;
-        strm.next_out = reinterpret_cast<Bytef*>(decompressedBuffer_o);
+        m_zlibStream->zalloc = Z_NULL;
+        m_zlibStream->zfree = Z_NULL;
+        m_zlibStream->opaque = Z_NULL;
+        m_zlibStream->avail_in = 0;
+        m_zlibStream->next_in = Z_NULL;
 
-        ret = inflateInit(&strm);
+        ret = inflateInit(m_zlibStream);
         if (ret != Z_OK) {
             return ret;
         }
-
-        ret = inflate(&strm, Z_NO_FLUSH);
-        if (ret != Z_OK && ret != Z_STREAM_END) {
-            inflateEnd(&strm);
+        m_isZlibStreamInitialized = true;
+    } else {
+        ret = inflateReset(m_zlibStream);
+        if (ret != Z_OK) {
             return ret;
         }
+    }
 
-        inflateEnd(&strm);
+    m_zlibStream->avail_in = static_cast<uInt>(compressedSize);
+    m_zlibStream->next_in = reinterpret_cast<Bytef*>(const_cast<void*>(compressedBuffer));
+
+    m_zlibStream->avail_out = static_cast<uInt>(decompressedSize);
+    m_zlibStream->next_out = reinterpret_cast<Bytef*>(decompressedBuffer_o);
+
+    ret = inflate(m_zlibStream, Z_NO_FLUSH);
+    if (ret != Z_OK && ret != Z_STREAM_END) {
+        return ret;
+    }
 
-        return 0;
+    return 0;
+}
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+int Decompressor::decompressZSTD(const ZSTD_DDict_s* dictionary, size_t compressedSize, const void* compressedBuffer,
+                                 size_t decompressedSize, void* decompressedBuffer_o)
+{
+    // The context is created by the first frame, ZSTD_decompress_usingDDict resets it for every frame.
+    if (nullptr == m_zstdContext) {
+        m_zstdContext = ZSTD_createDCtx();
+        if (nullptr == m_zstdContext) {
+            return -ZSTD_error_memory_allocation;
+        }
+    }
+
+    size_t ret = ZSTD_decompress_usingDDict(m_zstdContext, decompressedBuffer_o, decompressedSize, compressedBuffer,
+                                            compressedSize, dictionary);
+    if (ZSTD_isError(ret)) {
+        return -static_cast<int>(ZSTD_getErrorCode(ret));
+    }
+
+    return ret == decompressedSize ? 0 : -ZSTD_error_srcSize_wrong;
+}
+#endif
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+    int DecompressBufferLZ4(size_t compressedSize, void* compressedBuffer, size_t decompressedSize,
+                            void* decompressedBuffer_o)
+    {
+        return Decompressor::getThreadDecompressor().decompressLZ4(compressedSize, compressedBuffer,
+            decompressedSize, decompressedBuffer_o);
+    }
+
+    size_t GetBufferSizeLZ4InPlace(size_t compressedSize, size_t decompressedSize)
+    {
+        // The LZ4 block format decodes safely in place when the compressed data ends at the end of a
+        // buffer of decompressedSize + LZ4_DECOMPRESS_INPLACE_MARGIN(compressedSize) bytes. The frame
+        // format adds its header, block sizes and checksums to the input, which get the same room on top.
+        // The compressed size of incompressible data is the larger one.
+        size_t blockCount = decompressedSize / LZ4FrameMinBlockSize + 1;
+        size_t bufferSize = decompressedSize + LZ4_DECOMPRESS_INPLACE_MARGIN(compressedSize) + LZ4F_HEADER_SIZE_MAX
+            + blockCount * (LZ4FrameBlockHeaderSize + LZ4FrameChecksumSize)
+            + LZ4FrameBlockHeaderSize + LZ4FrameChecksumSize;
+        return (std::max)(bufferSize, compressedSize);
+    }
+
+    int DecompressBufferLZ4InPlace(size_t compressedSize, size_t decompressedSize, void* buffer_io,
+                                   size_t bufferSize)
+    {
+        return Decompressor::getThreadDecompressor().decompressLZ4InPlace(compressedSize, decompressedSize,
+            buffer_io, bufferSize);
+    }
+
+    size_t GetBufferSizeLZ4BlockInPlace(size_t compressedSize, size_t decompressedSize)
+    {
+        // The margin the LZ4 block format needs to decode in place, see GetBufferSizeLZ4InPlace.
+        return (std::max)(decompressedSize + LZ4_DECOMPRESS_INPLACE_MARGIN(compressedSize), compressedSize);
+    }
+
+    int DecompressBufferZLIB(size_t compressedSize, void* compressedBuffer, size_t decompressedSize,
+                             void* decompressedBuffer_o)
+    {
+        return Decompressor::getThreadDecompressor().decompressZLIB(compressedSize, compressedBuffer,
+            decompressedSize, decompressedBuffer_o);
     }
 
 #if defined (__cplusplus)
@@ -6,12 +6,78 @@
 #include "stddef.h"
 
 #if defined (__cplusplus)
+struct LZ4F_dctx_s;
+struct z_stream_s;
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+struct ZSTD_DCtx_s;
+struct ZSTD_DDict_s;
+#endif
+
+// Decompresses frames with contexts that are kept from frame to frame, the LZ4F context is reset
+// and the zlib stream and the zstd context are reset instead of being created again. A decompressor is not thread safe,
+// every decoding thread uses its own.
+class Decompressor
+{
+public:
+
+    Decompressor();
+    ~Decompressor();
+
+    // get the decompressor of the calling thread
+    static Decompressor& getThreadDecompressor();
+
+    // Decompress the LZ4 format data from buffer
+    int decompressLZ4(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                      void* decompressedBuffer_o);
+    // Decompress the LZ4 format data stored at the end of the buffer to the start of the same buffer
+    int decompressLZ4InPlace(size_t compressedSize, size_t decompressedSize, void* buffer_io, size_t bufferSize);
+    // Decompress a raw LZ4 block, which has no frame header, block sizes or checksums
+    int decompressLZ4Block(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                           void* decompressedBuffer_o);
+    // Decompress a raw LZ4 block stored at the end of the buffer to the start of the same buffer
+    int decompressLZ4BlockInPlace(size_t compressedSize, size_t decompressedSize, void* buffer_io,
+                                  size_t bufferSize);
+    // Decompress the ZLIB format data from buffer
+    int decompressZLIB(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                       void* decompressedBuffer_o);
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    // Decompress a zstd frame, with the dictionary it was compressed with or null
+    int decompressZSTD(const ZSTD_DDict_s* dictionary, size_t compressedSize, const void* compressedBuffer,
+                       size_t decompressedSize, void* decompressedBuffer_o);
+#endif
+
+private:
+
+    Decompressor(const Decompressor&);
+    Decompressor& operator=(const Decompressor&);
+
+    LZ4F_dctx_s* m_lz4Context;
+    z_stream_s* m_zlibStream;
+    bool m_isZlibStreamInitialized;
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    ZSTD_DCtx_s* m_zstdContext;
+#endif
+};
+
 extern "C" {
 #endif
+
+    // The functions below decompress with the decompressor of the calling thread.
+
     // Decompress the LZ4 format data from buffer
     int DecompressBufferLZ4(size_t compressedSize, void* compressedBuffer, size_t decompressedSize,
                             void* decompressedBuffer_o);
 
+    // Get the buffer size needed to decompress LZ4 format data of compressedSize bytes in place
+    size_t GetBufferSizeLZ4InPlace(size_t compressedSize, size_t decompressedSize);
+
+    // Decompress the LZ4 format data stored at the end of the buffer to the start of the same buffer
+    int DecompressBufferLZ4InPlace(size_t compressedSize, size_t decompressedSize, void* buffer_io,
+                                   size_t bufferSize);
+
+    // Get the buffer size needed to decompress a raw LZ4 block of compressedSize bytes in place
+    size_t GetBufferSizeLZ4BlockInPlace(size_t compressedSize, size_t decompressedSize);
+
     // Decompress the ZLIB format data from buffer
     int DecompressBufferZLIB(size_t compressedSize, void* compressedBuffer, size_t decompressedSize,
                              void* decompressedBuffer_o);
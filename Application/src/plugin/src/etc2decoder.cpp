@@ -0,0 +1,331 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "etc2decoder.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// SSE2 is part of every x86-64 target and NEON of every AArch64 target, 32-bit builds use them when
+// the compiler is allowed to.
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ETC2DECODER_SSE2 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define ETC2DECODER_NEON 1
+#endif
+
+namespace
+{
+    const size_t ETC2RGB8BlockSize = 8;
+    const size_t PixelSize = 4;
+    // palette entries of a block, four colors for each of the two subblocks
+    const size_t PaletteSize = 8;
+
+    // +small and +large modifier of the individual and differential modes per table
+    const int16_t ColorModifiers[8][2] = {
+        { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+    };
+
+    // distances of the T and H modes
+    const int16_t PaintDistances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+    // EAC alpha modifiers per table, they are multiplied by the multiplier of the block
+    const int16_t AlphaModifiers[16][8] = {
+        { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+        { -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+        { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+        { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+        { -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+        { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+        { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+        { -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 }
+    };
+
+    // Colors of a block before clamping, R, G, B and A of each palette entry.
+    struct BlockPalette {
+        int16_t base[PaletteSize][4];
+        int16_t modifier[PaletteSize][4];
+    };
+
+    inline uint32_t readBigEndian(const unsigned char* bytes)
+    {
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16)
+            | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+    }
+
+    // count bits of word from lowestBit, the bits of a block are numbered like in the ETC2
+    // specification with the high word holding bits 63 to 32
+    inline uint32_t getBits(uint32_t word, unsigned int lowestBit, unsigned int count)
+    {
+        return (word >> lowestBit) & ((1u << count) - 1);
+    }
+
+    inline int16_t extend4(uint32_t value)
+    {
+        return static_cast<int16_t>((value << 4) | value);
+    }
+
+    inline int16_t extend5(uint32_t value)
+    {
+        return static_cast<int16_t>((value << 3) | (value >> 2));
+    }
+
+    inline int16_t extend6(uint32_t value)
+    {
+        return static_cast<int16_t>((value << 2) | (value >> 4));
+    }
+
+    inline int16_t extend7(uint32_t value)
+    {
+        return static_cast<int16_t>((value << 1) | (value >> 6));
+    }
+
+    inline unsigned char clampColor(int value)
+    {
+        return static_cast<unsigned char>((std::min)((std::max)(value, 0), 255));
+    }
+
+    // values_o[i] = clamp(base[i] + modifier[i], 0, 255), count is a multiple of 8
+    void addSaturated(const int16_t* base, const int16_t* modifier, size_t count, unsigned char* values_o)
+    {
+        for (size_t i = 0; i < count; i += 8) {
+#if ETC2DECODER_SSE2
+            __m128i sum = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base + i)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(modifier + i)));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(values_o + i), _mm_packus_epi16(sum, sum));
+#elif ETC2DECODER_NEON
+            vst1_u8(values_o + i, vqmovun_s16(vaddq_s16(vld1q_s16(base + i), vld1q_s16(modifier + i))));
+#else
+            for (size_t j = i; j < i + 8; ++j) {
+                values_o[j] = clampColor(base[j] + modifier[j]);
+            }
+#endif
+        }
+    }
+
+    void setEntry(BlockPalette& palette, size_t entry, const int16_t color[3], int16_t modifier, int16_t alpha)
+    {
+        for (int channel = 0; channel < 3; ++channel) {
+            palette.base[entry][channel] = color[channel];
+            palette.modifier[entry][channel] = modifier;
+        }
+        palette.base[entry][3] = alpha;
+        palette.modifier[entry][3] = 0;
+    }
+
+    void setTransparentEntry(BlockPalette& palette, size_t entry)
+    {
+        memset(palette.base[entry], 0, sizeof(palette.base[entry]));
+        memset(palette.modifier[entry], 0, sizeof(palette.modifier[entry]));
+    }
+
+    // Planar blocks interpolate three colors, there is no palette.
+    void decodePlanarBlock(uint32_t high, uint32_t low, unsigned char pixels_o[64])
+    {
+        const int origin[3] = {
+            extend6(getBits(high, 25, 6)),
+            extend7((getBits(high, 24, 1) << 6) | getBits(high, 17, 6)),
+            extend6((getBits(high, 16, 1) << 5) | (getBits(high, 11, 2) << 3) | getBits(high, 7, 3))
+        };
+        const int horizontal[3] = {
+            extend6((getBits(high, 2, 5) << 1) | getBits(high, 0, 1)),
+            extend7(getBits(low, 25, 7)),
+            extend6(getBits(low, 19, 6))
+        };
+        const int vertical[3] = {
+            extend6(getBits(low, 13, 6)),
+            extend7(getBits(low, 6, 7)),
+            extend6(getBits(low, 0, 6))
+        };
+
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                unsigned char* pixel = pixels_o + (y * 4 + x) * PixelSize;
+                for (int channel = 0; channel < 3; ++channel) {
+                    pixel[channel] = clampColor((x * (horizontal[channel] - origin[channel])
+                        + y * (vertical[channel] - origin[channel]) + 4 * origin[channel] + 2) >> 2);
+                }
+                pixel[3] = 255;
+            }
+        }
+    }
+
+    // Decode an ETC2 RGB block, or an RGB8A1 block when isPunchThrough is set, alpha is 255 for opaque
+    // pixels. Transparent pixels are black like in the reference decoder.
+    void decodeColorBlock(const unsigned char* block, bool isPunchThrough, unsigned char pixels_o[64])
+    {
+        const uint32_t high = readBigEndian(block);
+        const uint32_t low = readBigEndian(block + 4);
+        // The diff bit of punch-through blocks tells whether every pixel is opaque, their colors are
+        // always differential.
+        const bool isDifferential = isPunchThrough || 0 != getBits(high, 1, 1);
+        const bool isOpaque = !isPunchThrough || 0 != getBits(high, 1, 1);
+
+        BlockPalette palette;
+        // palette entries 0 to 3 for every pixel unless the block has two subblocks
+        bool isFlipped = false;
+        bool hasSubblocks = false;
+
+        const int red = static_cast<int>(getBits(high, 27, 5));
+        const int green = static_cast<int>(getBits(high, 19, 5));
+        const int blue = static_cast<int>(getBits(high, 11, 5));
+        // sign extended 3 bit differences
+        const int redDifference = static_cast<int>(getBits(high, 24, 3) ^ 4u) - 4;
+        const int greenDifference = static_cast<int>(getBits(high, 16, 3) ^ 4u) - 4;
+        const int blueDifference = static_cast<int>(getBits(high, 8, 3) ^ 4u) - 4;
+
+        if (isDifferential && (red + redDifference < 0 || red + redDifference > 31)) {
+            // T mode
+            const int16_t colors[2][3] = {
+                { extend4((getBits(high, 27, 2) << 2) | getBits(high, 24, 2)), extend4(getBits(high, 20, 4)),
+                  extend4(getBits(high, 16, 4)) },
+                { extend4(getBits(high, 12, 4)), extend4(getBits(high, 8, 4)), extend4(getBits(high, 4, 4)) }
+            };
+            const int16_t distance = PaintDistances[(getBits(high, 2, 2) << 1) | getBits(high, 0, 1)];
+            setEntry(palette, 0, colors[0], 0, 255);
+            setEntry(palette, 1, colors[1], distance, 255);
+            setEntry(palette, 2, colors[1], 0, 255);
+            setEntry(palette, 3, colors[1], static_cast<int16_t>(-distance), 255);
+        } else if (isDifferential && (green + greenDifference < 0 || green + greenDifference > 31)) {
+            // H mode
+            const uint32_t colors444[2] = {
+                (getBits(high, 27, 4) << 8) | (((getBits(high, 24, 3) << 1) | getBits(high, 20, 1)) << 4)
+                    | (getBits(high, 19, 1) << 3) | getBits(high, 15, 3),
+                (getBits(high, 11, 4) << 8) | (getBits(high, 7, 4) << 4) | getBits(high, 3, 4)
+            };
+            int16_t colors[2][3];
+            for (int i = 0; i < 2; ++i) {
+                colors[i][0] = extend4(getBits(colors444[i], 8, 4));
+                colors[i][1] = extend4(getBits(colors444[i], 4, 4));
+                colors[i][2] = extend4(getBits(colors444[i], 0, 4));
+            }
+            const int16_t distance = PaintDistances[(getBits(high, 2, 1) << 2) | (getBits(high, 0, 1) << 1)
+                | (colors444[0] >= colors444[1] ? 1 : 0)];
+            setEntry(palette, 0, colors[0], distance, 255);
+            setEntry(palette, 1, colors[0], static_cast<int16_t>(-distance), 255);
+            setEntry(palette, 2, colors[1], distance, 255);
+            setEntry(palette, 3, colors[1], static_cast<int16_t>(-distance), 255);
+        } else if (isDifferential && (blue + blueDifference < 0 || blue + blueDifference > 31)) {
+            decodePlanarBlock(high, low, pixels_o);
+            return;
+        } else {
+            // individual or differential mode, two subblocks with a base color and a table each
+            int16_t colors[2][3];
+            if (isDifferential) {
+                colors[0][0] = extend5(red);
+                colors[0][1] = extend5(green);
+                colors[0][2] = extend5(blue);
+                colors[1][0] = extend5(red + redDifference);
+                colors[1][1] = extend5(green + greenDifference);
+                colors[1][2] = extend5(blue + blueDifference);
+            } else {
+                colors[0][0] = extend4(getBits(high, 28, 4));
+                colors[0][1] = extend4(getBits(high, 20, 4));
+                colors[0][2] = extend4(getBits(high, 12, 4));
+                colors[1][0] = extend4(getBits(high, 24, 4));
+                colors[1][1] = extend4(getBits(high, 16, 4));
+                colors[1][2] = extend4(getBits(high, 8, 4));
+            }
+
+            const uint32_t tables[2] = { getBits(high, 5, 3), getBits(high, 2, 3) };
+            for (int subblock = 0; subblock < 2; ++subblock) {
+                const int16_t* modifiers = ColorModifiers[tables[subblock]];
+                const size_t entry = subblock * 4;
+                // pixel index 0 has no modifier and 2 is transparent in blocks with transparent pixels
+                setEntry(palette, entry, colors[subblock], isOpaque ? modifiers[0] : 0, 255);
+                setEntry(palette, entry + 1, colors[subblock], modifiers[1], 255);
+                setEntry(palette, entry + 2, colors[subblock], static_cast<int16_t>(-modifiers[0]), 255);
+                setEntry(palette, entry + 3, colors[subblock], static_cast<int16_t>(-modifiers[1]), 255);
+            }
+            isFlipped = (0 != getBits(high, 0, 1));
+            hasSubblocks = true;
+        }
+
+        if (!isOpaque) {
+            setTransparentEntry(palette, 2);
+            setTransparentEntry(palette, 6);
+        }
+        if (!hasSubblocks) {
+            // T and H blocks use four entries, the others are computed along with them
+            memcpy(palette.base[4], palette.base[0], sizeof(palette.base[0]) * 4);
+            memcpy(palette.modifier[4], palette.modifier[0], sizeof(palette.modifier[0]) * 4);
+        }
+
+        unsigned char colors[PaletteSize * PixelSize];
+        addSaturated(&palette.base[0][0], &palette.modifier[0][0], PaletteSize * 4, colors);
+
+        // The pixel indices are stored column by column, the most significant bits in the upper half.
+        for (int x = 0; x < 4; ++x) {
+            for (int y = 0; y < 4; ++y) {
+                const unsigned int bit = x * 4 + y;
+                const uint32_t index = (getBits(low, bit + 16, 1) << 1) | getBits(low, bit, 1);
+                const uint32_t subblock = (isFlipped ? y : x) >> 1;
+                memcpy(pixels_o + (y * 4 + x) * PixelSize, colors + (subblock * 4 + index) * PixelSize, PixelSize);
+            }
+        }
+    }
+
+    // Decode an EAC alpha block into the alpha of the pixels.
+    void decodeAlphaBlock(const unsigned char* block, unsigned char pixels_io[64])
+    {
+        const int16_t base = block[0];
+        const int16_t multiplier = static_cast<int16_t>(block[1] >> 4);
+        const int16_t* modifiers = AlphaModifiers[block[1] & 0xf];
+
+        int16_t bases[8];
+        int16_t scaledModifiers[8];
+        for (int i = 0; i < 8; ++i) {
+            bases[i] = base;
+            scaledModifiers[i] = static_cast<int16_t>(modifiers[i] * multiplier);
+        }
+        unsigned char alphas[8];
+        addSaturated(bases, scaledModifiers, 8, alphas);
+
+        // 3 bit indices of the pixels column by column, from the most significant bits
+        const uint64_t indices = (static_cast<uint64_t>(readBigEndian(block + 2)) << 16)
+            | (static_cast<uint64_t>(block[6]) << 8) | block[7];
+        for (int x = 0; x < 4; ++x) {
+            for (int y = 0; y < 4; ++y) {
+                const unsigned int shift = 45 - 3 * (x * 4 + y);
+                pixels_io[(y * 4 + x) * PixelSize + 3] = alphas[(indices >> shift) & 7];
+            }
+        }
+    }
+}
+
+size_t GetETC2BlockSize(ETC2Format format)
+{
+    return (ETC2Format_RGBA8 == format) ? ETC2RGB8BlockSize * 2 : ETC2RGB8BlockSize;
+}
+
+void DecodeETC2Texture(ETC2Format format, const void* blocks, uint32_t width, uint32_t height,
+                       uint32_t firstBlockRow, uint32_t endBlockRow, void* pixels_o)
+{
+    const unsigned char* blockData = static_cast<const unsigned char*>(blocks);
+    unsigned char* pixels = static_cast<unsigned char*>(pixels_o);
+    const size_t blockSize = GetETC2BlockSize(format);
+    const uint32_t blockWidth = (width + 3) / 4;
+    const size_t rowSize = static_cast<size_t>(width) * PixelSize;
+
+    unsigned char blockPixels[16 * PixelSize];
+    for (uint32_t blockY = firstBlockRow; blockY < endBlockRow; ++blockY) {
+        const uint32_t rowCount = (std::min)(height - blockY * 4, 4u);
+        for (uint32_t blockX = 0; blockX < blockWidth; ++blockX) {
+            const unsigned char* block = blockData + (static_cast<size_t>(blockY) * blockWidth + blockX) * blockSize;
+            if (ETC2Format_RGBA8 == format) {
+                decodeColorBlock(block + ETC2RGB8BlockSize, false, blockPixels);
+                decodeAlphaBlock(block, blockPixels);
+            } else {
+                decodeColorBlock(block, ETC2Format_RGB8A1 == format, blockPixels);
+            }
+
+            const size_t columnCount = (std::min)(width - blockX * 4, 4u);
+            unsigned char* output = pixels + static_cast<size_t>(blockY) * 4 * rowSize + blockX * 4 * PixelSize;
+            for (uint32_t y = 0; y < rowCount; ++y) {
+                memcpy(output + y * rowSize, blockPixels + y * 4 * PixelSize, columnCount * PixelSize);
+            }
+        }
+    }
+}
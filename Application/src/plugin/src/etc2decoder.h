@@ -0,0 +1,30 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_ETC2DECODER_H_
+#define PLUGIN_SRC_ETC2DECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Decodes ETC2 textures to RGBA8 pixels on the CPU, for GPUs that cannot sample ETC2. The blocks are
+// decoded like the reference decoder of ETCPACK (etcdec.cxx) does: every block is turned into a
+// palette of its colors, computed with saturating SIMD adds, and the pixels pick from the palette.
+
+enum ETC2Format {
+    ETC2Format_RGB8,
+    // RGB8 with punch-through alpha
+    ETC2Format_RGB8A1,
+    // EAC alpha block followed by an RGB8 block
+    ETC2Format_RGBA8
+};
+
+// Number of bytes of a 4x4 block of a format.
+size_t GetETC2BlockSize(ETC2Format format);
+
+// Decode the block rows firstBlockRow to endBlockRow - 1 of a texture of width x height pixels into
+// the RGBA8 pixels of those rows, 4 * width bytes per row. The pixels of blocks that reach past the
+// edge of the texture are only written inside of it, so the rows can be decoded on several threads.
+void DecodeETC2Texture(ETC2Format format, const void* blocks, uint32_t width, uint32_t height,
+                       uint32_t firstBlockRow, uint32_t endBlockRow, void* pixels_o);
+
+#endif // PLUGIN_SRC_ETC2DECODER_H_
@@ -0,0 +1,53 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "etc2planes.h"
+
+#include <string.h>
+
+// SSE2 is part of every x86-64 target and NEON of every AArch64 target, 32-bit builds use them when
+// the compiler is allowed to.
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ETC2PLANES_SSE2 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define ETC2PLANES_NEON 1
+#endif
+
+namespace
+{
+    const size_t HalfBlockSize = ETC2RGBA8BlockSize / 2;
+}
+
+void InterleaveETC2RGBA8Planes(const void* planes, size_t size, void* blocks_o)
+{
+    const size_t blockCount = size / ETC2RGBA8BlockSize;
+    const unsigned char* alpha = static_cast<const unsigned char*>(planes);
+    const unsigned char* color = alpha + blockCount * HalfBlockSize;
+    unsigned char* blocks = static_cast<unsigned char*>(blocks_o);
+    size_t block = 0;
+
+    // Two blocks per step: 16 bytes of each plane hold the halves of two blocks.
+#if ETC2PLANES_SSE2
+    for (; block + 2 <= blockCount; block += 2) {
+        __m128i alphaHalves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + block * HalfBlockSize));
+        __m128i colorHalves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color + block * HalfBlockSize));
+        __m128i* output = reinterpret_cast<__m128i*>(blocks + block * ETC2RGBA8BlockSize);
+        _mm_storeu_si128(output, _mm_unpacklo_epi64(alphaHalves, colorHalves));
+        _mm_storeu_si128(output + 1, _mm_unpackhi_epi64(alphaHalves, colorHalves));
+    }
+#elif ETC2PLANES_NEON
+    for (; block + 2 <= blockCount; block += 2) {
+        uint8x16_t alphaHalves = vld1q_u8(alpha + block * HalfBlockSize);
+        uint8x16_t colorHalves = vld1q_u8(color + block * HalfBlockSize);
+        unsigned char* output = blocks + block * ETC2RGBA8BlockSize;
+        vst1q_u8(output, vcombine_u8(vget_low_u8(alphaHalves), vget_low_u8(colorHalves)));
+        vst1q_u8(output + ETC2RGBA8BlockSize, vcombine_u8(vget_high_u8(alphaHalves), vget_high_u8(colorHalves)));
+    }
+#endif
+
+    for (; block < blockCount; ++block) {
+        memcpy(blocks + block * ETC2RGBA8BlockSize, alpha + block * HalfBlockSize, HalfBlockSize);
+        memcpy(blocks + block * ETC2RGBA8BlockSize + HalfBlockSize, color + block * HalfBlockSize, HalfBlockSize);
+    }
+}
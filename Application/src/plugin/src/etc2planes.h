@@ -0,0 +1,19 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_ETC2PLANES_H_
+#define PLUGIN_SRC_ETC2PLANES_H_
+
+#include <stddef.h>
+
+// An ETC2 RGBA8 block is 8 bytes of EAC alpha followed by 8 bytes of ETC2 color. Planar frames store
+// the alpha halves of all blocks first and the color halves after them, which LZ4 and zstd find
+// longer matches in, the decoder puts the halves back together before the upload.
+
+// Number of bytes of an ETC2 RGBA8 block.
+const size_t ETC2RGBA8BlockSize = 16;
+
+// Interleave size bytes of planes, the alpha plane followed by the color plane of size / 16 blocks,
+// into the blocks. size is a multiple of the block size, the buffers do not overlap.
+void InterleaveETC2RGBA8Planes(const void* planes, size_t size, void* blocks_o);
+
+#endif // PLUGIN_SRC_ETC2PLANES_H_
@@ -2,6 +2,8 @@
 
 #include "filemapping.h"
 
+#include <stdint.h>
+
 #if defined (__QNX__) || defined (__ANDROID__) || defined (__linux__)
 #include <errno.h>
 #include <fcntl.h>
@@ -11,15 +13,26 @@
 #include <kanzi/core/legacy/file/kzs_file_base.hpp>
 #endif
 
+namespace
+{
+    // Smallest page size of the supported platforms, touching more often than the real page size
+    // is harmless.
+    const size_t PrefetchStride = 4096;
+}
 
 FileMapping::FileMapping()
     : m_fileBuffer(nullptr)
+    , m_fileSize(0)
 
 #if defined (_WIN32)
     , m_fileHandler()
     , m_fileMappingHandler()
 #endif
 
+#if defined (__ANDROID__)
+    , m_resourceFile(nullptr)
+#endif
+
 #if defined (__QNX__) || defined (__ANDROID__) || defined (__linux__)
     , m_fileDescriptor()
     , m_statBuffer()
@@ -36,6 +49,11 @@ void* FileMapping::getFileBuffer()
     return m_fileBuffer;
 }
 
+size_t FileMapping::getFileSize()
+{
+    return m_fileSize;
+}
+
 int FileMapping::mapFileIntoMemory(const char* fileName)
 {
 #if defined (_WIN32)
@@ -58,6 +76,13 @@ int FileMapping::mapFileIntoMemory(const char* fileName)
         return GetLastError();
     }
 
+    LARGE_INTEGER fileSize;
+    if (0 == GetFileSizeEx(m_fileHandler, &fileSize)) {
+        CloseHandle(m_fileHandler);
+        return GetLastError();
+    }
+    m_fileSize = static_cast<size_t>(fileSize.QuadPart);
+
     m_fileMappingHandler = CreateFileMappingA(
         m_fileHandler,
         NULL,          /// The handle cannot be inherited and the file mapping object gets a default
@@ -98,22 +123,31 @@ int FileMapping::mapFileIntoMemory(const char* fileName)
 #endif
 
 #if defined (__ANDROID__)
-        kzsError result;
-        kanzi::byte * pfileBuffer_temp;
-        //kzLogDebug(("FileMapping::file name: {}.",std::string(fileName)));
-
-        //kzLogDebug(("FileMapping::222222."));
-        result = kzsResourceFileCreate(nullptr, fileName, &m_resourceFile);
-        //kzLogDebug(("FileMapping::333333333."));
-        if (result != KZS_RESOURCE_FILE_ERROR)
-        {
-            //kzLogDebug(("FileMapping::4444444. result =  {}", result));
-            result = kzsResourceFileMemoryMap(m_resourceFile, &(pfileBuffer_temp));
-            m_fileBuffer = (void*)pfileBuffer_temp;
-            //kzLogDebug(("FileMapping::55555555. result = {}",result));
-        }
-
-        return 0;
+    kzsError result = kzsResourceFileCreate(nullptr, fileName, &m_resourceFile);
+    if (KZS_SUCCESS != result) {
+        m_resourceFile = nullptr;
+        return ENOENT;
+    }
+
+    /// The package readers check every offset against the file size, a mapping without one is not usable.
+    kzInt fileSize = kzsResourceFileGetSize(m_resourceFile);
+    if (fileSize <= 0) {
+        kzsResourceFileDelete(m_resourceFile);
+        m_resourceFile = nullptr;
+        return EIO;
+    }
+
+    kanzi::byte* fileBuffer = nullptr;
+    result = kzsResourceFileMemoryMap(m_resourceFile, &fileBuffer);
+    if (KZS_SUCCESS != result || nullptr == fileBuffer) {
+        kzsResourceFileDelete(m_resourceFile);
+        m_resourceFile = nullptr;
+        return EIO;
+    }
+    m_fileBuffer = fileBuffer;
+    m_fileSize = static_cast<size_t>(fileSize);
+
+    return 0;
 #elif defined (__QNX__) || defined (__linux__)
     m_fileDescriptor = open(fileName, O_RDONLY);
     if (-1 == m_fileDescriptor) {
@@ -124,6 +158,7 @@ int FileMapping::mapFileIntoMemory(const char* fileName)
         close(m_fileDescriptor);
         return errno;
     }
+    m_fileSize = static_cast<size_t>(m_statBuffer.st_size);
 
     /// When you map a file descriptor, the file's reference count is incremented.
     /// Therefore, you can close the file descriptor after mapping the file, and your process will
@@ -177,3 +212,25 @@ int FileMapping::closeFileMapping()
 
     return 0;
 }
+
+void FileMapping::prefetch(const void* address, size_t size)
+{
+    if (nullptr == address || 0 == size) {
+        return;
+    }
+
+#if defined (__QNX__) || defined (__linux__)
+    /// Start the read-ahead for the whole range before touching the pages one by one.
+    uintptr_t pageStart = reinterpret_cast<uintptr_t>(address) & ~(uintptr_t(PrefetchStride) - 1);
+    size_t length = reinterpret_cast<uintptr_t>(address) + size - pageStart;
+    posix_madvise(reinterpret_cast<void*>(pageStart), length, POSIX_MADV_WILLNEED);
+#endif
+
+    const volatile unsigned char* bytes = static_cast<const volatile unsigned char*>(address);
+    unsigned char sum = 0;
+    for (size_t i = 0; i < size; i += PrefetchStride) {
+        sum += bytes[i];
+    }
+    sum += bytes[size - 1];
+    (void)sum;
+}
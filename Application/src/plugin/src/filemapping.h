@@ -3,6 +3,8 @@
 #ifndef PLUGIN_SRC_FILEMAPPING_H_
 #define PLUGIN_SRC_FILEMAPPING_H_
 
+#include <stddef.h>
+
 #if defined (_WIN32)
 #include <windows.h>
 #endif
@@ -25,15 +27,20 @@ public:
     ~FileMapping();
     // get the buffer of file
     void* getFileBuffer();
+    // get the size of the mapped file
+    size_t getFileSize();
 
     // map file into memort
     int mapFileIntoMemory(const char* fileName);
     // close file mapping
     int closeFileMapping();
+    // fault in the pages of a range of the mapped file, so later reads do not hit the storage
+    void prefetch(const void* address, size_t size);
 
 private:
 
     void* m_fileBuffer;
+    size_t m_fileSize;
 
 #if defined (_WIN32)
     HANDLE m_fileHandler;
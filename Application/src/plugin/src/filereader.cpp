@@ -0,0 +1,156 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "filereader.h"
+
+#include <errno.h>
+
+#if !defined (_WIN32) && (defined (__QNX__) || defined (__linux__))
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+
+FileReader::FileReader()
+    : m_fileSize(0)
+
+#if defined (_WIN32)
+    , m_fileHandler(INVALID_HANDLE_VALUE)
+#elif defined (__QNX__) || defined (__linux__)
+    , m_fileDescriptor(-1)
+#endif
+{
+}
+
+FileReader::~FileReader()
+{
+    closeFile();
+}
+
+int FileReader::openFile(const char* fileName)
+{
+#if defined (_WIN32)
+    m_fileHandler = CreateFileA(
+        fileName,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_READONLY | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+
+    if (INVALID_HANDLE_VALUE == m_fileHandler) {
+        return GetLastError();
+    }
+
+    LARGE_INTEGER fileSize;
+    if (0 == GetFileSizeEx(m_fileHandler, &fileSize)) {
+        int ret = GetLastError();
+        closeFile();
+        return ret;
+    }
+    m_fileSize = static_cast<size_t>(fileSize.QuadPart);
+
+    return 0;
+#elif defined (__ANDROID__)
+    /// Packages on Android live in the application package, they can only be mapped.
+    (void)fileName;
+    return ENOTSUP;
+#elif defined (__QNX__) || defined (__linux__)
+    m_fileDescriptor = open(fileName, O_RDONLY);
+    if (-1 == m_fileDescriptor) {
+        return errno;
+    }
+
+    struct stat statBuffer;
+    if (-1 == fstat(m_fileDescriptor, &statBuffer)) {
+        int ret = errno;
+        closeFile();
+        return ret;
+    }
+    m_fileSize = static_cast<size_t>(statBuffer.st_size);
+
+    return 0;
+#else
+    (void)fileName;
+    return ENOTSUP;
+#endif
+}
+
+int FileReader::readFile(size_t offset, size_t size, void* buffer_o)
+{
+    if (offset > m_fileSize || size > m_fileSize - offset) {
+        return EINVAL;
+    }
+
+    char* buffer = static_cast<char*>(buffer_o);
+
+#if defined (_WIN32)
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(static_cast<unsigned long long>(offset) >> 32);
+
+        DWORD chunkSize = size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(size);
+        DWORD readSize = 0;
+        if (0 == ReadFile(m_fileHandler, buffer, chunkSize, &readSize, &overlapped)) {
+            return GetLastError();
+        }
+        if (0 == readSize) {
+            return EIO;
+        }
+
+        buffer += readSize;
+        offset += readSize;
+        size -= readSize;
+    }
+#elif defined (__QNX__) || defined (__linux__)
+    while (size > 0) {
+        ssize_t readSize = pread(m_fileDescriptor, buffer, size, static_cast<off_t>(offset));
+        if (-1 == readSize) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return errno;
+        }
+        if (0 == readSize) {
+            return EIO;
+        }
+
+        buffer += readSize;
+        offset += readSize;
+        size -= readSize;
+    }
+#endif
+
+    return 0;
+}
+
+size_t FileReader::getFileSize()
+{
+    return m_fileSize;
+}
+
+int FileReader::closeFile()
+{
+#if defined (_WIN32)
+    if (INVALID_HANDLE_VALUE != m_fileHandler) {
+        HANDLE fileHandler = m_fileHandler;
+        m_fileHandler = INVALID_HANDLE_VALUE;
+        if (0 == CloseHandle(fileHandler)) {
+            return GetLastError();
+        }
+    }
+#elif defined (__QNX__) || defined (__linux__)
+    if (-1 != m_fileDescriptor) {
+        int fileDescriptor = m_fileDescriptor;
+        m_fileDescriptor = -1;
+        if (-1 == close(fileDescriptor)) {
+            return errno;
+        }
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_FILEREADER_H_
+#define PLUGIN_SRC_FILEREADER_H_
+
+#include <stddef.h>
+
+#if defined (_WIN32)
+#include <windows.h>
+#endif
+
+// Reads ranges of a file with plain file reads, for platforms and storages where mapping the
+// package is not wanted.
+class FileReader
+{
+public:
+
+    FileReader();
+    ~FileReader();
+
+    // open file for reading
+    int openFile(const char* fileName);
+    // read a range of the file into a buffer
+    int readFile(size_t offset, size_t size, void* buffer_o);
+    // get the size of the file
+    size_t getFileSize();
+    // close file
+    int closeFile();
+
+private:
+
+    size_t m_fileSize;
+
+#if defined (_WIN32)
+    HANDLE m_fileHandler;
+#elif defined (__QNX__) || defined (__linux__)
+    int m_fileDescriptor;
+#endif
+};
+
+#endif // PLUGIN_SRC_FILEREADER_H_
@@ -1,10 +1,22 @@
 // Copyright 2022-2023 by Rightware. All rights reserved.
 
 #include "sequenceframeplugin.hpp"
+#include <errno.h>
+#include <math.h>
+#include <chrono>
 #include <string>
 
+#include "codecregistry.h"
 #include "filemapping.h"
+#include "filereader.h"
 #include "decompressor.h"
+#include "etc2decoder.h"
+#include "etc2planes.h"
+#include "transcodecache.h"
+#include "stagingcache.h"
+#include "texturepackage.h"
+#include "textureregion.h"
+#include "workerpool.h"
 #define LZ4_EXTERNAL_FILE (1)
 
 PropertyType<string> SequenceFramePlugin::PackagePathProperty(
@@ -47,6 +59,58 @@ PropertyType<bool> SequenceFramePlugin::ReverseProperty(
 )
 );
 
+PropertyType<bool> SequenceFramePlugin::TranscodeCacheProperty(
+    kzMakeFixedString("SequenceFramePlugin.TranscodeCache"), false, 0, false,
+    KZ_DECLARE_EDITOR_METADATA(
+        metadata.tooltip = "Whether or not to write the decoded frames of a compressed package to an"
+        " uncompressed cache file while playing, later plays use the cache file without decoding."
+        "The default value is false.";
+)
+);
+
+PropertyType<string> SequenceFramePlugin::TranscodeCacheDirectoryProperty(
+    kzMakeFixedString("SequenceFramePlugin.TranscodeCacheDirectory"), "", 0, false,
+    KZ_DECLARE_EDITOR_METADATA(
+        metadata.tooltip = "Directory for the transcode cache files."
+        "The default value is empty, which writes the cache file next to the package.";
+        metadata.editor = "BrowseFileTextEditor";
+)
+);
+
+PropertyType<int> SequenceFramePlugin::StagingCacheSizeProperty(
+    kzMakeFixedString("SequenceFramePlugin.StagingCacheSize"), 0, 0, false,
+    KZ_DECLARE_EDITOR_METADATA(
+        metadata.tooltip = "Bytes of RAM for copies of the compressed upcoming frames, so that decoding"
+        " does not wait for slow storage. The default value is 0, which disables the staging cache.";
+)
+);
+
+PropertyType<bool> SequenceFramePlugin::MemoryMapPackageProperty(
+    kzMakeFixedString("SequenceFramePlugin.MemoryMapPackage"), true, 0, false,
+    KZ_DECLARE_EDITOR_METADATA(
+        metadata.tooltip = "Whether or not to map the texture package into memory. When false, frames are"
+        " read with file reads and LZ4 frames are decoded in place in the texture buffer."
+        "The default value is true.";
+)
+);
+
+PropertyType<int> SequenceFramePlugin::DecodeThreadCountProperty(
+    kzMakeFixedString("SequenceFramePlugin.DecodeThreadCount"), 0, 0, false,
+    KZ_DECLARE_EDITOR_METADATA(
+        metadata.tooltip = "Threads that decode the stripes of a frame in packages with striped frames,"
+        " including the decompression thread. The default value is 0, which uses one thread per CPU core.";
+)
+);
+
+PropertyType<bool> SequenceFramePlugin::AdaptiveQualityProperty(
+    kzMakeFixedString("SequenceFramePlugin.AdaptiveQuality"), true, 0, false,
+    KZ_DECLARE_EDITOR_METADATA(
+        metadata.tooltip = "Whether or not to play a smaller resolution track of a package with several tracks"
+        " while the frames take too long to decode for the FPS, and the larger track again when there is"
+        " time left. The default value is true.";
+)
+);
+
 MessageType<SequenceFramePlugin::EmptyMessageArguments> SequenceFramePlugin::LoadAnimation(
     kzMakeFixedString("SequenceFramePlugin.LoadAnimation"), 0);
 MessageType<SequenceFramePlugin::EmptyMessageArguments> SequenceFramePlugin::PlayAnimation(
@@ -61,6 +125,43 @@ MessageType<SequenceFramePlugin::EmptyMessageArguments> SequenceFramePlugin::oLo
 MessageType<SequenceFramePlugin::EmptyMessageArguments> SequenceFramePlugin::oPlayingFinished(
     kzMakeFixedString("SequenceFramePlugin.oPlayingFinished"), 0);
 
+namespace
+{
+    // The block that clears the texture around trimmed frames, nullptr for formats without transparency.
+    const unsigned char* getTransparentBlock(GraphicsFormat format, size_t& blockSize_o)
+    {
+        switch (format) {
+        case GraphicsFormatETC2_R8G8B8A8_UNORM:
+            blockSize_o = sizeof(ETC2RGBA8TransparentBlock);
+            return ETC2RGBA8TransparentBlock;
+        case GraphicsFormatETC2_R8G8B8A1_UNORM:
+            blockSize_o = sizeof(ETC2RGB8A1TransparentBlock);
+            return ETC2RGB8A1TransparentBlock;
+        default:
+            blockSize_o = 0;
+            return nullptr;
+        }
+    }
+
+    // The format of the software decoder for a texture format, false for formats it cannot decode.
+    bool getSoftwareDecodeFormat(GraphicsFormat format, ETC2Format& format_o)
+    {
+        switch (format) {
+        case GraphicsFormatETC2_R8G8B8_UNORM:
+            format_o = ETC2Format_RGB8;
+            return true;
+        case GraphicsFormatETC2_R8G8B8A1_UNORM:
+            format_o = ETC2Format_RGB8A1;
+            return true;
+        case GraphicsFormatETC2_R8G8B8A8_UNORM:
+            format_o = ETC2Format_RGBA8;
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
 SequenceFramePluginSharedPtr SequenceFramePlugin::create(Domain* domain, string_view name)
 {
     SequenceFramePluginSharedPtr sequenceFramePlugin(new SequenceFramePlugin(domain, name));
@@ -74,11 +175,33 @@ SequenceFramePlugin::SequenceFramePlugin(Domain* domain, string_view name)
     : Node2D(domain, name)
     , m_decompressionThreadStatus(DecompressionThreadStatus_Idle)
     , m_texturePackageFile(nullptr)
+    , m_texturePackageReader(nullptr)
+    , m_isMappingPackage(true)
+    , m_transcodeCache(nullptr)
+    , m_stagingCache(nullptr)
+    , m_stagingCursor(-1)
+    , m_isStagingPending(false)
+    , m_texturePackage(nullptr)
+    , m_dictionaryCodec(nullptr)
+    , m_packageDictionary(nullptr)
+    , m_trackIndex(0)
+    , m_trackFallback(0)
+    , m_decodeTime(-1.0)
     , m_texture(nullptr)
     , m_isReversed(false)
+    , m_isLoopPlayback(false)
     , m_currentTextureIndex(0)
+    , m_decodedTextureIndex(-1)
     , m_textureSize(0)
+    , m_textureBufferSize(0)
     , m_textureData(nullptr)
+    , m_planeData(nullptr)
+    , m_regionData(nullptr)
+    , m_textureRegionIndex(-1)
+    , m_pixelData(nullptr)
+    , m_blockData(nullptr)
+    , m_uploadData(nullptr)
+    , m_decodeWorkerPool(nullptr)
     , m_fpsTimeStamp(0)
     , m_fpsCounter(0)
 {
@@ -94,6 +217,20 @@ SequenceFramePlugin::~SequenceFramePlugin()
     }
     m_decompressionCondition.notify_one();
     m_decompressionThread.join();
+
+    delete m_decodeWorkerPool;
+}
+
+uint64_t SequenceFramePlugin::getStagingCacheHitCount()
+{
+    std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+    return (nullptr != m_stagingCache) ? m_stagingCache->getHitCount() : 0;
+}
+
+uint64_t SequenceFramePlugin::getStagingCacheMissCount()
+{
+    std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+    return (nullptr != m_stagingCache) ? m_stagingCache->getMissCount() : 0;
 }
 
 void SequenceFramePlugin::onAttached()
@@ -126,31 +263,165 @@ void SequenceFramePlugin::onDetached()
     resetPluginStatus();
 }
 
-bool SequenceFramePlugin::loadAnimationFile()
-{
 #if LZ4_EXTERNAL_FILE
-    m_texturePackageFile = new FileMapping();
-    if (nullptr == m_texturePackageFile) {
-        kzLogDebug(("SequenceFramePlugin::onLoadAnimation Could not create fileapping."));
-        return false;
+bool SequenceFramePlugin::openTexturePackage(const string& filePath)
+{
+    const byte* packageData = nullptr;
+    size_t packageSize = 0;
+
+    if (m_isMappingPackage) {
+        m_texturePackageFile = new FileMapping();
+        if (nullptr == m_texturePackageFile) {
+            kzLogDebug(("SequenceFramePlugin::onLoadAnimation Could not create fileapping."));
+            return false;
+        }
+
+        int ret = m_texturePackageFile->mapFileIntoMemory(filePath.c_str());
+        if (0 != ret) {
+            kzLogDebug(("SequenceFramePlugin::onLoadAnimation: failed to map file '{}'", filePath));
+            delete m_texturePackageFile;
+            m_texturePackageFile = nullptr;
+            return false;
+        }
+
+        packageData = static_cast<const byte*>(m_texturePackageFile->getFileBuffer());
+        packageSize = m_texturePackageFile->getFileSize();
+    } else {
+        m_texturePackageReader = new FileReader();
+        int ret = m_texturePackageReader->openFile(filePath.c_str());
+        if (0 != ret) {
+            kzLogDebug(("SequenceFramePlugin::onLoadAnimation: failed to open file '{}'", filePath));
+            delete m_texturePackageReader;
+            m_texturePackageReader = nullptr;
+            return false;
+        }
     }
 
-    string filePath = getProperty(PackagePathProperty);
-    int ret = m_texturePackageFile->mapFileIntoMemory(filePath.c_str());
+    int ret = readPackageIndex(packageData, packageSize);
     if (0 != ret) {
-        kzLogDebug(("SequenceFramePlugin::onLoadAnimation: failed to map file '{}'", filePath));
-        delete m_texturePackageFile;
-        m_texturePackageFile = nullptr;
+        kzLogDebug(("SequenceFramePlugin::onLoadAnimation: failed to read file '{}', error {}", filePath, ret));
+        closeTexturePackage();
         return false;
     }
 
     if (0 != getFileInformation()) {
         kzLogDebug(("SequenceFramePlugin::onLoadAnimation Fail to get file info."));
+        closeTexturePackage();
+        return false;
+    }
+
+    return true;
+}
+
+bool SequenceFramePlugin::isTexturePackageOpen() const
+{
+    return nullptr != m_texturePackageFile || nullptr != m_texturePackageReader;
+}
+
+bool SequenceFramePlugin::openTranscodeCache(const string& filePath)
+{
+    // The cache is keyed by the bytes of the package header and index as they are stored in the file.
+    byte header[TexturePackage::HeaderReadSize];
+    const byte* headerData = header;
+    const byte* indexData = m_packageIndexData.data();
+    size_t headerSize = 0;
+    if (nullptr != m_texturePackageFile) {
+        const byte* packageData = static_cast<const byte*>(m_texturePackageFile->getFileBuffer());
+        headerSize = (std::min)(m_texturePackageFile->getFileSize(), TexturePackage::HeaderReadSize);
+        headerData = packageData;
+        indexData = packageData + m_texturePackage->getIndexOffset();
+    } else {
+        headerSize = (std::min)(m_texturePackageReader->getFileSize(), TexturePackage::HeaderReadSize);
+        int ret = m_texturePackageReader->readFile(0, headerSize, header);
+        if (0 != ret) {
+            // Without a key the package is played without the cache.
+            kzLogDebug(("SequenceFramePlugin::openTranscodeCache failed to read file '{}', error {}.", filePath, ret));
+            return true;
+        }
+    }
+    string cachePath = TranscodeCache::getCachePath(filePath, getProperty(TranscodeCacheDirectoryProperty),
+        headerData, headerSize, indexData, m_texturePackage->getIndexSize());
+    TexturePackageInfo packageInfo = m_texturePackageInfo;
+
+    // A complete cache file is an uncompressed package of the same frames.
+    closeTexturePackage();
+    if (openTexturePackage(cachePath)) {
+        if (TexturePackageCodec_None == m_texturePackageInfo.codec
+            && packageInfo.textureNumber == m_texturePackageInfo.textureNumber
+            && packageInfo.textureWidth == m_texturePackageInfo.textureWidth
+            && packageInfo.textureHeight == m_texturePackageInfo.textureHeight
+            && packageInfo.textureFormat == m_texturePackageInfo.textureFormat) {
+            return true;
+        }
+
+        kzLogDebug(("SequenceFramePlugin::openTranscodeCache cache file '{}' does not match the package.", cachePath));
+        closeTexturePackage();
+    }
+
+    if (!openTexturePackage(filePath)) {
+        return false;
+    }
+
+    // No cache yet, write it while playing.
+    m_transcodeCache = new TranscodeCache();
+    int ret = m_transcodeCache->create(cachePath, m_texturePackageInfo.textureNumber,
+        m_texturePackageInfo.textureWidth, m_texturePackageInfo.textureHeight,
+        m_texturePackageInfo.textureFormat, m_textureSize);
+    if (0 != ret) {
+        kzLogDebug(("SequenceFramePlugin::openTranscodeCache failed to create cache file '{}', error {}.", cachePath, ret));
+        delete m_transcodeCache;
+        m_transcodeCache = nullptr;
+    }
+
+    return true;
+}
+
+void SequenceFramePlugin::closeTexturePackage()
+{
+    if (m_texturePackageFile != nullptr) {
         m_texturePackageFile->closeFileMapping();
         delete m_texturePackageFile;
         m_texturePackageFile = nullptr;
+    }
+
+    if (m_texturePackageReader != nullptr) {
+        m_texturePackageReader->closeFile();
+        delete m_texturePackageReader;
+        m_texturePackageReader = nullptr;
+    }
+
+    vector<byte>().swap(m_packageIndexData);
+    vector<byte>().swap(m_frameReadBuffer);
+
+    deleteTexturePackage();
+    m_decodedTextureIndex = -1;
+
+    deleteDecodeBuffers();
+}
+#endif
+
+bool SequenceFramePlugin::loadAnimationFile()
+{
+#if LZ4_EXTERNAL_FILE
+    string filePath = getProperty(PackagePathProperty);
+#if defined (__ANDROID__)
+    // Packages inside the application package can only be mapped.
+    m_isMappingPackage = true;
+#else
+    m_isMappingPackage = getProperty(MemoryMapPackageProperty);
+#endif
+    if (!openTexturePackage(filePath)) {
         return false;
     }
+
+    // The cache holds the frames of one resolution, packages with several tracks are decoded.
+    if (getProperty(TranscodeCacheProperty)
+        && TexturePackageCodec_None != m_texturePackageInfo.codec
+        && 1 == m_texturePackage->getTrackCount()) {
+        if (!openTranscodeCache(filePath)) {
+            return false;
+        }
+    }
 #else
 	BinaryResourceSharedPtr bResource = nullptr;
 	bResource = getDomain()->getResourceManager()->acquireResource<BinaryResource>(getProperty(PackagePathProperty).c_str());
@@ -165,7 +436,7 @@ bool SequenceFramePlugin::loadAnimationFile()
 	}
     //kzLogDebug(("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!`~~~~~~~~~~~~2"));
 
-	if (0 != getFileInformation()) {
+	if (0 != readPackageIndex(computeSourcePointer, bResource->getSize()) || 0 != getFileInformation()) {
 		kzLogDebug(("SequenceFrameIndexPlugin::onLoadAnimation Fail to get file info."));
 		bResource = nullptr;
 		delete computeSourcePointer;
@@ -175,6 +446,7 @@ bool SequenceFramePlugin::loadAnimationFile()
 	//kzLogDebug(("!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!`~~~~~~~~~~~~3"));
 #endif
     m_isReversed = getProperty(ReverseProperty);
+    m_isLoopPlayback = getProperty(LoopPlaybackProperty);
     if (!m_isReversed) {
         m_currentTextureIndex = 0;
     }
@@ -182,10 +454,17 @@ bool SequenceFramePlugin::loadAnimationFile()
         m_currentTextureIndex = m_texturePackageInfo.textureNumber - 1;
     }
 
-    Texture::CreateInfo2D createInfo(m_texturePackageInfo.textureWidth,
-        m_texturePackageInfo.textureHeight,
-        m_texturePackageInfo.textureFormat);
-    m_texture = Texture::create(getDomain(), createInfo, "Animated Texture");
+    createAnimationTexture();
+    createDecodeWorkerPool();
+
+#if LZ4_EXTERNAL_FILE
+    int stagingCacheSize = getProperty(StagingCacheSizeProperty);
+    if (stagingCacheSize > 0) {
+        std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+        m_stagingCache = new StagingCache(static_cast<size_t>(stagingCacheSize));
+        m_stagingCursor = -1;
+    }
+#endif
 
     // request decompress first texture
     {
@@ -218,7 +497,7 @@ void SequenceFramePlugin::onLoadAnimation(const EmptyMessageArguments&)
 
 void SequenceFramePlugin::onPlayAnimation(const EmptyMessageArguments&)
 {
-    if (nullptr == m_texturePackageFile) {
+    if (!isTexturePackageOpen()) {
         //kzLogDebug(("SequenceFramePlugin::onPlayAnimation texture package is null"));
         if (!loadAnimationFile())
             return;
@@ -229,10 +508,13 @@ void SequenceFramePlugin::onPlayAnimation(const EmptyMessageArguments&)
         return;
     }
 
+    m_isLoopPlayback = getProperty(LoopPlaybackProperty);
+
     float FPS = getProperty(FPSProperty);
     if (FPS < 1.0) {
         FPS = 1.0;
     }
+    m_decodeLoadMonitor.setFrameInterval(1000.0 / FPS);
     m_playTextureTimerToken = getDomain()->getMainLoopScheduler()->appendTimer(UserStage,
         kzMakeFixedString(""),
         MainLoopScheduler::TimerRecurrence::Recurring,
@@ -266,17 +548,36 @@ void SequenceFramePlugin::onPauseAnimation(const EmptyMessageArguments&)
 
 void SequenceFramePlugin::onTimerShowTexture(chrono::nanoseconds, unsigned int)
 {
+    double decodeTime = -1.0;
     {
         std::lock_guard<kanzi::mutex> lock(m_decompressionThreadLock);
         if (DecompressionThreadStatus_Idle != m_decompressionThreadStatus) {
             // kzLogDebug(("SequenceFramePlugin::onTimerShowTexture current frame is not ready."));
             return;
         }
+        decodeTime = m_decodeTime;
+        m_decodeTime = -1.0;
     }
 
     if (0 <= m_currentTextureIndex
         && m_currentTextureIndex < m_texturePackageInfo.textureNumber) {
 
+        // When the node is shown at another size, or the decoding does not keep up, decode the frame
+        // again from the track that fits and show it on the next tick.
+        if (nullptr != m_texturePackage && m_texturePackage->getTrackCount() > 1) {
+            uint32_t track = chooseAdaptiveTrack(decodeTime);
+            if (track != m_trackIndex) {
+                if (switchTrack(track)) {
+                    {
+                        std::lock_guard<kanzi::mutex> lock(m_decompressionThreadLock);
+                        m_decompressionThreadStatus = DecompressionThreadStatus_RequestWork;
+                    }
+                    m_decompressionCondition.notify_one();
+                }
+                return;
+            }
+        }
+
         /*
         Texture::CreateInfo2D createInfo(m_texturePackageInfo.textureWidth,
             m_texturePackageInfo.textureHeight,
@@ -286,10 +587,11 @@ void SequenceFramePlugin::onTimerShowTexture(chrono::nanoseconds, unsigned int)
 
         swap(*m_texture, *m_texture_temp);
         */
-        m_texture->setData(m_textureData);
+        m_texture->setData(m_uploadData);
 
+        // A track switch replaces the texture.
         if (0 == m_currentTextureIndex
-            || nullptr == getProperty(StandardMaterial::TextureProperty)) {
+            || m_texture != getProperty(StandardMaterial::TextureProperty)) {
             setProperty(StandardMaterial::TextureProperty, m_texture);
         } else {
             //setChangeFlag(PropertyTypeChangeFlagRender);
@@ -376,11 +678,20 @@ void SequenceFramePlugin::decompressTexture()
 {
     //kzLogDebug(("SequenceFramePlugin::decompressTexture Thread decompress texture begin!."));
 
+    // contexts of the decoders, kept for the life of the thread
+    Decompressor decompressor;
+
     while (true)
     {
-        // Wait for work
+        // Wait for work, staging the upcoming frames while there is none
         {
             std::unique_lock<kanzi::mutex> lock(m_decompressionThreadLock);
+            while (DecompressionThreadStatus_Idle == m_decompressionThreadStatus && m_isStagingPending) {
+                lock.unlock();
+                bool isStagingPending = stageNextFrame();
+                lock.lock();
+                m_isStagingPending = isStagingPending;
+            }
             m_decompressionCondition.wait(lock, [this]() { return m_decompressionThreadStatus != DecompressionThreadStatus_Idle; });
             if (DecompressionThreadStatus_Destroy == m_decompressionThreadStatus) {
                 break;
@@ -392,115 +703,500 @@ void SequenceFramePlugin::decompressTexture()
 
         size_t size = 0;
         size_t offset = 0;
+        const std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
 
         // thread status working
-        if (0 == m_currentTextureIndex) {
-            size = m_texturePointerVector[m_currentTextureIndex] - m_texturePackageInfo.dataOffset;
-            offset = m_texturePackageInfo.dataOffset;
-        } else {
-            size = m_texturePointerVector[m_currentTextureIndex] - m_texturePointerVector[m_currentTextureIndex - 1];
-            offset = m_texturePointerVector[m_currentTextureIndex - 1];
-        }
+        getTextureFrame(m_currentTextureIndex, offset, size);
+        const TexturePackageFrame& frame = m_texturePackage->getFrame(m_currentTextureIndex);
+        // duplicate frames decode the frame they repeat
+        const int32_t decodedTextureIndex = static_cast<int32_t>(frame.reference);
+        const bool isDecoding = (decodedTextureIndex != m_decodedTextureIndex);
 #if LZ4_EXTERNAL_FILE
-        auto* fileOffset = static_cast<byte*>(m_texturePackageFile->getFileBuffer()) + offset;
+        int decompressionResult = 0;
+
+        if (decodedTextureIndex != m_decodedTextureIndex) {
+            // compressed payload of the frame, when it is in memory
+            const byte* frameData = nullptr;
+            {
+                std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+                if (nullptr != m_stagingCache) {
+                    m_stagingCache->advance(decodedTextureIndex);
+                    frameData = m_stagingCache->find(decodedTextureIndex, size);
+                }
+            }
+            const bool isStaged = (nullptr != frameData);
+            if (!isStaged && nullptr != m_texturePackageFile) {
+                frameData = static_cast<const byte*>(m_texturePackageFile->getFileBuffer()) + offset;
+            }
 
-        if (CompressionAlgorithm_LZ4 == m_texturePackageInfo.compressionAlgorithm) {
-            DecompressBufferLZ4(size, fileOffset, m_textureSize, m_textureData);
-        } else if (CompressionAlgorithm_ZLIB == m_texturePackageInfo.compressionAlgorithm) {
-            DecompressBufferZLIB(size, fileOffset, m_textureSize, m_textureData);
+            const FrameCodec* codec = CodecRegistry::getInstance().findCodec(frame.codec);
+            const void* dictionary = (codec == m_dictionaryCodec) ? m_packageDictionary : nullptr;
+            if (TexturePackageCodec_None == frame.codec) {
+                if (nullptr != frameData) {
+                    // Raw frames are uploaded straight from memory, only fault the pages in here
+                    // so that the kanzi thread does not stall on the storage.
+                    if (!isStaged) {
+                        m_texturePackageFile->prefetch(frameData, m_textureSize);
+                    }
+                    m_blockData = frameData;
+                } else {
+                    decompressionResult = m_texturePackageReader->readFile(offset, m_textureSize, m_textureData);
+                    m_textureRegionIndex = -1;
+                    m_blockData = m_textureData;
+                }
+            } else if (nullptr == frameData
+                && 0 == (frame.flags & (TexturePackageFrameFlag_Striped | TexturePackageFrameFlag_Planar
+                    | TexturePackageFrameFlag_Trimmed))
+                && nullptr != codec->decodeInPlace && size <= m_textureBufferSize) {
+                // Read the frame to the end of the texture buffer and decode it forward in place,
+                // there is no second buffer for the compressed frame.
+                m_textureRegionIndex = -1;
+                decompressionResult = m_texturePackageReader->readFile(offset, size,
+                    m_textureData + m_textureBufferSize - size);
+                if (0 == decompressionResult) {
+                    decompressionResult = codec->decodeInPlace(decompressor, dictionary, size, m_textureSize,
+                        m_textureData, m_textureBufferSize);
+                }
+                m_blockData = m_textureData;
+            } else {
+                if (nullptr == frameData) {
+                    m_frameReadBuffer.resize(size);
+                    decompressionResult = m_texturePackageReader->readFile(offset, size, m_frameReadBuffer.data());
+                    frameData = m_frameReadBuffer.data();
+                }
+
+                if (0 == decompressionResult) {
+                    decompressionResult = decodeFrame(decompressor, frame, codec, dictionary, frameData, size);
+                }
+                m_blockData = m_textureData;
+            }
+
+            m_decodedTextureIndex = (0 == decompressionResult) ? decodedTextureIndex : -1;
+        }
+
+        if (nullptr != m_transcodeCache && m_transcodeCache->isOpen() && 0 == decompressionResult) {
+            int ret = m_transcodeCache->writeFrame(m_currentTextureIndex, m_blockData);
+            if (0 == ret && m_transcodeCache->isComplete()) {
+                ret = m_transcodeCache->finish();
+            }
+            if (0 != ret) {
+                kzLogDebug(("SequenceFramePlugin::decompressTexture transcode cache failed, error {}.", ret));
+                m_transcodeCache->discard();
+            }
         }
+
+        if (m_texturePackageInfo.isSoftwareDecoded) {
+            // The texture holds pixels, a frame that fails to decode leaves the pixels of the previous one.
+            if (isDecoding && 0 == decompressionResult) {
+                decodePixels(m_blockData);
+            }
+            m_uploadData = m_pixelData;
+        } else {
+            m_uploadData = m_blockData;
+        }
+
+        m_stagingCursor = m_currentTextureIndex;
 #else
-        if (CompressionAlgorithm_LZ4 == m_texturePackageInfo.compressionAlgorithm) {
-            DecompressBufferLZ4(size, 
-                 const_cast<byte*>(computeSourcePointer) + offset,
-                m_textureSize, m_textureData);
-        } else if (CompressionAlgorithm_ZLIB
-                   == m_texturePackageInfo.compressionAlgorithm) {
-            DecompressBufferZLIB(size, 
-				const_cast<byte*>(computeSourcePointer) + offset,
-                m_textureSize, m_textureData);
+        if (decodedTextureIndex == m_decodedTextureIndex) {
+            // A duplicate of the decoded frame, upload it again.
+        } else if (TexturePackageCodec_None == frame.codec) {
+            m_blockData = computeSourcePointer + offset;
+        } else {
+            const FrameCodec* codec = CodecRegistry::getInstance().findCodec(frame.codec);
+            const void* dictionary = (codec == m_dictionaryCodec) ? m_packageDictionary : nullptr;
+            decodeFrame(decompressor, frame, codec, dictionary, computeSourcePointer + offset, size);
+            m_blockData = m_textureData;
         }
+        if (m_texturePackageInfo.isSoftwareDecoded) {
+            if (isDecoding) {
+                decodePixels(m_blockData);
+            }
+            m_uploadData = m_pixelData;
+        } else {
+            m_uploadData = m_blockData;
+        }
+        m_decodedTextureIndex = decodedTextureIndex;
 #endif
         //kzLogDebug(("SequenceFramePlugin::decompressTexture Thread decompress texture {}", pluginData->m_currentTextureIndex));
+        const double decodeTime = isDecoding
+            ? std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count()
+            : -1.0;
         // current texture decompressed
         {
             std::lock_guard<kanzi::mutex> lock(m_decompressionThreadLock);
+            m_decodeTime = decodeTime;
             if (m_decompressionThreadStatus == DecompressionThreadStatus_Working)
                 m_decompressionThreadStatus = DecompressionThreadStatus_Idle;
+            m_isStagingPending = (nullptr != m_stagingCache);
         }
     }
 
     kzLogDebug(("SequenceFramePlugin::decompressTexture(): exit thread."));
 }
 
-int SequenceFramePlugin::getFileInformation()
+int SequenceFramePlugin::decodeFrame(Decompressor& decompressor, const TexturePackageFrame& frame,
+                                     const FrameCodec* codec, const void* dictionary, const byte* frameData,
+                                     size_t size)
+{
+    // Trimmed frames are decoded to the region buffer and placed into the texture buffer, planar frames
+    // are decoded to the plane buffer and interleaved into either.
+    const bool isPlanar = (0 != (frame.flags & TexturePackageFrameFlag_Planar));
+    const bool isTrimmed = (0 != (frame.flags & TexturePackageFrameFlag_Trimmed));
+    byte* frameTexture = isTrimmed ? m_regionData : m_textureData;
+    byte* decodedData = isPlanar ? m_planeData : frameTexture;
+    const size_t decodedSize = isTrimmed ? frame.decodedSize : m_textureSize;
+    int ret = 0;
+
+    if (!isTrimmed) {
+        m_textureRegionIndex = -1;
+    }
+
+    if (0 == (frame.flags & TexturePackageFrameFlag_Striped)) {
+        ret = codec->decode(decompressor, dictionary, size, frameData, decodedSize, decodedData);
+        if (0 == ret && isPlanar) {
+            InterleaveETC2RGBA8Planes(decodedData, decodedSize, frameTexture);
+        }
+    } else {
+        vector<TexturePackageStripe> stripes;
+        ret = TexturePackage::parseStripes(frameData, size, decodedSize, stripes);
+        if (0 != ret) {
+            return ret;
+        }
+
+        // Every stripe decodes to its own rows of the texture, the threads never write the same bytes.
+        // Each thread decodes with the decompressor of its own, the planes of a stripe are its own too.
+        ret = m_decodeWorkerPool->run(stripes.size(), [&](size_t index) {
+            const TexturePackageStripe& stripe = stripes[index];
+            if (isPlanar && 0 != stripe.decodedSize % ETC2RGBA8BlockSize) {
+                return EINVAL;
+            }
+
+            int stripeResult = codec->decode(Decompressor::getThreadDecompressor(), dictionary, stripe.size,
+                frameData + stripe.offset, stripe.decodedSize, decodedData + stripe.decodedOffset);
+            if (0 == stripeResult && isPlanar) {
+                InterleaveETC2RGBA8Planes(decodedData + stripe.decodedOffset, stripe.decodedSize,
+                    frameTexture + stripe.decodedOffset);
+            }
+            return stripeResult;
+        });
+    }
+
+    if (0 == ret && isTrimmed) {
+        const size_t textureBlockWidth = (m_texturePackageInfo.textureWidth + 3) / 4;
+        const size_t textureBlockHeight = (m_texturePackageInfo.textureHeight + 3) / 4;
+        TextureBlockRect previous = { 0, 0, static_cast<uint32_t>(textureBlockWidth),
+                                      static_cast<uint32_t>(textureBlockHeight) };
+        if (0 <= m_textureRegionIndex) {
+            const TexturePackageFrame& previousFrame = m_texturePackage->getFrame(m_textureRegionIndex);
+            previous.x = previousFrame.trimX;
+            previous.y = previousFrame.trimY;
+            previous.width = previousFrame.trimWidth;
+            previous.height = previousFrame.trimHeight;
+        }
+
+        const TextureBlockRect rect = { frame.trimX, frame.trimY, frame.trimWidth, frame.trimHeight };
+        size_t blockSize = 0;
+        const unsigned char* transparentBlock = getTransparentBlock(m_texturePackageInfo.textureFormat, blockSize);
+        PlaceTextureRegion(m_regionData, rect, previous, transparentBlock, blockSize, textureBlockWidth, m_textureData);
+        m_textureRegionIndex = static_cast<int32_t>(frame.reference);
+    }
+
+    return ret;
+}
+
+bool SequenceFramePlugin::stageNextFrame()
 {
 #if LZ4_EXTERNAL_FILE
-    if (nullptr == m_texturePackageFile->getFileBuffer()) {
-        kzLogDebug(("SequenceFramePlugin::getFileInformation Texture package buffer is NULL."));
-        return -1;
+    std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+    if (nullptr == m_stagingCache || !isTexturePackageOpen() || m_stagingCursor < 0) {
+        return false;
+    }
+
+    // Stage the first upcoming frame that is not staged yet.
+    int32_t index = m_stagingCursor;
+    for (int32_t i = 1; i < m_texturePackageInfo.textureNumber; ++i) {
+        index = getNextTextureIndex(index);
+        if (index < 0 || index == m_stagingCursor) {
+            return false;
+        }
+
+        // Duplicates are staged as the frame they repeat.
+        int32_t stagedIndex = static_cast<int32_t>(m_texturePackage->getFrame(index).reference);
+        if (!m_stagingCache->contains(stagedIndex)) {
+            size_t offset = 0;
+            size_t size = 0;
+            getTextureFrame(stagedIndex, offset, size);
+            if (nullptr != m_texturePackageFile) {
+                return m_stagingCache->stage(stagedIndex,
+                    static_cast<byte*>(m_texturePackageFile->getFileBuffer()) + offset, size);
+            }
+
+            unsigned char* stagedData = m_stagingCache->stage(stagedIndex, size);
+            if (nullptr == stagedData) {
+                return false;
+            }
+            if (0 != m_texturePackageReader->readFile(offset, size, stagedData)) {
+                m_stagingCache->unstage();
+                return false;
+            }
+            return true;
+        }
+    }
+#endif
+
+    return false;
+}
+
+void SequenceFramePlugin::getTextureFrame(int32_t index, size_t& offset, size_t& size) const
+{
+    const TexturePackageFrame& frame = m_texturePackage->getFrame(index);
+    offset = static_cast<size_t>(frame.offset);
+    size = frame.size;
+}
+
+int32_t SequenceFramePlugin::getNextTextureIndex(int32_t index) const
+{
+    if (!m_isReversed) {
+        ++index;
+        if (index >= m_texturePackageInfo.textureNumber) {
+            index = m_isLoopPlayback ? 0 : -1;
+        }
+    } else {
+        --index;
+        if (index < 0) {
+            index = m_isLoopPlayback ? m_texturePackageInfo.textureNumber - 1 : -1;
+        }
+    }
+
+    return index;
+}
+
+int SequenceFramePlugin::readPackageIndex(const byte* packageData, size_t packageSize)
+{
+    m_texturePackage = new TexturePackage();
+
+    if (nullptr != packageData) {
+        int ret = m_texturePackage->parseHeader(packageData,
+            (std::min)(packageSize, TexturePackage::HeaderReadSize), packageSize);
+        if (0 == ret) {
+            ret = m_texturePackage->parseTracks(packageData + m_texturePackage->getTrackTableOffset());
+        }
+        if (0 == ret) {
+            ret = readTrackIndex(packageData, chooseTrack());
+        }
+        if (0 != ret) {
+            return ret;
+        }
+
+        return createPackageDictionary(packageData);
+    }
+
+    // Only the header and the indexes are read, the frames are read when they are decoded.
+    packageSize = m_texturePackageReader->getFileSize();
+    byte header[TexturePackage::HeaderReadSize];
+    size_t headerSize = (std::min)(packageSize, sizeof(header));
+    int ret = m_texturePackageReader->readFile(0, headerSize, header);
+    if (0 == ret) {
+        ret = m_texturePackage->parseHeader(header, headerSize, packageSize);
+    }
+    if (0 == ret && 0 != m_texturePackage->getTrackTableSize()) {
+        vector<byte> trackTable(m_texturePackage->getTrackTableSize());
+        ret = m_texturePackageReader->readFile(static_cast<size_t>(m_texturePackage->getTrackTableOffset()),
+            trackTable.size(), trackTable.data());
+        if (0 == ret) {
+            ret = m_texturePackage->parseTracks(trackTable.data());
+        }
+    }
+    if (0 == ret) {
+        ret = readTrackIndex(nullptr, chooseTrack());
+    }
+    if (0 != ret) {
+        return ret;
+    }
+
+    return createPackageDictionary(nullptr);
+}
+
+int SequenceFramePlugin::readTrackIndex(const byte* packageData, uint32_t track)
+{
+    int ret = m_texturePackage->selectTrack(track);
+    if (0 != ret) {
+        return ret;
+    }
+    m_trackIndex = track;
+
+    if (nullptr != packageData) {
+        return m_texturePackage->parseIndex(packageData + m_texturePackage->getIndexOffset());
+    }
+
+    m_packageIndexData.resize(m_texturePackage->getIndexSize());
+    ret = m_texturePackageReader->readFile(static_cast<size_t>(m_texturePackage->getIndexOffset()),
+        m_packageIndexData.size(), m_packageIndexData.data());
+    if (0 == ret) {
+        ret = m_texturePackage->parseIndex(m_packageIndexData.data());
+    }
+
+    return ret;
+}
+
+uint32_t SequenceFramePlugin::chooseTrack()
+{
+    // The size of the node on the screen, before the first layout the track stays as it is.
+    Vector2 scale = getWorldTransform().getScale();
+    float width = fabs(getActualSize().getX() * scale.getX());
+    float height = fabs(getActualSize().getY() * scale.getY());
+    if (width <= 0.0f || height <= 0.0f) {
+        return (std::min)(m_trackIndex, m_texturePackage->getTrackCount() - 1);
     }
 
-    auto* bufStart = static_cast<byte*>(m_texturePackageFile->getFileBuffer());
-    memcpy(&(m_texturePackageInfo.sizeOffset),
-        bufStart,
-        sizeof(int32_t));
-    memcpy(&(m_texturePackageInfo.dataOffset),
-        bufStart + sizeof(int32_t),
-        sizeof(int32_t));
-    memcpy(&(m_texturePackageInfo.textureNumber),
-        bufStart + sizeof(int32_t) * 2,
-        sizeof(int32_t));
-    memcpy(&(m_texturePackageInfo.textureWidth),
-        bufStart + sizeof(int32_t) * 3,
-        sizeof(int32_t));
-    memcpy(&(m_texturePackageInfo.textureHeight),
-        bufStart + sizeof(int32_t) * 4,
-        sizeof(int32_t));
-    memcpy(&(m_texturePackageInfo.textureFormat),
-        bufStart + sizeof(int32_t) * 5,
-        sizeof(int32_t));
-    memcpy(&(m_texturePackageInfo.compressionAlgorithm),
-        bufStart + sizeof(int32_t) * 6,
-        sizeof(int32_t));
+    // Tracks are ordered largest first, the largest one is used when none covers the node.
+    uint32_t chosenTrack = 0;
+    for (uint32_t i = 1; i < m_texturePackage->getTrackCount(); ++i) {
+        const TexturePackageTrack& track = m_texturePackage->getTrack(i);
+        if (track.textureWidth >= width && track.textureHeight >= height) {
+            chosenTrack = i;
+        }
+    }
+
+    return chosenTrack;
+}
+
+uint32_t SequenceFramePlugin::chooseAdaptiveTrack(double decodeTime)
+{
+    const uint32_t lastTrack = m_texturePackage->getTrackCount() - 1;
+    const uint32_t track = chooseTrack();
+
+    if (!getProperty(AdaptiveQualityProperty)) {
+        m_trackFallback = 0;
+    } else if (0.0 <= decodeTime) {
+        // Frames that repeat the decoded frame take no decode time and are left out of the average.
+        int step = m_decodeLoadMonitor.addDecodeTime(decodeTime);
+        if (0 < step && track + m_trackFallback < lastTrack) {
+            ++m_trackFallback;
+        } else if (0 > step && 0 < m_trackFallback) {
+            --m_trackFallback;
+        }
+    }
+
+    return (std::min)(track + m_trackFallback, lastTrack);
+}
+
+bool SequenceFramePlugin::switchTrack(uint32_t track)
+{
+#if LZ4_EXTERNAL_FILE
+    const byte* packageData = (nullptr != m_texturePackageFile)
+        ? static_cast<const byte*>(m_texturePackageFile->getFileBuffer()) : nullptr;
 #else
-	if (nullptr == computeSourcePointer) {
-		kzLogDebug(("SequenceFramePlugin::getFileInformation Texture package buffer is NULL."));
-		return -1;
-	}
-	memcpy(&(m_texturePackageInfo.sizeOffset),
-		computeSourcePointer + sizeof(int32_t) * 0,
-		sizeof(int32_t));
-	memcpy(&(m_texturePackageInfo.dataOffset),
-		computeSourcePointer + sizeof(int32_t) * 1,
-		sizeof(int32_t));
-	memcpy(&(m_texturePackageInfo.textureNumber),
-		computeSourcePointer + sizeof(int32_t) * 2,
-		sizeof(int32_t));
-	memcpy(&(m_texturePackageInfo.textureWidth),
-		computeSourcePointer + sizeof(int32_t) * 3,
-		sizeof(int32_t));
-	memcpy(&(m_texturePackageInfo.textureHeight),
-		computeSourcePointer + sizeof(int32_t) * 4,
-		sizeof(int32_t));
-	memcpy(&(m_texturePackageInfo.textureFormat),
-		computeSourcePointer + sizeof(int32_t) * 5,
-		sizeof(int32_t));
-	memcpy(&(m_texturePackageInfo.compressionAlgorithm),
-		computeSourcePointer + sizeof(int32_t) * 6,
-		sizeof(int32_t));
+    const byte* packageData = computeSourcePointer;
 #endif
+    int ret = 0;
+
+    {
+        // The decompression thread stages frames of the package while it is idle.
+        std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+        if (nullptr != m_stagingCache) {
+            m_stagingCache->clear();
+        }
+
+        deleteDecodeBuffers();
+        m_decodedTextureIndex = -1;
+
+        ret = readTrackIndex(packageData, track);
+        if (0 == ret) {
+            ret = getFileInformation();
+        }
+    }
+    // The decode times of the previous track say nothing about this one.
+    m_decodeLoadMonitor.reset();
+
+    // A track that cannot be read leaves the package without a frame index, the animation stops.
+    if (0 != ret) {
+        kzLogDebug(("SequenceFramePlugin::switchTrack Fail to switch to track {}, error {}.", track, ret));
+        resetPluginStatus();
+        return false;
+    }
 
-    if (m_texturePackageInfo.sizeOffset < 0 || m_texturePackageInfo.dataOffset < 0 ||
-        m_texturePackageInfo.textureNumber < 0 || m_texturePackageInfo.textureWidth < 0 ||
+    kzLogDebug(("SequenceFramePlugin::switchTrack track {}, {}x{}, fallback {}.", track,
+        m_texturePackageInfo.textureWidth, m_texturePackageInfo.textureHeight, m_trackFallback));
+    createAnimationTexture();
+    createDecodeWorkerPool();
+
+    return true;
+}
+
+int SequenceFramePlugin::createPackageDictionary(const byte* packageData)
+{
+    size_t dictionarySize = m_texturePackage->getDictionarySize();
+    if (0 == dictionarySize) {
+        return 0;
+    }
+
+    const FrameCodec* codec = CodecRegistry::getInstance().findCodec(m_texturePackage->getCodec());
+    if (nullptr == codec || nullptr == codec->createDictionary) {
+        // The codec check of getFileInformation reports an unknown codec.
+        kzLogDebug(("SequenceFramePlugin::createPackageDictionary codec {} does not use the dictionary.",
+            m_texturePackage->getCodec()));
+        return 0;
+    }
+
+    // The codec copies what it needs, a dictionary that is read is only kept for the call.
+    size_t dictionaryOffset = static_cast<size_t>(m_texturePackage->getDictionaryOffset());
+    vector<byte> dictionaryData;
+    const byte* dictionary = nullptr;
+    if (nullptr != packageData) {
+        dictionary = packageData + dictionaryOffset;
+    } else {
+        dictionaryData.resize(dictionarySize);
+        int ret = m_texturePackageReader->readFile(dictionaryOffset, dictionarySize, dictionaryData.data());
+        if (0 != ret) {
+            return ret;
+        }
+        dictionary = dictionaryData.data();
+    }
+
+    m_packageDictionary = codec->createDictionary(dictionary, dictionarySize);
+    if (nullptr == m_packageDictionary) {
+        return ENOMEM;
+    }
+    m_dictionaryCodec = codec;
+
+    return 0;
+}
+
+void SequenceFramePlugin::deleteTexturePackage()
+{
+    if (nullptr != m_packageDictionary) {
+        m_dictionaryCodec->freeDictionary(m_packageDictionary);
+        m_packageDictionary = nullptr;
+    }
+    m_dictionaryCodec = nullptr;
+
+    delete m_texturePackage;
+    m_texturePackage = nullptr;
+}
+
+int SequenceFramePlugin::getFileInformation()
+{
+    if (nullptr == m_texturePackage) {
+        kzLogDebug(("SequenceFramePlugin::getFileInformation Texture package is NULL."));
+        return -1;
+    }
+
+    m_texturePackageInfo.textureNumber = static_cast<int32_t>(m_texturePackage->getTextureNumber());
+    m_texturePackageInfo.textureWidth = static_cast<int32_t>(m_texturePackage->getTextureWidth());
+    m_texturePackageInfo.textureHeight = static_cast<int32_t>(m_texturePackage->getTextureHeight());
+    m_texturePackageInfo.textureFormat = static_cast<GraphicsFormat>(m_texturePackage->getTextureFormat());
+    m_texturePackageInfo.codec = m_texturePackage->getCodec();
+    m_texturePackageInfo.isStriped = false;
+    m_texturePackageInfo.isSoftwareDecoded = false;
+
+    if (m_texturePackageInfo.textureNumber < 0 || m_texturePackageInfo.textureWidth < 0 ||
         m_texturePackageInfo.textureHeight < 0 || m_texturePackageInfo.textureFormat < 1 ||
-        m_texturePackageInfo.compressionAlgorithm < 1) {
+        nullptr == CodecRegistry::getInstance().findCodec(m_texturePackageInfo.codec)) {
 
         kzLogDebug(("SequenceFramePlugin::getFileInformation Bad header information.\n"));
-        kzLogDebug(("SequenceFramePlugin::getFileInformation sizeOffset is {}\n",
-            m_texturePackageInfo.sizeOffset));
-        kzLogDebug(("SequenceFramePlugin::getFileInformation dataOffset is {}\n",
-            m_texturePackageInfo.dataOffset));
+        kzLogDebug(("SequenceFramePlugin::getFileInformation version is {}\n",
+            m_texturePackage->getVersion()));
         kzLogDebug(("SequenceFramePlugin::getFileInformation textureNumber is {}\n",
             m_texturePackageInfo.textureNumber));
         kzLogDebug(("SequenceFramePlugin::getFileInformation textureWidth is {}\n",
@@ -509,8 +1205,8 @@ int SequenceFramePlugin::getFileInformation()
             m_texturePackageInfo.textureHeight));
         kzLogDebug(("SequenceFramePlugin::getFileInformation textureFormat is {}\n",
             m_texturePackageInfo.textureFormat));
-        kzLogDebug(("SequenceFramePlugin::getFileInformation compressionAlgorithm is {}\n",
-            m_texturePackageInfo.compressionAlgorithm));
+        kzLogDebug(("SequenceFramePlugin::getFileInformation codec is {}\n",
+            m_texturePackageInfo.codec));
 
         return -1;
     }
@@ -519,26 +1215,98 @@ int SequenceFramePlugin::getFileInformation()
         m_texturePackageInfo.textureHeight,
         m_texturePackageInfo.textureFormat);
 
-    m_textureData = new byte[m_textureSize];
+    // Uncompressed frames are uploaded from the package itself and need no decode buffer,
+    // unless the package is read instead of mapped. Frames that are read and decoded in place need
+    // room for the compressed frame behind the texture.
+    bool hasCompressedFrames = false;
+    bool hasPlanarFrames = false;
+    bool hasTrimmedFrames = false;
+    m_textureBufferSize = m_textureSize;
+    for (const TexturePackageFrame& frame : m_texturePackage->getFrames()) {
+        if (0 != (frame.flags & TexturePackageFrameFlag_Delta)) {
+            kzLogDebug(("SequenceFramePlugin::getFileInformation Delta frames are not supported.\n"));
+            return -1;
+        }
 
-    for (int32_t i = 0; i < m_texturePackageInfo.textureNumber; ++i) {
-        size_t textureSize = 0;
-#if LZ4_EXTERNAL_FILE
-		memcpy(&textureSize, static_cast<byte*>(m_texturePackageFile->getFileBuffer())
-			+ m_texturePackageInfo.sizeOffset + sizeof(int32_t) * i, sizeof(int32_t));
-#else
-			memcpy(&textureSize, const_cast<byte*>(computeSourcePointer)
-				+ m_texturePackageInfo.sizeOffset + sizeof(int32_t) * i, sizeof(int32_t));
-#endif
+        if (0 != (frame.flags & TexturePackageFrameFlag_Trimmed)) {
+            // The rectangle is a part of the texture blocks, the blocks around it are cleared.
+            size_t blockSize = 0;
+            if (TexturePackageCodec_None == frame.codec
+                || nullptr == getTransparentBlock(m_texturePackageInfo.textureFormat, blockSize)
+                || static_cast<size_t>(frame.trimWidth) * frame.trimHeight * blockSize != frame.decodedSize
+                || frame.decodedSize > m_textureSize) {
+                kzLogDebug(("SequenceFramePlugin::getFileInformation Bad trimmed frame, {}x{} blocks of {} bytes.\n",
+                    frame.trimWidth, frame.trimHeight, frame.decodedSize));
+                return -1;
+            }
+            hasTrimmedFrames = true;
+        } else if (0 != frame.decodedSize && frame.decodedSize != m_textureSize) {
+            kzLogDebug(("SequenceFramePlugin::getFileInformation Decoded frame size {} is not the texture size.\n",
+                frame.decodedSize));
+            return -1;
+        }
 
-        if (textureSize < 0) {
-            kzLogDebug(("The {} compressed texture size is less than 0.\n", i));
-            m_texturePointerVector.clear();
+        const FrameCodec* codec = CodecRegistry::getInstance().findCodec(frame.codec);
+        if (nullptr == codec) {
+            kzLogDebug(("SequenceFramePlugin::getFileInformation Unknown codec {}.\n", frame.codec));
             return -1;
         }
 
-        m_texturePointerVector.push_back(textureSize);
+        if (0 != (frame.flags & TexturePackageFrameFlag_Striped)) {
+            if (TexturePackageCodec_None == frame.codec) {
+                kzLogDebug(("SequenceFramePlugin::getFileInformation Uncompressed frames cannot be striped.\n"));
+                return -1;
+            }
+            m_texturePackageInfo.isStriped = true;
+        }
+
+        if (0 != (frame.flags & TexturePackageFrameFlag_Planar)) {
+            if (TexturePackageCodec_None == frame.codec
+                || GraphicsFormatETC2_R8G8B8A8_UNORM != m_texturePackageInfo.textureFormat) {
+                kzLogDebug(("SequenceFramePlugin::getFileInformation Only compressed ETC2 RGBA8 frames can be planar.\n"));
+                return -1;
+            }
+            hasPlanarFrames = true;
+        }
+
+        if (TexturePackageCodec_None == frame.codec) {
+            // Frames may be followed by alignment padding, but never be shorter than a texture.
+            if (frame.size < m_textureSize) {
+                kzLogDebug(("SequenceFramePlugin::getFileInformation Uncompressed frame is smaller than the texture.\n"));
+                return -1;
+            }
+            continue;
+        }
+
+        hasCompressedFrames = true;
+        if (nullptr != m_texturePackageReader && nullptr != codec->getInPlaceBufferSize) {
+            m_textureBufferSize = (std::max)(m_textureBufferSize,
+                codec->getInPlaceBufferSize(frame.size, m_textureSize));
+        }
     }
+
+    if (nullptr != m_texturePackageReader || hasCompressedFrames) {
+        m_textureData = new byte[m_textureBufferSize];
+    }
+    if (hasPlanarFrames) {
+        m_planeData = new byte[m_textureSize];
+    }
+    if (hasTrimmedFrames) {
+        m_regionData = new byte[m_textureSize];
+    }
+
+    // GPUs without ETC2, for example desktop GL drivers, get pixels decoded on the decode threads
+    // instead of leaving the decoding to the driver on the kanzi thread.
+    ETC2Format softwareFormat;
+    if (getSoftwareDecodeFormat(m_texturePackageInfo.textureFormat, softwareFormat)
+        && !isTextureFormatSupported(m_texturePackageInfo.textureFormat)) {
+        kzLogDebug(("SequenceFramePlugin::getFileInformation Texture format {} is decoded on the CPU.\n",
+            m_texturePackageInfo.textureFormat));
+        m_texturePackageInfo.isSoftwareDecoded = true;
+        m_pixelData = new byte[getDataSizeBytes(m_texturePackageInfo.textureWidth,
+            m_texturePackageInfo.textureHeight, GraphicsFormatR8G8B8A8_UNORM)];
+    }
+
     return 0;
 }
 
@@ -547,17 +1315,103 @@ void SequenceFramePlugin::resetPluginStatus()
     getDomain()->getMainLoopScheduler()->removeTimer(m_playTextureTimerToken);
 
 #if LZ4_EXTERNAL_FILE
-    if (m_texturePackageFile != nullptr) {
-        m_texturePackageFile->closeFileMapping();
-        delete m_texturePackageFile;
-        m_texturePackageFile = nullptr;
+    // An unfinished cache file is removed, the next play starts it again.
+    delete m_transcodeCache;
+    m_transcodeCache = nullptr;
+
+    {
+        // The decompression thread stages frames from the package while it is idle.
+        std::lock_guard<kanzi::mutex> lock(m_stagingCacheLock);
+        if (nullptr != m_stagingCache) {
+            kzLogDebug(("SequenceFramePlugin::resetPluginStatus staging cache hits {}, misses {}.",
+                m_stagingCache->getHitCount(), m_stagingCache->getMissCount()));
+            delete m_stagingCache;
+            m_stagingCache = nullptr;
+        }
+        m_stagingCursor = -1;
+
+        closeTexturePackage();
     }
 #endif
 
     m_currentTextureIndex = 0;
     
-    m_texturePointerVector.clear();
+    deleteTexturePackage();
+    delete m_decodeWorkerPool;
+    m_decodeWorkerPool = nullptr;
+    m_decodedTextureIndex = -1;
+    m_trackFallback = 0;
+    m_decodeLoadMonitor.reset();
+
+    deleteDecodeBuffers();
+}
+
+void SequenceFramePlugin::createDecodeWorkerPool()
+{
+    if ((!m_texturePackageInfo.isStriped && !m_texturePackageInfo.isSoftwareDecoded)
+        || nullptr != m_decodeWorkerPool) {
+        return;
+    }
 
+    int decodeThreadCount = getProperty(DecodeThreadCountProperty);
+    if (decodeThreadCount <= 0) {
+        decodeThreadCount = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    m_decodeWorkerPool = new WorkerPool(static_cast<unsigned int>((std::max)(decodeThreadCount, 1)));
+}
+
+void SequenceFramePlugin::deleteDecodeBuffers()
+{
     delete[] m_textureData;
     m_textureData = nullptr;
+    delete[] m_planeData;
+    m_planeData = nullptr;
+    delete[] m_regionData;
+    m_regionData = nullptr;
+    m_textureRegionIndex = -1;
+    delete[] m_pixelData;
+    m_pixelData = nullptr;
+    m_blockData = nullptr;
+    m_uploadData = nullptr;
+}
+
+void SequenceFramePlugin::createAnimationTexture()
+{
+    GraphicsFormat format = m_texturePackageInfo.isSoftwareDecoded
+        ? GraphicsFormatR8G8B8A8_UNORM : m_texturePackageInfo.textureFormat;
+    Texture::CreateInfo2D createInfo(m_texturePackageInfo.textureWidth,
+        m_texturePackageInfo.textureHeight,
+        format);
+    m_texture = Texture::create(getDomain(), createInfo, "Animated Texture");
+}
+
+bool SequenceFramePlugin::isTextureFormatSupported(GraphicsFormat format)
+{
+    // WARNING: Check the Kanzi documentation for the Renderer when porting to other versions of Kanzi.
+    Renderer* renderer = getDomain()->getRenderer3D()->getCoreRenderer();
+    return renderer->isTextureFormatSupported(format);
+}
+
+void SequenceFramePlugin::decodePixels(const byte* textureData)
+{
+    ETC2Format format;
+    getSoftwareDecodeFormat(m_texturePackageInfo.textureFormat, format);
+    const uint32_t width = static_cast<uint32_t>(m_texturePackageInfo.textureWidth);
+    const uint32_t height = static_cast<uint32_t>(m_texturePackageInfo.textureHeight);
+    const uint32_t blockHeight = (height + 3) / 4;
+
+    if (nullptr == m_decodeWorkerPool) {
+        DecodeETC2Texture(format, textureData, width, height, 0, blockHeight, m_pixelData);
+        return;
+    }
+
+    // Every thread decodes a band of block rows.
+    const size_t taskCount = (std::min)(static_cast<size_t>(m_decodeWorkerPool->getThreadCount()),
+        static_cast<size_t>(blockHeight));
+    m_decodeWorkerPool->run(taskCount, [&](size_t index) {
+        DecodeETC2Texture(format, textureData, width, height,
+            static_cast<uint32_t>(blockHeight * index / taskCount),
+            static_cast<uint32_t>(blockHeight * (index + 1) / taskCount), m_pixelData);
+        return 0;
+    });
 }
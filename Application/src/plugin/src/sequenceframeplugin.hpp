@@ -7,10 +7,20 @@
 // To improve compilation time in production projects, include only the header files of the Kanzi functionality you are using.
 #include <kanzi/kanzi.hpp>
 
+#include "decodeloadmonitor.h"
+
 using namespace kanzi;
 
 class SequenceFramePlugin;
 class FileMapping;
+class FileReader;
+class TranscodeCache;
+class StagingCache;
+class TexturePackage;
+struct FrameCodec;
+class WorkerPool;
+class Decompressor;
+struct TexturePackageFrame;
 typedef kanzi::shared_ptr<SequenceFramePlugin> SequenceFramePluginSharedPtr;
 
 // The template component.
@@ -28,6 +38,12 @@ public:
     static PropertyType<bool> LoopPlaybackProperty;
     static PropertyType<bool> KeepLastFrameVisibleProperty;
     static PropertyType<bool> ReverseProperty;
+    static PropertyType<bool> TranscodeCacheProperty;
+    static PropertyType<string> TranscodeCacheDirectoryProperty;
+    static PropertyType<int> StagingCacheSizeProperty;
+    static PropertyType<bool> MemoryMapPackageProperty;
+    static PropertyType<int> DecodeThreadCountProperty;
+    static PropertyType<bool> AdaptiveQualityProperty;
 
     static MessageType<EmptyMessageArguments> LoadAnimation;
     static MessageType<EmptyMessageArguments> PlayAnimation;
@@ -43,6 +59,12 @@ public:
         KZ_METACLASS_PROPERTY_TYPE(LoopPlaybackProperty);
         KZ_METACLASS_PROPERTY_TYPE(KeepLastFrameVisibleProperty);
         KZ_METACLASS_PROPERTY_TYPE(ReverseProperty);
+        KZ_METACLASS_PROPERTY_TYPE(TranscodeCacheProperty);
+        KZ_METACLASS_PROPERTY_TYPE(TranscodeCacheDirectoryProperty);
+        KZ_METACLASS_PROPERTY_TYPE(StagingCacheSizeProperty);
+        KZ_METACLASS_PROPERTY_TYPE(MemoryMapPackageProperty);
+        KZ_METACLASS_PROPERTY_TYPE(DecodeThreadCountProperty);
+        KZ_METACLASS_PROPERTY_TYPE(AdaptiveQualityProperty);
         KZ_METACLASS_MESSAGE_TYPE(LoadAnimation);
         KZ_METACLASS_MESSAGE_TYPE(PlayAnimation);
         KZ_METACLASS_MESSAGE_TYPE(StopAnimation);
@@ -57,6 +79,11 @@ public:
 
     virtual ~SequenceFramePlugin();
 
+    // Number of frames decoded from the staging cache since the animation was loaded.
+    uint64_t getStagingCacheHitCount();
+    // Number of frames decoded from the package since the animation was loaded with a staging cache.
+    uint64_t getStagingCacheMissCount();
+
 protected:
 
     // Constructor.
@@ -73,20 +100,17 @@ private:
         DecompressionThreadStatus_Destroy       // thread should quit (set by kanzi thread)
     };
 
-    enum CompressionAlgorithm {
-        CompressionAlgorithm_None = 0,
-        CompressionAlgorithm_LZ4 = 1,
-        CompressionAlgorithm_ZLIB = 2
-    };
-
     struct TexturePackageInfo {
-        int32_t sizeOffset;
-        int32_t dataOffset;
         int32_t textureNumber;
         int32_t textureWidth;
         int32_t textureHeight;
         GraphicsFormat textureFormat;
-        CompressionAlgorithm compressionAlgorithm;
+        // codec of most frames, see TexturePackageCodec
+        uint32_t codec;
+        // whether frames are split into stripes that are decoded in parallel
+        bool isStriped;
+        // whether the GPU cannot sample textureFormat, the frames are decoded to RGBA8 pixels on the CPU
+        bool isSoftwareDecoded;
     };
 
 
@@ -120,6 +144,66 @@ private:
      */
     void decompressTexture();
 
+    /**
+     * @brief decode a frame payload that is in memory into the texture buffer, the stripes of a striped
+     * frame are decoded on the decode worker pool, a trimmed frame is placed into its rectangle
+     */
+    int decodeFrame(Decompressor& decompressor, const TexturePackageFrame& frame, const FrameCodec* codec,
+                    const void* dictionary, const byte* frameData, size_t size);
+
+    /**
+     * @brief copy the payload of the next upcoming frame into the staging cache
+     */
+    bool stageNextFrame();
+
+    /**
+     * @brief get the position of a frame in the texture package
+     */
+    void getTextureFrame(int32_t index, size_t& offset, size_t& size) const;
+
+    /**
+     * @brief get the frame played after a frame, or -1 at the end of the animation
+     */
+    int32_t getNextTextureIndex(int32_t index) const;
+
+    /**
+     * @brief parse the header and index of the texture package, from packageData when the package
+     * is in memory, otherwise with file reads
+     */
+    int readPackageIndex(const byte* packageData, size_t packageSize);
+
+    /**
+     * @brief select a resolution track of the texture package and parse its frame index, from packageData
+     * when the package is in memory, otherwise with file reads
+     */
+    int readTrackIndex(const byte* packageData, uint32_t track);
+
+    /**
+     * @brief get the smallest resolution track that covers the node on the screen
+     */
+    uint32_t chooseTrack();
+
+    /**
+     * @brief get the track to play, chooseTrack() or a smaller track while the decode time of the frames
+     * does not fit the frame interval, see AdaptiveQualityProperty
+     */
+    uint32_t chooseAdaptiveTrack(double decodeTime);
+
+    /**
+     * @brief continue the animation on another resolution track, while the decompression thread is idle
+     */
+    bool switchTrack(uint32_t track);
+
+    /**
+     * @brief prepare the dictionary of the texture package for the codec of the package
+     */
+    int createPackageDictionary(const byte* packageData);
+
+    /**
+     * @brief release the texture package and its dictionary
+     */
+    void deleteTexturePackage();
+
     /**
      * @brief get the common information of comression file
      */
@@ -130,23 +214,111 @@ private:
      */
     void resetPluginStatus();
 
+    /**
+     * @brief create the threads that decode the stripes of a frame, when the frames are striped,
+     * or the pixels of a frame, when they are decoded on the CPU
+     */
+    void createDecodeWorkerPool();
+
+    /**
+     * @brief create the texture the frames are uploaded to, RGBA8 when the frames are decoded on the CPU
+     */
+    void createAnimationTexture();
+
+    /**
+     * @brief whether the GPU can sample a texture format
+     */
+    bool isTextureFormatSupported(GraphicsFormat format);
+
+    /**
+     * @brief decode the ETC2 blocks of a frame to the RGBA8 pixels in m_pixelData, on the decode threads
+     */
+    void decodePixels(const byte* textureData);
+
+    /**
+     * @brief release the buffers the frames are decoded into
+     */
+    void deleteDecodeBuffers();
+
     bool loadAnimationFile();
 
+    /**
+     * @brief map or open a texture package and read its information
+     */
+    bool openTexturePackage(const string& filePath);
+
+    /**
+     * @brief whether a texture package is open
+     */
+    bool isTexturePackageOpen() const;
+
+    /**
+     * @brief switch to the transcode cache of the package, or start writing it
+     */
+    bool openTranscodeCache(const string& filePath);
+
+    /**
+     * @brief close the texture package and release its decode buffer
+     */
+    void closeTexturePackage();
+
     DecompressionThreadStatus m_decompressionThreadStatus;
     kanzi::thread m_decompressionThread;
     kanzi::mutex m_decompressionThreadLock;
     kanzi::condition_variable m_decompressionCondition;
 
     FileMapping* m_texturePackageFile;
+    // package opened for file reads instead of mapping, see MemoryMapPackageProperty
+    FileReader* m_texturePackageReader;
+    bool m_isMappingPackage;
+    // index of a package that is read instead of mapped, kept as the key of its transcode cache
+    vector<byte> m_packageIndexData;
+    // compressed frame read from the package, when it cannot be decoded in place
+    vector<byte> m_frameReadBuffer;
+    TranscodeCache* m_transcodeCache;
+    StagingCache* m_stagingCache;
+    kanzi::mutex m_stagingCacheLock;
+    // last frame decoded, staging continues from the frame after it
+    int32_t m_stagingCursor;
+    bool m_isStagingPending;
+    TexturePackage* m_texturePackage;
+    // dictionary of the package prepared by its codec, passed to the frames of that codec
+    const FrameCodec* m_dictionaryCodec;
+    void* m_packageDictionary;
     TexturePackageInfo m_texturePackageInfo;
+    // resolution track of the package that is played
+    uint32_t m_trackIndex;
+    // tracks below the one that fits the node, taken while the decoding does not keep up
+    uint32_t m_trackFallback;
+    DecodeLoadMonitor m_decodeLoadMonitor;
+    // milliseconds the decompression thread took for the last frame, negative when it decoded nothing
+    double m_decodeTime;
     TextureSharedPtr m_texture;
     TextureSharedPtr m_texture_temp;
 
     bool m_isReversed;
+    bool m_isLoopPlayback;
     int32_t m_currentTextureIndex;
-    vector<size_t> m_texturePointerVector;
+    // frame the decoded texture in m_blockData belongs to, duplicates of it are not decoded again
+    int32_t m_decodedTextureIndex;
     size_t m_textureSize;
+    // size of m_textureData, larger than a texture when frames are decoded in place
+    size_t m_textureBufferSize;
     byte* m_textureData;
+    // decoded planes of planar frames, interleaved into m_textureData
+    byte* m_planeData;
+    // decoded rectangle of trimmed frames, placed into m_textureData
+    byte* m_regionData;
+    // trimmed frame whose rectangle m_textureData holds, -1 when any of its blocks may be visible
+    int32_t m_textureRegionIndex;
+    // RGBA8 pixels of the current frame, when the frames are decoded on the CPU
+    byte* m_pixelData;
+    // ETC2 blocks of the decoded frame, either m_textureData or a frame inside the package
+    const byte* m_blockData;
+    // texture data of the current frame, m_blockData or m_pixelData when the frames are decoded on the CPU
+    const byte* m_uploadData;
+    // threads that decode the stripes of a frame, created for striped packages
+    WorkerPool* m_decodeWorkerPool;
 	const byte* computeSourcePointer = NULL;
     MessageSubscriptionToken m_loadAnimationMessageToken;
     MessageSubscriptionToken m_playAnimationMessageToken;
@@ -0,0 +1,131 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "stagingcache.h"
+
+#include <string.h>
+
+namespace
+{
+    const size_t MaxFreeBufferCount = 2;
+}
+
+StagingCache::StagingCache(size_t budget)
+    : m_budget(budget)
+    , m_stagedBytes(0)
+    , m_hitCount(0)
+    , m_missCount(0)
+{
+}
+
+const unsigned char* StagingCache::find(int32_t index, size_t size)
+{
+    for (const StagedFrame& stagedFrame : m_stagedFrames) {
+        if (stagedFrame.index == index && stagedFrame.data.size() == size) {
+            ++m_hitCount;
+            return stagedFrame.data.data();
+        }
+    }
+
+    ++m_missCount;
+    return nullptr;
+}
+
+bool StagingCache::contains(int32_t index) const
+{
+    for (const StagedFrame& stagedFrame : m_stagedFrames) {
+        if (stagedFrame.index == index) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void StagingCache::advance(int32_t index)
+{
+    if (!contains(index)) {
+        clear();
+        return;
+    }
+
+    while (m_stagedFrames.front().index != index) {
+        releaseFront();
+    }
+}
+
+bool StagingCache::stage(int32_t index, const void* data, size_t size)
+{
+    unsigned char* stagedData = stage(index, size);
+    if (nullptr == stagedData) {
+        return false;
+    }
+
+    memcpy(stagedData, data, size);
+    return true;
+}
+
+unsigned char* StagingCache::stage(int32_t index, size_t size)
+{
+    if (m_stagedBytes + size > m_budget) {
+        return nullptr;
+    }
+
+    m_stagedFrames.push_back(StagedFrame());
+    StagedFrame& stagedFrame = m_stagedFrames.back();
+    stagedFrame.index = index;
+    // Reuse the storage of dropped frames, payloads of a clip are of similar size.
+    if (!m_freeBuffers.empty()) {
+        stagedFrame.data.swap(m_freeBuffers.back());
+        m_freeBuffers.pop_back();
+    }
+    stagedFrame.data.resize(size);
+    m_stagedBytes += size;
+    return stagedFrame.data.data();
+}
+
+void StagingCache::unstage()
+{
+    if (!m_stagedFrames.empty()) {
+        m_stagedBytes -= m_stagedFrames.back().data.size();
+        m_stagedFrames.pop_back();
+    }
+}
+
+void StagingCache::clear()
+{
+    while (!m_stagedFrames.empty()) {
+        releaseFront();
+    }
+}
+
+size_t StagingCache::getBudget() const
+{
+    return m_budget;
+}
+
+size_t StagingCache::getStagedBytes() const
+{
+    return m_stagedBytes;
+}
+
+uint64_t StagingCache::getHitCount() const
+{
+    return m_hitCount;
+}
+
+uint64_t StagingCache::getMissCount() const
+{
+    return m_missCount;
+}
+
+void StagingCache::releaseFront()
+{
+    m_stagedBytes -= m_stagedFrames.front().data.size();
+    // The playback stages about one frame for each one it drops, more spare buffers would only
+    // hold memory outside of the budget.
+    if (m_freeBuffers.size() < MaxFreeBufferCount) {
+        m_freeBuffers.push_back(std::vector<unsigned char>());
+        m_freeBuffers.back().swap(m_stagedFrames.front().data);
+    }
+    m_stagedFrames.pop_front();
+}
@@ -0,0 +1,60 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_STAGINGCACHE_H_
+#define PLUGIN_SRC_STAGINGCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+// Keeps copies of the compressed payloads of the upcoming frames in RAM, so that decoding a frame
+// does not wait for the storage. Frames are staged in playback order and dropped once the playback
+// has moved past them. This holds compressed bytes only, decoded frames are not cached here.
+class StagingCache
+{
+public:
+
+    explicit StagingCache(size_t budget);
+
+    // get the staged payload of a frame, or nullptr when it is not staged
+    const unsigned char* find(int32_t index, size_t size);
+    // whether the payload of a frame is staged
+    bool contains(int32_t index) const;
+    // drop the frames staged before a frame, or every frame if it is not staged
+    void advance(int32_t index);
+    // copy the payload of the frame that follows the staged ones in playback order,
+    // returns false when it does not fit into the budget
+    bool stage(int32_t index, const void* data, size_t size);
+    // reserve room for the payload of the frame that follows the staged ones, the caller fills it,
+    // returns nullptr when it does not fit into the budget
+    unsigned char* stage(int32_t index, size_t size);
+    // drop the frame staged last, when filling it failed
+    void unstage();
+    // drop every staged frame
+    void clear();
+
+    size_t getBudget() const;
+    size_t getStagedBytes() const;
+    uint64_t getHitCount() const;
+    uint64_t getMissCount() const;
+
+private:
+
+    struct StagedFrame {
+        int32_t index;
+        std::vector<unsigned char> data;
+    };
+
+    void releaseFront();
+
+    std::deque<StagedFrame> m_stagedFrames;
+    std::vector<std::vector<unsigned char> > m_freeBuffers;
+    size_t m_budget;
+    size_t m_stagedBytes;
+    uint64_t m_hitCount;
+    uint64_t m_missCount;
+};
+
+#endif // PLUGIN_SRC_STAGINGCACHE_H_
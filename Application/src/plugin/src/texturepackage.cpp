@@ -0,0 +1,445 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "texturepackage.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+    const char PackageMagic[4] = { 'S', 'F', 'P', 'K' };
+    const uint32_t PackageVersion1 = 1;
+    const uint32_t PackageVersion2 = 2;
+    const size_t Version1HeaderSize = sizeof(int32_t) * 7;
+    const size_t Version2HeaderSize = 64;
+    const size_t Version2DictionaryHeaderSize = 80;
+    const size_t Version2TrackHeaderSize = 96;
+    const size_t TrackEntrySize = 16;
+    const size_t Version2IndexEntrySize = 24;
+    const size_t Version2TrimIndexEntrySize = 32;
+    const size_t StripeEntrySize = sizeof(uint32_t) * 2;
+
+    template <typename T>
+    T readValue(const unsigned char* data, size_t offset)
+    {
+        T value;
+        memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+}
+
+const size_t TexturePackage::HeaderReadSize;
+
+TexturePackage::TexturePackage()
+    : m_version(0)
+    , m_textureNumber(0)
+    , m_textureWidth(0)
+    , m_textureHeight(0)
+    , m_textureFormat(0)
+    , m_codec(TexturePackageCodec_None)
+    , m_alignment(1)
+    , m_flags(0)
+    , m_indexOffset(0)
+    , m_dataOffset(0)
+    , m_dictionaryOffset(0)
+    , m_dictionarySize(0)
+    , m_trackCount(1)
+    , m_trackTableOffset(0)
+    , m_fileSize(0)
+    , m_indexEntrySize(0)
+{
+}
+
+int TexturePackage::parseHeader(const void* data, size_t size, uint64_t fileSize)
+{
+    const unsigned char* header = static_cast<const unsigned char*>(data);
+    m_frames.clear();
+    m_fileSize = fileSize;
+    m_flags = 0;
+    m_dictionaryOffset = 0;
+    m_dictionarySize = 0;
+    m_trackCount = 1;
+    m_trackTableOffset = 0;
+    m_tracks.clear();
+
+    if (nullptr == header || size > fileSize) {
+        return EINVAL;
+    }
+
+    if (size >= Version2HeaderSize && 0 == memcmp(header, PackageMagic, sizeof(PackageMagic))) {
+        m_version = readValue<uint16_t>(header, 4);
+        uint16_t headerSize = readValue<uint16_t>(header, 6);
+        m_textureNumber = readValue<uint32_t>(header, 8);
+        m_textureWidth = readValue<uint32_t>(header, 12);
+        m_textureHeight = readValue<uint32_t>(header, 16);
+        m_textureFormat = readValue<uint32_t>(header, 20);
+        m_codec = readValue<uint32_t>(header, 24);
+        m_alignment = readValue<uint32_t>(header, 28);
+        m_indexOffset = readValue<uint64_t>(header, 32);
+        m_dataOffset = readValue<uint64_t>(header, 40);
+        m_flags = readValue<uint32_t>(header, 48);
+        m_indexEntrySize = readValue<uint32_t>(header, 52);
+
+        if (PackageVersion2 != m_version || headerSize < Version2HeaderSize
+            || m_indexEntrySize < Version2IndexEntrySize
+            || 0 == m_alignment || 0 != (m_alignment & (m_alignment - 1))) {
+            return EINVAL;
+        }
+
+        if (headerSize >= Version2DictionaryHeaderSize) {
+            if (size < Version2DictionaryHeaderSize) {
+                return EINVAL;
+            }
+
+            m_dictionaryOffset = readValue<uint64_t>(header, 64);
+            m_dictionarySize = readValue<uint32_t>(header, 72);
+            if (m_dictionaryOffset > fileSize || m_dictionarySize > fileSize - m_dictionaryOffset) {
+                return EINVAL;
+            }
+        }
+
+        if (headerSize >= Version2TrackHeaderSize) {
+            if (size < Version2TrackHeaderSize) {
+                return EINVAL;
+            }
+
+            m_trackCount = (std::max)(readValue<uint32_t>(header, 80), 1u);
+            m_trackTableOffset = readValue<uint64_t>(header, 88);
+            if (m_trackCount > 1 && (m_trackTableOffset > fileSize
+                || m_trackCount > (fileSize - m_trackTableOffset) / TrackEntrySize)) {
+                return EINVAL;
+            }
+        }
+
+        // The indexes of all tracks end the file, they are found only with the real size of the file.
+        if (0 != (m_flags & TexturePackageFlag_IndexAtEnd)) {
+            if (fileSize >= SIZE_MAX || m_textureNumber > fileSize / m_indexEntrySize / m_trackCount) {
+                return EINVAL;
+            }
+            m_indexOffset = fileSize - static_cast<uint64_t>(m_textureNumber) * m_indexEntrySize * m_trackCount;
+        }
+    } else {
+        if (size < Version1HeaderSize) {
+            return EINVAL;
+        }
+
+        int32_t sizeOffset = readValue<int32_t>(header, 0);
+        int32_t dataOffset = readValue<int32_t>(header, 4);
+        int32_t textureNumber = readValue<int32_t>(header, 8);
+        int32_t textureWidth = readValue<int32_t>(header, 12);
+        int32_t textureHeight = readValue<int32_t>(header, 16);
+        if (sizeOffset < static_cast<int32_t>(Version1HeaderSize) || dataOffset < 0 || textureNumber < 0
+            || textureWidth < 0 || textureHeight < 0) {
+            return EINVAL;
+        }
+
+        m_version = PackageVersion1;
+        m_textureNumber = textureNumber;
+        m_textureWidth = textureWidth;
+        m_textureHeight = textureHeight;
+        m_textureFormat = readValue<uint32_t>(header, 20);
+        m_codec = readValue<uint32_t>(header, 24);
+        m_alignment = 1;
+        m_indexOffset = sizeOffset;
+        m_dataOffset = dataOffset;
+        m_indexEntrySize = sizeof(int32_t);
+    }
+
+    if (m_dataOffset > fileSize || m_indexOffset > fileSize
+        || m_textureNumber > (fileSize - m_indexOffset) / m_indexEntrySize) {
+        return EINVAL;
+    }
+
+    TexturePackageTrack track = { m_textureWidth, m_textureHeight, m_indexOffset };
+    m_tracks.assign(1, track);
+    return 0;
+}
+
+uint32_t TexturePackage::getTrackCount() const
+{
+    return static_cast<uint32_t>(m_tracks.size());
+}
+
+uint64_t TexturePackage::getTrackTableOffset() const
+{
+    return m_trackTableOffset;
+}
+
+size_t TexturePackage::getTrackTableSize() const
+{
+    return (m_trackCount > 1) ? TrackEntrySize * m_trackCount : 0;
+}
+
+int TexturePackage::parseTracks(const void* data)
+{
+    const unsigned char* table = static_cast<const unsigned char*>(data);
+    if (m_trackCount <= 1) {
+        return 0;
+    }
+    if (nullptr == table) {
+        return EINVAL;
+    }
+
+    std::vector<TexturePackageTrack> tracks(m_trackCount);
+    for (uint32_t i = 0; i < m_trackCount; ++i) {
+        TexturePackageTrack& track = tracks[i];
+        track.textureWidth = readValue<uint32_t>(table, TrackEntrySize * i);
+        track.textureHeight = readValue<uint32_t>(table, TrackEntrySize * i + 4);
+        track.indexOffset = readValue<uint64_t>(table, TrackEntrySize * i + 8);
+        if (0 != (m_flags & TexturePackageFlag_IndexAtEnd)) {
+            track.indexOffset = m_fileSize
+                - static_cast<uint64_t>(m_textureNumber) * m_indexEntrySize * (m_trackCount - i);
+        }
+        if (track.indexOffset > m_fileSize || m_textureNumber > (m_fileSize - track.indexOffset) / m_indexEntrySize) {
+            return EINVAL;
+        }
+    }
+
+    m_tracks.swap(tracks);
+    return 0;
+}
+
+const TexturePackageTrack& TexturePackage::getTrack(uint32_t track) const
+{
+    return m_tracks[track];
+}
+
+int TexturePackage::selectTrack(uint32_t track)
+{
+    if (track >= m_tracks.size()) {
+        return EINVAL;
+    }
+
+    m_frames.clear();
+    m_textureWidth = m_tracks[track].textureWidth;
+    m_textureHeight = m_tracks[track].textureHeight;
+    m_indexOffset = m_tracks[track].indexOffset;
+    return 0;
+}
+
+uint64_t TexturePackage::getIndexOffset() const
+{
+    return m_indexOffset;
+}
+
+size_t TexturePackage::getIndexSize() const
+{
+    return m_indexEntrySize * m_textureNumber;
+}
+
+int TexturePackage::parseIndex(const void* data)
+{
+    const unsigned char* index = static_cast<const unsigned char*>(data);
+    const size_t blockWidth = (static_cast<size_t>(m_textureWidth) + 3) / 4;
+    const size_t blockHeight = (static_cast<size_t>(m_textureHeight) + 3) / 4;
+    m_frames.clear();
+
+    if (blockWidth > UINT16_MAX || blockHeight > UINT16_MAX) {
+        return EINVAL;
+    }
+
+    if (nullptr == index && 0 != m_textureNumber) {
+        return EINVAL;
+    }
+
+    m_frames.resize(m_textureNumber);
+
+    if (PackageVersion1 == m_version) {
+        uint64_t offset = m_dataOffset;
+        for (uint32_t i = 0; i < m_textureNumber; ++i) {
+            uint64_t endOffset = readValue<uint32_t>(index, sizeof(int32_t) * i);
+            if (endOffset < offset || endOffset > m_fileSize || endOffset - offset > UINT32_MAX) {
+                m_frames.clear();
+                return EINVAL;
+            }
+
+            TexturePackageFrame& frame = m_frames[i];
+            frame.offset = offset;
+            frame.size = static_cast<uint32_t>(endOffset - offset);
+            frame.decodedSize = 0;
+            frame.codec = static_cast<uint16_t>(m_codec);
+            frame.flags = TexturePackageFrameFlag_Key;
+            frame.reference = i;
+            frame.trimX = 0;
+            frame.trimY = 0;
+            frame.trimWidth = static_cast<uint16_t>(blockWidth);
+            frame.trimHeight = static_cast<uint16_t>(blockHeight);
+            offset = endOffset;
+        }
+
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < m_textureNumber; ++i) {
+        const unsigned char* entry = index + m_indexEntrySize * i;
+        TexturePackageFrame& frame = m_frames[i];
+        frame.offset = readValue<uint64_t>(entry, 0);
+        frame.size = readValue<uint32_t>(entry, 8);
+        frame.decodedSize = readValue<uint32_t>(entry, 12);
+        frame.codec = readValue<uint16_t>(entry, 16);
+        frame.flags = readValue<uint16_t>(entry, 18);
+        frame.reference = readValue<uint32_t>(entry, 20);
+        frame.trimX = 0;
+        frame.trimY = 0;
+        frame.trimWidth = static_cast<uint16_t>(blockWidth);
+        frame.trimHeight = static_cast<uint16_t>(blockHeight);
+
+        if (0 != (frame.flags & TexturePackageFrameFlag_Trimmed)) {
+            if (m_indexEntrySize < Version2TrimIndexEntrySize) {
+                m_frames.clear();
+                return EINVAL;
+            }
+
+            frame.trimX = readValue<uint16_t>(entry, 24);
+            frame.trimY = readValue<uint16_t>(entry, 26);
+            frame.trimWidth = readValue<uint16_t>(entry, 28);
+            frame.trimHeight = readValue<uint16_t>(entry, 30);
+            if (0 == frame.trimWidth || 0 == frame.trimHeight
+                || frame.trimX + frame.trimWidth > blockWidth || frame.trimY + frame.trimHeight > blockHeight) {
+                m_frames.clear();
+                return EINVAL;
+            }
+        }
+
+        if (0 != (frame.flags & TexturePackageFrameFlag_Duplicate)) {
+            // Duplicates refer to an earlier frame, which is never a duplicate itself after this.
+            if (frame.reference >= i) {
+                m_frames.clear();
+                return EINVAL;
+            }
+
+            uint32_t reference = frame.reference;
+            if (0 != (m_frames[reference].flags & TexturePackageFrameFlag_Duplicate)) {
+                reference = m_frames[reference].reference;
+            }
+
+            const TexturePackageFrame& source = m_frames[reference];
+            frame.offset = source.offset;
+            frame.size = source.size;
+            frame.decodedSize = source.decodedSize;
+            frame.codec = source.codec;
+            frame.flags = source.flags | TexturePackageFrameFlag_Duplicate;
+            frame.reference = reference;
+            frame.trimX = source.trimX;
+            frame.trimY = source.trimY;
+            frame.trimWidth = source.trimWidth;
+            frame.trimHeight = source.trimHeight;
+            continue;
+        }
+
+        // Frames that decode on their own refer to themselves, the readers take reference as the frame
+        // that holds the payload.
+        const bool isDelta = (0 != (frame.flags & TexturePackageFrameFlag_Delta));
+        if ((isDelta && frame.reference >= m_textureNumber) || (!isDelta && frame.reference != i)
+            || frame.offset < m_dataOffset || frame.offset > m_fileSize
+            || frame.size > m_fileSize - frame.offset || 0 != frame.offset % m_alignment) {
+            m_frames.clear();
+            return EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+int TexturePackage::parseStripes(const void* payload, size_t size, size_t decodedSize,
+                                 std::vector<TexturePackageStripe>& stripes_o)
+{
+    const unsigned char* data = static_cast<const unsigned char*>(payload);
+    stripes_o.clear();
+
+    if (nullptr == data || size < sizeof(uint32_t)) {
+        return EINVAL;
+    }
+
+    size_t stripeCount = readValue<uint32_t>(data, 0);
+    if (0 == stripeCount || stripeCount > (size - sizeof(uint32_t)) / StripeEntrySize) {
+        return EINVAL;
+    }
+
+    size_t offset = sizeof(uint32_t) + StripeEntrySize * stripeCount;
+    size_t decodedOffset = 0;
+    stripes_o.resize(stripeCount);
+    for (size_t i = 0; i < stripeCount; ++i) {
+        TexturePackageStripe& stripe = stripes_o[i];
+        stripe.size = readValue<uint32_t>(data, sizeof(uint32_t) + StripeEntrySize * i);
+        stripe.decodedSize = readValue<uint32_t>(data, sizeof(uint32_t) + StripeEntrySize * i + sizeof(uint32_t));
+        if (stripe.size > size - offset || stripe.decodedSize > decodedSize - decodedOffset) {
+            stripes_o.clear();
+            return EINVAL;
+        }
+
+        stripe.offset = static_cast<uint32_t>(offset);
+        stripe.decodedOffset = static_cast<uint32_t>(decodedOffset);
+        offset += stripe.size;
+        decodedOffset += stripe.decodedSize;
+    }
+
+    if (decodedOffset != decodedSize) {
+        stripes_o.clear();
+        return EINVAL;
+    }
+
+    return 0;
+}
+
+uint32_t TexturePackage::getVersion() const
+{
+    return m_version;
+}
+
+uint32_t TexturePackage::getTextureNumber() const
+{
+    return m_textureNumber;
+}
+
+uint32_t TexturePackage::getTextureWidth() const
+{
+    return m_textureWidth;
+}
+
+uint32_t TexturePackage::getTextureHeight() const
+{
+    return m_textureHeight;
+}
+
+uint32_t TexturePackage::getTextureFormat() const
+{
+    return m_textureFormat;
+}
+
+uint32_t TexturePackage::getCodec() const
+{
+    return m_codec;
+}
+
+uint32_t TexturePackage::getAlignment() const
+{
+    return m_alignment;
+}
+
+uint64_t TexturePackage::getDataOffset() const
+{
+    return m_dataOffset;
+}
+
+uint64_t TexturePackage::getDictionaryOffset() const
+{
+    return m_dictionaryOffset;
+}
+
+size_t TexturePackage::getDictionarySize() const
+{
+    return m_dictionarySize;
+}
+
+const TexturePackageFrame& TexturePackage::getFrame(uint32_t index) const
+{
+    return m_frames[index];
+}
+
+const std::vector<TexturePackageFrame>& TexturePackage::getFrames() const
+{
+    return m_frames;
+}
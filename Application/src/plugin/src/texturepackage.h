@@ -0,0 +1,212 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_TEXTUREPACKAGE_H_
+#define PLUGIN_SRC_TEXTUREPACKAGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Texture package layout, all values are little endian.
+//
+// Version 1 has no magic. Its header is seven int32 values: sizeOffset, dataOffset, textureNumber,
+// textureWidth, textureHeight, textureFormat and compressionAlgorithm. At sizeOffset follows an int32
+// end offset per frame, a frame ends where the next one starts.
+//
+// Version 2 starts with this header of 64, 80 or 96 bytes:
+//
+//   0    char[4] magic, "SFPK"
+//   4    uint16 version, 2
+//   6    uint16 headerSize, 64, 80 or 96
+//   8    uint32 textureNumber
+//   12   uint32 textureWidth
+//   16   uint32 textureHeight
+//   20   uint32 textureFormat
+//   24   uint32 codec, the codec of most frames
+//   28   uint32 alignment of the frame payloads, a power of two
+//   32   uint64 indexOffset
+//   40   uint64 dataOffset
+//   48   uint32 flags, TexturePackageFlag values
+//   52   uint32 indexEntrySize
+//   56   uint64 reserved, 0
+//   64   uint64 dictionaryOffset, when headerSize is 80
+//   72   uint32 dictionarySize, 0 when the package has no dictionary
+//   76   uint32 reserved, 0
+//   80   uint32 trackCount, when headerSize is 96, 0 or 1 when the package has one track
+//   84   uint32 reserved, 0
+//   88   uint64 trackTableOffset
+//
+// The dictionary is shared by the frames of the package codec, for example a zstd dictionary trained
+// on the frames of the sequence.
+//
+// A package with several tracks holds the sequence in several resolutions, like the mip levels of a
+// texture. Every track has a frame index of its own, the header describes track 0. At trackTableOffset
+// follows an entry per track, largest first:
+//
+//   uint32 textureWidth, uint32 textureHeight, uint64 indexOffset
+//
+// The tracks share the frame count, texture format, codec, alignment and dictionary of the header.
+//
+// At indexOffset follows an entry of indexEntrySize bytes per frame, the entries of this version are
+// the 24 or 32 bytes of TexturePackageFrame:
+//
+//   uint64 offset, uint32 size, uint32 decodedSize, uint16 codec, uint16 flags, uint32 reference,
+//   uint16 trimX, uint16 trimY, uint16 trimWidth, uint16 trimHeight, when indexEntrySize is 32
+//
+// A trimmed frame holds only the blocks of its trim rectangle, in 4x4 blocks of the texture, row by
+// row. The blocks outside of it are transparent.
+//
+// A package with TexturePackageFlag_IndexAtEnd is written in one pass, for example to a pipe: the indexes
+// of all tracks follow the frame data, track by track, the last one ends with the file. The index offsets
+// in the header and the track table are ~0, readers find the indexes from the size of the file, and
+// readers without the flag reject the package.
+//
+// Readers ignore bytes past the fields they know, in the header and in the index entries.
+//
+// The payload of a striped frame is split into stripes, row bands of 4x4 blocks that are compressed
+// one by one with the codec of the frame, so that they can be decoded in parallel. The payload starts
+// with the stripe index:
+//
+//   uint32 stripeCount, then per stripe uint32 size and uint32 decodedSize
+//
+// The stripes follow in order, each decodes to the bytes of the texture after the previous one.
+
+// Codec ids, the first three are the compressionAlgorithm values of version 1. The decoders of the
+// ids are found in the CodecRegistry.
+enum TexturePackageCodec {
+    TexturePackageCodec_None = 0,
+    TexturePackageCodec_LZ4 = 1,
+    TexturePackageCodec_ZLIB = 2,
+    // a raw LZ4 block, the index records its decoded size
+    TexturePackageCodec_LZ4Block = 3,
+    // a zstd frame, optionally compressed with the dictionary of the package
+    TexturePackageCodec_ZSTD = 4
+};
+
+enum TexturePackageFlag {
+    // the frame indexes are at the end of the package
+    TexturePackageFlag_IndexAtEnd = 0x1
+};
+
+enum TexturePackageFrameFlag {
+    // the frame decodes on its own
+    TexturePackageFrameFlag_Key = 0x1,
+    // the frame is coded against its reference frame
+    TexturePackageFrameFlag_Delta = 0x2,
+    // the frame has no payload of its own, it shows its reference frame again
+    TexturePackageFrameFlag_Duplicate = 0x4,
+    // the payload is split into stripes, see TexturePackage::parseStripes
+    TexturePackageFrameFlag_Striped = 0x8,
+    // the ETC2 RGBA8 blocks decode as an alpha plane and a color plane, per stripe when striped,
+    // see etc2planes.h
+    TexturePackageFrameFlag_Planar = 0x10,
+    // the payload decodes to the blocks of the trim rectangle only, see TexturePackageFrame
+    TexturePackageFrameFlag_Trimmed = 0x20
+};
+
+struct TexturePackageFrame {
+    uint64_t offset;
+    uint32_t size;
+    // size of the decoded frame, 0 when the package does not record it
+    uint32_t decodedSize;
+    uint16_t codec;
+    uint16_t flags;
+    // frame index a delta or duplicate frame refers to, the frame itself otherwise
+    uint32_t reference;
+    // trim rectangle in 4x4 blocks, the whole texture unless the frame is trimmed
+    uint16_t trimX;
+    uint16_t trimY;
+    uint16_t trimWidth;
+    uint16_t trimHeight;
+};
+
+struct TexturePackageTrack {
+    uint32_t textureWidth;
+    uint32_t textureHeight;
+    uint64_t indexOffset;
+};
+
+struct TexturePackageStripe {
+    // position of the stripe in the frame payload
+    uint32_t offset;
+    uint32_t size;
+    // position of the decoded stripe in the texture
+    uint32_t decodedOffset;
+    uint32_t decodedSize;
+};
+
+// Parses the header and frame index of a texture package of either version. The caller reads the
+// bytes, so the same code serves mapped packages, packages read with file reads and the tools.
+class TexturePackage
+{
+public:
+
+    // bytes at the start of a package that cover the header of every version
+    static const size_t HeaderReadSize = 96;
+
+    TexturePackage();
+
+    // parse the header, data holds the first min(HeaderReadSize, fileSize) bytes of the package, a fileSize of
+    // SIZE_MAX stands for an unknown size and rejects packages with TexturePackageFlag_IndexAtEnd
+    int parseHeader(const void* data, size_t size, uint64_t fileSize);
+    // position of the frame index in the package, valid after parseHeader
+    uint64_t getIndexOffset() const;
+    size_t getIndexSize() const;
+    // parse the frame index, data holds getIndexSize() bytes read from getIndexOffset()
+    int parseIndex(const void* data);
+
+    // position of the track table in the package, the size is 0 for packages with one track
+    uint64_t getTrackTableOffset() const;
+    size_t getTrackTableSize() const;
+    // parse the track table, data holds getTrackTableSize() bytes read from getTrackTableOffset()
+    int parseTracks(const void* data);
+    // number of resolution tracks, 1 until the track table is parsed
+    uint32_t getTrackCount() const;
+    const TexturePackageTrack& getTrack(uint32_t track) const;
+    // make the texture size and frame index those of a track, parse the index of the track after this
+    int selectTrack(uint32_t track);
+
+    uint32_t getVersion() const;
+    uint32_t getTextureNumber() const;
+    uint32_t getTextureWidth() const;
+    uint32_t getTextureHeight() const;
+    uint32_t getTextureFormat() const;
+    uint32_t getCodec() const;
+    uint32_t getAlignment() const;
+    uint64_t getDataOffset() const;
+    // position and size of the dictionary, the size is 0 when there is none
+    uint64_t getDictionaryOffset() const;
+    size_t getDictionarySize() const;
+
+    // parse the stripe index of a striped frame payload, the stripes must decode to decodedSize bytes
+    static int parseStripes(const void* payload, size_t size, size_t decodedSize,
+                            std::vector<TexturePackageStripe>& stripes_o);
+
+    // duplicate frames carry the payload position and codec of the frame they repeat
+    const TexturePackageFrame& getFrame(uint32_t index) const;
+    const std::vector<TexturePackageFrame>& getFrames() const;
+
+private:
+
+    uint32_t m_version;
+    uint32_t m_textureNumber;
+    uint32_t m_textureWidth;
+    uint32_t m_textureHeight;
+    uint32_t m_textureFormat;
+    uint32_t m_codec;
+    uint32_t m_alignment;
+    uint32_t m_flags;
+    uint64_t m_indexOffset;
+    uint64_t m_dataOffset;
+    uint64_t m_dictionaryOffset;
+    size_t m_dictionarySize;
+    uint32_t m_trackCount;
+    uint64_t m_trackTableOffset;
+    std::vector<TexturePackageTrack> m_tracks;
+    uint64_t m_fileSize;
+    size_t m_indexEntrySize;
+    std::vector<TexturePackageFrame> m_frames;
+};
+
+#endif // PLUGIN_SRC_TEXTUREPACKAGE_H_
@@ -0,0 +1,49 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "textureregion.h"
+
+#include <string.h>
+
+const unsigned char ETC2RGBA8TransparentBlock[16] = { 0 };
+const unsigned char ETC2RGB8A1TransparentBlock[8] = { 0, 0, 0, 0, 0xff, 0xff, 0, 0 };
+
+namespace
+{
+    void fillBlocks(unsigned char* blocks, size_t count, const void* clearBlock, size_t blockSize)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            memcpy(blocks + i * blockSize, clearBlock, blockSize);
+        }
+    }
+}
+
+void PlaceTextureRegion(const void* region, const TextureBlockRect& rect, const TextureBlockRect& previous,
+                        const void* clearBlock, size_t blockSize, size_t textureBlockWidth, void* texture_o)
+{
+    const unsigned char* regionBlocks = static_cast<const unsigned char*>(region);
+    unsigned char* texture = static_cast<unsigned char*>(texture_o);
+    const size_t rowSize = textureBlockWidth * blockSize;
+
+    // Clear the rows of the previous rectangle, around the new rectangle where the two overlap.
+    for (uint32_t y = previous.y; y < previous.y + previous.height; ++y) {
+        unsigned char* row = texture + y * rowSize;
+        if (y < rect.y || y >= rect.y + rect.height || previous.x + previous.width <= rect.x
+            || rect.x + rect.width <= previous.x) {
+            fillBlocks(row + previous.x * blockSize, previous.width, clearBlock, blockSize);
+            continue;
+        }
+
+        if (previous.x < rect.x) {
+            fillBlocks(row + previous.x * blockSize, rect.x - previous.x, clearBlock, blockSize);
+        }
+        if (previous.x + previous.width > rect.x + rect.width) {
+            fillBlocks(row + (rect.x + rect.width) * blockSize, previous.x + previous.width - rect.x - rect.width,
+                       clearBlock, blockSize);
+        }
+    }
+
+    for (uint32_t y = 0; y < rect.height; ++y) {
+        memcpy(texture + (rect.y + y) * rowSize + rect.x * blockSize, regionBlocks + y * rect.width * blockSize,
+               rect.width * blockSize);
+    }
+}
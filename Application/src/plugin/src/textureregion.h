@@ -0,0 +1,32 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_TEXTUREREGION_H_
+#define PLUGIN_SRC_TEXTUREREGION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Trimmed frames hold the blocks of the rectangle around their visible pixels only. The decoder
+// places the rectangle into the texture and makes the blocks that the previous rectangle covered
+// transparent again, so that the work follows the visible area instead of the texture size.
+
+// A transparent ETC2 RGBA8 block: EAC alpha 0 and black color.
+extern const unsigned char ETC2RGBA8TransparentBlock[16];
+// A transparent ETC2 RGB8A1 block: differential mode without the opaque bit, every pixel index 2.
+extern const unsigned char ETC2RGB8A1TransparentBlock[8];
+
+// A rectangle of 4x4 blocks of a texture.
+struct TextureBlockRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Copy the blocks of rect, rect.width * rect.height blocks row by row in region, into the texture of
+// textureBlockWidth blocks per row, and fill the blocks of previous outside of rect with clearBlock.
+// Both rectangles lie inside the texture.
+void PlaceTextureRegion(const void* region, const TextureBlockRect& rect, const TextureBlockRect& previous,
+                        const void* clearBlock, size_t blockSize, size_t textureBlockWidth, void* texture_o);
+
+#endif // PLUGIN_SRC_TEXTUREREGION_H_
@@ -0,0 +1,202 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "transcodecache.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "texturepackage.h"
+#define XXH_STATIC_LINKING_ONLY
+#include "xxhash.h"
+
+namespace
+{
+    // Frames of the cache start on page boundaries, the same layout the packer uses for
+    // uncompressed packages.
+    const size_t CachePageSize = 4096;
+    const size_t CacheHeaderSize = 64;
+    const size_t CacheIndexEntrySize = 24;
+
+    template <typename T>
+    void writeValue(unsigned char* data, size_t offset, T value)
+    {
+        memcpy(data + offset, &value, sizeof(T));
+    }
+
+    size_t alignOffset(size_t offset)
+    {
+        return (offset + CachePageSize - 1) / CachePageSize * CachePageSize;
+    }
+
+    int seekFile(FILE* file, size_t offset)
+    {
+#if defined (_WIN32)
+        return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET);
+#else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET);
+#endif
+    }
+}
+
+TranscodeCache::TranscodeCache()
+    : m_file(nullptr)
+    , m_writtenFrameCount(0)
+    , m_dataOffset(0)
+    , m_frameStride(0)
+    , m_textureSize(0)
+{
+}
+
+TranscodeCache::~TranscodeCache()
+{
+    discard();
+}
+
+std::string TranscodeCache::getCachePath(const std::string& packagePath, const std::string& cacheDirectory,
+                                         const void* packageHeader, size_t packageHeaderSize,
+                                         const void* packageIndex, size_t packageIndexSize)
+{
+    XXH64_state_t state;
+    XXH64_reset(&state, 0);
+    XXH64_update(&state, packageHeader, packageHeaderSize);
+    XXH64_update(&state, packageIndex, packageIndexSize);
+
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(XXH64_digest(&state)));
+
+    std::string cachePath = packagePath;
+    if (!cacheDirectory.empty()) {
+        size_t separator = packagePath.find_last_of("/\\");
+        std::string fileName = (std::string::npos == separator) ? packagePath : packagePath.substr(separator + 1);
+        cachePath = cacheDirectory;
+        if ('/' != cachePath.back() && '\\' != cachePath.back()) {
+            cachePath += '/';
+        }
+        cachePath += fileName;
+    }
+
+    return cachePath + "." + hash + ".raw";
+}
+
+int TranscodeCache::create(const std::string& fileName, int32_t textureNumber, int32_t textureWidth,
+                           int32_t textureHeight, int32_t textureFormat, size_t textureSize)
+{
+    discard();
+
+    if (textureNumber <= 0 || 0 == textureSize) {
+        return EINVAL;
+    }
+
+    m_fileName = fileName;
+    m_temporaryFileName = fileName + ".part";
+    m_textureSize = textureSize;
+    m_frameStride = alignOffset(textureSize);
+    m_dataOffset = alignOffset(CacheHeaderSize + CacheIndexEntrySize * textureNumber);
+    m_writtenFrames.assign(textureNumber, false);
+    m_writtenFrameCount = 0;
+
+    if (m_textureSize > UINT32_MAX
+        || (SIZE_MAX - m_dataOffset) / m_frameStride < static_cast<size_t>(textureNumber)) {
+        return EFBIG;
+    }
+
+    m_file = fopen(m_temporaryFileName.c_str(), "wb");
+    if (nullptr == m_file) {
+        return errno;
+    }
+
+    // A version 2 package, see texturepackage.h.
+    std::vector<unsigned char> header(CacheHeaderSize + CacheIndexEntrySize * textureNumber, 0);
+    memcpy(header.data(), "SFPK", 4);
+    writeValue<uint16_t>(header.data(), 4, 2);
+    writeValue<uint16_t>(header.data(), 6, static_cast<uint16_t>(CacheHeaderSize));
+    writeValue<uint32_t>(header.data(), 8, textureNumber);
+    writeValue<uint32_t>(header.data(), 12, textureWidth);
+    writeValue<uint32_t>(header.data(), 16, textureHeight);
+    writeValue<uint32_t>(header.data(), 20, textureFormat);
+    writeValue<uint32_t>(header.data(), 24, TexturePackageCodec_None);
+    writeValue<uint32_t>(header.data(), 28, static_cast<uint32_t>(CachePageSize));
+    writeValue<uint64_t>(header.data(), 32, CacheHeaderSize);
+    writeValue<uint64_t>(header.data(), 40, m_dataOffset);
+    writeValue<uint32_t>(header.data(), 52, static_cast<uint32_t>(CacheIndexEntrySize));
+
+    for (int32_t i = 0; i < textureNumber; ++i) {
+        unsigned char* entry = header.data() + CacheHeaderSize + CacheIndexEntrySize * i;
+        writeValue<uint64_t>(entry, 0, m_dataOffset + m_frameStride * i);
+        writeValue<uint32_t>(entry, 8, static_cast<uint32_t>(m_textureSize));
+        writeValue<uint32_t>(entry, 12, static_cast<uint32_t>(m_textureSize));
+        writeValue<uint16_t>(entry, 16, TexturePackageCodec_None);
+        writeValue<uint16_t>(entry, 18, TexturePackageFrameFlag_Key);
+        writeValue<uint32_t>(entry, 20, i);
+    }
+
+    if (fwrite(header.data(), header.size(), 1, m_file) != 1) {
+        int ret = errno;
+        discard();
+        return ret;
+    }
+
+    return 0;
+}
+
+int TranscodeCache::writeFrame(int32_t index, const void* textureData)
+{
+    if (nullptr == m_file || index < 0 || static_cast<size_t>(index) >= m_writtenFrames.size()) {
+        return EINVAL;
+    }
+
+    if (m_writtenFrames[index]) {
+        return 0;
+    }
+
+    if (0 != seekFile(m_file, m_dataOffset + m_frameStride * index) ||
+        fwrite(textureData, m_textureSize, 1, m_file) != 1) {
+        return errno;
+    }
+
+    m_writtenFrames[index] = true;
+    ++m_writtenFrameCount;
+    return 0;
+}
+
+bool TranscodeCache::isOpen() const
+{
+    return nullptr != m_file;
+}
+
+bool TranscodeCache::isComplete() const
+{
+    return nullptr != m_file && m_writtenFrameCount == m_writtenFrames.size();
+}
+
+int TranscodeCache::finish()
+{
+    if (!isComplete() || m_writtenFrames.empty()) {
+        return EINVAL;
+    }
+
+    int ret = fclose(m_file);
+    m_file = nullptr;
+    if (0 != ret) {
+        remove(m_temporaryFileName.c_str());
+        return errno;
+    }
+
+    remove(m_fileName.c_str());
+    if (0 != rename(m_temporaryFileName.c_str(), m_fileName.c_str())) {
+        ret = errno;
+        remove(m_temporaryFileName.c_str());
+        return ret;
+    }
+
+    return 0;
+}
+
+void TranscodeCache::discard()
+{
+    if (nullptr != m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+        remove(m_temporaryFileName.c_str());
+    }
+}
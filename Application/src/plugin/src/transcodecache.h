@@ -0,0 +1,54 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_TRANSCODECACHE_H_
+#define PLUGIN_SRC_TRANSCODECACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+// Writes the decoded frames of a compressed texture package into an uncompressed, page aligned
+// package while it is played. Once every frame has been written the file is renamed to its final
+// name, later plays map it and upload the frames without decompressing them.
+class TranscodeCache
+{
+public:
+
+    TranscodeCache();
+    ~TranscodeCache();
+
+    // get the cache file name of a package, the name is keyed by the hash of the raw package header and index
+    static std::string getCachePath(const std::string& packagePath, const std::string& cacheDirectory,
+                                    const void* packageHeader, size_t packageHeaderSize,
+                                    const void* packageIndex, size_t packageIndexSize);
+
+    // create the temporary cache file with the header and index of the uncompressed package
+    int create(const std::string& fileName, int32_t textureNumber, int32_t textureWidth,
+               int32_t textureHeight, int32_t textureFormat, size_t textureSize);
+    // write a decoded frame, frames may come in any order and more than once
+    int writeFrame(int32_t index, const void* textureData);
+    // whether the cache file is being written
+    bool isOpen() const;
+    // whether every frame has been written
+    bool isComplete() const;
+    // close the complete cache file and give it its final name
+    int finish();
+    // close and remove an incomplete cache file
+    void discard();
+
+private:
+
+    FILE* m_file;
+    std::string m_fileName;
+    std::string m_temporaryFileName;
+    std::vector<bool> m_writtenFrames;
+    size_t m_writtenFrameCount;
+    size_t m_dataOffset;
+    size_t m_frameStride;
+    size_t m_textureSize;
+};
+
+#endif // PLUGIN_SRC_TRANSCODECACHE_H_
@@ -0,0 +1,95 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "workerpool.h"
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+    : m_task(nullptr)
+    , m_taskCount(0)
+    , m_nextTask(0)
+    , m_job(0)
+    , m_busyThreadCount(0)
+    , m_result(0)
+    , m_isDestroying(false)
+{
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        m_threads.push_back(std::thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_isDestroying = true;
+    }
+    m_workCondition.notify_all();
+
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+unsigned int WorkerPool::getThreadCount() const
+{
+    return static_cast<unsigned int>(m_threads.size()) + 1;
+}
+
+int WorkerPool::run(size_t taskCount, const Task& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_task = &task;
+        m_taskCount = taskCount;
+        m_nextTask = 0;
+        m_result = 0;
+        m_busyThreadCount = m_threads.size();
+        ++m_job;
+    }
+    m_workCondition.notify_all();
+
+    runTasks();
+
+    // The task is owned by the caller, no worker may still hold it when run returns.
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_doneCondition.wait(lock, [this]() { return 0 == m_busyThreadCount; });
+    m_task = nullptr;
+    return m_result;
+}
+
+void WorkerPool::work()
+{
+    uint64_t lastJob = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_workCondition.wait(lock, [this, lastJob]() { return m_isDestroying || m_job != lastJob; });
+            if (m_isDestroying) {
+                return;
+            }
+            lastJob = m_job;
+        }
+
+        runTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            --m_busyThreadCount;
+        }
+        m_doneCondition.notify_one();
+    }
+}
+
+void WorkerPool::runTasks()
+{
+    // Tasks are claimed one at a time, a slow task does not hold up the ones behind it.
+    for (size_t index = m_nextTask++; index < m_taskCount; index = m_nextTask++) {
+        int ret = (*m_task)(index);
+        if (0 != ret) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (0 == m_result) {
+                m_result = ret;
+            }
+        }
+    }
+}
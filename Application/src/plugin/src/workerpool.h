@@ -0,0 +1,55 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef PLUGIN_SRC_WORKERPOOL_H_
+#define PLUGIN_SRC_WORKERPOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the tasks of a job on a fixed set of threads, the thread that calls run works on the job
+// too. One job runs at a time, run returns when every task of it has finished.
+class WorkerPool
+{
+public:
+
+    // a task gets its index and returns 0, or an error that fails the job
+    typedef std::function<int(size_t)> Task;
+
+    // threadCount includes the calling thread, a pool of one thread runs the tasks in run
+    explicit WorkerPool(unsigned int threadCount);
+    ~WorkerPool();
+
+    unsigned int getThreadCount() const;
+    // run tasks 0 to taskCount - 1, returns the first error of a task or 0
+    int run(size_t taskCount, const Task& task);
+
+private:
+
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    void work();
+    void runTasks();
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_lock;
+    std::condition_variable m_workCondition;
+    std::condition_variable m_doneCondition;
+    const Task* m_task;
+    size_t m_taskCount;
+    std::atomic<size_t> m_nextTask;
+    // counts the jobs, a worker takes part in a job once
+    uint64_t m_job;
+    size_t m_busyThreadCount;
+    int m_result;
+    bool m_isDestroying;
+};
+
+#endif // PLUGIN_SRC_WORKERPOOL_H_
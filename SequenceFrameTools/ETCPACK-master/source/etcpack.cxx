@@ -49,9 +49,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h> 
+#include <ctype.h>
 #include <time.h>
 #include <sys/timeb.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 #include "image.h"
+#include "etcpack.h"
+#include "etcsimd.h"
 
 // Typedefs
 typedef unsigned char uint8;
@@ -157,12 +167,16 @@ void setupAlphaTable();
 static uint8 table59T[8] = {3,6,11,16,23,32,41,64};  // 3-bit table for the 59 bit T-mode
 static uint8 table58H[8] = {3,6,11,16,23,32,41,64};  // 3-bit table for the 58 bit H-mode
 uint8 weight[3] = {1,1,1};			// Color weight
+// Weights of the vectorized error calculations
+static const unsigned int equalWeights[3] = {1, 1, 1};
+static const unsigned int perceptualWeights1000[3] = {PERCEPTUAL_WEIGHT_R_SQUARED_TIMES1000, PERCEPTUAL_WEIGHT_G_SQUARED_TIMES1000, PERCEPTUAL_WEIGHT_B_SQUARED_TIMES1000};
+static const double perceptualWeights[3] = {PERCEPTUAL_WEIGHT_R_SQUARED, PERCEPTUAL_WEIGHT_G_SQUARED, PERCEPTUAL_WEIGHT_B_SQUARED};
 
 // Enums
-static enum{PATTERN_H = 0, 
+enum{PATTERN_H = 0, 
 			PATTERN_T = 1};
 
-static enum{MODE_ETC1, MODE_THUMB_T, MODE_THUMB_H, MODE_PLANAR};
+enum{MODE_ETC1, MODE_THUMB_T, MODE_THUMB_H, MODE_PLANAR};
 // The ETC2 package of codecs includes the following codecs:
 //
 // codec                                             enum
@@ -202,11 +216,8 @@ static enum{MODE_ETC1, MODE_THUMB_T, MODE_THUMB_H, MODE_PLANAR};
 // (GL_COMPRESSED_R11_EAC) and signed (GL_COMPRESSED_SIGNED_R11_EAC) version of 
 // the codec.
 // 
-static enum{ETC1_RGB_NO_MIPMAPS,ETC2PACKAGE_RGB_NO_MIPMAPS,ETC2PACKAGE_RGBA_NO_MIPMAPS_OLD,ETC2PACKAGE_RGBA_NO_MIPMAPS,ETC2PACKAGE_RGBA1_NO_MIPMAPS,ETC2PACKAGE_R_NO_MIPMAPS,ETC2PACKAGE_RG_NO_MIPMAPS,ETC2PACKAGE_R_SIGNED_NO_MIPMAPS,ETC2PACKAGE_RG_SIGNED_NO_MIPMAPS,ETC2PACKAGE_sRGB_NO_MIPMAPS,ETC2PACKAGE_sRGBA_NO_MIPMAPS,ETC2PACKAGE_sRGBA1_NO_MIPMAPS};
-static enum {MODE_COMPRESS, MODE_UNCOMPRESS, MODE_PSNR};
-static enum {SPEED_SLOW, SPEED_FAST, SPEED_MEDIUM};
-static enum {METRIC_PERCEPTUAL, METRIC_NONPERCEPTUAL};
-static enum {CODEC_ETC, CODEC_ETC2};
+// The identifiers, speeds, metrics and codecs are declared in etcpack.h.
+enum {MODE_COMPRESS, MODE_UNCOMPRESS, MODE_PSNR};
 
 int mode = MODE_COMPRESS;
 int speed = SPEED_FAST;
@@ -214,6 +225,7 @@ int metric = METRIC_PERCEPTUAL;
 int codec = CODEC_ETC2;
 int format = ETC2PACKAGE_RGB_NO_MIPMAPS;
 int verbose = true;
+int threads = 1;
 extern int formatSigned;
 int ktxFile=0;
 bool first_time_message = true;
@@ -244,7 +256,7 @@ KTX_header;
 #define KTX_ENDIAN_REF      (0x04030201)
 #define KTX_ENDIAN_REF_REV  (0x01020304)
 
-static enum {GL_R=0x1903,GL_RG=0x8227,GL_RGB=0x1907,GL_RGBA=0x1908};
+enum {GL_R=0x1903,GL_RG=0x8227,GL_RGB=0x1907,GL_RGBA=0x1908};
 #define GL_SRGB                                          0x8C40
 #define GL_SRGB8                                         0x8C41
 #define GL_SRGB8_ALPHA8                                  0x8C43
@@ -448,103 +460,154 @@ int find_pos_of_extension(char *src)
 		return q;
 }
 
-// Read source file. Does conversion if file format is not .ppm.
-// Will expand file to be divisible by four in the x- and y- dimension.
-// NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
-bool readSrcFile(char *filename,uint8 *&img,int &width,int &height, int &expandedwidth, int &expandedheight)
+// Reads an image file as RGBA with bitrate (8 or 16) bits per channel.
+// PNG and TGA files are decoded in memory and .ppm files get opaque alpha. Other formats
+// are converted to a .png file of this process first, so that several etcpack processes
+// can compress in the same directory.
+bool readImageFile(char *filename,uint8 *&pixels,int &width,int &height,int bitrate)
 {
-	int w1,h1;
-	int wdiv4, hdiv4;
-	char str[255];
-
-
-	// Delete temp file if it exists.
-	if(fileExist("tmp.ppm"))
+	char extension[8] = "";
+	int q = find_pos_of_extension(filename);
+	if(q>=0 && strlen(&filename[q])<sizeof(extension))
 	{
-		sprintf(str, "del tmp.ppm\n");
-		system(str);
+		for(int i=0; filename[q+i]; i++)
+			extension[i] = tolower(filename[q+i]);
+		extension[strlen(&filename[q])] = 0;
 	}
 
-	int q = find_pos_of_extension(filename);
-	if(!strcmp(&filename[q],".ppm")) 
+	if(!strcmp(extension,".png")) 
+		return fReadPNG(filename,width,height,pixels,bitrate);
+	if(!strcmp(extension,".tga")) 
+		return fReadTGA(filename,width,height,pixels,bitrate);
+	if(!strcmp(extension,".ppm")) 
 	{
-		// Already a .ppm file. Just copy. 
-		sprintf(str,"copy %s tmp.ppm \n", filename);
-		printf("Copying source file to tmp.ppm\n", filename);
+		uint8 *rgb;
+		if(!fReadPPM(filename,width,height,rgb,bitrate))
+			return false;
+		int bytes = bitrate/8;
+		pixels = (uint8*) malloc(width*height*4*bytes);
+		for(int i=0; i<width*height; i++)
+		{
+			memcpy(&pixels[i*4*bytes],&rgb[i*3*bytes],3*bytes);
+			memset(&pixels[(i*4+3)*bytes],255,bytes);
+		}
+		free(rgb);
+		return true;
 	}
-	else
+
+	// Converting from other format to .png 
+	// 
+	// Use your favorite command line image converter program,
+	// for instance Image Magick. Just make sure the syntax can
+	// be written as below:
+	// 
+	// C:\magick convert source.jpg dest.png
+	//
+	char tmpfile[64];
+	char str[300];
+#ifdef _WIN32
+	sprintf(tmpfile,"etcpack%u.png",(unsigned int)GetCurrentProcessId());
+#else
+	sprintf(tmpfile,"etcpack%u.png",(unsigned int)getpid());
+#endif
+	sprintf(str,"magick convert %s %s\n", filename, tmpfile);
+	printf("Converting source file from %s to .png\n", filename);
+	system(str);
+	bool ok = fReadPNG(tmpfile,width,height,pixels,bitrate);
+	remove(tmpfile);
+	return ok;
+}
+
+// Copies count channels, starting at channel first, out of RGBA pixels into a new image.
+uint8 *extractChannels(uint8 *pixels,int width,int height,int bitrate,int first,int count)
+{
+	int bytes = bitrate/8;
+	uint8 *img = (uint8*) malloc(width*height*count*bytes);
+	if(!img)
 	{
-		// Converting from other format to .ppm 
-		// 
-		// Use your favorite command line image converter program,
-		// for instance Image Magick. Just make sure the syntax can
-		// be written as below:
-		// 
-		// C:\magick convert source.jpg dest.ppm
-		//
-		sprintf(str,"magick convert %s tmp.ppm\n", filename);
-		printf("Converting source file from %s to .ppm\n", filename);
+		printf("Error: could not allocate memory for the image\n");
+		exit(1);
 	}
-	// Execute system call
-	system(str);
+	for(int i=0; i<width*height; i++)
+		memcpy(&img[i*count*bytes],&pixels[(i*4+first)*bytes],count*bytes);
+	return img;
+}
+
+// Read source file into the RGB image to compress and the plane readAlpha compresses:
+// the alpha channel for the RGBA formats, the red channel for the R format, otherwise NULL.
+// The R format does not compress the RGB image and gets NULL for it.
+// Will expand the RGB image to be divisible by four in the x- and y- dimension.
+// NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
+bool readSrcFile(char *filename,uint8 *&img,uint8 *&alphasrc,int &width,int &height, int &expandedwidth, int &expandedheight)
+{
+	int wdiv4, hdiv4;
+	uint8 *pixels;
 
 	int bitrate=8;
-	if(format==ETC2PACKAGE_RG_NO_MIPMAPS)
+	if(format==ETC2PACKAGE_RG_NO_MIPMAPS||format==ETC2PACKAGE_R_NO_MIPMAPS)
 		bitrate=16;
-	if(fReadPPM("tmp.ppm",w1,h1,img,bitrate))
+	if(!readImageFile(filename,pixels,width,height,bitrate))
+	{
+		printf("Could not read %s\n", filename);
+		exit(1);	
+	}
+
+	img=NULL;
+	alphasrc=NULL;
+	if(format==ETC2PACKAGE_RGBA_NO_MIPMAPS||format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS) 
+		alphasrc=extractChannels(pixels,width,height,bitrate,3,1);
+	else if(format==ETC2PACKAGE_R_NO_MIPMAPS) 
+		alphasrc=extractChannels(pixels,width,height,bitrate,0,1);
+	expandedwidth = 4*((width+3)/4);
+	expandedheight = 4*((height+3)/4);
+	if(format==ETC2PACKAGE_R_NO_MIPMAPS)
 	{
-		width=w1;
-		height=h1;
-		system("del tmp.ppm");
+		free(pixels);
+		return true;
+	}
+	img=extractChannels(pixels,width,height,bitrate,0,3);
+	free(pixels);
 
-		// Width must be divisible by 4 and height must be
-		// divisible by 4. Otherwise, we will expand the image
+	// Width must be divisible by 4 and height must be
+	// divisible by 4. Otherwise, we will expand the image
 
-		wdiv4 = width / 4;
-		hdiv4 = height / 4;
+	wdiv4 = width / 4;
+	hdiv4 = height / 4;
 
-		expandedwidth = width;
-		expandedheight = height;
+	expandedwidth = width;
+	expandedheight = height;
 
-		if( !(wdiv4 * 4 == width) )
+	if( !(wdiv4 * 4 == width) )
+	{
+		printf(" Width = %d is not divisible by four... ", width);
+		printf(" expanding image in x-dir... ");
+		if(expandToWidthDivByFour(img, width, height, expandedwidth, expandedheight,bitrate))
 		{
-			printf(" Width = %d is not divisible by four... ", width);
-			printf(" expanding image in x-dir... ");
-			if(expandToWidthDivByFour(img, width, height, expandedwidth, expandedheight,bitrate))
-			{
-				printf("OK.\n");
-			}
-			else
-			{
-				printf("\n Error: could not expand image\n");
-				return false;
-			}
+			printf("OK.\n");
 		}
-		if( !(hdiv4 * 4 == height))
+		else
 		{
-			printf(" Height = %d is not divisible by four... ", height);
-			printf(" expanding image in y-dir...");
-			if(expandToHeightDivByFour(img, expandedwidth, height, expandedwidth, expandedheight,bitrate))
-			{
-				printf("OK.\n");
-			}
-			else
-			{
-				printf("\n Error: could not expand image\n");
-				return false;
-			}
+			printf("\n Error: could not expand image\n");
+			return false;
 		}
-		if(!(expandedwidth == width && expandedheight == height))
-		   printf("Active pixels: %dx%d. Expanded image: %dx%d\n",width,height,expandedwidth,expandedheight);
-		return true;
 	}
-	else
+	if( !(hdiv4 * 4 == height))
 	{
-		printf("Could not read tmp.ppm file\n");
-		exit(1);	
+		printf(" Height = %d is not divisible by four... ", height);
+		printf(" expanding image in y-dir...");
+		if(expandToHeightDivByFour(img, expandedwidth, height, expandedwidth, expandedheight,bitrate))
+		{
+			printf("OK.\n");
+		}
+		else
+		{
+			printf("\n Error: could not expand image\n");
+			return false;
+		}
 	}
-	return false;
-
+	if(!(expandedwidth == width && expandedheight == height))
+	   printf("Active pixels: %dx%d. Expanded image: %dx%d\n",width,height,expandedwidth,expandedheight);
+	return true;
 }
 
 // Reads a file without expanding it to be divisible by 4.
@@ -552,47 +615,12 @@ bool readSrcFile(char *filename,uint8 *&img,int &width,int &height, int &expande
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 bool readSrcFileNoExpand(char *filename,uint8 *&img,int &width,int &height)
 {
-	int w1,h1;
-	char str[255];
+	uint8 *pixels;
 
-
-	// Delete temp file if it exists.
-	if(fileExist("tmp.ppm"))
-	{
-		sprintf(str, "del tmp.ppm\n");
-		system(str);
-	}
-
-
-	int q = find_pos_of_extension(filename);
-	if(!strcmp(&filename[q],".ppm")) 
+	if(readImageFile(filename,pixels,width,height,8))
 	{
-		// Already a .ppm file. Just copy. 
-		sprintf(str,"copy %s tmp.ppm \n", filename);
-		printf("Copying source file to tmp.ppm\n", filename);
-	}
-	else
-	{
-		// Converting from other format to .ppm 
-		// 
-		// Use your favorite command line image converter program,
-		// for instance Image Magick. Just make sure the syntax can
-		// be written as below:
-		// 
-		// C:\magick convert source.jpg dest.ppm
-		//
-		sprintf(str,"magick convert %s tmp.ppm\n", filename);
-//		printf("Converting source file from %s to .ppm\n", filename);
-	}
-	// Execute system call
-	system(str);
-
-	if(fReadPPM("tmp.ppm",w1,h1,img,8))
-	{
-		width=w1;
-		height=h1;
-		system("del tmp.ppm");
-
+		img=extractChannels(pixels,width,height,8,0,3);
+		free(pixels);
 		return true;
 	}
 	return false;
@@ -710,6 +738,18 @@ void readArguments(int argc,char *argv[],char* src,char *dst)
 					exit(1);
 				}
 			}
+			//thread flag
+			else if(!strcmp(argv[i],"-t")) 
+			{
+				// We have argument -t. Now check for the number of threads, 0 for one per processor.
+				char *end;
+				threads = (int) strtol(argv[i+1], &end, 10);
+				if(end==argv[i+1]||*end!='\0'||threads<0) 
+				{
+					printf("Error: %s not part of flag %s\n",argv[i+1], argv[i]);
+					exit(1);
+				}
+			}
 			else if(!strcmp(argv[i],"-p")) 
 			{
 				mode=MODE_PSNR;
@@ -1404,6 +1444,82 @@ const unsigned int square_table_percep_blue[511] = {
 						 50176*KB, 50625*KB, 51076*KB, 51529*KB, 51984*KB, 52441*KB, 52900*KB, 53361*KB, 53824*KB, 54289*KB, 54756*KB, 55225*KB, 55696*KB, 56169*KB, 56644*KB, 57121*KB, 
 						 57600*KB, 58081*KB, 58564*KB, 59049*KB, 59536*KB, 60025*KB, 60516*KB, 61009*KB, 61504*KB, 62001*KB, 62500*KB, 63001*KB, 63504*KB, 64009*KB, 64516*KB, 65025*KB}; 
 
+// Copies the pixels of a 2x4 or 4x2 area column by column, as the loops of compressBlockWithTable2x4
+// and compressBlockWithTable4x2 visit them, into the red, green and blue planes of the vectorized
+// error calculations.
+void gatherArea(uint8 *img,int width,int startx,int starty,int areawidth,int areaheight,uint8 *pixels)
+{
+	int i = 0;
+	for(int x=startx; x<startx+areawidth; x++)
+	{
+		for(int y=starty; y<starty+areaheight; y++)
+		{
+			pixels[i]=RED(img,width,x,y);
+			pixels[8+i]=GREEN(img,width,x,y);
+			pixels[16+i]=BLUE(img,width,x,y);
+			i++;
+		}
+	}
+}
+
+// Stores the best color of each pixel of a 2x4 or 4x2 area as its pixel index.
+void putAreaIndices(uint8 *best,int areaheight,unsigned int *pixel_indices_MSBp, unsigned int *pixel_indices_LSBp)
+{
+	unsigned int pixel_indices_MSB=0, pixel_indices_LSB=0, pixel_indices;
+	for(int i=0; i<8; i++)
+	{
+		// the bits of a column of the block are next to each other
+		int bit = (i/areaheight)*4 + i%areaheight;
+		pixel_indices = scramble[best[i]];
+		PUTBITS( pixel_indices_MSB, (pixel_indices >> 1), 1, bit);
+		PUTBITS( pixel_indices_LSB, (pixel_indices & 1) , 1, bit);
+	}
+	*pixel_indices_MSBp = pixel_indices_MSB;
+	*pixel_indices_LSBp = pixel_indices_LSB;
+}
+
+// The colors of a table compressBlockWithTable2x4 and compressBlockWithTable4x2 try.
+void tableColors(uint8 *avg_color,int table,int (*colors)[3])
+{
+	for(int q=0;q<4;q++)
+	{
+		colors[q][0]=CLAMP(0, avg_color[0]+compressParams[table][q],255);
+		colors[q][1]=CLAMP(0, avg_color[1]+compressParams[table][q],255);
+		colors[q][2]=CLAMP(0, avg_color[2]+compressParams[table][q],255);
+	}
+}
+
+// Finds all pixel indices of a gathered 2x4 or 4x2 area with the vectorized error calculation.
+// Gives the same indices and error as compressBlockWithTable2x4 and compressBlockWithTable4x2
+// with equal weights, and as their percep1000 versions with perceptual weights.
+unsigned int compressAreaWithTable(uint8 *pixels,int areaheight,uint8 *avg_color,int table,const unsigned int *weights,unsigned int *pixel_indices_MSBp, unsigned int *pixel_indices_LSBp)
+{
+	int colors[4][3];
+	uint8 best[8];
+	tableColors(avg_color,table,colors);
+	unsigned int sum_error = simdBestColors(pixels,8,colors,4,weights,best,NULL);
+	putAreaIndices(best,areaheight,pixel_indices_MSBp,pixel_indices_LSBp);
+	return sum_error;
+}
+
+// The same for the floating point perceptual error of compressBlockWithTable2x4percep and
+// compressBlockWithTable4x2percep. Returns false when the processor cannot calculate it.
+bool compressAreaWithTablePercep(uint8 *pixels,int areaheight,uint8 *avg_color,int table,float &sum_error,unsigned int *pixel_indices_MSBp, unsigned int *pixel_indices_LSBp)
+{
+	int colors[4][3];
+	uint8 best[8];
+	float errors[8];
+	tableColors(avg_color,table,colors);
+	if(!simdBestColorsPerceptual(pixels,8,colors,4,perceptualWeights,best,errors))
+		return false;
+	// added up in the order of the scalar loop
+	sum_error=0;
+	for(int i=0; i<8; i++)
+		sum_error+=errors[i];
+	putAreaIndices(best,areaheight,pixel_indices_MSBp,pixel_indices_LSBp);
+	return true;
+}
+
 // Find the best table to use for a 2x4 area by testing all.
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 int tryalltables_3bittable2x4(uint8 *img,int width,int height,int startx,int starty,uint8 *avg_color, unsigned int &best_table,unsigned int &best_pixel_indices_MSB, unsigned int &best_pixel_indices_LSB)
@@ -1412,10 +1528,17 @@ int tryalltables_3bittable2x4(uint8 *img,int width,int height,int startx,int sta
 	int q;
 	int err;
 	unsigned int pixel_indices_MSB, pixel_indices_LSB;
+	uint8 pixels[3*8];
+
+	if(simdLevel!=SIMD_NONE)
+		gatherArea(img,width,startx,starty,2,4,pixels);
 
 	for(q=0;q<16;q+=2)		// try all the 8 tables. 
 	{
-		err=compressBlockWithTable2x4(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
+		if(simdLevel!=SIMD_NONE)
+			err=(int) compressAreaWithTable(pixels,4,avg_color,q,equalWeights,&pixel_indices_MSB, &pixel_indices_LSB);
+		else
+			err=compressBlockWithTable2x4(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
 
 		if(err<min_error)
 		{
@@ -1438,11 +1561,18 @@ unsigned int tryalltables_3bittable2x4percep1000(uint8 *img,int width,int height
 	int q;
 	unsigned int err;
 	unsigned int pixel_indices_MSB, pixel_indices_LSB;
+	uint8 pixels[3*8];
+
+	if(simdLevel!=SIMD_NONE)
+		gatherArea(img,width,startx,starty,2,4,pixels);
 
 	for(q=0;q<16;q+=2)		// try all the 8 tables. 
 	{
 
-		err=compressBlockWithTable2x4percep1000(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
+		if(simdLevel!=SIMD_NONE)
+			err=compressAreaWithTable(pixels,4,avg_color,q,perceptualWeights1000,&pixel_indices_MSB, &pixel_indices_LSB);
+		else
+			err=compressBlockWithTable2x4percep1000(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
 
 		if(err<min_error)
 		{
@@ -1466,10 +1596,15 @@ int tryalltables_3bittable2x4percep(uint8 *img,int width,int height,int startx,i
 	int q;
 	float err;
 	unsigned int pixel_indices_MSB, pixel_indices_LSB;
+	uint8 pixels[3*8];
+
+	if(simdLevel!=SIMD_NONE)
+		gatherArea(img,width,startx,starty,2,4,pixels);
 
 	for(q=0;q<16;q+=2)		// try all the 8 tables. 
 	{
-		err=compressBlockWithTable2x4percep(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
+		if(simdLevel==SIMD_NONE||!compressAreaWithTablePercep(pixels,4,avg_color,q,err,&pixel_indices_MSB, &pixel_indices_LSB))
+			err=compressBlockWithTable2x4percep(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
 
 		if(err<min_error)
 		{
@@ -1491,10 +1626,17 @@ int tryalltables_3bittable4x2(uint8 *img,int width,int height,int startx,int sta
 	int q;
 	int err;
 	unsigned int pixel_indices_MSB, pixel_indices_LSB;
+	uint8 pixels[3*8];
+
+	if(simdLevel!=SIMD_NONE)
+		gatherArea(img,width,startx,starty,4,2,pixels);
 
 	for(q=0;q<16;q+=2)		// try all the 8 tables. 
 	{
-		err=compressBlockWithTable4x2(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
+		if(simdLevel!=SIMD_NONE)
+			err=(int) compressAreaWithTable(pixels,2,avg_color,q,equalWeights,&pixel_indices_MSB, &pixel_indices_LSB);
+		else
+			err=compressBlockWithTable4x2(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
 
 		if(err<min_error)
 		{
@@ -1518,10 +1660,17 @@ unsigned int tryalltables_3bittable4x2percep1000(uint8 *img,int width,int height
 	int q;
 	unsigned int err;
 	unsigned int pixel_indices_MSB, pixel_indices_LSB;
+	uint8 pixels[3*8];
+
+	if(simdLevel!=SIMD_NONE)
+		gatherArea(img,width,startx,starty,4,2,pixels);
 
 	for(q=0;q<16;q+=2)		// try all the 8 tables. 
 	{
-		err=compressBlockWithTable4x2percep1000(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
+		if(simdLevel!=SIMD_NONE)
+			err=compressAreaWithTable(pixels,2,avg_color,q,perceptualWeights1000,&pixel_indices_MSB, &pixel_indices_LSB);
+		else
+			err=compressBlockWithTable4x2percep1000(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
 
 		if(err<min_error)
 		{
@@ -1543,10 +1692,15 @@ int tryalltables_3bittable4x2percep(uint8 *img,int width,int height,int startx,i
 	int q;
 	float err;
 	unsigned int pixel_indices_MSB, pixel_indices_LSB;
+	uint8 pixels[3*8];
+
+	if(simdLevel!=SIMD_NONE)
+		gatherArea(img,width,startx,starty,4,2,pixels);
 
 	for(q=0;q<16;q+=2)		// try all the 8 tables. 
 	{
-		err=compressBlockWithTable4x2percep(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
+		if(simdLevel==SIMD_NONE||!compressAreaWithTablePercep(pixels,2,avg_color,q,err,&pixel_indices_MSB, &pixel_indices_LSB))
+			err=compressBlockWithTable4x2percep(img,width,height,startx,starty,avg_color,q,&pixel_indices_MSB, &pixel_indices_LSB);
 
 		if(err<min_error)
 		{
@@ -5068,6 +5222,18 @@ void compressBlockDiffFlipCombined(uint8 *img,int width,int height,int startx,in
 	}
 }
 
+#define LBG_RAND_MAX 0x7fff
+
+// Random numbers for the seeds of the LBG-algorithm. Each block keeps its own state instead of
+// resetting the one of rand(), which is shared by all threads compressing blocks at the same time.
+// The generator is the one of the Visual C++ runtime, so the output of the Windows builds is unchanged
+// and the other platforms now give the same output.
+int randLBG(unsigned int *state)
+{
+	*state = *state * 214013 + 2531011;
+	return (int) ((*state >> 16) & LBG_RAND_MAX);
+}
+
 // Calculation of the two block colors using the LBG-algorithm
 // The following method scales down the intensity, since this can be compensated for anyway by both the H and T mode.
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
@@ -5075,8 +5241,8 @@ void computeColorLBGHalfIntensityFast(uint8 *img,int width,int startx,int starty
 {
 	uint8 block_mask[4][4];
 
-	// reset rand so that we get predictable output per block
-	srand(10000);
+	// start every block from the same seed so that we get predictable output per block
+	unsigned int rand_state = 10000;
 	//LBG-algorithm
 	double D = 0, oldD, bestD = MAXIMUM_ERROR, eps = 0.0000000001;
 	double error_a, error_b;
@@ -5145,7 +5311,7 @@ void computeColorLBGHalfIntensityFast(uint8 *img,int width,int startx,int starty
 		{
 			for (uint8 c = 0; c < 3; ++c) 
 			{ 
-				current_colors[s][c] = double((double(rand())/RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
+				current_colors[s][c] = double((double(randLBG(&rand_state))/LBG_RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
 			}
 		}
 		
@@ -5269,8 +5435,8 @@ void computeColorLBGNotIntensityFast(uint8 *img,int width,int startx,int starty,
 {
 	uint8 block_mask[4][4];
 
-	// reset rand so that we get predictable output per block
-	srand(10000);
+	// start every block from the same seed so that we get predictable output per block
+	unsigned int rand_state = 10000;
 	//LBG-algorithm
 	double D = 0, oldD, bestD = MAXIMUM_ERROR, eps = 0.0000000001;
 	double error_a, error_b;
@@ -5339,7 +5505,7 @@ void computeColorLBGNotIntensityFast(uint8 *img,int width,int startx,int starty,
 		{
 			for (uint8 c = 0; c < 3; ++c) 
 			{ 
-				current_colors[s][c] = double((double(rand())/RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
+				current_colors[s][c] = double((double(randLBG(&rand_state))/LBG_RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
 			}
 		}
 		// divide into two quantization sets and calculate distortion
@@ -5461,8 +5627,8 @@ void computeColorLBGNotIntensity(uint8 *img,int width,int startx,int starty, uin
 {
 	uint8 block_mask[4][4];
 
-	// reset rand so that we get predictable output per block
-	srand(10000);
+	// start every block from the same seed so that we get predictable output per block
+	unsigned int rand_state = 10000;
 	//LBG-algorithm
 	double D = 0, oldD, bestD = MAXIMUM_ERROR, eps = 0.0000000001;
 	double error_a, error_b;
@@ -5531,7 +5697,7 @@ void computeColorLBGNotIntensity(uint8 *img,int width,int startx,int starty, uin
 		{
 			for (uint8 c = 0; c < 3; ++c) 
 			{ 
-				current_colors[s][c] = double((double(rand())/RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
+				current_colors[s][c] = double((double(randLBG(&rand_state))/LBG_RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
 			}
 		}
 		
@@ -5653,8 +5819,8 @@ void computeColorLBG(uint8 *img,int width,int startx,int starty, uint8 (LBG_colo
 {
 	uint8 block_mask[4][4];
 
-	// reset rand so that we get predictable output per block
-	srand(10000);
+	// start every block from the same seed so that we get predictable output per block
+	unsigned int rand_state = 10000;
 	//LBG-algorithm
 	double D = 0, oldD, bestD = MAXIMUM_ERROR, eps = 0.0000000001;
 	double error_a, error_b;
@@ -5715,7 +5881,7 @@ void computeColorLBG(uint8 *img,int width,int startx,int starty, uint8 (LBG_colo
 		{
 			for (uint8 c = 0; c < 3; ++c) 
 			{ 
-				current_colors[s][c] = double((double(rand())/RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
+				current_colors[s][c] = double((double(randLBG(&rand_state))/LBG_RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
 			}
 		}
 		
@@ -5833,8 +5999,8 @@ void computeColorLBGfast(uint8 *img,int width,int startx,int starty, uint8 (LBG_
 {
 	uint8 block_mask[4][4];
 
-	// reset rand so that we get predictable output per block
-	srand(10000);
+	// start every block from the same seed so that we get predictable output per block
+	unsigned int rand_state = 10000;
 	//LBG-algorithm
 	double D = 0, oldD, bestD = MAXIMUM_ERROR, eps = 0.0000000001;
 	double error_a, error_b;
@@ -5890,7 +6056,7 @@ void computeColorLBGfast(uint8 *img,int width,int startx,int starty, uint8 (LBG_
 		{
 			for (uint8 c = 0; c < 3; ++c) 
 			{ 
-				current_colors[s][c] = double((double(rand())/RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
+				current_colors[s][c] = double((double(randLBG(&rand_state))/LBG_RAND_MAX)*(max_v[c]-min_v[c])) + min_v[c];
 			}
 		}
 		
@@ -6046,6 +6212,74 @@ void swapColors(uint8 (colors)[2][3])
 // using a distance d and one of the H- or T-patterns.
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 
+// Calculate the error for the block at position (startx,starty) the way calculateError59T does,
+// with the vectorized error calculation and the given weights of the color channels.
+// The parameters needed for reconstruction is calculated as well
+unsigned int calculateError59Tsimd(uint8* srcimg, int width, int startx, int starty, uint8 (colorsRGB444)[2][3], uint8 &distance, unsigned int &pixel_indices, const unsigned int *weights, unsigned int max_error) 
+{
+	unsigned int block_error = 0, 
+		   best_block_error = max_error;
+	uint8 best_sw;
+	unsigned int pixel_colors;
+	uint8 colors[2][3];
+	uint8 possible_colors[4][3];
+	int candidate_colors[4][3];
+	uint8 pixels[3*16];
+	uint8 best[16];
+
+	// The pixels row by row, in the order of the pixel indices
+	for (int y = 0; y < BLOCKHEIGHT; ++y) 
+	{
+		for (int x = 0; x < BLOCKWIDTH; ++x) 
+		{
+			pixels[y*4+x] = srcimg[3*((starty+y)*width+startx+x)+R];
+			pixels[16+y*4+x] = srcimg[3*((starty+y)*width+startx+x)+G];
+			pixels[32+y*4+x] = srcimg[3*((starty+y)*width+startx+x)+B];
+		}
+	}
+
+	// First use the colors as they are, then swap them
+	for (uint8 sw = 0; sw <2; ++sw) 
+	{ 
+		if (sw == 1) 
+		{
+			swapColors(colorsRGB444);
+		}
+		decompressColor(R_BITS59T, G_BITS59T, B_BITS59T, colorsRGB444, colors);
+
+		// Test all distances
+		for (uint8 d = 0; d < BINPOW(TABLE_BITS_59T); ++d) 
+		{
+			calculatePaintColors59T(d,PATTERN_T, colors, possible_colors);
+			for (int c = 0; c < 4; ++c) 
+			{
+				candidate_colors[c][R] = CLAMP(0,possible_colors[c][R],255);
+				candidate_colors[c][G] = CLAMP(0,possible_colors[c][G],255);
+				candidate_colors[c][B] = CLAMP(0,possible_colors[c][B],255);
+			}
+			block_error = simdBestColors(pixels, 16, candidate_colors, 4, weights, best, NULL);
+			pixel_colors = 0;
+			for (int q = 0; q < 16; ++q) 
+				pixel_colors = (pixel_colors << 2) | best[q];
+
+			if (block_error < best_block_error) 
+			{
+				best_block_error = block_error;
+				distance = d;
+				pixel_indices = pixel_colors;
+				best_sw = sw;
+			}
+		}
+		
+		if (sw == 1 && best_sw == 0) 
+		{
+			swapColors(colorsRGB444);
+		}
+		decompressColor(R_BITS59T, G_BITS59T, B_BITS59T, colorsRGB444, colors);
+	}
+	return best_block_error;
+}
+
 // Calculate the error for the block at position (startx,starty)
 // The parameters needed for reconstruction are calculated as well
 // 
@@ -6056,6 +6290,8 @@ void swapColors(uint8 (colors)[2][3])
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 unsigned int calculateError59Tperceptual1000(uint8* srcimg, int width, int startx, int starty, uint8 (colorsRGB444)[2][3], uint8 &distance, unsigned int &pixel_indices) 
 {
+	if (simdLevel != SIMD_NONE)
+		return calculateError59Tsimd(srcimg, width, startx, starty, colorsRGB444, distance, pixel_indices, perceptualWeights1000, MAXERR1000);
 
 	unsigned int block_error = 0, 
 		   best_block_error = MAXERR1000,
@@ -6143,6 +6379,12 @@ unsigned int calculateError59Tperceptual1000(uint8* srcimg, int width, int start
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 double calculateError59T(uint8* srcimg, int width, int startx, int starty, uint8 (colorsRGB444)[2][3], uint8 &distance, unsigned int &pixel_indices) 
 {
+	if (simdLevel != SIMD_NONE)
+	{
+		// the errors are whole numbers, the sums are the same as of the doubles
+		unsigned int weights[3] = {weight[R], weight[G], weight[B]};
+		return calculateError59Tsimd(srcimg, width, startx, starty, colorsRGB444, distance, pixel_indices, weights, MAXIMUM_ERROR);
+	}
 	double block_error = 0, 
 		     best_block_error = MAXIMUM_ERROR, 
 				 pixel_error, 
@@ -8121,9 +8363,9 @@ bool hasAlpha(uint8* alphaimg, int ix, int iy, int width)
 	return false;
 }
 
-// Compress a block with ETC2 RGB
+// Compress a block with ETC2 RGB, or with punch-through alpha if imageformat is RGBA1
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
-void compressBlockETC2Fast(uint8 *img, uint8* alphaimg, uint8 *imgdec,int width,int height,int startx,int starty, unsigned int &compressed1, unsigned int &compressed2)
+void compressBlockETC2Fast(uint8 *img, uint8* alphaimg, uint8 *imgdec,int width,int height,int startx,int starty, unsigned int &compressed1, unsigned int &compressed2, int imageformat)
 {
 	unsigned int etc1_word1;
 	unsigned int etc1_word2;
@@ -8151,7 +8393,7 @@ void compressBlockETC2Fast(uint8 *img, uint8* alphaimg, uint8 *imgdec,int width,
 	signed char best_char;
 	int best_mode;
 	
-	if(format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS)
+	if(imageformat==ETC2PACKAGE_RGBA1_NO_MIPMAPS||imageformat==ETC2PACKAGE_sRGBA1_NO_MIPMAPS)
 	{
 		/*                if we have one-bit alpha, we never use the individual mode,
 		                  instead that bit flags that one of our four offsets will instead
@@ -8463,12 +8705,10 @@ extern int alphaBase[16][4];
 // Note also that it its contents will depend on the value of formatSigned.
 int *valtab;
 
-void setupAlphaTableAndValtab()
+// Creates the precalculated data for the signed or unsigned 11-bit formats, see valtab above.
+int *createValtab(int signedformat)
 {
-  setupAlphaTable();
-
-	//fix precomputation table..!
-	valtab = new int[1024*512];
+	int *table = new int[1024*512];
     int16 val16;
 	int count=0;
 	for(int base=0; base<256; base++) 
@@ -8479,25 +8719,33 @@ void setupAlphaTableAndValtab()
 			{
 				for(int index=0; index<8; index++) 
 				{
-					if(formatSigned)
+					if(signedformat)
 					{
 						val16=get16bits11signed(base,tab,mul,index);
-						valtab[count] = val16 + 256*128;
+						table[count] = val16 + 256*128;
 					}
 					else
-						valtab[count]=get16bits11bits(base,tab,mul,index);
+						table[count]=get16bits11bits(base,tab,mul,index);
 					count++;
 				}
 			}
 		}
 	}
+	return table;
 }
 
-// Reads alpha data
+void setupAlphaTableAndValtab()
+{
+  setupAlphaTable();
+
+	//fix precomputation table..!
+	valtab = createValtab(formatSigned);
+}
+
+// Reads alpha data out of the plane readSrcFile returns, width x height pixels
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
-void readAlpha(uint8* &data, int &width, int &height, int &extendedwidth, int &extendedheight) 
+void readAlpha(uint8* alphasrc, uint8* &data, int &width, int &height, int &extendedwidth, int &extendedheight) 
 {
-	//width and height are already known..?
 	uint8* tempdata;
 	int wantedBitDepth;
 	if(format==ETC2PACKAGE_RGBA_NO_MIPMAPS||format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS) 
@@ -8513,7 +8761,8 @@ void readAlpha(uint8* &data, int &width, int &height, int &extendedwidth, int &e
 		printf("invalid format for alpha reading!\n");
 		exit(1);
 	}
-	fReadPGM("alpha.pgm",width,height,tempdata,wantedBitDepth);
+	tempdata=alphasrc;
+	printf("read %d-bit alpha channel\n",wantedBitDepth);
 	extendedwidth=4*((width+3)/4);
 	extendedheight=4*((height+3)/4);
 
@@ -8746,9 +8995,9 @@ int getPremulIndex(int base, int tab, int mul, int index)
 	return (base<<11)+(tab<<7)+(mul<<3)+index;
 }
 
-// Calculates the error used in compressBlockAlpha16()
+// Calculates the error used in compressBlockAlpha16(), valtable is the valtab of the context
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
-double calcError(uint8* data, int ix, int iy, int width, int height, int base, int tab, int mul, double prevbest) 
+double calcError(const int *valtable, uint8* data, int ix, int iy, int width, int height, int base, int tab, int mul, double prevbest) 
 {
 	int offset = getPremulIndex(base,tab,mul,0);
 	double error=0;
@@ -8764,7 +9013,7 @@ double calcError(uint8* data, int ix, int iy, int width, int height, int base, i
 			for(int index=0; index<8; index++) 
 			{
 				double indexError;
-				indexError = alpha-valtab[offset+index];
+				indexError = alpha-valtable[offset+index];
 				indexError*=indexError;
 				if(indexError<besthere)
 					besthere=indexError;
@@ -8780,7 +9029,7 @@ double calcError(uint8* data, int ix, int iy, int width, int height, int base, i
 // compressBlockAlpha16
 // 
 // Compresses a block using the 11-bit EAC formats.
-// Depends on the global variable formatSigned.
+// Depends on the formatSigned of the context.
 // 
 // COMPRESSED_R11_EAC (if formatSigned = 0)
 // This is an 11-bit unsigned format. Since we do not have a good 11-bit file format, we use 16-bit pgm instead.
@@ -8799,7 +9048,7 @@ double calcError(uint8* data, int ix, int iy, int width, int height, int base, i
 // COMPRESSED_RG11_EAC is compressed by calling the function twice, dito for COMPRESSED_SIGNED_RG11_EAC.
 // 
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
-void compressBlockAlpha16(uint8* data, int ix, int iy, int width, int height, uint8* returnData) 
+void compressBlockAlpha16(const EncoderContext *context, uint8* data, int ix, int iy, int width, int height, uint8* returnData) 
 {
 	unsigned int bestbase, besttable, bestmul;
 	double besterror;
@@ -8811,7 +9060,7 @@ void compressBlockAlpha16(uint8* data, int ix, int iy, int width, int height, ui
 		{
 			for(int mul=0; mul<16; mul++) 
 			{
-				double e = calcError(data, ix, iy, width, height,base,table,mul,besterror);
+				double e = calcError(context->valtab, data, ix, iy, width, height,base,table,mul,besterror);
 				if(e<besterror) 
 				{
 					bestbase=base;
@@ -8824,7 +9073,7 @@ void compressBlockAlpha16(uint8* data, int ix, int iy, int width, int height, ui
 	}
 	returnData[0]=bestbase;
 	returnData[1]=(bestmul<<4)+besttable;
-	if(formatSigned) 
+	if(context->formatSigned) 
 	{
 		//if we have a signed format, the base value should be given as a signed byte. 
 		signed char signedbase = bestbase-128;
@@ -8851,7 +9100,7 @@ void compressBlockAlpha16(uint8* data, int ix, int iy, int width, int height, ui
 			for(unsigned int index=0; index<8; index++) 
 			{
 				double indexError;
-				if(formatSigned)
+				if(context->formatSigned)
 				{
 					int16 val16;
 					int val;
@@ -12599,6 +12848,45 @@ void precalcError59T_col1_RG(uint8* block, int colorRGB444_packed, unsigned int
 }
 #endif
 
+#if EXHAUSTIVE_CODE_ACTIVE
+// Precalculates, for the 8 distances of table, the smallest error of each pixel of the block to
+// the colors color-distance and color+distance, and to color itself when center is set, with the
+// vectorized error calculation. The errors of distance d go to precalc_err[d*16].
+void precalcErrorsSimd(uint8* block, uint8 *color, uint8 *table, bool center, const unsigned int *weights, unsigned int *precalc_err)
+{
+	uint8 pixels[3*16];
+	int possible_colors[3][3];
+	int numcolors;
+
+	for (int x = 0; x < 16; x++)
+	{
+		pixels[x] = block[4*x + R];
+		pixels[16+x] = block[4*x + G];
+		pixels[32+x] = block[4*x + B];
+	}
+	for (int d = 0; d < 8; d++)
+	{
+		numcolors = 0;
+		possible_colors[numcolors][R] = CLAMP(0, color[R] - table[d], 255);
+		possible_colors[numcolors][G] = CLAMP(0, color[G] - table[d], 255);
+		possible_colors[numcolors][B] = CLAMP(0, color[B] - table[d], 255);
+		numcolors++;
+		if (center)
+		{
+			possible_colors[numcolors][R] = color[R];
+			possible_colors[numcolors][G] = color[G];
+			possible_colors[numcolors][B] = color[B];
+			numcolors++;
+		}
+		possible_colors[numcolors][R] = CLAMP(0, color[R] + table[d], 255);
+		possible_colors[numcolors][G] = CLAMP(0, color[G] + table[d], 255);
+		possible_colors[numcolors][B] = CLAMP(0, color[B] + table[d], 255);
+		numcolors++;
+		simdBestColors(pixels, 16, possible_colors, numcolors, weights, NULL, &precalc_err[d*16]);
+	}
+}
+#endif
+
 #if EXHAUSTIVE_CODE_ACTIVE
 // Precalculates a table used in exhaustive compression of the T-mode.
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
@@ -12667,6 +12955,12 @@ void precalcError59T_col0_RGBpercep1000(uint8* block, int colorRGB444_packed, un
 	color[R] = (((colorRGB444_packed >> 8) ) << 4) | ((colorRGB444_packed >> 8) ) ;
 	color[G] = (((colorRGB444_packed >> 4) & 0xf) << 4) | ((colorRGB444_packed >> 4) & 0xf) ;
 	color[B] = (((colorRGB444_packed) & 0xf) << 4) | ((colorRGB444_packed) & 0xf) ;
+
+	if (simdLevel != SIMD_NONE)
+	{
+		precalcErrorsSimd(block, color, table59T, true, perceptualWeights1000, &precalc_err_col0_RGB[colorRGB444_packed*8*16]);
+		return;
+	}
 	
 	/* Test all distances */
 	/* unroll loop for (uint8 d = 0; d < 8; ++d) */
@@ -12752,6 +13046,12 @@ void precalcError59T_col0_RGB(uint8* block, int colorRGB444_packed, unsigned int
 	color[G] = (((colorRGB444_packed >> 4) & 0xf) << 4) | ((colorRGB444_packed >> 4) & 0xf) ;
 	color[B] = (((colorRGB444_packed) & 0xf) << 4) | ((colorRGB444_packed) & 0xf) ;
 
+	if (simdLevel != SIMD_NONE)
+	{
+		precalcErrorsSimd(block, color, table59T, true, equalWeights, &precalc_err_col0_RGB[colorRGB444_packed*8*16]);
+		return;
+	}
+
 	/* Test all distances */
 	/* unroll loop for (uint8 d = 0; d < 8; ++d) */
 	{
@@ -14013,6 +14313,12 @@ void precalcError58Hperceptual1000(uint8* block, uint8 (colorsRGB444)[2][3],int
  	colors[0][G] = (colorsRGB444[0][G] << 4) | colorsRGB444[0][G];
  	colors[0][B] = (colorsRGB444[0][B] << 4) | colorsRGB444[0][B];
 
+	if (simdLevel != SIMD_NONE)
+	{
+		precalcErrorsSimd(block, colors[0], table58H, false, perceptualWeights1000, &precalc_err[colorRGB444_packed*8*16]);
+		return;
+	}
+
 	// Test all distances
 	/* unroll loop for (uint8 d = 0; d < 8; ++d) */
 
@@ -14086,6 +14392,12 @@ void precalcError58H(uint8* block, uint8 (colorsRGB444)[2][3],int colorRGB444_pa
  	colors[0][G] = (colorsRGB444[0][G] << 4) | colorsRGB444[0][G];
  	colors[0][B] = (colorsRGB444[0][B] << 4) | colorsRGB444[0][B];
 
+	if (simdLevel != SIMD_NONE)
+	{
+		precalcErrorsSimd(block, colors[0], table58H, false, equalWeights, &precalc_err[colorRGB444_packed*8*16]);
+		return;
+	}
+
 	// Test all distances
 	/* unroll loop for (uint8 d = 0; d < 8; ++d) */
 
@@ -15540,24 +15852,391 @@ void compressBlockETC2Exhaustive(uint8 *img, uint8 *imgdec,int width,int height,
 //// Exhaustive code ends here.
 
 
+// Fills in an encoder context and sets up the tables shared by all contexts.
+void initEncoderContext(EncoderContext *context, int imagecodec, int imageformat, int signedformat, int imagespeed, int imagemetric)
+{
+	context->codec = imagecodec;
+	context->format = imageformat;
+	context->formatSigned = signedformat;
+	context->speed = imagespeed;
+	context->metric = imagemetric;
+	context->verbose = false;
+	context->threads = 1;
+	context->valtab = NULL;
+
+	readCompressParams();
+	setupAlphaTable();
+	setupSimd();
+	if(imageformat==ETC2PACKAGE_R_NO_MIPMAPS||imageformat==ETC2PACKAGE_RG_NO_MIPMAPS)
+		context->valtab = createValtab(signedformat);
+}
+
+// Frees what initEncoderContext allocated for the context.
+void freeEncoderContext(EncoderContext *context)
+{
+	delete[] context->valtab;
+	context->valtab = NULL;
+}
+
+// Number of bytes of the compressed blocks of an image.
+int getCompressedImageSize(const EncoderContext *context, int expandedwidth, int expandedheight)
+{
+	int halfbytes=1;
+	if(context->format==ETC2PACKAGE_RG_NO_MIPMAPS||context->format==ETC2PACKAGE_RGBA_NO_MIPMAPS||context->format==ETC2PACKAGE_sRGBA_NO_MIPMAPS)
+		halfbytes=2;
+	return ((expandedwidth/4)*4*(expandedheight/4)*4*halfbytes)/2;
+}
+
+// Write a word in big endian style to memory
+void write_big_endian_4byte_word_to_memory(unsigned int *blockadr, uint8 *dest)
+{
+	unsigned int block;
+
+	block = blockadr[0];
+
+	dest[0] = (block >> 24) & 0xff;
+	dest[1] = (block >> 16) & 0xff;
+	dest[2] = (block >> 8) & 0xff;
+	dest[3] = (block >> 0) & 0xff;
+}
+
+// Compress the block rows from startrow up to endrow of an image in memory into their place in compressed.
+// Every block is decompressed into its own pixels of imgdec, so that bands of rows can be compressed at the same time.
+void compressBlockRows(const EncoderContext *context, uint8 *img, uint8 *alphaimg, uint8 *alphaimg2, uint8 *imgdec, int expandedwidth, int expandedheight, int startrow, int endrow, bool showprogress, uint8 *compressed)
+{
+	int x,y;
+	unsigned int block1, block2;
+	// the format of the context, not the global of the command line tool
+	const int format = context->format;
+
+	int totblocks = expandedheight/4 * expandedwidth/4;
+	int countblocks = startrow * expandedwidth/4;
+	double percentageblocks=-1.0;
+	double oldpercentageblocks;
+
+	compressed += countblocks*getCompressedImageSize(context, 4, 4);
+	for(y=startrow;y<endrow;y++)
+	{
+		for(x=0;x<expandedwidth/4;x++)
+		{
+			countblocks++;
+			oldpercentageblocks = percentageblocks;
+			percentageblocks = 100.0*countblocks/(1.0*totblocks);
+			//compress color channels
+			if(context->codec==CODEC_ETC) 
+			{
+				if(context->metric==METRIC_NONPERCEPTUAL) 
+				{
+					if(context->speed==SPEED_FAST)
+						compressBlockDiffFlipFast(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
+					else
+#if EXHAUSTIVE_CODE_ACTIVE
+						compressBlockETC1Exhaustive(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);		
+#else
+						printf("Not implemented in this version\n");
+#endif
+				}
+				else 
+				{
+					if(context->speed==SPEED_FAST)
+						compressBlockDiffFlipFastPerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
+					else
+#if EXHAUSTIVE_CODE_ACTIVE
+						compressBlockETC1ExhaustivePerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);	
+#else
+						printf("Not implemented in this version\n");
+#endif
+				}
+			}
+			else 
+			{
+				if(format==ETC2PACKAGE_R_NO_MIPMAPS||format==ETC2PACKAGE_RG_NO_MIPMAPS) 
+				{
+					//don't compress color
+				}
+				else if(format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS) 
+				{
+					//this is only available for fast/nonperceptual
+					compressBlockETC2Fast(img, alphaimg,imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2, format);
+				}
+				else if(context->metric==METRIC_NONPERCEPTUAL) 
+				{
+					if(context->speed==SPEED_FAST)
+						compressBlockETC2Fast(img, alphaimg,imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2, format);
+					else
+#if EXHAUSTIVE_CODE_ACTIVE
+						compressBlockETC2Exhaustive(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);		
+#else
+						printf("Not implemented in this version\n");
+#endif
+				}
+				else 
+				{
+					if(context->speed==SPEED_FAST)
+						compressBlockETC2FastPerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
+					else
+#if EXHAUSTIVE_CODE_ACTIVE
+						compressBlockETC2ExhaustivePerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);	
+#else
+						printf("Not implemented in this version\n");
+#endif
+				}
+			}
+			
+			//compression of alpha channel in case of 4-bit alpha. Uses 8-bit alpha channel as input, and has 8-bit precision.
+			if(format==ETC2PACKAGE_RGBA_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA_NO_MIPMAPS) 
+			{
+				if(context->speed==SPEED_SLOW)
+					compressBlockAlphaSlow(alphaimg,4*x,4*y,expandedwidth,expandedheight,compressed);
+				else
+					compressBlockAlphaFast(alphaimg,4*x,4*y,expandedwidth,expandedheight,compressed);
+				compressed+=8;
+			}
+
+			//store compressed color channels
+			if(format!=ETC2PACKAGE_R_NO_MIPMAPS&&format!=ETC2PACKAGE_RG_NO_MIPMAPS) 
+			{
+				write_big_endian_4byte_word_to_memory(&block1, compressed);
+				write_big_endian_4byte_word_to_memory(&block2, compressed+4);
+				compressed+=8;
+			}
+
+			//1-channel or 2-channel alpha compression: uses 16-bit data as input, and has 11-bit precision
+			if(format==ETC2PACKAGE_R_NO_MIPMAPS||format==ETC2PACKAGE_RG_NO_MIPMAPS) 
+			{ 
+				compressBlockAlpha16(context,alphaimg,4*x,4*y,expandedwidth,expandedheight,compressed);
+				compressed+=8;
+			}
+			//compression of second alpha channel in RG-compression
+			if(format==ETC2PACKAGE_RG_NO_MIPMAPS) 
+			{
+				compressBlockAlpha16(context,alphaimg2,4*x,4*y,expandedwidth,expandedheight,compressed);
+				compressed+=8;
+			}
+#if 1
+			if(context->verbose&&showprogress)
+			{
+				if(context->speed==SPEED_FAST) 
+				{
+					if( ((int)(percentageblocks) != (int)(oldpercentageblocks) ) || percentageblocks == 100.0)
+						printf("Compressed %d of %d blocks, %.0f%% finished.\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", countblocks, totblocks, 100.0*countblocks/(1.0*totblocks));
+				}
+				else
+					printf("Compressed %d of %d blocks, %.0f%% finished.\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", countblocks, totblocks, 100.0*countblocks/(1.0*totblocks));
+			}
+#endif
+		}
+	}
+
+}
+
+#define BAND_BLOCK_ROWS 4
+
+// An image compressed by several threads. The threads take the next band of BAND_BLOCK_ROWS block
+// rows until there are none left, a band is small enough for its pixels to stay in the cache.
+typedef struct CompressionJob_t
+{
+	const EncoderContext *context;
+	uint8 *img;
+	uint8 *alphaimg;
+	uint8 *alphaimg2;
+	uint8 *imgdec;
+	int expandedwidth;
+	int expandedheight;
+	uint8 *compressed;
+	int numbands;
+	int nextband;
+	int countblocks;
+#ifdef _WIN32
+	CRITICAL_SECTION lock;
+#else
+	pthread_mutex_t lock;
+#endif
+}
+CompressionJob;
+
+// Locks the bands and the progress of a job.
+void lockJob(CompressionJob *job)
+{
+#ifdef _WIN32
+	EnterCriticalSection(&job->lock);
+#else
+	pthread_mutex_lock(&job->lock);
+#endif
+}
+
+// Unlocks the bands and the progress of a job.
+void unlockJob(CompressionJob *job)
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&job->lock);
+#else
+	pthread_mutex_unlock(&job->lock);
+#endif
+}
+
+// Compresses bands of a job until all bands are taken.
+void compressBands(CompressionJob *job)
+{
+	int band, startrow, endrow;
+	int blockrows = job->expandedheight/4;
+	int totblocks = blockrows * job->expandedwidth/4;
+	for(;;)
+	{
+		lockJob(job);
+		band = job->nextband++;
+		unlockJob(job);
+		if(band>=job->numbands)
+			break;
+		startrow = band*BAND_BLOCK_ROWS;
+		endrow = JAS_MIN(startrow+BAND_BLOCK_ROWS, blockrows);
+		compressBlockRows(job->context, job->img, job->alphaimg, job->alphaimg2, job->imgdec, job->expandedwidth, job->expandedheight, startrow, endrow, false, job->compressed);
+
+		lockJob(job);
+		job->countblocks += (endrow-startrow) * job->expandedwidth/4;
+		if(job->context->verbose)
+			printf("Compressed %d of %d blocks, %.0f%% finished.\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", job->countblocks, totblocks, 100.0*job->countblocks/(1.0*totblocks));
+		unlockJob(job);
+	}
+}
+
+// Thread function compressing bands of a job.
+#ifdef _WIN32
+DWORD WINAPI compressBandsThread(LPVOID job)
+#else
+void *compressBandsThread(void *job)
+#endif
+{
+	compressBands((CompressionJob*) job);
+	return 0;
+}
+
+// Number of processors of the computer.
+int getProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int) info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count>0) ? (int) count : 1;
+#endif
+}
+
+// Compress an image in memory.
+// Reads nothing but the context, the image and tables that do not change once set up, so that
+// several images can be compressed at the same time, each with its own context.
+void compressImage(const EncoderContext *context, uint8 *img, uint8 *alphaimg, int expandedwidth, int expandedheight, uint8 *compressed)
+{
+	int x,y;
+	uint8 *imgdec;
+	uint8* alphaimg2=NULL;
+	const int format = context->format;
+	imgdec = (unsigned char*) malloc(expandedwidth*expandedheight*3);
+	if(!imgdec)
+	{
+		printf("Could not allocate decompression buffer --- exiting\n");
+		exit(1);
+	}
+
+	if(format==ETC2PACKAGE_RG_NO_MIPMAPS) 
+	{
+		//extract data from red and green channel into two alpha channels.
+		//note that the image will be 16-bit per channel in this case.
+		alphaimg= (unsigned char*)malloc(expandedwidth*expandedheight*2);
+		alphaimg2=(unsigned char*)malloc(expandedwidth*expandedheight*2);
+		if(!alphaimg||!alphaimg2) 
+		{
+			printf("failed allocating space for alpha buffers!\n");
+			exit(1);
+		}
+		for(y=0;y<expandedheight;y++)
+		{
+			for(x=0;x<expandedwidth;x++)
+			{
+				alphaimg[2*(y*expandedwidth+x)]=img[6*(y*expandedwidth+x)];
+				alphaimg[2*(y*expandedwidth+x)+1]=img[6*(y*expandedwidth+x)+1];
+				alphaimg2[2*(y*expandedwidth+x)]=img[6*(y*expandedwidth+x)+2];
+				alphaimg2[2*(y*expandedwidth+x)+1]=img[6*(y*expandedwidth+x)+3];
+			}
+		}
+	}
+	int numbands = (expandedheight/4 + BAND_BLOCK_ROWS - 1) / BAND_BLOCK_ROWS;
+	int numthreads = JAS_MIN(context->threads, numbands);
+	if(numthreads<=1)
+	{
+		compressBlockRows(context, img, alphaimg, alphaimg2, imgdec, expandedwidth, expandedheight, 0, expandedheight/4, true, compressed);
+	}
+	else
+	{
+		// Every block goes to its own place in compressed, whichever thread compresses it.
+		CompressionJob job;
+		job.context = context;
+		job.img = img;
+		job.alphaimg = alphaimg;
+		job.alphaimg2 = alphaimg2;
+		job.imgdec = imgdec;
+		job.expandedwidth = expandedwidth;
+		job.expandedheight = expandedheight;
+		job.compressed = compressed;
+		job.numbands = numbands;
+		job.nextband = 0;
+		job.countblocks = 0;
+
+		// This thread compresses bands as well, also when no other thread could be started.
+#ifdef _WIN32
+		InitializeCriticalSection(&job.lock);
+		HANDLE *handles = (HANDLE*) malloc((numthreads-1)*sizeof(HANDLE));
+		int started = 0;
+		for(int i=0; handles && i<numthreads-1; i++)
+		{
+			handles[started] = CreateThread(NULL, 0, compressBandsThread, &job, 0, NULL);
+			if(handles[started])
+				started++;
+		}
+		compressBands(&job);
+		for(int i=0; i<started; i++)
+		{
+			WaitForSingleObject(handles[i], INFINITE);
+			CloseHandle(handles[i]);
+		}
+		DeleteCriticalSection(&job.lock);
+#else
+		pthread_mutex_init(&job.lock, NULL);
+		pthread_t *handles = (pthread_t*) malloc((numthreads-1)*sizeof(pthread_t));
+		int started = 0;
+		for(int i=0; handles && i<numthreads-1; i++)
+		{
+			if(!pthread_create(&handles[started], NULL, compressBandsThread, &job))
+				started++;
+		}
+		compressBands(&job);
+		for(int i=0; i<started; i++)
+			pthread_join(handles[i], NULL);
+		pthread_mutex_destroy(&job.lock);
+#endif
+		free(handles);
+	}
+
+	if(format==ETC2PACKAGE_RG_NO_MIPMAPS) 
+	{
+		free(alphaimg);
+		free(alphaimg2);
+	}
+	free(imgdec);
+}
+
 // Compress an image file.
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 void compressImageFile(uint8 *img, uint8 *alphaimg,int width,int height,char *dstfile, int expandedwidth, int expandedheight)
 {
 	FILE *f;
-	int x,y,w,h;
-	unsigned int block1, block2;
+	int w,h;
 	unsigned short wi, hi;
 	unsigned char magic[4];
 	unsigned char version[2];
 	unsigned short texture_type=format;
-	uint8 *imgdec;
-	uint8* alphaimg2;
-	imgdec = (unsigned char*) malloc(expandedwidth*expandedheight*3);
-	if(!imgdec)
-	{
-		printf("Could not allocate decompression buffer --- exiting\n");
-	}
 
 	magic[0]   = 'P'; magic[1]   = 'K'; magic[2] = 'M'; magic[3] = ' '; 
 
@@ -15721,154 +16400,29 @@ void compressImageFile(uint8 *img, uint8 *alphaimg,int width,int height,char *ds
 			write_big_endian_2byte_word(&activew, f);
 			write_big_endian_2byte_word(&activeh, f);
 		}
-		int totblocks = expandedheight/4 * expandedwidth/4;
-		int countblocks = 0;
-		double percentageblocks=-1.0;
-		double oldpercentageblocks;
-		
-		if(format==ETC2PACKAGE_RG_NO_MIPMAPS) 
+		if(codec==CODEC_ETC2&&(format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS)&&speed==SPEED_SLOW&&first_time_message)
 		{
-			//extract data from red and green channel into two alpha channels.
-			//note that the image will be 16-bit per channel in this case.
-			alphaimg= (unsigned char*)malloc(expandedwidth*expandedheight*2);
-			alphaimg2=(unsigned char*)malloc(expandedwidth*expandedheight*2);
-			setupAlphaTableAndValtab();
-			if(!alphaimg||!alphaimg2) 
-			{
-				printf("failed allocating space for alpha buffers!\n");
-				exit(1);
-			}
-			for(y=0;y<expandedheight;y++)
-			{
-				for(x=0;x<expandedwidth;x++)
-				{
-					alphaimg[2*(y*expandedwidth+x)]=img[6*(y*expandedwidth+x)];
-					alphaimg[2*(y*expandedwidth+x)+1]=img[6*(y*expandedwidth+x)+1];
-					alphaimg2[2*(y*expandedwidth+x)]=img[6*(y*expandedwidth+x)+2];
-					alphaimg2[2*(y*expandedwidth+x)+1]=img[6*(y*expandedwidth+x)+3];
-				}
-			}
+			//this is only available for fast/nonperceptual
+			printf("Slow codec not implemented for RGBA1 --- using fast codec instead.\n");
+			first_time_message = false;
 		}
-		for(y=0;y<expandedheight/4;y++)
-		{
-			for(x=0;x<expandedwidth/4;x++)
-			{
-				countblocks++;
-				oldpercentageblocks = percentageblocks;
-				percentageblocks = 100.0*countblocks/(1.0*totblocks);
-				//compress color channels
-				if(codec==CODEC_ETC) 
-				{
-					if(metric==METRIC_NONPERCEPTUAL) 
-					{
-						if(speed==SPEED_FAST)
-							compressBlockDiffFlipFast(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
-						else
-#if EXHAUSTIVE_CODE_ACTIVE
-							compressBlockETC1Exhaustive(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);		
-#else
-							printf("Not implemented in this version\n");
-#endif
-					}
-					else 
-					{
-						if(speed==SPEED_FAST)
-							compressBlockDiffFlipFastPerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
-						else
-#if EXHAUSTIVE_CODE_ACTIVE
-							compressBlockETC1ExhaustivePerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);	
-#else
-							printf("Not implemented in this version\n");
-#endif
-					}
-				}
-				else 
-				{
-					if(format==ETC2PACKAGE_R_NO_MIPMAPS||format==ETC2PACKAGE_RG_NO_MIPMAPS) 
-					{
-						//don't compress color
-					}
-					else if(format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS) 
-					{
-						//this is only available for fast/nonperceptual
-						if(speed == SPEED_SLOW && first_time_message)
-						{
-							printf("Slow codec not implemented for RGBA1 --- using fast codec instead.\n");
-							first_time_message = false;
-						}
-						compressBlockETC2Fast(img, alphaimg,imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
-					}
-					else if(metric==METRIC_NONPERCEPTUAL) 
-					{
-						if(speed==SPEED_FAST)
-							compressBlockETC2Fast(img, alphaimg,imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
-						else
-#if EXHAUSTIVE_CODE_ACTIVE
-							compressBlockETC2Exhaustive(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);		
-#else
-							printf("Not implemented in this version\n");
-#endif
-					}
-					else 
-					{
-						if(speed==SPEED_FAST)
-							compressBlockETC2FastPerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);
-						else
-#if EXHAUSTIVE_CODE_ACTIVE
-							compressBlockETC2ExhaustivePerceptual(img, imgdec, expandedwidth, expandedheight, 4*x, 4*y, block1, block2);	
-#else
-							printf("Not implemented in this version\n");
-#endif
-					}
-				}
-				
-				//compression of alpha channel in case of 4-bit alpha. Uses 8-bit alpha channel as input, and has 8-bit precision.
-				if(format==ETC2PACKAGE_RGBA_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA_NO_MIPMAPS) 
-				{
-					uint8 alphadata[8];
-					if(speed==SPEED_SLOW)
-						compressBlockAlphaSlow(alphaimg,4*x,4*y,expandedwidth,expandedheight,alphadata);
-					else
-						compressBlockAlphaFast(alphaimg,4*x,4*y,expandedwidth,expandedheight,alphadata);
-					//write the 8 bytes of alphadata into f.
-					fwrite(alphadata,1,8,f);
-				}
 
-				//store compressed color channels
-				if(format!=ETC2PACKAGE_R_NO_MIPMAPS&&format!=ETC2PACKAGE_RG_NO_MIPMAPS) 
-				{
-					write_big_endian_4byte_word(&block1, f);
-					write_big_endian_4byte_word(&block2, f);
-				}
-
-				//1-channel or 2-channel alpha compression: uses 16-bit data as input, and has 11-bit precision
-				if(format==ETC2PACKAGE_R_NO_MIPMAPS||format==ETC2PACKAGE_RG_NO_MIPMAPS) 
-				{ 
-					uint8 alphadata[8];
-					compressBlockAlpha16(alphaimg,4*x,4*y,expandedwidth,expandedheight,alphadata);
-					fwrite(alphadata,1,8,f);
-				}
-				//compression of second alpha channel in RG-compression
-				if(format==ETC2PACKAGE_RG_NO_MIPMAPS) 
-				{
-					uint8 alphadata[8];
-					compressBlockAlpha16(alphaimg2,4*x,4*y,expandedwidth,expandedheight,alphadata);
-					fwrite(alphadata,1,8,f);
-				}
-#if 1
-				if(verbose)
-				{
-					if(speed==SPEED_FAST) 
-					{
-						if( ((int)(percentageblocks) != (int)(oldpercentageblocks) ) || percentageblocks == 100.0)
-							printf("Compressed %d of %d blocks, %.0f%% finished.\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", countblocks, totblocks, 100.0*countblocks/(1.0*totblocks));
-					}
-					else
-						printf("Compressed %d of %d blocks, %.0f%% finished.\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b", countblocks, totblocks, 100.0*countblocks/(1.0*totblocks));
-				}
-#endif
-			}
+		EncoderContext context;
+		initEncoderContext(&context, codec, format, formatSigned, speed, metric);
+		context.verbose = verbose;
+	context.threads = (threads>0) ? threads : getProcessorCount();
+		int imagesize = getCompressedImageSize(&context, expandedwidth, expandedheight);
+		uint8 *compressed = (uint8*) malloc(imagesize);
+		if(!compressed)
+		{
+			printf("Could not allocate compression buffer --- exiting\n");
+			exit(1);
 		}
+		compressImage(&context, img, alphaimg, expandedwidth, expandedheight, compressed);
+		fwrite(compressed, 1, imagesize, f);
+		free(compressed);
+		freeEncoderContext(&context);
+
 		printf("\n");
 		fclose(f);
 		printf("Saved file <%s>.\n",dstfile);
@@ -15934,26 +16488,21 @@ void compressFile(char *srcfile,char *dstfile)
 	printf("\n");
 	if(readCompressParams())
 	{
-		if(format==ETC2PACKAGE_R_NO_MIPMAPS||readSrcFile(srcfile,srcimg,width,height,extendedwidth, extendedheight))
+		uint8* alphasrc;
+		if(readSrcFile(srcfile,srcimg,alphasrc,width,height,extendedwidth, extendedheight))
 		{
 			//make sure that alphasrcimg contains the alpha channel or is null here, and pass it to compressimagefile
 			uint8* alphaimg=NULL;
 			if(format==ETC2PACKAGE_RGBA_NO_MIPMAPS||format==ETC2PACKAGE_RGBA1_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA_NO_MIPMAPS||format==ETC2PACKAGE_sRGBA1_NO_MIPMAPS) 
 			{
-				char str[300];
 				//printf("reading alpha channel....");
-				sprintf(str,"magick convert %s -alpha extract alpha.pgm\n",srcfile);
-				system(str);
-				readAlpha(alphaimg,width,height,extendedwidth,extendedheight);
+				readAlpha(alphasrc,alphaimg,width,height,extendedwidth,extendedheight);
 				printf("ok!\n");
 				setupAlphaTableAndValtab();
 			}
 			else if(format==ETC2PACKAGE_R_NO_MIPMAPS) 
 			{
-				char str[300];
-				sprintf(str,"magick convert %s alpha.pgm\n",srcfile);
-				system(str);
-				readAlpha(alphaimg,width,height,extendedwidth,extendedheight);
+				readAlpha(alphasrc,alphaimg,width,height,extendedwidth,extendedheight);
 				printf("read alpha ok, size is %d,%d (%d,%d)",width,height,extendedwidth,extendedheight);
 				setupAlphaTableAndValtab();
 			}
@@ -16015,7 +16564,7 @@ double calculatePSNRTwoFiles(char *srcfile1,char *srcfile2)
 // NO WARRANTY --- SEE STATEMENT IN TOP OF FILE (C) Ericsson AB 2005-2013. All Rights Reserved.
 int main(int argc,char *argv[])
 {
-	if(argc==3 || argc==4 || argc == 5 || argc == 7 || argc == 9 || argc == 11 || argc == 13)
+	if(argc==3 || argc==4 || argc == 5 || argc == 7 || argc == 9 || argc == 11 || argc == 13 || argc == 15)
 	{
 		// The source file is always the second last one. 
 		char srcfile[200];
@@ -16067,6 +16616,8 @@ int main(int argc,char *argv[])
 		printf("                                         (1 equals punchthrough)\n");
 		printf("                                         (default: RGB)\n");
 		printf("      -v {on|off}                        Detailed progress info. (default on)\n");
+		printf("      -t {threads}                       Threads compressing bands of the image,\n");
+		printf("                                         0 for one per processor (default: 1)\n");
 		printf("                                                            \n");
 		printf("Examples: \n");
 		printf("  etcpack img.ppm img.pkm                Compresses img.ppm to img.pkm in\n"); 
@@ -16075,6 +16626,8 @@ int main(int argc,char *argv[])
 		printf("                                         ETC2 RGB format\n");
 		printf("  etcpack img.pkm img_copy.ppm           Decompresses img.pkm to img_copy.ppm\n");
 		printf("  etcpack -s slow img.ppm img.pkm        Compress using the slow mode.\n");
+		printf("  etcpack -s slow -t 0 img.ppm img.pkm   Compress using the slow mode on all\n");
+		printf("                                         processors.\n");
 		printf("  etcpack -p orig.ppm copy.ppm           Calculate PSNR between orig and copy\n");
 		printf("  etcpack -f RGBA8 img.tga img.pkm       Compresses img.tga to img.pkm, using \n");
 		printf("                                         etc2 + alpha.\n");
@@ -0,0 +1,45 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef ETCPACK_H
+#define ETCPACK_H
+
+// Texture formats of the codecs, see the table in etcpack.cxx.
+enum{ETC1_RGB_NO_MIPMAPS,ETC2PACKAGE_RGB_NO_MIPMAPS,ETC2PACKAGE_RGBA_NO_MIPMAPS_OLD,ETC2PACKAGE_RGBA_NO_MIPMAPS,ETC2PACKAGE_RGBA1_NO_MIPMAPS,ETC2PACKAGE_R_NO_MIPMAPS,ETC2PACKAGE_RG_NO_MIPMAPS,ETC2PACKAGE_R_SIGNED_NO_MIPMAPS,ETC2PACKAGE_RG_SIGNED_NO_MIPMAPS,ETC2PACKAGE_sRGB_NO_MIPMAPS,ETC2PACKAGE_sRGBA_NO_MIPMAPS,ETC2PACKAGE_sRGBA1_NO_MIPMAPS};
+enum {SPEED_SLOW, SPEED_FAST, SPEED_MEDIUM};
+enum {METRIC_PERCEPTUAL, METRIC_NONPERCEPTUAL};
+enum {CODEC_ETC, CODEC_ETC2};
+
+// The settings of the encoder for an image. The command line tool keeps its settings in globals,
+// a program compressing several images at the same time gives every image a context instead,
+// the encoder reads nothing else that changes, so each thread can compress with its own context.
+typedef struct EncoderContext_t
+{
+	int codec;
+	int format;
+	int formatSigned;
+	int speed;
+	int metric;
+	int verbose;
+	// number of threads compressImage compresses bands of block rows with, 1 by default
+	int threads;
+	// precalculated data for the 11-bit formats (R and RG), depends on formatSigned
+	int *valtab;
+}
+EncoderContext;
+
+// Fills in the context and sets up the tables the encoder shares between contexts, which does not
+// change them afterwards. Set up the contexts before the threads using them start.
+void initEncoderContext(EncoderContext *context, int imagecodec, int imageformat, int signedformat, int imagespeed, int imagemetric);
+void freeEncoderContext(EncoderContext *context);
+
+// Number of bytes compressImage writes for an image of the expanded size.
+int getCompressedImageSize(const EncoderContext *context, int expandedwidth, int expandedheight);
+
+// Compresses an image in memory into the blocks of a .pkm file, without its header, row by row.
+// With several threads the bands of block rows are shared out between them, the blocks come out
+// the same as compressed by one thread.
+// The image is expanded to a multiple of 4 pixels: img has 3 bytes per pixel (6 for the 16-bit
+// R and RG formats), alphaimg 1 byte (2 for R) or is NULL for formats without alpha.
+void compressImage(const EncoderContext *context, unsigned char *img, unsigned char *alphaimg, int expandedwidth, int expandedheight, unsigned char *compressed);
+
+#endif
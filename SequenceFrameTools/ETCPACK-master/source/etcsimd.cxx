@@ -0,0 +1,386 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include <stdlib.h>
+#include <string.h>
+#include "etcsimd.h"
+
+// The x86 versions are only built for 64-bit processors, where the scalar code does its
+// floating point calculations with the same SSE2 instructions and gets the same results.
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#include <smmintrin.h>
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#define SIMD_X86_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_ARM 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang compile the instructions of a function only when asked to, Visual C++ always does.
+#if defined(__GNUC__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+typedef unsigned char uint8;
+
+int simdLevel = SIMD_NONE;
+int simdInitialized = 0;
+
+// Finds the best instructions of the processor for the error calculations.
+int detectSimd()
+{
+#if SIMD_X86
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+#if SIMD_X86_AVX2
+	if(__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+#endif
+	if(__builtin_cpu_supports("sse4.1"))
+		return SIMD_SSE41;
+#else
+	int info[4];
+	__cpuid(info, 0);
+	int maxleaf = info[0];
+	__cpuid(info, 1);
+	int sse41 = info[2] & (1<<19);
+#if SIMD_X86_AVX2
+	// AVX2 needs the operating system to save the 256-bit registers as well
+	int osxsave = info[2] & (1<<27);
+	if(maxleaf>=7 && osxsave && (_xgetbv(0) & 6)==6)
+	{
+		__cpuidex(info, 7, 0);
+		if(info[1] & (1<<5))
+			return SIMD_AVX2;
+	}
+#endif
+	if(sse41)
+		return SIMD_SSE41;
+#endif
+	return SIMD_NONE;
+#elif SIMD_ARM
+	// Advanced SIMD is part of every 64-bit ARM processor
+	return SIMD_NEON;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+// Sets simdLevel once.
+void setupSimd()
+{
+	if(simdInitialized)
+		return;
+	int level = detectSimd();
+	const char *limit = getenv("ETCPACK_SIMD");
+	if(limit)
+	{
+		if(!strcmp(limit,"none"))
+			level = SIMD_NONE;
+		else if(!strcmp(limit,"sse4.1") && level==SIMD_AVX2)
+			level = SIMD_SSE41;
+	}
+	simdLevel = level;
+	simdInitialized = 1;
+}
+
+// The error calculation of the loops in etcpack.cxx, for processors without vector instructions.
+unsigned int bestColorsScalar(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const unsigned int *weights, uint8 *best, unsigned int *errors)
+{
+	unsigned int sum = 0;
+	for(int i=0; i<numpixels; i++)
+	{
+		unsigned int min_error = 0;
+		uint8 min_index = 0;
+		for(int c=0; c<numcolors; c++)
+		{
+			int dr = pixels[i] - colors[c][0];
+			int dg = pixels[numpixels+i] - colors[c][1];
+			int db = pixels[2*numpixels+i] - colors[c][2];
+			unsigned int error = weights[0]*(dr*dr) + weights[1]*(dg*dg) + weights[2]*(db*db);
+			if(c==0 || error<min_error)
+			{
+				min_error = error;
+				min_index = (uint8) c;
+			}
+		}
+		if(best)
+			best[i] = min_index;
+		if(errors)
+			errors[i] = min_error;
+		sum += min_error;
+	}
+	return sum;
+}
+
+#if SIMD_X86
+// Loads 4 bytes as 32-bit integers.
+TARGET_SSE41 static inline __m128i load4BytesSSE41(const uint8 *bytes)
+{
+	int word;
+	memcpy(&word, bytes, 4);
+	return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(word));
+}
+
+// Weighted squared errors of 4 pixels to a color.
+// The errors stay below 2^31, so that they can be compared as signed integers.
+TARGET_SSE41 static inline __m128i colorErrorSSE41(__m128i r, __m128i g, __m128i b, const int *color, __m128i wr, __m128i wg, __m128i wb)
+{
+	__m128i dr = _mm_sub_epi32(r, _mm_set1_epi32(color[0]));
+	__m128i dg = _mm_sub_epi32(g, _mm_set1_epi32(color[1]));
+	__m128i db = _mm_sub_epi32(b, _mm_set1_epi32(color[2]));
+	__m128i error = _mm_mullo_epi32(wr, _mm_mullo_epi32(dr, dr));
+	error = _mm_add_epi32(error, _mm_mullo_epi32(wg, _mm_mullo_epi32(dg, dg)));
+	return _mm_add_epi32(error, _mm_mullo_epi32(wb, _mm_mullo_epi32(db, db)));
+}
+
+// The error calculation for 4 pixels at a time with SSE4.1.
+TARGET_SSE41 unsigned int bestColorsSSE41(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const unsigned int *weights, uint8 *best, unsigned int *errors)
+{
+	const __m128i wr = _mm_set1_epi32((int) weights[0]);
+	const __m128i wg = _mm_set1_epi32((int) weights[1]);
+	const __m128i wb = _mm_set1_epi32((int) weights[2]);
+	// the lowest byte of each 32-bit index
+	const __m128i indexbytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+	__m128i sum = _mm_setzero_si128();
+
+	for(int i=0; i<numpixels; i+=4)
+	{
+		__m128i r = load4BytesSSE41(pixels + i);
+		__m128i g = load4BytesSSE41(pixels + numpixels + i);
+		__m128i b = load4BytesSSE41(pixels + 2*numpixels + i);
+
+		__m128i min_error = colorErrorSSE41(r, g, b, colors[0], wr, wg, wb);
+		__m128i min_index = _mm_setzero_si128();
+		for(int c=1; c<numcolors; c++)
+		{
+			__m128i error = colorErrorSSE41(r, g, b, colors[c], wr, wg, wb);
+			// the first of equal errors stays the best
+			__m128i smaller = _mm_cmplt_epi32(error, min_error);
+			min_error = _mm_min_epi32(error, min_error);
+			min_index = _mm_blendv_epi8(min_index, _mm_set1_epi32(c), smaller);
+		}
+
+		sum = _mm_add_epi32(sum, min_error);
+		if(errors)
+			_mm_storeu_si128((__m128i*) (errors + i), min_error);
+		if(best)
+		{
+			int word = _mm_cvtsi128_si32(_mm_shuffle_epi8(min_index, indexbytes));
+			memcpy(best + i, &word, 4);
+		}
+	}
+
+	sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+	sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 4));
+	return (unsigned int) _mm_cvtsi128_si32(sum);
+}
+
+// The floating point error calculation for 4 pixels at a time with SSE4.1. The red error is
+// calculated in double precision, the green and blue errors in single precision and added
+// in double precision, as in the scalar code.
+TARGET_SSE41 void bestColorsPerceptualSSE41(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const double *weights, uint8 *best, float *errors)
+{
+	const __m128d wr = _mm_set1_pd(weights[0]);
+	const __m128 wg = _mm_set1_ps((float) weights[1]);
+	const __m128 wb = _mm_set1_ps((float) weights[2]);
+	const __m128i indexbytes = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+	for(int i=0; i<numpixels; i+=4)
+	{
+		__m128i r = load4BytesSSE41(pixels + i);
+		__m128i g = load4BytesSSE41(pixels + numpixels + i);
+		__m128i b = load4BytesSSE41(pixels + 2*numpixels + i);
+
+		__m128 min_error = _mm_setzero_ps();
+		__m128i min_index = _mm_setzero_si128();
+		for(int c=0; c<numcolors; c++)
+		{
+			__m128i dr = _mm_sub_epi32(r, _mm_set1_epi32(colors[c][0]));
+			__m128i dg = _mm_sub_epi32(g, _mm_set1_epi32(colors[c][1]));
+			__m128i db = _mm_sub_epi32(b, _mm_set1_epi32(colors[c][2]));
+			__m128i sqr = _mm_mullo_epi32(dr, dr);
+			__m128 green = _mm_mul_ps(wg, _mm_cvtepi32_ps(_mm_mullo_epi32(dg, dg)));
+			__m128 blue = _mm_mul_ps(wb, _mm_cvtepi32_ps(_mm_mullo_epi32(db, db)));
+
+			__m128d low = _mm_mul_pd(wr, _mm_cvtepi32_pd(sqr));
+			__m128d high = _mm_mul_pd(wr, _mm_cvtepi32_pd(_mm_unpackhi_epi64(sqr, sqr)));
+			low = _mm_add_pd(low, _mm_cvtps_pd(green));
+			high = _mm_add_pd(high, _mm_cvtps_pd(_mm_movehl_ps(green, green)));
+			low = _mm_add_pd(low, _mm_cvtps_pd(blue));
+			high = _mm_add_pd(high, _mm_cvtps_pd(_mm_movehl_ps(blue, blue)));
+			__m128 error = _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+
+			if(c==0)
+			{
+				min_error = error;
+			}
+			else
+			{
+				__m128 smaller = _mm_cmplt_ps(error, min_error);
+				min_error = _mm_blendv_ps(min_error, error, smaller);
+				min_index = _mm_blendv_epi8(min_index, _mm_set1_epi32(c), _mm_castps_si128(smaller));
+			}
+		}
+
+		_mm_storeu_ps(errors + i, min_error);
+		int word = _mm_cvtsi128_si32(_mm_shuffle_epi8(min_index, indexbytes));
+		memcpy(best + i, &word, 4);
+	}
+}
+#endif
+
+#if SIMD_X86_AVX2
+// Weighted squared errors of 8 pixels to a color.
+TARGET_AVX2 static inline __m256i colorErrorAVX2(__m256i r, __m256i g, __m256i b, const int *color, __m256i wr, __m256i wg, __m256i wb)
+{
+	__m256i dr = _mm256_sub_epi32(r, _mm256_set1_epi32(color[0]));
+	__m256i dg = _mm256_sub_epi32(g, _mm256_set1_epi32(color[1]));
+	__m256i db = _mm256_sub_epi32(b, _mm256_set1_epi32(color[2]));
+	__m256i error = _mm256_mullo_epi32(wr, _mm256_mullo_epi32(dr, dr));
+	error = _mm256_add_epi32(error, _mm256_mullo_epi32(wg, _mm256_mullo_epi32(dg, dg)));
+	return _mm256_add_epi32(error, _mm256_mullo_epi32(wb, _mm256_mullo_epi32(db, db)));
+}
+
+// The error calculation for 8 pixels at a time with AVX2.
+TARGET_AVX2 unsigned int bestColorsAVX2(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const unsigned int *weights, uint8 *best, unsigned int *errors)
+{
+	const __m256i wr = _mm256_set1_epi32((int) weights[0]);
+	const __m256i wg = _mm256_set1_epi32((int) weights[1]);
+	const __m256i wb = _mm256_set1_epi32((int) weights[2]);
+	__m256i sum = _mm256_setzero_si256();
+
+	for(int i=0; i<numpixels; i+=8)
+	{
+		__m256i r = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (pixels + i)));
+		__m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (pixels + numpixels + i)));
+		__m256i b = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (pixels + 2*numpixels + i)));
+
+		__m256i min_error = colorErrorAVX2(r, g, b, colors[0], wr, wg, wb);
+		__m256i min_index = _mm256_setzero_si256();
+		for(int c=1; c<numcolors; c++)
+		{
+			__m256i error = colorErrorAVX2(r, g, b, colors[c], wr, wg, wb);
+			__m256i smaller = _mm256_cmpgt_epi32(min_error, error);
+			min_error = _mm256_min_epi32(error, min_error);
+			min_index = _mm256_blendv_epi8(min_index, _mm256_set1_epi32(c), smaller);
+		}
+
+		sum = _mm256_add_epi32(sum, min_error);
+		if(errors)
+			_mm256_storeu_si256((__m256i*) (errors + i), min_error);
+		if(best)
+		{
+			// the indices are below 256, two packs take their lowest bytes in the order of the pixels
+			__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(min_index), _mm256_extracti128_si256(min_index, 1));
+			_mm_storel_epi64((__m128i*) (best + i), _mm_packus_epi16(words, words));
+		}
+	}
+
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+	half = _mm_add_epi32(half, _mm_srli_si128(half, 8));
+	half = _mm_add_epi32(half, _mm_srli_si128(half, 4));
+	return (unsigned int) _mm_cvtsi128_si32(half);
+}
+#endif
+
+#if SIMD_ARM
+// Loads 4 bytes as 32-bit integers.
+static inline int32x4_t load4BytesNEON(const uint8 *bytes)
+{
+	uint32_t word;
+	memcpy(&word, bytes, 4);
+	uint8x8_t bytes8 = vreinterpret_u8_u32(vdup_n_u32(word));
+	return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes8))));
+}
+
+// Weighted squared errors of 4 pixels to a color.
+static inline int32x4_t colorErrorNEON(int32x4_t r, int32x4_t g, int32x4_t b, const int *color, int32x4_t wr, int32x4_t wg, int32x4_t wb)
+{
+	int32x4_t dr = vsubq_s32(r, vdupq_n_s32(color[0]));
+	int32x4_t dg = vsubq_s32(g, vdupq_n_s32(color[1]));
+	int32x4_t db = vsubq_s32(b, vdupq_n_s32(color[2]));
+	int32x4_t error = vmulq_s32(wr, vmulq_s32(dr, dr));
+	error = vmlaq_s32(error, wg, vmulq_s32(dg, dg));
+	return vmlaq_s32(error, wb, vmulq_s32(db, db));
+}
+
+// The error calculation for 4 pixels at a time with NEON.
+unsigned int bestColorsNEON(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const unsigned int *weights, uint8 *best, unsigned int *errors)
+{
+	const int32x4_t wr = vdupq_n_s32((int) weights[0]);
+	const int32x4_t wg = vdupq_n_s32((int) weights[1]);
+	const int32x4_t wb = vdupq_n_s32((int) weights[2]);
+	uint32x4_t sum = vdupq_n_u32(0);
+
+	for(int i=0; i<numpixels; i+=4)
+	{
+		int32x4_t r = load4BytesNEON(pixels + i);
+		int32x4_t g = load4BytesNEON(pixels + numpixels + i);
+		int32x4_t b = load4BytesNEON(pixels + 2*numpixels + i);
+
+		int32x4_t min_error = colorErrorNEON(r, g, b, colors[0], wr, wg, wb);
+		uint32x4_t min_index = vdupq_n_u32(0);
+		for(int c=1; c<numcolors; c++)
+		{
+			int32x4_t error = colorErrorNEON(r, g, b, colors[c], wr, wg, wb);
+			uint32x4_t smaller = vcltq_s32(error, min_error);
+			min_error = vminq_s32(error, min_error);
+			min_index = vbslq_u32(smaller, vdupq_n_u32(c), min_index);
+		}
+
+		sum = vaddq_u32(sum, vreinterpretq_u32_s32(min_error));
+		if(errors)
+			vst1q_u32(errors + i, vreinterpretq_u32_s32(min_error));
+		if(best)
+		{
+			uint8x8_t indices = vmovn_u16(vcombine_u16(vmovn_u32(min_index), vdup_n_u16(0)));
+			uint32_t word = vget_lane_u32(vreinterpret_u32_u8(indices), 0);
+			memcpy(best + i, &word, 4);
+		}
+	}
+	return vaddvq_u32(sum);
+}
+#endif
+
+// Finds the best of numcolors colors for every pixel with the best instructions of the processor.
+unsigned int simdBestColors(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const unsigned int *weights, uint8 *best, unsigned int *errors)
+{
+#if SIMD_X86_AVX2
+	if(simdLevel==SIMD_AVX2)
+		return bestColorsAVX2(pixels, numpixels, colors, numcolors, weights, best, errors);
+#endif
+#if SIMD_X86
+	if(simdLevel==SIMD_SSE41 || simdLevel==SIMD_AVX2)
+		return bestColorsSSE41(pixels, numpixels, colors, numcolors, weights, best, errors);
+#endif
+#if SIMD_ARM
+	if(simdLevel==SIMD_NEON)
+		return bestColorsNEON(pixels, numpixels, colors, numcolors, weights, best, errors);
+#endif
+	return bestColorsScalar(pixels, numpixels, colors, numcolors, weights, best, errors);
+}
+
+// ARM compilers may fuse the multiplications and additions of the scalar floating point code,
+// there is no vector version which is sure to round the same way.
+bool simdBestColorsPerceptual(const uint8 *pixels, int numpixels, const int (*colors)[3], int numcolors, const double *weights, uint8 *best, float *errors)
+{
+#if SIMD_X86
+	if(simdLevel==SIMD_SSE41 || simdLevel==SIMD_AVX2)
+	{
+		bestColorsPerceptualSSE41(pixels, numpixels, colors, numcolors, weights, best, errors);
+		return true;
+	}
+#endif
+	return false;
+}
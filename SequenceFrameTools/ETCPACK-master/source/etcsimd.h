@@ -0,0 +1,31 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef ETCSIMD_H
+#define ETCSIMD_H
+
+// Vectorized versions of the error calculations the encoder spends most of its time in.
+// They give exactly the errors and indices of the loops in etcpack.cxx, which use them
+// when setupSimd has found instructions for them on the processor.
+
+enum {SIMD_NONE, SIMD_SSE41, SIMD_AVX2, SIMD_NEON};
+
+// The instructions the error calculations use, set by setupSimd.
+extern int simdLevel;
+
+// Finds the best instructions the processor has, once. The environment variable
+// ETCPACK_SIMD set to none, sse4.1 or avx2 keeps it from using better ones.
+void setupSimd();
+
+// For each of numpixels pixels, a multiple of 8, finds the first of numcolors colors with
+// the smallest error weights[0]*dR^2 + weights[1]*dG^2 + weights[2]*dB^2. The pixels are
+// given as numpixels red values followed by the green and the blue values. The index of
+// the color goes to best and the error to errors, either can be NULL. Returns the sum of
+// the errors.
+unsigned int simdBestColors(const unsigned char *pixels, int numpixels, const int (*colors)[3], int numcolors, const unsigned int *weights, unsigned char *best, unsigned int *errors);
+
+// The same with the floating point error of compressBlockWithTable2x4percep, rounded the
+// same way: (float)(weights[0]*dR^2 + (float)weights[1]*dG^2 + (float)weights[2]*dB^2).
+// Returns false when the processor has no instructions for it, then nothing is calculated.
+bool simdBestColorsPerceptual(const unsigned char *pixels, int numpixels, const int (*colors)[3], int numcolors, const double *weights, unsigned char *best, float *errors);
+
+#endif
@@ -459,3 +459,760 @@ bool fWriteTGAfromRGBandA(char *filename, int width, int height, unsigned char *
 	fclose(f1);
 	return true;
 }
+
+// Reads a whole file into memory.
+static unsigned char *readFileBytes(char *filename, int &size)
+{
+	FILE *f;
+	unsigned char *data = NULL;
+	f = fopen(filename, "rb");
+	if(!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if(length > 0 && length < (1<<30))
+	{
+		data = (unsigned char*) malloc(length);
+		if(data && fread(data, length, 1, f) != 1)
+		{
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(f);
+	size = (int) length;
+	return data;
+}
+
+// Inflate (RFC 1950 and 1951) for the image data of PNG files. Huffman codes of up to
+// INFLATE_FAST_BITS bits are looked up directly, longer codes are searched canonically.
+#define INFLATE_FAST_BITS 9
+
+typedef struct InflateHuffman_t
+{
+	unsigned short fast[1<<INFLATE_FAST_BITS];	// (code length << 9) | symbol, 0 for longer codes
+	unsigned short firstcode[16];
+	unsigned short firstsymbol[16];
+	int maxcode[17];
+	unsigned char size[288];
+	unsigned short value[288];
+} InflateHuffman;
+
+typedef struct InflateStream_t
+{
+	const unsigned char *in;
+	int pos;
+	int length;
+	unsigned int bits;
+	int numbits;
+	unsigned char *out;
+	unsigned char *outstart;
+	unsigned char *outend;
+} InflateStream;
+
+static const int inflateLengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const int inflateLengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const int inflateDistanceBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const int inflateDistanceExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+// Reverses the order of the length lowest bits of code.
+static int reverseBits(int code, int length)
+{
+	int reversed = 0;
+	for(int i=0; i<length; i++)
+	{
+		reversed = (reversed<<1) | (code&1);
+		code >>= 1;
+	}
+	return reversed;
+}
+
+// Builds the decoding tables of a canonical Huffman code from its code lengths.
+static bool buildHuffman(InflateHuffman *huffman, const unsigned char *lengths, int num)
+{
+	int counts[16];
+	int nextcode[16];
+	int code = 0;
+	int symbol = 0;
+
+	memset(counts, 0, sizeof(counts));
+	memset(huffman->fast, 0, sizeof(huffman->fast));
+	for(int i=0; i<num; i++)
+		counts[lengths[i]]++;
+	counts[0] = 0;
+	for(int i=1; i<16; i++)
+	{
+		nextcode[i] = code;
+		huffman->firstcode[i] = (unsigned short) code;
+		huffman->firstsymbol[i] = (unsigned short) symbol;
+		code += counts[i];
+		if(counts[i] && code-1 >= (1<<i))
+			return false;
+		huffman->maxcode[i] = code << (16-i);
+		code <<= 1;
+		symbol += counts[i];
+	}
+	huffman->maxcode[16] = 0x10000;
+	for(int i=0; i<num; i++)
+	{
+		int length = lengths[i];
+		if(length)
+		{
+			int slot = nextcode[length] - huffman->firstcode[length] + huffman->firstsymbol[length];
+			huffman->size[slot] = (unsigned char) length;
+			huffman->value[slot] = (unsigned short) i;
+			if(length <= INFLATE_FAST_BITS)
+			{
+				for(int j=reverseBits(nextcode[length], length); j<(1<<INFLATE_FAST_BITS); j+=(1<<length))
+					huffman->fast[j] = (unsigned short) ((length<<9) | i);
+			}
+			nextcode[length]++;
+		}
+	}
+	return true;
+}
+
+// Tops up the bit buffer. Reading past the end gives zeros, inflateZlib checks the position at the end.
+static void fillBits(InflateStream *stream)
+{
+	while(stream->numbits <= 24)
+	{
+		unsigned int byte = 0;
+		if(stream->pos < stream->length)
+			byte = stream->in[stream->pos];
+		stream->pos++;
+		stream->bits |= byte << stream->numbits;
+		stream->numbits += 8;
+	}
+}
+
+// Reads the next n bits of the stream, the first bit read is the lowest one.
+static unsigned int getBits(InflateStream *stream, int n)
+{
+	if(stream->numbits < n)
+		fillBits(stream);
+	unsigned int value = stream->bits & ((1u<<n)-1);
+	stream->bits >>= n;
+	stream->numbits -= n;
+	return value;
+}
+
+// Returns the next symbol of the Huffman code, or -1 if the bits are no code.
+static int decodeSymbol(InflateStream *stream, const InflateHuffman *huffman)
+{
+	if(stream->numbits < 16)
+		fillBits(stream);
+	int entry = huffman->fast[stream->bits & ((1<<INFLATE_FAST_BITS)-1)];
+	if(entry)
+	{
+		stream->bits >>= (entry>>9);
+		stream->numbits -= (entry>>9);
+		return entry & 511;
+	}
+	int code = reverseBits(stream->bits & 0xffff, 16);
+	int length = INFLATE_FAST_BITS+1;
+	while(code >= huffman->maxcode[length])
+		length++;
+	if(length == 16)
+		return -1;
+	int slot = (code >> (16-length)) - huffman->firstcode[length] + huffman->firstsymbol[length];
+	if(slot >= 288 || huffman->size[slot] != length)
+		return -1;
+	stream->bits >>= length;
+	stream->numbits -= length;
+	return huffman->value[slot];
+}
+
+// Decodes the symbols of a compressed block up to its end of block code.
+static bool inflateCodes(InflateStream *stream, const InflateHuffman *lengths, const InflateHuffman *distances)
+{
+	for(;;)
+	{
+		int symbol = decodeSymbol(stream, lengths);
+		if(symbol < 0)
+			return false;
+		if(symbol < 256)
+		{
+			if(stream->out >= stream->outend)
+				return false;
+			*stream->out++ = (unsigned char) symbol;
+		}
+		else if(symbol == 256)
+		{
+			return true;
+		}
+		else
+		{
+			symbol -= 257;
+			if(symbol >= 29)
+				return false;
+			int length = inflateLengthBase[symbol] + getBits(stream, inflateLengthExtra[symbol]);
+			symbol = decodeSymbol(stream, distances);
+			if(symbol < 0 || symbol >= 30)
+				return false;
+			int distance = inflateDistanceBase[symbol] + getBits(stream, inflateDistanceExtra[symbol]);
+			if(distance > stream->out - stream->outstart || length > stream->outend - stream->out)
+				return false;
+			const unsigned char *from = stream->out - distance;
+			while(length--)
+				*stream->out++ = *from++;
+		}
+	}
+}
+
+// Reads the code lengths of a block with dynamic Huffman codes.
+static bool readDynamicHuffman(InflateStream *stream, InflateHuffman *lengths, InflateHuffman *distances)
+{
+	static const unsigned char order[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+	unsigned char codelengths[19];
+	unsigned char sizes[288+32];
+	InflateHuffman codes;
+
+	int numlengths = getBits(stream, 5) + 257;
+	int numdistances = getBits(stream, 5) + 1;
+	int numcodes = getBits(stream, 4) + 4;
+	memset(codelengths, 0, sizeof(codelengths));
+	for(int i=0; i<numcodes; i++)
+		codelengths[order[i]] = (unsigned char) getBits(stream, 3);
+	if(!buildHuffman(&codes, codelengths, 19))
+		return false;
+
+	int n = 0;
+	while(n < numlengths+numdistances)
+	{
+		int symbol = decodeSymbol(stream, &codes);
+		if(symbol < 0 || symbol > 18)
+			return false;
+		if(symbol < 16)
+		{
+			sizes[n++] = (unsigned char) symbol;
+		}
+		else
+		{
+			int fill = 0;
+			int repeat;
+			if(symbol == 16)
+			{
+				if(n == 0)
+					return false;
+				fill = sizes[n-1];
+				repeat = 3 + getBits(stream, 2);
+			}
+			else if(symbol == 17)
+				repeat = 3 + getBits(stream, 3);
+			else
+				repeat = 11 + getBits(stream, 7);
+			if(n+repeat > numlengths+numdistances)
+				return false;
+			memset(&sizes[n], fill, repeat);
+			n += repeat;
+		}
+	}
+	return buildHuffman(lengths, sizes, numlengths) && buildHuffman(distances, &sizes[numlengths], numdistances);
+}
+
+// Inflates a zlib stream into exactly outlength bytes. The checksums are not verified.
+static bool inflateZlib(const unsigned char *in, int inlength, unsigned char *out, int outlength)
+{
+	InflateStream stream;
+	InflateHuffman lengths;
+	InflateHuffman distances;
+
+	if(inlength < 2 || (in[0]&15) != 8 || (in[0]*256+in[1]) % 31 != 0 || (in[1]&32))
+		return false;
+	stream.in = in;
+	stream.pos = 2;
+	stream.length = inlength;
+	stream.bits = 0;
+	stream.numbits = 0;
+	stream.out = out;
+	stream.outstart = out;
+	stream.outend = out+outlength;
+
+	bool last = false;
+	while(!last)
+	{
+		last = (getBits(&stream, 1) != 0);
+		int type = getBits(&stream, 2);
+		if(type == 0)
+		{
+			// stored block, starts at the next byte
+			getBits(&stream, stream.numbits & 7);
+			int length = getBits(&stream, 16);
+			int nlength = getBits(&stream, 16);
+			if(length != (~nlength & 0xffff) || length > stream.outend - stream.out)
+				return false;
+			while(length--)
+				*stream.out++ = (unsigned char) getBits(&stream, 8);
+		}
+		else if(type == 1)
+		{
+			unsigned char sizes[288];
+			memset(&sizes[0], 8, 144);
+			memset(&sizes[144], 9, 112);
+			memset(&sizes[256], 7, 24);
+			memset(&sizes[280], 8, 8);
+			buildHuffman(&lengths, sizes, 288);
+			memset(sizes, 5, 30);
+			buildHuffman(&distances, sizes, 30);
+			if(!inflateCodes(&stream, &lengths, &distances))
+				return false;
+		}
+		else if(type == 2)
+		{
+			if(!readDynamicHuffman(&stream, &lengths, &distances) || !inflateCodes(&stream, &lengths, &distances))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return stream.out == stream.outend && stream.pos - stream.numbits/8 <= stream.length;
+}
+
+// Reads a 32-bit big endian value, as PNG stores them.
+static unsigned int readBigEndian32(const unsigned char *data)
+{
+	return ((unsigned int) data[0]<<24) | (data[1]<<16) | (data[2]<<8) | data[3];
+}
+
+// Returns the sample with the given index of a PNG row with 1, 2, 4, 8 or 16 bits per sample.
+static int readPNGSample(const unsigned char *row, int index, int bitdepth)
+{
+	if(bitdepth == 8)
+		return row[index];
+	if(bitdepth == 16)
+		return (row[2*index]<<8) | row[2*index+1];
+	int bit = index*bitdepth;
+	return (row[bit>>3] >> (8-bitdepth-(bit&7))) & ((1<<bitdepth)-1);
+}
+
+// Undoes the PNG filters of the rows of one (interlace) pass in place.
+static bool unfilterPNG(unsigned char *data, int rowbytes, int rows, int pixelbytes)
+{
+	unsigned char *prev = NULL;
+	for(int y=0; y<rows; y++)
+	{
+		int filter = data[0];
+		unsigned char *row = data+1;
+		for(int i=0; i<rowbytes; i++)
+		{
+			int a = (i >= pixelbytes) ? row[i-pixelbytes] : 0;
+			int b = prev ? prev[i] : 0;
+			int c = (prev && i >= pixelbytes) ? prev[i-pixelbytes] : 0;
+			switch(filter)
+			{
+			case 0:
+				break;
+			case 1:
+				row[i] = (unsigned char) (row[i]+a);
+				break;
+			case 2:
+				row[i] = (unsigned char) (row[i]+b);
+				break;
+			case 3:
+				row[i] = (unsigned char) (row[i]+((a+b)>>1));
+				break;
+			case 4:
+				{
+					int p = a+b-c;
+					int pa = abs(p-a);
+					int pb = abs(p-b);
+					int pc = abs(p-c);
+					row[i] = (unsigned char) (row[i]+((pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c));
+				}
+				break;
+			default:
+				return false;
+			}
+		}
+		prev = row;
+		data += rowbytes+1;
+	}
+	return true;
+}
+
+// Stores an RGBA pixel with 16 bits per channel with targetbitrate bits per channel,
+// 16-bit channels are big endian like in .ppm files.
+static void storeRGBA16(unsigned char *pixel, const int *rgba, int targetbitrate)
+{
+	for(int c=0; c<4; c++)
+	{
+		if(targetbitrate == 16)
+		{
+			pixel[2*c] = (unsigned char) (rgba[c]>>8);
+			pixel[2*c+1] = (unsigned char) rgba[c];
+		}
+		else
+		{
+			pixel[c] = (unsigned char) (rgba[c]>>8);
+		}
+	}
+}
+
+// Decodes a PNG file in memory into RGBA pixels.
+static bool decodePNG(const unsigned char *file, int size, int &width, int &height, unsigned char *&pixels, int targetbitrate)
+{
+	static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+	static const int passx[7] = {0, 4, 0, 2, 0, 1, 0};
+	static const int passy[7] = {0, 0, 4, 0, 2, 0, 1};
+	static const int passdx[7] = {8, 8, 4, 4, 2, 2, 1};
+	static const int passdy[7] = {8, 8, 8, 4, 4, 2, 2};
+	unsigned char palette[256*4];
+	int palettesize = 0;
+	int key[3] = {-1, -1, -1};
+	unsigned char *idat = NULL;
+	int idatsize = 0;
+	int bitdepth = 0;
+	int colortype = -1;
+	int interlace = 0;
+
+	if(size < 8 || memcmp(file, signature, 8) != 0)
+		return false;
+	for(int i=0; i<256; i++)
+	{
+		palette[4*i] = palette[4*i+1] = palette[4*i+2] = 0;
+		palette[4*i+3] = 255;
+	}
+
+	width = height = 0;
+	int pos = 8;
+	while(pos+12 <= size)
+	{
+		unsigned int length = readBigEndian32(&file[pos]);
+		const unsigned char *type = &file[pos+4];
+		const unsigned char *data = &file[pos+8];
+		if(length > (unsigned int) (size-pos-12))
+			break;
+		if(!memcmp(type, "IHDR", 4) && length >= 13)
+		{
+			unsigned int w = readBigEndian32(data);
+			unsigned int h = readBigEndian32(data+4);
+			if(w == 0 || h == 0 || w > (1<<16) || h > (1<<16) || w > (1u<<26)/h || data[10] != 0 || data[11] != 0 || data[12] > 1)
+				break;
+			width = w;
+			height = h;
+			bitdepth = data[8];
+			colortype = data[9];
+			interlace = data[12];
+		}
+		else if(!memcmp(type, "PLTE", 4) && length%3 == 0 && length <= 3*256)
+		{
+			palettesize = length/3;
+			for(int i=0; i<palettesize; i++)
+				memcpy(&palette[4*i], &data[3*i], 3);
+		}
+		else if(!memcmp(type, "tRNS", 4))
+		{
+			if(colortype == 3)
+			{
+				for(unsigned int i=0; i<length && i<256; i++)
+					palette[4*i+3] = data[i];
+			}
+			else if(colortype == 0 && length >= 2)
+			{
+				key[0] = key[1] = key[2] = (data[0]<<8) | data[1];
+			}
+			else if(colortype == 2 && length >= 6)
+			{
+				for(int c=0; c<3; c++)
+					key[c] = (data[2*c]<<8) | data[2*c+1];
+			}
+		}
+		else if(!memcmp(type, "IDAT", 4))
+		{
+			unsigned char *grown = (unsigned char*) realloc(idat, idatsize+length);
+			if(!grown)
+				break;
+			idat = grown;
+			memcpy(&idat[idatsize], data, length);
+			idatsize += length;
+		}
+		else if(!memcmp(type, "IEND", 4))
+		{
+			break;
+		}
+		pos += 12+length;
+	}
+
+	int channels = 0;
+	switch(colortype)
+	{
+	case 0: channels = (bitdepth == 1 || bitdepth == 2 || bitdepth == 4 || bitdepth == 8 || bitdepth == 16) ? 1 : 0; break;
+	case 2: channels = (bitdepth == 8 || bitdepth == 16) ? 3 : 0; break;
+	case 3: channels = (bitdepth == 1 || bitdepth == 2 || bitdepth == 4 || bitdepth == 8) ? 1 : 0; break;
+	case 4: channels = (bitdepth == 8 || bitdepth == 16) ? 2 : 0; break;
+	case 6: channels = (bitdepth == 8 || bitdepth == 16) ? 4 : 0; break;
+	}
+	if(width == 0 || channels == 0 || (colortype == 3 && palettesize == 0) || !idat)
+	{
+		free(idat);
+		return false;
+	}
+
+	// the filtered rows of all passes, each with its filter byte
+	int numpasses = interlace ? 7 : 1;
+	int passwidth[7], passheight[7];
+	int rawsize = 0;
+	for(int p=0; p<numpasses; p++)
+	{
+		int dx = interlace ? passdx[p] : 1;
+		int dy = interlace ? passdy[p] : 1;
+		int x0 = interlace ? passx[p] : 0;
+		int y0 = interlace ? passy[p] : 0;
+		passwidth[p] = (width > x0) ? (width-x0+dx-1)/dx : 0;
+		passheight[p] = (height > y0) ? (height-y0+dy-1)/dy : 0;
+		if(passwidth[p] && passheight[p])
+			rawsize += passheight[p]*((passwidth[p]*channels*bitdepth+7)/8+1);
+	}
+	unsigned char *raw = (unsigned char*) malloc(rawsize);
+	pixels = (unsigned char*) malloc(width*height*4*targetbitrate/8);
+	bool ok = raw && pixels && inflateZlib(idat, idatsize, raw, rawsize);
+	free(idat);
+
+	unsigned char *passdata = raw;
+	for(int p=0; ok && p<numpasses; p++)
+	{
+		if(!passwidth[p] || !passheight[p])
+			continue;
+		int rowbytes = (passwidth[p]*channels*bitdepth+7)/8;
+		ok = unfilterPNG(passdata, rowbytes, passheight[p], (channels*bitdepth+7)/8);
+		for(int y=0; ok && y<passheight[p]; y++)
+		{
+			const unsigned char *row = &passdata[y*(rowbytes+1)+1];
+			int yy = interlace ? passy[p]+y*passdy[p] : y;
+			for(int x=0; x<passwidth[p]; x++)
+			{
+				int xx = interlace ? passx[p]+x*passdx[p] : x;
+				int samples[4];
+				int rgba[4];
+				for(int c=0; c<channels; c++)
+					samples[c] = readPNGSample(row, x*channels+c, bitdepth);
+				if(colortype == 3)
+				{
+					if(samples[0] >= palettesize)
+					{
+						ok = false;
+						break;
+					}
+					for(int c=0; c<4; c++)
+						rgba[c] = palette[4*samples[0]+c]*257;
+				}
+				else
+				{
+					// scale to 16 bits, 8-bit samples are replicated to 16 bits like in fReadPPM
+					int scale = 65535/((1<<bitdepth)-1);
+					bool transparent = (colortype == 0 && samples[0] == key[0]) ||
+						(colortype == 2 && samples[0] == key[0] && samples[1] == key[1] && samples[2] == key[2]);
+					if(channels < 3)
+					{
+						rgba[0] = rgba[1] = rgba[2] = samples[0]*scale;
+						rgba[3] = (channels == 2) ? samples[1]*scale : 65535;
+					}
+					else
+					{
+						for(int c=0; c<channels; c++)
+							rgba[c] = samples[c]*scale;
+						if(channels == 3)
+							rgba[3] = 65535;
+					}
+					if(transparent)
+						rgba[3] = 0;
+				}
+				storeRGBA16(&pixels[(yy*width+xx)*4*targetbitrate/8], rgba, targetbitrate);
+			}
+		}
+		passdata += passheight[p]*(rowbytes+1);
+	}
+	free(raw);
+	if(!ok)
+	{
+		free(pixels);
+		pixels = NULL;
+	}
+	return ok;
+}
+
+// fReadPNG
+//
+// reads a .png file of any color type, bit depth and interlacing and returns it in pixels
+// as RGBA with targetbitrate (8 or 16) bits per channel. Gray images are spread to RGB and
+// images without alpha channel get opaque alpha, except for colors made transparent by tRNS.
+bool fReadPNG(char *filename, int &width, int &height, unsigned char *&pixels, int targetbitrate)
+{
+	int size;
+	unsigned char *file = readFileBytes(filename, size);
+	if(!file)
+	{
+		printf("Error: could not open %s.\n", filename);
+		return false;
+	}
+	bool ok = decodePNG(file, size, width, height, pixels, targetbitrate);
+	if(!ok)
+		printf("Error: could not decode the .png file %s.\n", filename);
+	free(file);
+	return ok;
+}
+
+// Expands a TGA pixel or color map entry of 8 (gray), 15, 16, 24 or 32 bits to RGBA.
+static void readTGAColor(const unsigned char *data, int bits, bool hasalpha, unsigned char *rgba)
+{
+	if(bits == 8)
+	{
+		rgba[0] = rgba[1] = rgba[2] = data[0];
+		rgba[3] = 255;
+	}
+	else if(bits == 15 || bits == 16)
+	{
+		int value = data[0] | (data[1]<<8);
+		int r = (value>>10) & 31;
+		int g = (value>>5) & 31;
+		int b = value & 31;
+		rgba[0] = (unsigned char) ((r<<3) | (r>>2));
+		rgba[1] = (unsigned char) ((g<<3) | (g>>2));
+		rgba[2] = (unsigned char) ((b<<3) | (b>>2));
+		rgba[3] = (bits == 16 && hasalpha && !(value & 0x8000)) ? 0 : 255;
+	}
+	else
+	{
+		rgba[0] = data[2];
+		rgba[1] = data[1];
+		rgba[2] = data[0];
+		rgba[3] = (bits == 32) ? data[3] : 255;
+	}
+}
+
+// fReadTGA
+//
+// reads an uncompressed or RLE compressed true color, gray or color mapped .tga file
+// and returns it in pixels as RGBA with targetbitrate (8 or 16) bits per channel.
+bool fReadTGA(char *filename, int &width, int &height, unsigned char *&pixels, int targetbitrate)
+{
+	int size;
+	unsigned char *file = readFileBytes(filename, size);
+	if(!file)
+	{
+		printf("Error: could not open %s.\n", filename);
+		return false;
+	}
+
+	bool ok = (size >= 18);
+	int cmaptype = ok ? file[1] : 0;
+	int type = ok ? file[2] : 0;
+	int cmapfirst = ok ? file[3] | (file[4]<<8) : 0;
+	int cmaplength = ok ? file[5] | (file[6]<<8) : 0;
+	int cmapbits = ok ? file[7] : 0;
+	width = ok ? file[12] | (file[13]<<8) : 0;
+	height = ok ? file[14] | (file[15]<<8) : 0;
+	int bits = ok ? file[16] : 0;
+	int descriptor = ok ? file[17] : 0;
+	bool hasalpha = (descriptor & 15) != 0;
+	bool rle = (type >= 9);
+	int basetype = rle ? type-8 : type;
+
+	if(basetype == 1)
+		ok = ok && cmaptype == 1 && bits == 8 && (cmapbits == 15 || cmapbits == 16 || cmapbits == 24 || cmapbits == 32);
+	else if(basetype == 2)
+		ok = ok && (bits == 15 || bits == 16 || bits == 24 || bits == 32);
+	else if(basetype == 3)
+		ok = ok && bits == 8;
+	else
+		ok = false;
+	ok = ok && width > 0 && height > 0;
+
+	int pos = 18 + (ok ? file[0] : 0);
+	const unsigned char *cmap = &file[pos < size ? pos : 0];
+	int cmapbytes = (cmapbits+7)/8;
+	if(cmaptype == 1)
+		pos += cmaplength*cmapbytes;
+	ok = ok && pos <= size;
+
+	// the pixels as stored in the file, after RLE decoding
+	int pixelbytes = (bits+7)/8;
+	int numpixels = width*height;
+	unsigned char *stored = ok ? (unsigned char*) malloc(numpixels*pixelbytes) : NULL;
+	ok = ok && stored;
+	if(ok && rle)
+	{
+		int count = 0;
+		while(ok && count < numpixels)
+		{
+			if(pos >= size)
+			{
+				ok = false;
+				break;
+			}
+			int header = file[pos++];
+			int n = (header & 127) + 1;
+			int packetbytes = (header & 128) ? pixelbytes : n*pixelbytes;
+			if(count+n > numpixels || pos+packetbytes > size)
+			{
+				ok = false;
+				break;
+			}
+			for(int i=0; i<n; i++)
+				memcpy(&stored[(count+i)*pixelbytes], &file[(header & 128) ? pos : pos+i*pixelbytes], pixelbytes);
+			pos += packetbytes;
+			count += n;
+		}
+	}
+	else if(ok)
+	{
+		ok = (pos+numpixels*pixelbytes <= size);
+		if(ok)
+			memcpy(stored, &file[pos], numpixels*pixelbytes);
+	}
+
+	pixels = ok ? (unsigned char*) malloc(numpixels*4*targetbitrate/8) : NULL;
+	ok = ok && pixels;
+	for(int i=0; ok && i<numpixels; i++)
+	{
+		// rows are stored from the bottom unless bit 5 of the descriptor is set
+		int x = i % width;
+		int y = i / width;
+		if(descriptor & 0x10)
+			x = width-1-x;
+		if(!(descriptor & 0x20))
+			y = height-1-y;
+		unsigned char rgba[4];
+		if(basetype == 1)
+		{
+			int index = stored[i] - cmapfirst;
+			if(index < 0 || index >= cmaplength)
+			{
+				ok = false;
+				break;
+			}
+			readTGAColor(&cmap[index*cmapbytes], cmapbits, hasalpha, rgba);
+		}
+		else
+		{
+			readTGAColor(&stored[i*pixelbytes], bits, hasalpha, rgba);
+		}
+		unsigned char *pixel = &pixels[(y*width+x)*4*targetbitrate/8];
+		for(int c=0; c<4; c++)
+		{
+			if(targetbitrate == 16)
+			{
+				pixel[2*c] = rgba[c];
+				pixel[2*c+1] = rgba[c];
+			}
+			else
+			{
+				pixel[c] = rgba[c];
+			}
+		}
+	}
+
+	free(stored);
+	free(file);
+	if(!ok)
+	{
+		free(pixels);
+		pixels = NULL;
+		printf("Error: could not decode the .tga file %s.\n", filename);
+	}
+	return ok;
+}
@@ -58,6 +58,9 @@ bool fWritePGM(char *filename, int width, int height, unsigned char *pixels,bool
 int fReadPGM(char *filename, int &width, int &height, unsigned char *&pixels, int wantedBitDepth);
 // write a TGA image with both RGB and alpha
 bool fWriteTGAfromRGBandA(char *filename, int width, int height, unsigned char *pixelsRGB, unsigned char *pixelsA, bool reverse_y);
+// read a PNG or TGA image as RGBA with 8 or 16 bits per channel
+bool fReadPNG(char *filename, int &width, int &height, unsigned char *&pixels, int targetbitrate);
+bool fReadTGA(char *filename, int &width, int &height, unsigned char *&pixels, int targetbitrate);
 
 #endif
 
@@ -4,6 +4,7 @@ import shutil
 import struct
 import sys
 
+import lz4.block
 import lz4.frame
 import zlib
 
@@ -12,29 +13,109 @@ from PIL import ImageOps
 import inspect
 
 '''
-Format | C Type | Python Type | Standard Size
-l      | long   | integer     | 4 bytes
+The package is written in version 2 of the format, see Application/src/plugin/src/texturepackage.h.
+Every value is packed little endian with a fixed size ("<"), native "l" is 8 bytes on Linux.
+
+Format | C Type   | Standard Size
+H      | uint16_t | 2 bytes
+I      | uint32_t | 4 bytes
+Q      | uint64_t | 8 bytes
 '''
-CONST_LONG_BYTES = 4
+CONST_PACKAGE_MAGIC = b"SFPK"
+CONST_PACKAGE_VERSION = 2
+CONST_HEADER_BYTES = 80
+# Packages with several tracks append the track count and the track table offset to the header.
+CONST_TRACK_HEADER_BYTES = 96
+CONST_TRACK_ENTRY_BYTES = 16
+CONST_INDEX_ENTRY_BYTES = 32
 CONST_PKM_HEADER_BYTES = 16
 
+CONST_FRAME_FLAG_KEY = 0x1
+CONST_FRAME_FLAG_DUPLICATE = 0x4
+CONST_FRAME_FLAG_STRIPED = 0x8
+CONST_FRAME_FLAG_PLANAR = 0x10
+CONST_FRAME_FLAG_TRIMMED = 0x20
+
 
 '''
 WARNING: Check the Kanzi documentation for "GraphicsFormat" when port this script to other versions of Kanzi.
 '''
 # textureFormat: GraphicsFormatETC2_R8G8B8A8_UNORM = 34 (Kanzi 3.6.5)
+# The ETC2 RGB8 and RGB8A1 formats precede it: GraphicsFormatETC2_R8G8B8_UNORM = 30,
+# GraphicsFormatETC2_R8G8B8A1_UNORM = 32 (Kanzi 3.6.5)
 
+GraphicsFormatETC2_R8G8B8_UNORM = 30
+GraphicsFormatETC2_R8G8B8A1_UNORM = 32
 GraphicsFormatETC2_R8G8B8A8_UNORM = 34
 
+texturePackageHeader = {"textureNumber": 480, "textureWidth": 960, "textureHeight": 540, "textureFormat": 34, "compressionAlgorithm": 1}
+
+'''
+"none" stores the ETC2 blocks as they are, every frame starts on a page boundary so that the plugin
+can upload it straight from the mapped package. It is only packed when requested on the command line.
+'''
+CONST_PAGE_BYTES = 4096
+
+'''
+"lz4block" stores every frame as one raw LZ4 block without the frame header and checksums of "lz4",
+the decoded size of the frame is in the package index. It is only packed when requested on the command line.
+'''
+
+'''
+"zstd" compresses every frame with a dictionary trained on frames of the sequence, the dictionary is stored
+once in the package. It needs the zstandard module and a plugin built with SEQUENCEFRAMEPLUGIN_ZSTD, it is only
+packed when requested on the command line.
+'''
+CONST_ZSTD_LEVEL = 19
+CONST_ZSTD_DICTIONARY_BYTES = 112640
+# Frames sampled for the training, spread over the sequence.
+CONST_ZSTD_TRAINING_FRAMES = 64
+zstdDictionarySuffix = ".zstdict"
+
+compressionTable = { "lz4":      {"enum": 1, "suffix": ".lz4",  "alignment": 1},
+                     "zlib":     {"enum": 2, "suffix": ".zlib", "alignment": 1},
+                     "none":     {"enum": 0, "suffix": ".raw",  "alignment": CONST_PAGE_BYTES},
+                     "lz4block": {"enum": 3, "suffix": ".lz4b", "alignment": 1},
+                     "zstd":     {"enum": 4, "suffix": ".zst",  "alignment": 1} }
+compressionList = [ compressionTable["lz4"], compressionTable["zlib"] ]
+
+'''
+Compressed frames can be split into stripes, row bands of 4x4 blocks that are compressed one by one so that
+the plugin decodes them on several threads. A stripe count of 1 packs every frame as one piece.
+'''
+stripeCount = 1
+
 '''
-WARNING: The maximum value of dataOffset (long) in the C++ program should be larger than the package size.
+Compressed frames can store the 8 byte alpha halves of the ETC2 RGBA8 blocks before the 8 byte color halves
+instead of interleaving them, the compressor finds longer matches in the alpha plane, most of all in sequences
+with constant alpha. The plugin interleaves the planes again after decoding.
 '''
-texturePackageHeader = {"sizeOffset": 0, "dataOffset": 0, "textureNumber": 480, "textureWidth": 960, "textureHeight": 540, "textureFormat": 34, "compressionAlgorithm": 1}
-texturePackageHeader["sizeOffset"] = CONST_LONG_BYTES * len(texturePackageHeader)
-texturePackageHeader["dataOffset"] = texturePackageHeader["sizeOffset"] + CONST_LONG_BYTES * texturePackageHeader["textureNumber"]
+planarFrames = False
 
-compressionList = [ {"enum": 1, "suffix": ".lz4" },
-                    {"enum": 2, "suffix": ".zlib"} ]
+'''
+The texture format follows the alpha of the sequence: RGB8 when every pixel is opaque, RGB8A1 when every pixel is
+either opaque or transparent, RGBA8 otherwise. RGB8 and RGB8A1 blocks are 8 bytes, half of an RGBA8 block, which
+halves the texture memory, the decoding and the upload. The plugin uses the format of the package header.
+'''
+textureFormatTable = { "RGBA8": {"etcpack": "RGBA8", "suffix": "_ETC2_RGBA8", "graphicsFormat": GraphicsFormatETC2_R8G8B8A8_UNORM, "blockBytes": 16},
+                       "RGBA1": {"etcpack": "RGBA1", "suffix": "_ETC2_RGBA1", "graphicsFormat": GraphicsFormatETC2_R8G8B8A1_UNORM, "blockBytes": 8},
+                       "RGB":   {"etcpack": "RGB",   "suffix": "_ETC2_RGB",   "graphicsFormat": GraphicsFormatETC2_R8G8B8_UNORM,   "blockBytes": 8} }
+textureFormat = textureFormatTable["RGBA8"]
+
+'''
+Compressed frames with alpha keep only the blocks of the rectangle around their non-transparent pixels, in 4x4
+blocks. The index records the rectangle, the plugin decodes it and clears the rest of the texture, so the decoding
+follows the visible area. The rectangle of every frame is kept in a *.trim file until the package is written.
+'''
+trimSuffix = ".trim"
+
+'''
+A package can hold the sequence in several resolutions, the tracks, like the mip levels of a texture. Track 0 has the
+size of the package, every further track divides it by one of the divisors on the command line, "2,4" adds the half
+and the quarter size. The plugin decodes the smallest track that still covers the size of the node on the screen.
+The files of a track carry its suffix after the image name.
+'''
+trackList = [ {"suffix": "", "width": texturePackageHeader["textureWidth"], "height": texturePackageHeader["textureHeight"]} ]
 
 formattedDirectoryName = "texture_{0:06d}"
 formattedImageName = "frame_{0:06d}"
@@ -44,12 +125,36 @@ imageEndIndex = imageStartIndex + texturePackageHeader["textureNumber"]
 
 intermediateSuffix = ".tga"
 
+def alignOffset(offset, alignment):
+    return (offset + alignment - 1) // alignment * alignment
+
 def log(msg):
     frame = inspect.currentframe().f_back
     func_name = frame.f_code.co_name
     line_no = frame.f_lineno
     print(f'{func_name}()::{line_no}| {msg}')
 
+'''
+TO choose the texture format from the alpha of all images
+- stops at the first image with translucent pixels
+'''
+def detectTextureFormat(startIndex, endIndex):
+    print("============================================== Detect texture format.\n")
+    isOpaque = True
+
+    for i in range(startIndex, endIndex):
+        with Image.open(formattedImageName.format(i) + imageSuffix, "r") as im:
+            if (im.mode in ("RGB", "L") and "transparency" not in im.info):
+                continue
+            histogram = im.convert("RGBA").getchannel("A").histogram()
+        if (any(histogram[1:255])):
+            log(f'{formattedImageName.format(i)} is translucent')
+            return textureFormatTable["RGBA8"]
+        if (0 != histogram[0]):
+            isOpaque = False
+
+    return textureFormatTable["RGB"] if isOpaque else textureFormatTable["RGBA1"]
+
 """
 TO seperate images and tools to folders
 in: images
@@ -84,7 +189,7 @@ out: every compressed image in *pkm format
 - before compressing in pkm, images compressed in *.tga with Pillow (PIL)
 - then images compressed in *.pkm with ETCPACK
 '''
-def createTextures(startIndex, endIndex, dirName, width, height):
+def createTextures(startIndex, endIndex, dirName, trackList, textureFormat):
     print("================================================ Create textures.\n")
     os.chdir(dirName)
     log(os.getcwd())
@@ -92,101 +197,284 @@ def createTextures(startIndex, endIndex, dirName, width, height):
     for i in range(startIndex, endIndex):
         imageName = formattedImageName.format(i)
         log(f'imageName = {imageName + imageSuffix}')
-        with Image.open(imageName + imageSuffix, "r") as im:
-            try:
-                im = im.resize((width, height))
-                im = ImageOps.flip(im)
-                im.save(imageName + intermediateSuffix)
-                log(f"Resize & FLip {imageName} and save as {imageName + intermediateSuffix} SUCCESS")
-            except Exception as e:
-                log(f"Resize & FLip {imageName} and save as {imageName + intermediateSuffix} FAILED: {e}")
-        os.system(f"etcpack -c etc2 -f RGBA8 {imageName + intermediateSuffix} {imageName}_ETC2_RGBA8.pkm -v on")
-        log(f"etcpack -c etc2 -f RGBA8 {imageName + intermediateSuffix} {imageName}_ETC2_RGBA8.pkm -v on")
+        for track in trackList:
+            trackName = imageName + track["suffix"]
+            with Image.open(imageName + imageSuffix, "r") as im:
+                try:
+                    im = im.resize((track["width"], track["height"]))
+                    im = ImageOps.flip(im)
+                    im.save(trackName + intermediateSuffix)
+                    log(f"Resize & FLip {imageName} and save as {trackName + intermediateSuffix} SUCCESS")
+                except Exception as e:
+                    log(f"Resize & FLip {imageName} and save as {trackName + intermediateSuffix} FAILED: {e}")
+            command = f"etcpack -c etc2 -f {textureFormat['etcpack']} {trackName + intermediateSuffix} {trackName}{textureFormat['suffix']}.pkm -v on"
+            os.system(command)
+            log(command)
 
     os.chdir("..")
     print("createTextures done ++++++++++++++++++++++++++++++++++++ " + dirName)
 
+def deinterleavePlanes(textureFile):
+    alphaPlane = b"".join(textureFile[i : i + 8] for i in range(0, len(textureFile), 16))
+    colorPlane = b"".join(textureFile[i + 8 : i + 16] for i in range(0, len(textureFile), 16))
+    return alphaPlane + colorPlane
+
+def compressFrame(textureFile, compression, zstdCompressor, planar):
+    if (planar):
+        textureFile = deinterleavePlanes(textureFile)
+
+    if (compression["suffix"] == ".lz4"):
+        return lz4.frame.compress(textureFile, compression_level = lz4.frame.COMPRESSIONLEVEL_MAX)
+    elif (compression["suffix"] == ".lz4b"):
+        return lz4.block.compress(textureFile, mode = "high_compression", compression = 12, store_size = False)
+    elif (compression["suffix"] == ".zst"):
+        return zstdCompressor.compress(textureFile)
+    elif (compression["suffix"] == ".zlib"):
+        return zlib.compress(textureFile)
+    return textureFile
+
+'''
+TO split a frame into stripes of whole 4x4 block rows and compress them one by one
+- the payload starts with the stripe count, then the compressed and decoded size of every stripe
+'''
+def compressStripes(textureFile, compression, zstdCompressor, stripeCount, blockWidth, planar, blockBytes):
+    rowBytes = blockWidth * blockBytes
+    blockRows = len(textureFile) // rowBytes
+    stripeRows = (blockRows + stripeCount - 1) // stripeCount
+
+    stripes = []
+    for row in range(0, blockRows, stripeRows):
+        stripe = textureFile[row * rowBytes : (row + stripeRows) * rowBytes]
+        stripes.append((compressFrame(stripe, compression, zstdCompressor, planar), len(stripe)))
+
+    payload = struct.pack("<I", len(stripes))
+    for (stripe, decodedSize) in stripes:
+        payload += struct.pack("<II", len(stripe), decodedSize)
+    return payload + b"".join(stripe for (stripe, decodedSize) in stripes)
+
 '''
 TO compress every *.pkm to *.lz4 and *.zlib
 in: pkm
 out: lz4
 - use lib lz4 to compress 
+- compressed frames keep the blocks of their trim rectangle only
 '''
-def compressTextures(startIndex, endIndex, dirName):
+def findTrimRect(imageName, width, height, textureFormat):
+    blockWidth = (width + 3) // 4
+    blockHeight = (height + 3) // 4
+    if (textureFormat is textureFormatTable["RGB"]):
+        return (0, 0, blockWidth, blockHeight)
+
+    # The intermediate image is resized and flipped like the texture.
+    with Image.open(imageName + intermediateSuffix, "r") as im:
+        box = im.convert("RGBA").getchannel("A").getbbox()
+    if (box is None):
+        return (0, 0, 1, 1) # Nothing is visible, keep one transparent block.
+
+    (left, top, right, bottom) = box
+    return (left // 4, top // 4, (right + 3) // 4 - left // 4, (bottom + 3) // 4 - top // 4)
+
+def trimTexture(textureFile, trimRect, blockWidth, blockBytes):
+    (x, y, w, h) = trimRect
+    return b"".join(textureFile[((row * blockWidth) + x) * blockBytes : ((row * blockWidth) + x + w) * blockBytes]
+                    for row in range(y, y + h))
+
+def compressTextures(startIndex, endIndex, dirName, compressionList, stripeCount, trackList, planarFrames, textureFormat):
     print("============================================== Compress textures.\n")
     os.chdir(dirName)
 
+    zstdCompressor = None
+    if compressionTable["zstd"] in compressionList:
+        import zstandard
+        dictionary = None
+        dictionaryName = os.path.join("..", textureFormat["suffix"] + zstdDictionarySuffix)
+        if os.path.exists(dictionaryName):
+            with open(dictionaryName, "rb") as dictionaryFile:
+                dictionary = zstandard.ZstdCompressionDict(dictionaryFile.read())
+        # The plugin knows the frame size from the index, the frame header does not need it.
+        zstdCompressor = zstandard.ZstdCompressor(level = CONST_ZSTD_LEVEL, dict_data = dictionary,
+                                                  write_content_size = False, write_dict_id = False)
+
     for i in range(startIndex, endIndex):
-        imageName = formattedImageName.format(i)
+        for track in trackList:
+            trackName = formattedImageName.format(i) + track["suffix"]
+            blockWidth = (track["width"] + 3) // 4
 
-        with open(imageName + "_ETC2_RGBA8.pkm", "rb") as inFile:
-            inFile.seek(CONST_PKM_HEADER_BYTES, 0) # Discard header information.
-            textureFile = inFile.read()
+            trimRect = findTrimRect(trackName, track["width"], track["height"], textureFormat)
+            with open(trackName + textureFormat["suffix"] + trimSuffix, "wb") as outFile:
+                outFile.write(struct.pack("<HHHH", *trimRect))
 
-            for compression in compressionList:
-                textureCompressedFile = 0
-                if (compression["suffix"] == ".lz4"):
-                    textureCompressedFile = lz4.frame.compress(textureFile, compression_level = lz4.frame.COMPRESSIONLEVEL_MAX)
-                elif (compression["suffix"] == ".zlib"):
-                    textureCompressedFile = zlib.compress(textureFile)
+            with open(trackName + textureFormat["suffix"] + ".pkm", "rb") as inFile:
+                inFile.seek(CONST_PKM_HEADER_BYTES, 0) # Discard header information.
+                textureFile = inFile.read()
+            trimmedTextureFile = trimTexture(textureFile, trimRect, blockWidth, textureFormat["blockBytes"])
 
-                with open(imageName + "_ETC2_RGBA8.pkm" + compression["suffix"], "wb") as outFile:
+            for compression in compressionList:
+                planar = planarFrames and compression["suffix"] != ".raw"
+                # Uncompressed frames are uploaded from the package as they are, they keep the whole texture.
+                if (compression["suffix"] == ".raw"):
+                    textureCompressedFile = compressFrame(textureFile, compression, zstdCompressor, planar)
+                elif (stripeCount > 1):
+                    textureCompressedFile = compressStripes(trimmedTextureFile, compression, zstdCompressor, stripeCount,
+                                                            trimRect[2], planar, textureFormat["blockBytes"])
+                else:
+                    textureCompressedFile = compressFrame(trimmedTextureFile, compression, zstdCompressor, planar)
+
+                with open(trackName + textureFormat["suffix"] + ".pkm" + compression["suffix"], "wb") as outFile:
                     outFile.write(textureCompressedFile)
 
     os.chdir("..")
     print("compressTextures done ++++++++++++++++++++++++++++++++++ " + dirName)
 
 '''
-TO pack every lz4 to an final result
+TO train the zstd dictionary of the package on the ETC2 frames of all directories
+- when the training fails, the frames are compressed without a dictionary
 '''
-def packTextures(startIndex, endIndex):
-    print("================================================== Pack textures.\n")
+def trainDictionary(ranges):
+    print("============================================== Train dictionary.\n")
+    import zstandard
 
-    for compression in compressionList:
-        with open("_ETC2_RGBA8" + compression["suffix"], "wb") as outFile: # Clear the file if already exsited.
-            texturePackageHeader["textureFormat"] = GraphicsFormatETC2_R8G8B8A8_UNORM
-            texturePackageHeader["compressionAlgorithm"] = compression["enum"]
+    frames = [(dirName, i) for (startIndex, endIndex, dirName) in ranges for i in range(startIndex, endIndex)]
+    step = max(1, len(frames) // CONST_ZSTD_TRAINING_FRAMES)
 
-            for key, value in texturePackageHeader.items():
-                outFile.write(struct.pack("l", value))
+    samples = []
+    for (dirName, i) in frames[::step]:
+        with open(os.path.join(dirName, formattedImageName.format(i) + textureFormat["suffix"] + ".pkm"), "rb") as inFile:
+            inFile.seek(CONST_PKM_HEADER_BYTES, 0)
+            samples.append(inFile.read())
 
-            for i in range(startIndex, endIndex):
-                outFile.write(struct.pack("l", 0)) # Placeholders
+    try:
+        dictionary = zstandard.train_dictionary(CONST_ZSTD_DICTIONARY_BYTES, samples, level = CONST_ZSTD_LEVEL, threads = -1)
+    except zstandard.ZstdError as error:
+        log(f'no dictionary: {error}')
+        return
 
-            headerOffset = texturePackageHeader["sizeOffset"]
-            dataOffset = texturePackageHeader["dataOffset"]
+    with open(textureFormat["suffix"] + zstdDictionarySuffix, "wb") as outFile:
+        outFile.write(dictionary.as_bytes())
 
-            for i in range(startIndex, endIndex):
-                imageName = formattedImageName.format(i)
+    print("trainDictionary done ++++++++++++++++++++++++++++++++++ " + str(len(dictionary.as_bytes())))
 
-                textureName = imageName + "_ETC2_RGBA8.pkm" + compression["suffix"]
-                compressedSize = os.path.getsize(textureName)
-                
-                with open(textureName, "rb") as inFile:
-                    outFile.seek(0, 2)
-                    outFile.write(inFile.read())
-                    inFile.seek(0, 2)
-                    dataOffset += inFile.tell()
+'''
+TO pack every lz4 to an final result
+- the index follows the header, the frames follow the index
+- a frame that is the same as an earlier frame is stored once, its entry is flagged as duplicate
+- the zstd dictionary follows the index
+- a frame trimmed to less than the whole texture is flagged as trimmed, its entry holds the rectangle
+- with several tracks the track table follows the header, an index per track follows the table
+'''
+def packTextures(startIndex, endIndex):
+    print("================================================== Pack textures.\n")
 
-                outFile.seek(headerOffset, 0)
-                outFile.write(struct.pack("l", dataOffset))
-                headerOffset += CONST_LONG_BYTES
+    textureNumber = texturePackageHeader["textureNumber"]
+    zstdDictionaryName = textureFormat["suffix"] + zstdDictionarySuffix
+    trackCount = len(trackList)
+    headerBytes = CONST_TRACK_HEADER_BYTES if trackCount > 1 else CONST_HEADER_BYTES
+
+    for compression in compressionList:
+        with open(textureFormat["suffix"] + compression["suffix"], "wb") as outFile: # Clear the file if already exsited.
+            texturePackageHeader["textureFormat"] = textureFormat["graphicsFormat"]
+            texturePackageHeader["compressionAlgorithm"] = compression["enum"]
+            alignment = compression["alignment"]
+            frameFlags = CONST_FRAME_FLAG_KEY
+            if (stripeCount > 1 and compression["suffix"] != ".raw"):
+                frameFlags |= CONST_FRAME_FLAG_STRIPED
+            if (planarFrames and compression["suffix"] != ".raw"):
+                frameFlags |= CONST_FRAME_FLAG_PLANAR
+
+            dictionary = b""
+            if (compression["suffix"] == ".zst" and os.path.exists(zstdDictionaryName)):
+                with open(zstdDictionaryName, "rb") as dictionaryFile:
+                    dictionary = dictionaryFile.read()
+
+            trackTableOffset = headerBytes if trackCount > 1 else 0
+            indexOffset = headerBytes + (CONST_TRACK_ENTRY_BYTES * trackCount if trackCount > 1 else 0)
+            indexOffsets = [indexOffset + CONST_INDEX_ENTRY_BYTES * textureNumber * t for t in range(trackCount)]
+            dictionaryOffset = indexOffset + CONST_INDEX_ENTRY_BYTES * textureNumber * trackCount
+            dataOffset = alignOffset(dictionaryOffset + len(dictionary), alignment)
+
+            outFile.write(CONST_PACKAGE_MAGIC)
+            outFile.write(struct.pack("<HHIIIIIIQQIIQQII", CONST_PACKAGE_VERSION, headerBytes,
+                                      textureNumber,
+                                      texturePackageHeader["textureWidth"],
+                                      texturePackageHeader["textureHeight"],
+                                      texturePackageHeader["textureFormat"],
+                                      texturePackageHeader["compressionAlgorithm"],
+                                      alignment, indexOffset, dataOffset,
+                                      0, CONST_INDEX_ENTRY_BYTES, 0,
+                                      dictionaryOffset, len(dictionary), 0))
+            if (trackCount > 1):
+                outFile.write(struct.pack("<IIQ", trackCount, 0, trackTableOffset))
+                for (track, trackIndexOffset) in zip(trackList, indexOffsets):
+                    outFile.write(struct.pack("<IIQ", track["width"], track["height"], trackIndexOffset))
+            outFile.write(bytes(dictionaryOffset - outFile.tell())) # Index placeholders.
+            outFile.write(dictionary)
+            outFile.write(bytes(dataOffset - outFile.tell())) # Padding.
+
+            indexList = []
+            for track in trackList:
+                blockWidth = (track["width"] + 3) // 4
+                blockHeight = (track["height"] + 3) // 4
+                fullRect = (0, 0, blockWidth, blockHeight)
+
+                index = []
+                payloads = {}
+                for i in range(startIndex, endIndex):
+                    trackName = formattedImageName.format(i) + track["suffix"]
+
+                    textureName = trackName + textureFormat["suffix"] + ".pkm" + compression["suffix"]
+                    with open(textureName, "rb") as inFile:
+                        payload = inFile.read()
+
+                    trimRect = fullRect
+                    if (compression["suffix"] != ".raw"):
+                        with open(trackName + textureFormat["suffix"] + trimSuffix, "rb") as inFile:
+                            trimRect = struct.unpack("<HHHH", inFile.read())
+                    flags = frameFlags | (CONST_FRAME_FLAG_TRIMMED if trimRect != fullRect else 0)
+                    decodedSize = trimRect[2] * trimRect[3] * textureFormat["blockBytes"]
+
+                    # Trimmed frames with the same blocks are the same frame only at the same position.
+                    frameIndex = i - startIndex
+                    if (payload, trimRect) in payloads:
+                        reference = payloads[(payload, trimRect)]
+                        index.append((0, 0, decodedSize, compression["enum"], CONST_FRAME_FLAG_DUPLICATE, reference, *trimRect))
+                        continue
+                    payloads[(payload, trimRect)] = frameIndex
+
+                    index.append((dataOffset, len(payload), decodedSize, compression["enum"], flags, frameIndex, *trimRect))
+                    outFile.write(payload)
+                    dataOffset += len(payload)
+
+                    # Padding keeps the next frame aligned.
+                    paddedDataOffset = alignOffset(dataOffset, alignment)
+                    outFile.write(bytes(paddedDataOffset - dataOffset))
+                    dataOffset = paddedDataOffset
+                indexList.append(index)
+
+            for (index, trackIndexOffset) in zip(indexList, indexOffsets):
+                outFile.seek(trackIndexOffset, 0)
+                for entry in index:
+                    outFile.write(struct.pack("<QIIHHIHHHH", *entry))
 
     print("packTextures done +++++++++++++++++++++++++++++++++++++++++++++++++")
 
 '''
 TO move all *.lz4 to an parent folder
 '''
-def postprocess(startIndex, endIndex, dirName):
+def postprocess(startIndex, endIndex, dirName, compressionList, trackList, textureFormat):
     print("==================================================== Postprocess.\n")
 
     for i in range(startIndex, endIndex):
         imageName = formattedImageName.format(i)
         shutil.move(os.path.join(dirName, imageName + imageSuffix), imageName + imageSuffix)
 
-        for compression in compressionList:
-            textureName = imageName + "_ETC2_RGBA8.pkm" + compression["suffix"]
-            shutil.move(os.path.join(dirName, textureName), textureName)
+        for track in trackList:
+            trackName = imageName + track["suffix"]
+            for compression in compressionList:
+                textureName = trackName + textureFormat["suffix"] + ".pkm" + compression["suffix"]
+                shutil.move(os.path.join(dirName, textureName), textureName)
+
+            trimName = trackName + textureFormat["suffix"] + trimSuffix
+            shutil.move(os.path.join(dirName, trimName), trimName)
 
     print("postprocess done +++++++++++++++++++++++++++++++++++++++ " + dirName)
 
@@ -204,10 +492,17 @@ def cleaning(startIndex, endIndex):
         # os.mkdir(dirName)
 
         for i in range(startIndex, endIndex):
-            imageName = formattedImageName.format(i)
-            textureName = imageName + "_ETC2_RGBA8.pkm" + compression["suffix"]
-            os.remove(textureName)
-            # shutil.move(textureName, os.path.join(dirName, textureName))
+            for track in trackList:
+                textureName = formattedImageName.format(i) + track["suffix"] + textureFormat["suffix"] + ".pkm" + compression["suffix"]
+                os.remove(textureName)
+                # shutil.move(textureName, os.path.join(dirName, textureName))
+
+    for i in range(startIndex, endIndex):
+        for track in trackList:
+            os.remove(formattedImageName.format(i) + track["suffix"] + textureFormat["suffix"] + trimSuffix)
+
+    if os.path.exists(textureFormat["suffix"] + zstdDictionarySuffix):
+        os.remove(textureFormat["suffix"] + zstdDictionarySuffix)
 
     print("cleaning done +++++++++++++++++++++++++++++++++++++++++++++++++++++")
 
@@ -215,19 +510,37 @@ def cleaning(startIndex, endIndex):
 if __name__ == '__main__':
     multiprocessing.freeze_support()
     
-    if (4 == len(sys.argv)):
+    if (8 == len(sys.argv)):
+        for (i, divisor) in enumerate(sys.argv[7].split(","), 1):
+            trackList.append({"suffix": f"_T{i}", "divisor": int(divisor)})
+    if (7 <= len(sys.argv)):
+        planarFrames = (sys.argv[6] == "planar")
+    if (6 <= len(sys.argv)):
+        stripeCount = max(1, int(sys.argv[5]))
+    if (5 <= len(sys.argv)):
+        compressionList = [compressionTable[name] for name in sys.argv[4].split(",")]
+    if (4 <= len(sys.argv)):
         texturePackageHeader["textureNumber"] = int(sys.argv[1])
         texturePackageHeader["textureWidth"] = int(sys.argv[2])
         texturePackageHeader["textureHeight"] = int(sys.argv[3])
-        texturePackageHeader["sizeOffset"] = CONST_LONG_BYTES * len(texturePackageHeader)
-        texturePackageHeader["dataOffset"] = texturePackageHeader["sizeOffset"] + CONST_LONG_BYTES * texturePackageHeader["textureNumber"]
         imageEndIndex = imageStartIndex + texturePackageHeader["textureNumber"]
+    trackList[0]["width"] = texturePackageHeader["textureWidth"]
+    trackList[0]["height"] = texturePackageHeader["textureHeight"]
+    for track in trackList[1:]:
+        track["width"] = max(4, texturePackageHeader["textureWidth"] // track["divisor"])
+        track["height"] = max(4, texturePackageHeader["textureHeight"] // track["divisor"])
     print("=====textureNumber = ", texturePackageHeader["textureNumber"])
     print("=====textureWidth = ", texturePackageHeader["textureWidth"])
     print("=====textureHeight = ", texturePackageHeader["textureHeight"])
-    print("=====sizeOffset = ", texturePackageHeader["sizeOffset"])
-    print("=====dataOffset = ", texturePackageHeader["dataOffset"])
     print("=====imageEndIndex = ", imageEndIndex)
+    print("=====stripeCount = ", stripeCount)
+    print("=====tracks = ", [(track["width"], track["height"]) for track in trackList])
+
+    textureFormat = detectTextureFormat(imageStartIndex, imageEndIndex)
+    # Planes split the alpha and color halves of RGBA8 blocks, the other formats have no alpha half.
+    planarFrames = planarFrames and textureFormat is textureFormatTable["RGBA8"]
+    print("=====textureFormat = ", textureFormat["etcpack"])
+    print("=====planarFrames = ", planarFrames)
 
     directoryNumber = int(multiprocessing.cpu_count() * 10)
     workloadPerDirectory = int(texturePackageHeader["textureNumber"] / directoryNumber)
@@ -255,7 +568,7 @@ if __name__ == '__main__':
         if (i >= workloadMore):
             startIndex = imageStartIndex + i * workloadPerDirectory + workloadMore
             endIndex = imageStartIndex + (i + 1) * workloadPerDirectory  + workloadMore
-        pool.apply_async(createTextures, (startIndex, endIndex, dirName, texturePackageHeader["textureWidth"], texturePackageHeader["textureHeight"] ))        
+        pool.apply_async(createTextures, (startIndex, endIndex, dirName, trackList, textureFormat, ))        
     # i=3
     # startIndex = imageStartIndex + i * (workloadPerDirectory + 1)
     # endIndex = imageStartIndex + (i + 1) * (workloadPerDirectory + 1)
@@ -268,6 +581,18 @@ if __name__ == '__main__':
     pool.close()
     pool.join()
 
+    if compressionTable["zstd"] in compressionList:
+        ranges = []
+        for i in range(0, directoryNumber):
+            dirName = formattedDirectoryName.format(i)
+            startIndex = imageStartIndex + i * (workloadPerDirectory + 1)
+            endIndex = imageStartIndex + (i + 1) * (workloadPerDirectory + 1)
+            if (i >= workloadMore):
+                startIndex = imageStartIndex + i * workloadPerDirectory + workloadMore
+                endIndex = imageStartIndex + (i + 1) * workloadPerDirectory  + workloadMore
+            ranges.append((startIndex, endIndex, dirName))
+        trainDictionary(ranges)
+
     pool = multiprocessing.Pool()
     for i in range(0, directoryNumber):
         dirName = formattedDirectoryName.format(i)
@@ -276,7 +601,7 @@ if __name__ == '__main__':
         if (i >= workloadMore):
             startIndex = imageStartIndex + i * workloadPerDirectory + workloadMore
             endIndex = imageStartIndex + (i + 1) * workloadPerDirectory  + workloadMore
-        pool.apply_async(compressTextures, (startIndex, endIndex, dirName, ))  
+        pool.apply_async(compressTextures, (startIndex, endIndex, dirName, compressionList, stripeCount, trackList, planarFrames, textureFormat, ))  
     pool.close()
     pool.join()
 
@@ -288,7 +613,7 @@ if __name__ == '__main__':
         if (i >= workloadMore):
             startIndex = imageStartIndex + i * workloadPerDirectory + workloadMore
             endIndex = imageStartIndex + (i + 1) * workloadPerDirectory  + workloadMore
-        pool.apply_async(postprocess, (startIndex, endIndex, dirName, ))  
+        pool.apply_async(postprocess, (startIndex, endIndex, dirName, compressionList, trackList, textureFormat, ))  
     pool.close()
     pool.join()
 
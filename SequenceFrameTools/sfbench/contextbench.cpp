@@ -0,0 +1,164 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+// Measures the per-frame overhead of setting up the decoders on small frames.
+//
+// Usage: sfcontextbench [-n iterations]
+//
+// Every frame is decoded twice: once with contexts created and freed for the frame, which is what
+// the plugin did before the decoders kept their contexts, and once with a Decompressor that resets
+// its contexts. The frames are synthetic and compress about as well as ETC2 data of a flat image,
+// on small frames the decode itself is cheap and the context setup dominates. "lz4 4MB" frames
+// declare 4 MB blocks in their header, LZ4F allocates its buffers for that block size.
+
+#include "decompressor.h"
+#include "lz4frame.h"
+#include "zlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+namespace
+{
+    int decompressFreshLZ4(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                           void* decompressedBuffer_o)
+    {
+        LZ4F_dctx* dctx;
+        size_t ret = LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION);
+        if (LZ4F_isError(ret)) {
+            return -1;
+        }
+
+        ret = LZ4F_decompress(dctx, decompressedBuffer_o, &decompressedSize, compressedBuffer, &compressedSize, NULL);
+        LZ4F_freeDecompressionContext(dctx);
+        return LZ4F_isError(ret) ? -1 : 0;
+    }
+
+    int decompressFreshZLIB(size_t compressedSize, const void* compressedBuffer, size_t decompressedSize,
+                            void* decompressedBuffer_o)
+    {
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        strm.avail_in = static_cast<uInt>(compressedSize);
+        strm.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(compressedBuffer));
+        strm.avail_out = static_cast<uInt>(decompressedSize);
+        strm.next_out = reinterpret_cast<Bytef*>(decompressedBuffer_o);
+
+        int ret = inflateInit(&strm);
+        if (ret != Z_OK) {
+            return ret;
+        }
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        inflateEnd(&strm);
+        return (ret == Z_OK || ret == Z_STREAM_END) ? 0 : ret;
+    }
+
+    // 16 byte blocks drawn from a small palette, like the blocks of a texture with flat areas.
+    std::vector<unsigned char> createFrame(size_t size, unsigned int seed)
+    {
+        std::vector<unsigned char> palette(16 * 16);
+        for (size_t i = 0; i < palette.size(); ++i) {
+            seed = seed * 1103515245U + 12345U;
+            palette[i] = static_cast<unsigned char>(seed >> 16);
+        }
+
+        std::vector<unsigned char> frame(size);
+        for (size_t i = 0; i < size; i += 16) {
+            seed = seed * 1103515245U + 12345U;
+            size_t block = (seed >> 16) % 16;
+            memcpy(frame.data() + i, palette.data() + block * 16, (size - i < 16) ? size - i : 16);
+        }
+
+        return frame;
+    }
+
+    template <typename Function>
+    double measure(int iterations, Function function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            if (0 != function()) {
+                return -1.0;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 2000;
+    if (argc > 2 && 0 == strcmp(argv[1], "-n")) {
+        iterations = atoi(argv[2]) > 0 ? atoi(argv[2]) : 1;
+    }
+
+    const size_t frameSizes[] = { 1024, 4096, 16384, 65536, 262144 };
+
+    printf("frame size  codec    fresh contexts  reused contexts  saved per frame\n");
+    for (size_t frameSize : frameSizes) {
+        std::vector<unsigned char> frame = createFrame(frameSize, static_cast<unsigned int>(frameSize));
+        std::vector<unsigned char> decoded(frameSize);
+
+        std::vector<unsigned char> lz4Frame(LZ4F_compressFrameBound(frameSize, NULL));
+        size_t lz4Size = LZ4F_compressFrame(lz4Frame.data(), lz4Frame.size(), frame.data(), frameSize, NULL);
+
+        // LZ4F sizes its internal buffers by the block size of the frame header, not by the frame.
+        LZ4F_preferences_t largeBlockPreferences;
+        memset(&largeBlockPreferences, 0, sizeof(largeBlockPreferences));
+        largeBlockPreferences.frameInfo.blockSizeID = LZ4F_max4MB;
+        std::vector<unsigned char> lz4LargeBlockFrame(LZ4F_compressFrameBound(frameSize, &largeBlockPreferences));
+        size_t lz4LargeBlockSize = LZ4F_compressFrame(lz4LargeBlockFrame.data(), lz4LargeBlockFrame.size(),
+                                                      frame.data(), frameSize, &largeBlockPreferences);
+
+        uLongf zlibSize = compressBound(static_cast<uLong>(frameSize));
+        std::vector<unsigned char> zlibFrame(zlibSize);
+        if (LZ4F_isError(lz4Size) || LZ4F_isError(lz4LargeBlockSize)
+            || Z_OK != compress(zlibFrame.data(), &zlibSize, frame.data(), static_cast<uLong>(frameSize))) {
+            fprintf(stderr, "cannot compress the test frame\n");
+            return 1;
+        }
+
+        Decompressor decompressor;
+        unsigned char* output = decoded.data();
+
+        double lz4Fresh = measure(iterations, [&]() {
+            return decompressFreshLZ4(lz4Size, lz4Frame.data(), frameSize, output);
+        });
+        double lz4Reused = measure(iterations, [&]() {
+            return decompressor.decompressLZ4(lz4Size, lz4Frame.data(), frameSize, output);
+        });
+        double lz4LargeBlockFresh = measure(iterations, [&]() {
+            return decompressFreshLZ4(lz4LargeBlockSize, lz4LargeBlockFrame.data(), frameSize, output);
+        });
+        double lz4LargeBlockReused = measure(iterations, [&]() {
+            return decompressor.decompressLZ4(lz4LargeBlockSize, lz4LargeBlockFrame.data(), frameSize, output);
+        });
+        double zlibFresh = measure(iterations, [&]() {
+            return decompressFreshZLIB(zlibSize, zlibFrame.data(), frameSize, output);
+        });
+        double zlibReused = measure(iterations, [&]() {
+            return decompressor.decompressZLIB(zlibSize, zlibFrame.data(), frameSize, output);
+        });
+
+        if (lz4Fresh < 0.0 || lz4Reused < 0.0 || lz4LargeBlockFresh < 0.0 || lz4LargeBlockReused < 0.0
+            || zlibFresh < 0.0 || zlibReused < 0.0 || 0 != memcmp(decoded.data(), frame.data(), frameSize)) {
+            fprintf(stderr, "%zu byte frame failed to decompress\n", frameSize);
+            return 1;
+        }
+
+        printf("%10zu  lz4     %11.2f us  %12.2f us  %12.2f us\n", frameSize, lz4Fresh, lz4Reused, lz4Fresh - lz4Reused);
+        printf("%10zu  lz4 4MB %11.2f us  %12.2f us  %12.2f us\n", frameSize, lz4LargeBlockFresh, lz4LargeBlockReused,
+               lz4LargeBlockFresh - lz4LargeBlockReused);
+        printf("%10zu  zlib    %11.2f us  %12.2f us  %12.2f us\n", frameSize, zlibFresh, zlibReused, zlibFresh - zlibReused);
+    }
+
+    return 0;
+}
@@ -0,0 +1,335 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+// Measures the per-frame cost of making a texture package frame ready for upload.
+//
+// Usage: sfbench [-n iterations] [-t threads] [-k track] [-p] [-c reference] package [package ...]
+//
+// Pass the same clip packed with different compression algorithms to compare them, for example
+// _ETC2_RGBA8.lz4 and _ETC2_RGBA8.raw. The package is read into memory first, so the numbers are
+// the CPU cost of the decoder. For uncompressed packages the frame is read once, which is the work
+// the upload does on top of a decoded frame anyway. Striped frames are decoded on -t threads, like
+// the plugin does with its DecodeThreadCount property. Planar frames include interleaving the planes,
+// trimmed frames placing their rectangle into the texture. -k picks the resolution track of packages
+// with several, 0 is the largest. -p adds decoding the ETC2 blocks to RGBA8 pixels on the -t threads,
+// which the plugin does when the GPU has no ETC2. -c decodes the pixels too and checks that every frame has
+// the same color as in the reference package, for example that an ETC2 RGB8 package of an opaque clip shows
+// what its ETC2 RGBA8 package shows; a package that differs makes sfbench fail.
+
+#include "codecregistry.h"
+#include "decompressor.h"
+#include "etc2decoder.h"
+#include "etc2planes.h"
+#include "texturepackage.h"
+#include "textureregion.h"
+#include "workerpool.h"
+#include "xxhash.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Kanzi graphics formats of the packages
+    const uint32_t GraphicsFormatETC2_R8G8B8_UNORM = 30;
+    const uint32_t GraphicsFormatETC2_R8G8B8A1_UNORM = 32;
+
+    ETC2Format getPixelFormat(uint32_t textureFormat)
+    {
+        if (GraphicsFormatETC2_R8G8B8_UNORM == textureFormat) {
+            return ETC2Format_RGB8;
+        }
+        return (GraphicsFormatETC2_R8G8B8A1_UNORM == textureFormat) ? ETC2Format_RGB8A1 : ETC2Format_RGBA8;
+    }
+
+    const char* getCompressionName(uint32_t codec)
+    {
+        const FrameCodec* frameCodec = CodecRegistry::getInstance().findCodec(codec);
+        return (nullptr != frameCodec) ? frameCodec->name : "unknown";
+    }
+
+    bool readFile(const char* fileName, std::vector<unsigned char>& content)
+    {
+        std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+
+        content.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(content.data()), content.size()));
+    }
+
+    // hash of the color of decoded pixels, alpha is left out
+    uint64_t getColorHash(const std::vector<unsigned char>& pixelData, std::vector<unsigned char>& colorData)
+    {
+        colorData.resize(pixelData.size() / 4 * 3);
+        for (size_t i = 0, j = 0; i < pixelData.size(); i += 4, j += 3) {
+            memcpy(&colorData[j], &pixelData[i], 3);
+        }
+        return XXH64(colorData.data(), colorData.size(), 0);
+    }
+
+    // Decodes every frame of the package iterations times and prints the timing. When isDecodingPixels is set
+    // colorHashes_o gets the color hash of every frame.
+    int benchmarkPackage(const char* fileName, int iterations, uint32_t track, bool isDecodingPixels,
+                         WorkerPool& workerPool, std::vector<uint64_t>& colorHashes_o)
+    {
+        colorHashes_o.clear();
+        std::vector<unsigned char> package;
+        if (!readFile(fileName, package)) {
+            fprintf(stderr, "%s: cannot read package\n", fileName);
+            return -1;
+        }
+
+        TexturePackage info;
+        int ret = info.parseHeader(package.data(), std::min(package.size(), TexturePackage::HeaderReadSize),
+                                   package.size());
+        if (0 == ret) {
+            ret = info.parseTracks(package.data() + info.getTrackTableOffset());
+        }
+        if (0 == ret) {
+            ret = info.selectTrack(std::min(track, info.getTrackCount() - 1));
+        }
+        if (0 == ret) {
+            ret = info.parseIndex(package.data() + info.getIndexOffset());
+        }
+        if (0 != ret || 0 == info.getTextureNumber() || 0 == info.getTextureWidth() || 0 == info.getTextureHeight()) {
+            fprintf(stderr, "%s: bad header\n", fileName);
+            return -1;
+        }
+
+        // Version 2 frames carry their decoded size, which follows the texture format of the package. Version 1
+        // packages are always ETC2 RGBA8: 16 bytes per 4x4 block.
+        const TexturePackageFrame& firstFrame = info.getFrame(0);
+        const size_t textureBlockWidth = (info.getTextureWidth() + 3) / 4;
+        size_t blockSize = 16;
+        if (0 != firstFrame.decodedSize) {
+            blockSize = firstFrame.decodedSize / (static_cast<size_t>(firstFrame.trimWidth) * firstFrame.trimHeight);
+        }
+        size_t textureSize = textureBlockWidth * ((info.getTextureHeight() + 3) / 4) * blockSize;
+        std::vector<unsigned char> textureData(textureSize);
+        std::vector<unsigned char> planeData(textureSize);
+        std::vector<unsigned char> regionData(textureSize);
+        const unsigned char* transparentBlock = (sizeof(ETC2RGBA8TransparentBlock) == blockSize)
+            ? ETC2RGBA8TransparentBlock : ETC2RGB8A1TransparentBlock;
+        // rectangle of the last trimmed frame in textureData, the whole texture after other frames
+        const TextureBlockRect fullRect = { 0, 0, static_cast<uint32_t>(textureBlockWidth),
+                                            static_cast<uint32_t>((info.getTextureHeight() + 3) / 4) };
+        TextureBlockRect textureRect = fullRect;
+        const ETC2Format pixelFormat = getPixelFormat(info.getTextureFormat());
+        const uint32_t blockHeight = (info.getTextureHeight() + 3) / 4;
+        std::vector<unsigned char> pixelData(isDecodingPixels ? info.getTextureWidth() * info.getTextureHeight() * 4 : 0);
+        std::vector<unsigned char> colorData;
+
+        // The plugin prepares the dictionary once when it opens the package.
+        const FrameCodec* dictionaryCodec = CodecRegistry::getInstance().findCodec(info.getCodec());
+        void* dictionary = nullptr;
+        if (0 != info.getDictionarySize() && nullptr != dictionaryCodec && nullptr != dictionaryCodec->createDictionary) {
+            dictionary = dictionaryCodec->createDictionary(package.data() + info.getDictionaryOffset(),
+                                                           info.getDictionarySize());
+            if (nullptr == dictionary) {
+                fprintf(stderr, "%s: bad dictionary\n", fileName);
+                return -1;
+            }
+        }
+
+        Decompressor decompressor;
+        std::vector<TexturePackageStripe> stripes;
+        std::vector<double> frameTimes;
+        size_t compressedBytes = 0;
+        unsigned int checksum = 0;
+
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            for (uint32_t i = 0; i < info.getTextureNumber(); ++i) {
+                const TexturePackageFrame& frame = info.getFrame(i);
+                size_t size = frame.size;
+                unsigned char* data = package.data() + frame.offset;
+
+                const FrameCodec* codec = CodecRegistry::getInstance().findCodec(frame.codec);
+                const bool isPlanar = (0 != (frame.flags & TexturePackageFrameFlag_Planar));
+                const bool isTrimmed = (0 != (frame.flags & TexturePackageFrameFlag_Trimmed));
+                unsigned char* frameTexture = isTrimmed ? regionData.data() : textureData.data();
+                unsigned char* decodedData = isPlanar ? planeData.data() : frameTexture;
+                const size_t decodedSize = isTrimmed ? frame.decodedSize : textureSize;
+
+                auto start = std::chrono::steady_clock::now();
+                int ret = 0;
+                if (0 != (frame.flags & TexturePackageFrameFlag_Duplicate)) {
+                    // The plugin uploads the decoded frame again.
+                    size = 0;
+                } else if (TexturePackageCodec_None == frame.codec) {
+                    for (size_t j = 0; j < textureSize; j += 64) {
+                        checksum += data[j];
+                    }
+                } else if (nullptr != codec && 0 != (frame.flags & TexturePackageFrameFlag_Striped)) {
+                    const void* stripeDictionary = (codec == dictionaryCodec) ? dictionary : nullptr;
+                    ret = TexturePackage::parseStripes(data, size, decodedSize, stripes);
+                    if (0 == ret) {
+                        ret = workerPool.run(stripes.size(), [&](size_t index) {
+                            const TexturePackageStripe& stripe = stripes[index];
+                            int stripeResult = codec->decode(Decompressor::getThreadDecompressor(), stripeDictionary,
+                                                             stripe.size, data + stripe.offset, stripe.decodedSize,
+                                                             decodedData + stripe.decodedOffset);
+                            if (0 == stripeResult && isPlanar) {
+                                InterleaveETC2RGBA8Planes(decodedData + stripe.decodedOffset, stripe.decodedSize,
+                                                          frameTexture + stripe.decodedOffset);
+                            }
+                            return stripeResult;
+                        });
+                    }
+                } else if (nullptr != codec) {
+                    ret = codec->decode(decompressor, (codec == dictionaryCodec) ? dictionary : nullptr, size, data,
+                                        decodedSize, decodedData);
+                    if (0 == ret && isPlanar) {
+                        InterleaveETC2RGBA8Planes(decodedData, decodedSize, frameTexture);
+                    }
+                } else {
+                    ret = -1;
+                }
+
+                if (0 != (frame.flags & TexturePackageFrameFlag_Duplicate)) {
+                    // Nothing was decoded.
+                } else if (0 == ret && isTrimmed) {
+                    const TextureBlockRect rect = { frame.trimX, frame.trimY, frame.trimWidth, frame.trimHeight };
+                    PlaceTextureRegion(regionData.data(), rect, textureRect, transparentBlock, blockSize,
+                                       textureBlockWidth, textureData.data());
+                    textureRect = rect;
+                } else {
+                    textureRect = fullRect;
+                }
+
+                if (isDecodingPixels && 0 == ret && 0 == (frame.flags & TexturePackageFrameFlag_Duplicate)) {
+                    const unsigned char* blocks = (TexturePackageCodec_None == frame.codec) ? data : textureData.data();
+                    const size_t bandCount = std::min<size_t>(workerPool.getThreadCount(), blockHeight);
+                    ret = workerPool.run(bandCount, [&](size_t index) {
+                        DecodeETC2Texture(pixelFormat, blocks, info.getTextureWidth(), info.getTextureHeight(),
+                                          static_cast<uint32_t>(blockHeight * index / bandCount),
+                                          static_cast<uint32_t>(blockHeight * (index + 1) / bandCount), pixelData.data());
+                        return 0;
+                    });
+                }
+                auto end = std::chrono::steady_clock::now();
+
+                if (0 != ret) {
+                    fprintf(stderr, "%s: frame %u failed to decompress (%d)\n", fileName, i, ret);
+                    if (nullptr != dictionary) {
+                        dictionaryCodec->freeDictionary(dictionary);
+                    }
+                    return -1;
+                }
+
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                compressedBytes += size;
+
+                // Duplicates show their reference frame, which is not the one in pixelData.
+                if (isDecodingPixels && 0 == iteration) {
+                    colorHashes_o.push_back((0 != (frame.flags & TexturePackageFrameFlag_Duplicate))
+                                            ? colorHashes_o[frame.reference] : getColorHash(pixelData, colorData));
+                }
+            }
+        }
+
+        if (nullptr != dictionary) {
+            dictionaryCodec->freeDictionary(dictionary);
+        }
+
+        std::sort(frameTimes.begin(), frameTimes.end());
+        double total = 0.0;
+        for (double frameTime : frameTimes) {
+            total += frameTime;
+        }
+
+        printf("%s: v%u %s, %u frames %ux%u (track %u of %u), %.1f MB, %zu byte dictionary\n", fileName,
+               info.getVersion(), getCompressionName(info.getCodec()), info.getTextureNumber(), info.getTextureWidth(),
+               info.getTextureHeight(), std::min(track, info.getTrackCount() - 1), info.getTrackCount(),
+               package.size() / 1048576.0, info.getDictionarySize());
+        printf("    ratio %.3f, mean %.3f ms, median %.3f ms, p99 %.3f ms, max %.3f ms, %.0f MB/s (%u)\n",
+               static_cast<double>(compressedBytes) / (static_cast<double>(textureSize) * frameTimes.size()),
+               total / frameTimes.size(), frameTimes[frameTimes.size() / 2],
+               frameTimes[frameTimes.size() * 99 / 100], frameTimes.back(),
+               textureSize * frameTimes.size() / 1048576.0 / (total / 1000.0), checksum & 0xff);
+
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 3;
+    int threadCount = 1;
+    uint32_t track = 0;
+    bool isDecodingPixels = false;
+    const char* referenceName = nullptr;
+    int firstPackage = 1;
+    while (firstPackage + 1 < argc) {
+        if (0 == strcmp(argv[firstPackage], "-p")) {
+            isDecodingPixels = true;
+            ++firstPackage;
+            continue;
+        }
+        if (0 == strcmp(argv[firstPackage], "-n")) {
+            iterations = std::max(1, atoi(argv[firstPackage + 1]));
+        } else if (0 == strcmp(argv[firstPackage], "-t")) {
+            threadCount = std::max(1, atoi(argv[firstPackage + 1]));
+        } else if (0 == strcmp(argv[firstPackage], "-k")) {
+            track = static_cast<uint32_t>(std::max(0, atoi(argv[firstPackage + 1])));
+        } else if (0 == strcmp(argv[firstPackage], "-c")) {
+            referenceName = argv[firstPackage + 1];
+            isDecodingPixels = true;
+        } else {
+            break;
+        }
+        firstPackage += 2;
+    }
+
+    if (firstPackage >= argc) {
+        fprintf(stderr, "usage: sfbench [-n iterations] [-t threads] [-k track] [-p] [-c reference] package "
+                        "[package ...]\n");
+        return 1;
+    }
+
+    WorkerPool workerPool(static_cast<unsigned int>(threadCount));
+    std::vector<uint64_t> referenceHashes;
+    if (nullptr != referenceName
+        && 0 != benchmarkPackage(referenceName, 1, track, isDecodingPixels, workerPool, referenceHashes)) {
+        return 1;
+    }
+
+    int result = 0;
+    std::vector<uint64_t> colorHashes;
+    for (int i = firstPackage; i < argc; ++i) {
+        if (0 != benchmarkPackage(argv[i], iterations, track, isDecodingPixels, workerPool, colorHashes)) {
+            result = 1;
+            continue;
+        }
+        if (nullptr == referenceName) {
+            continue;
+        }
+
+        if (colorHashes.size() != referenceHashes.size()) {
+            printf("    %zu frames, %s has %zu\n", colorHashes.size(), referenceName, referenceHashes.size());
+            result = 1;
+            continue;
+        }
+        size_t differentFrames = 0;
+        for (size_t j = 0; j < colorHashes.size(); ++j) {
+            if (colorHashes[j] != referenceHashes[j]) {
+                ++differentFrames;
+            }
+        }
+        printf("    color of %zu of %zu frames differs from %s\n", differentFrames, colorHashes.size(), referenceName);
+        if (0 != differentFrames) {
+            result = 1;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,212 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "compressor.h"
+#include "texturepackage.h"
+
+#include "lz4.h"
+#include "lz4frame_static.h"
+#include "lz4hc.h"
+#include "zlib.h"
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+#include "zdict.h"
+#include "zstd.h"
+#include "zstd_errors.h"
+#endif
+
+#include <string.h>
+
+namespace
+{
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    const int ZSTDLevel = 19;
+    const size_t ZSTDDictionarySize = 112640;
+#endif
+}
+
+Compressor::Compressor()
+    : m_lz4Context(nullptr)
+    , m_lz4BlockState(LZ4_sizeofStateHC())
+    , m_lz4FastBlockState(LZ4_sizeofState())
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    , m_zstdContext(ZSTD_createCCtx())
+#endif
+{
+    LZ4F_cctx* cctx = nullptr;
+    if (!LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))) {
+        m_lz4Context = cctx;
+    }
+}
+
+Compressor::~Compressor()
+{
+    if (nullptr != m_lz4Context) {
+        LZ4F_freeCompressionContext(m_lz4Context);
+    }
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    ZSTD_freeCCtx(m_zstdContext);
+#endif
+}
+
+Compressor& Compressor::getThreadCompressor()
+{
+    static thread_local Compressor compressor;
+    return compressor;
+}
+
+int Compressor::compress(uint32_t codec, const void* dictionary, const void* data, size_t size,
+                         std::vector<unsigned char>& compressed_o)
+{
+    return compress(codec, getDefaultLevel(codec), dictionary, data, size, compressed_o);
+}
+
+int Compressor::compress(uint32_t codec, int level, const void* dictionary, const void* data, size_t size,
+                         std::vector<unsigned char>& compressed_o)
+{
+    (void)dictionary;
+    switch (codec) {
+    case TexturePackageCodec_None:
+        compressed_o.assign(static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + size);
+        return 0;
+    case TexturePackageCodec_LZ4:
+        return compressLZ4(level, data, size, compressed_o);
+    case TexturePackageCodec_ZLIB:
+        return compressZLIB(level, data, size, compressed_o);
+    case TexturePackageCodec_LZ4Block:
+        return compressLZ4Block(level, data, size, compressed_o);
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    case TexturePackageCodec_ZSTD:
+        return compressZSTD(level, static_cast<const ZSTD_CDict*>(dictionary), data, size, compressed_o);
+#endif
+    default:
+        return -1;
+    }
+}
+
+int Compressor::getDefaultLevel(uint32_t codec)
+{
+    switch (codec) {
+    case TexturePackageCodec_LZ4:
+    case TexturePackageCodec_LZ4Block:
+        return LZ4HC_CLEVEL_MAX;
+    case TexturePackageCodec_ZLIB:
+        return Z_DEFAULT_COMPRESSION;
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    case TexturePackageCodec_ZSTD:
+        return ZSTDLevel;
+#endif
+    default:
+        return 0;
+    }
+}
+
+int Compressor::compressLZ4(int level, const void* data, size_t size, std::vector<unsigned char>& compressed_o)
+{
+    if (nullptr == m_lz4Context) {
+        return LZ4F_ERROR_allocation_failed;
+    }
+
+    // The frame records its content size, like lz4.frame.compress of the script.
+    LZ4F_preferences_t preferences;
+    memset(&preferences, 0, sizeof(preferences));
+    preferences.frameInfo.contentSize = size;
+    preferences.compressionLevel = level;
+
+    compressed_o.resize(LZ4F_compressFrameBound(size, &preferences));
+    size_t ret = LZ4F_compressFrame_usingCDict(m_lz4Context, compressed_o.data(), compressed_o.size(), data, size,
+                                               nullptr, &preferences);
+    if (LZ4F_isError(ret)) {
+        return LZ4F_getErrorCode(ret);
+    }
+    compressed_o.resize(ret);
+    return 0;
+}
+
+int Compressor::compressLZ4Block(int level, const void* data, size_t size, std::vector<unsigned char>& compressed_o)
+{
+    compressed_o.resize(LZ4_compressBound(static_cast<int>(size)));
+    int ret = 0;
+    if (level < LZ4HC_CLEVEL_MIN) {
+        ret = LZ4_compress_fast_extState(m_lz4FastBlockState.data(), static_cast<const char*>(data),
+                                         reinterpret_cast<char*>(compressed_o.data()), static_cast<int>(size),
+                                         static_cast<int>(compressed_o.size()), 1);
+    } else {
+        ret = LZ4_compress_HC_extStateHC(m_lz4BlockState.data(), static_cast<const char*>(data),
+                                         reinterpret_cast<char*>(compressed_o.data()), static_cast<int>(size),
+                                         static_cast<int>(compressed_o.size()), level);
+    }
+    if (ret <= 0) {
+        return -1;
+    }
+    compressed_o.resize(ret);
+    return 0;
+}
+
+int Compressor::compressZLIB(int level, const void* data, size_t size, std::vector<unsigned char>& compressed_o)
+{
+    uLongf compressedSize = compressBound(static_cast<uLong>(size));
+    compressed_o.resize(compressedSize);
+    int ret = compress2(compressed_o.data(), &compressedSize, static_cast<const Bytef*>(data),
+                        static_cast<uLong>(size), level);
+    if (Z_OK != ret) {
+        return ret;
+    }
+    compressed_o.resize(compressedSize);
+    return 0;
+}
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+std::vector<unsigned char> Compressor::trainDictionary(const std::vector<std::vector<unsigned char> >& samples)
+{
+    std::vector<unsigned char> samplesBuffer;
+    std::vector<size_t> sampleSizes;
+    for (const std::vector<unsigned char>& sample : samples) {
+        samplesBuffer.insert(samplesBuffer.end(), sample.begin(), sample.end());
+        sampleSizes.push_back(sample.size());
+    }
+
+    std::vector<unsigned char> dictionary(ZSTDDictionarySize);
+    size_t ret = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samplesBuffer.data(), sampleSizes.data(),
+                                       static_cast<unsigned int>(sampleSizes.size()));
+    if (ZDICT_isError(ret)) {
+        dictionary.clear();
+    } else {
+        dictionary.resize(ret);
+    }
+    return dictionary;
+}
+
+void* Compressor::createDictionary(const std::vector<unsigned char>& dictionary)
+{
+    return ZSTD_createCDict(dictionary.data(), dictionary.size(), ZSTDLevel);
+}
+
+void Compressor::freeDictionary(void* dictionary)
+{
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(dictionary));
+}
+
+int Compressor::compressZSTD(int level, const ZSTD_CDict_s* dictionary, const void* data, size_t size,
+                             std::vector<unsigned char>& compressed_o)
+{
+    if (nullptr == m_zstdContext) {
+        return -1;
+    }
+
+    // The plugin knows the frame size from the index and the dictionary from the package, the frame
+    // header needs neither.
+    ZSTD_CCtx_reset(m_zstdContext, ZSTD_reset_session_and_parameters);
+    ZSTD_CCtx_setParameter(m_zstdContext, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setParameter(m_zstdContext, ZSTD_c_contentSizeFlag, 0);
+    ZSTD_CCtx_setParameter(m_zstdContext, ZSTD_c_dictIDFlag, 0);
+    ZSTD_CCtx_refCDict(m_zstdContext, dictionary);
+
+    compressed_o.resize(ZSTD_compressBound(size));
+    size_t ret = ZSTD_compress2(m_zstdContext, compressed_o.data(), compressed_o.size(), data, size);
+    if (ZSTD_isError(ret)) {
+        return -static_cast<int>(ZSTD_getErrorCode(ret));
+    }
+    compressed_o.resize(ret);
+    return 0;
+}
+#endif
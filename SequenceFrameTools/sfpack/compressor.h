@@ -0,0 +1,74 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef SFPACK_COMPRESSOR_H_
+#define SFPACK_COMPRESSOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+struct LZ4F_cctx_s;
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+struct ZSTD_CCtx_s;
+struct ZSTD_CDict_s;
+#endif
+
+// Compresses frame payloads with the codecs of the package format, with the settings TexturePacker.py
+// used: LZ4 frames and blocks at the highest LZ4HC level, zlib at its default level and zstd at level
+// 19 with the dictionary of the package. The contexts are kept from frame to frame, a compressor is
+// not thread safe, every packing thread uses its own.
+class Compressor
+{
+public:
+
+    Compressor();
+    ~Compressor();
+
+    // get the compressor of the calling thread
+    static Compressor& getThreadCompressor();
+
+    // Compress size bytes of data with a TexturePackageCodec into compressed_o, returns 0 or an error.
+    // The dictionary is the one created for the codec, or null.
+    int compress(uint32_t codec, const void* dictionary, const void* data, size_t size,
+                 std::vector<unsigned char>& compressed_o);
+    // Compress at another level of the codec: LZ4 levels below 3 are the fast LZ4 compressor, the others
+    // LZ4HC levels, zlib and zstd take their own levels. The zstd dictionary keeps the level it was
+    // created with.
+    int compress(uint32_t codec, int level, const void* dictionary, const void* data, size_t size,
+                 std::vector<unsigned char>& compressed_o);
+    // the level compress uses for a codec
+    static int getDefaultLevel(uint32_t codec);
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    // Train the zstd dictionary of a package on samples of its frames, returns an empty dictionary
+    // when the training fails, the frames are compressed without one then.
+    static std::vector<unsigned char> trainDictionary(const std::vector<std::vector<unsigned char> >& samples);
+    // prepare a trained dictionary for compressing, the compressors of all threads can share it
+    static void* createDictionary(const std::vector<unsigned char>& dictionary);
+    static void freeDictionary(void* dictionary);
+#endif
+
+private:
+
+    Compressor(const Compressor&);
+    Compressor& operator=(const Compressor&);
+
+    int compressLZ4(int level, const void* data, size_t size, std::vector<unsigned char>& compressed_o);
+    int compressLZ4Block(int level, const void* data, size_t size, std::vector<unsigned char>& compressed_o);
+    int compressZLIB(int level, const void* data, size_t size, std::vector<unsigned char>& compressed_o);
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    int compressZSTD(int level, const ZSTD_CDict_s* dictionary, const void* data, size_t size,
+                     std::vector<unsigned char>& compressed_o);
+#endif
+
+    LZ4F_cctx_s* m_lz4Context;
+    // LZ4HC and LZ4 states of the raw blocks
+    std::vector<char> m_lz4BlockState;
+    std::vector<char> m_lz4FastBlockState;
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    ZSTD_CCtx_s* m_zstdContext;
+#endif
+};
+
+#endif // SFPACK_COMPRESSOR_H_
@@ -0,0 +1,75 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "decodetimer.h"
+
+#include "codecregistry.h"
+#include "decompressor.h"
+#include "etc2planes.h"
+#include "texturepackage.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    // The fastest decode is the one the least disturbed by the other packing threads.
+    const int DecodeRepeatCount = 3;
+
+    int decodePayload(const FrameCodec& codec, uint16_t flags, const std::vector<unsigned char>& payload,
+                      size_t decodedSize, std::vector<TexturePackageStripe>& stripes_io,
+                      std::vector<unsigned char>& planes_io, std::vector<unsigned char>& texture_io)
+    {
+        const bool isPlanar = (0 != (flags & TexturePackageFrameFlag_Planar));
+        unsigned char* decodedData = isPlanar ? planes_io.data() : texture_io.data();
+        Decompressor& decompressor = Decompressor::getThreadDecompressor();
+        if (0 == (flags & TexturePackageFrameFlag_Striped)) {
+            int ret = codec.decode(decompressor, nullptr, payload.size(), payload.data(), decodedSize, decodedData);
+            if (0 == ret && isPlanar) {
+                InterleaveETC2RGBA8Planes(decodedData, decodedSize, texture_io.data());
+            }
+            return ret;
+        }
+
+        int ret = TexturePackage::parseStripes(payload.data(), payload.size(), decodedSize, stripes_io);
+        for (size_t i = 0; i < stripes_io.size() && 0 == ret; ++i) {
+            const TexturePackageStripe& stripe = stripes_io[i];
+            ret = codec.decode(decompressor, nullptr, stripe.size, payload.data() + stripe.offset, stripe.decodedSize,
+                               decodedData + stripe.decodedOffset);
+            if (0 == ret && isPlanar) {
+                InterleaveETC2RGBA8Planes(decodedData + stripe.decodedOffset, stripe.decodedSize,
+                                          texture_io.data() + stripe.decodedOffset);
+            }
+        }
+        return ret;
+    }
+}
+
+int MeasureFrameDecodeTime(uint32_t codec, uint16_t flags, const std::vector<unsigned char>& payload,
+                           size_t decodedSize, double& milliseconds_o)
+{
+    milliseconds_o = 0.0;
+    if (TexturePackageCodec_None == codec) {
+        return 0;
+    }
+    const FrameCodec* frameCodec = CodecRegistry::getInstance().findCodec(codec);
+    if (nullptr == frameCodec) {
+        return -1;
+    }
+
+    static thread_local std::vector<TexturePackageStripe> stripes;
+    static thread_local std::vector<unsigned char> planes;
+    static thread_local std::vector<unsigned char> texture;
+    planes.resize(decodedSize);
+    texture.resize(decodedSize);
+
+    for (int i = 0; i < DecodeRepeatCount; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        int ret = decodePayload(*frameCodec, flags, payload, decodedSize, stripes, planes, texture);
+        const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        if (0 != ret) {
+            return ret;
+        }
+        milliseconds_o = (0 == i) ? duration.count() : std::min(milliseconds_o, duration.count());
+    }
+    return 0;
+}
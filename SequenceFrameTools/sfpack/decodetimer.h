@@ -0,0 +1,19 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef SFPACK_DECODETIMER_H_
+#define SFPACK_DECODETIMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Time the plugin takes to make a frame payload of a codec ready for upload on the calling thread, in
+// milliseconds, the fastest of a few decodes. The payload is decoded with the decoders of the plugin,
+// without a dictionary. Stripes are decoded one after the other, as on a single core, and planar
+// payloads include interleaving the planes. Uncompressed frames are uploaded as they are and take no
+// time. Returns 0 or the error of the decoder.
+int MeasureFrameDecodeTime(uint32_t codec, uint16_t flags, const std::vector<unsigned char>& payload,
+                           size_t decodedSize, double& milliseconds_o);
+
+#endif // SFPACK_DECODETIMER_H_
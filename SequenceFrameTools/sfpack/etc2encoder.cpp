@@ -0,0 +1,396 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "etc2encoder.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+    // Split the pixels into the RGB and alpha images etcpack reads, expanded to whole blocks the way
+    // etcpack expands them: RGB repeats the last column and row, alpha repeats the last pixel it read
+    // going down the columns. RGB8 needs no alpha image.
+    void splitImage(ETC2Format format, const unsigned char* pixels, uint32_t width, uint32_t height,
+                    uint32_t expandedWidth, uint32_t expandedHeight, std::vector<unsigned char>& rgb_o,
+                    std::vector<unsigned char>& alpha_o)
+    {
+        rgb_o.resize(static_cast<size_t>(expandedWidth) * expandedHeight * 3);
+        for (uint32_t y = 0; y < expandedHeight; ++y) {
+            const uint32_t sourceY = (y < height) ? y : height - 1;
+            for (uint32_t x = 0; x < expandedWidth; ++x) {
+                const uint32_t sourceX = (x < width) ? x : width - 1;
+                const unsigned char* pixel = pixels + (static_cast<size_t>(sourceY) * width + sourceX) * 4;
+                unsigned char* rgb = &rgb_o[(static_cast<size_t>(y) * expandedWidth + x) * 3];
+                rgb[0] = pixel[0];
+                rgb[1] = pixel[1];
+                rgb[2] = pixel[2];
+            }
+        }
+
+        if (ETC2Format_RGB8 == format) {
+            alpha_o.clear();
+            return;
+        }
+
+        alpha_o.resize(static_cast<size_t>(expandedWidth) * expandedHeight);
+        unsigned char last = 0;
+        for (uint32_t x = 0; x < expandedWidth; ++x) {
+            for (uint32_t y = 0; y < expandedHeight; ++y) {
+                if (x < width && y < height) {
+                    last = pixels[(static_cast<size_t>(y) * width + x) * 4 + 3];
+                }
+                alpha_o[static_cast<size_t>(y) * expandedWidth + x] = last;
+            }
+        }
+
+        if (ETC2Format_RGB8A1 == format) {
+            for (unsigned char& alpha : alpha_o) {
+                alpha = (alpha < 128) ? 0 : 255;
+            }
+        }
+    }
+
+    // Bytes of a block in the reference: RGB, then alpha for the formats with alpha.
+    size_t getBlockPixelSize(ETC2Format format)
+    {
+        return (ETC2Format_RGB8 == format) ? 48 : 64;
+    }
+
+    // Copy the pixels of block (x, y) of the split images into blockPixels_o.
+    void getBlockPixels(const std::vector<unsigned char>& rgb, const std::vector<unsigned char>& alpha,
+                        uint32_t expandedWidth, uint32_t x, uint32_t y, unsigned char* blockPixels_o)
+    {
+        for (uint32_t row = 0; row < 4; ++row) {
+            const size_t offset = static_cast<size_t>(y * 4 + row) * expandedWidth + x * 4;
+            memcpy(blockPixels_o + row * 12, &rgb[offset * 3], 12);
+            if (!alpha.empty()) {
+                memcpy(blockPixels_o + 48 + row * 4, &alpha[offset], 4);
+            }
+        }
+    }
+
+    // Pixels of all the blocks of the split images, block by block.
+    void getImageBlockPixels(ETC2Format format, const std::vector<unsigned char>& rgb,
+                             const std::vector<unsigned char>& alpha, uint32_t expandedWidth, uint32_t expandedHeight,
+                             std::vector<unsigned char>& blockPixels_o)
+    {
+        const uint32_t blocksPerRow = expandedWidth / 4;
+        const size_t pixelSize = getBlockPixelSize(format);
+        blockPixels_o.resize(static_cast<size_t>(blocksPerRow) * (expandedHeight / 4) * pixelSize);
+        for (uint32_t y = 0; y < expandedHeight / 4; ++y) {
+            for (uint32_t x = 0; x < blocksPerRow; ++x) {
+                getBlockPixels(rgb, alpha, expandedWidth, x, y, &blockPixels_o[(y * blocksPerRow + x) * pixelSize]);
+            }
+        }
+    }
+
+    // Copy the pixels of a block into block (x, y) of the split images.
+    void setBlockPixels(const unsigned char* blockPixels, uint32_t expandedWidth, uint32_t x, uint32_t y,
+                        std::vector<unsigned char>& rgb_io, std::vector<unsigned char>& alpha_io)
+    {
+        for (uint32_t row = 0; row < 4; ++row) {
+            const size_t offset = static_cast<size_t>(y * 4 + row) * expandedWidth + x * 4;
+            memcpy(&rgb_io[offset * 3], blockPixels + row * 12, 12);
+            if (!alpha_io.empty()) {
+                memcpy(&alpha_io[offset], blockPixels + 48 + row * 4, 4);
+            }
+        }
+    }
+
+    // The weights of the perceptual metric ETCPACK encodes with, calculateWeightedPSNR gives the perceptually
+    // weighted PSNR with them.
+    const double PerceptualWeights[3] = { 0.299, 0.587, 0.114 };
+
+    struct BlockError {
+        // weighted squared error of the color
+        double color;
+        double alpha;
+    };
+
+    // Squared error of pixel i of a decoded block, the color weighted, plus that of the alpha.
+    double getPixelError(ETC2Format format, const unsigned char* decoded, const unsigned char* blockPixels, int i,
+                         BlockError& error_io)
+    {
+        double colorError = 0.0;
+        for (int channel = 0; channel < 3; ++channel) {
+            const double difference = decoded[i * 4 + channel] - blockPixels[i * 3 + channel];
+            colorError += PerceptualWeights[channel] * difference * difference;
+        }
+        double alphaError = 0.0;
+        if (ETC2Format_RGB8 != format) {
+            const double difference = decoded[i * 4 + 3] - blockPixels[48 + i];
+            alphaError = difference * difference;
+        }
+        error_io.color += colorError;
+        error_io.alpha += alphaError;
+        return colorError + alphaError;
+    }
+
+    // Decode a block and compare it with the pixels it was encoded from.
+    BlockError getBlockError(ETC2Format format, const unsigned char* block, const unsigned char* blockPixels)
+    {
+        unsigned char decoded[64];
+        DecodeETC2Texture(format, block, 4, 4, 0, 1, decoded);
+        BlockError error = { 0.0, 0.0 };
+        for (int i = 0; i < 16; ++i) {
+            getPixelError(format, decoded, blockPixels, i, error);
+        }
+        return error;
+    }
+
+    // Give the color half of a block the first four bytes of another color half, its mode, base colors and
+    // tables, and pick the pixel indices anew: every pixel takes the index that decodes closest to it. The
+    // colors of an index are those of the block decoded with all of its pixels on the index. The indices are
+    // two bit planes, most significant first, of a bit per pixel, column by column.
+    void snapColorHalf(ETC2Format format, size_t colorOffset, const unsigned char* baseColors,
+                       const unsigned char* blockPixels, unsigned char* block_io)
+    {
+        unsigned char* colorHalf = block_io + colorOffset;
+        memcpy(colorHalf, baseColors, 4);
+        double bestErrors[16];
+        unsigned int indexPlanes[2] = { 0, 0 };
+        for (unsigned int index = 0; index < 4; ++index) {
+            const unsigned char highBits = (0 != (index & 2)) ? 0xff : 0;
+            const unsigned char lowBits = (0 != (index & 1)) ? 0xff : 0;
+            const unsigned char indices[4] = { highBits, highBits, lowBits, lowBits };
+            memcpy(colorHalf + 4, indices, 4);
+            unsigned char decoded[64];
+            DecodeETC2Texture(format, block_io, 4, 4, 0, 1, decoded);
+            for (int i = 0; i < 16; ++i) {
+                BlockError pixelError = { 0.0, 0.0 };
+                const double error = getPixelError(format, decoded, blockPixels, i, pixelError);
+                if (0 == index || error < bestErrors[i]) {
+                    const unsigned int bit = 1u << ((i % 4) * 4 + i / 4);
+                    bestErrors[i] = error;
+                    indexPlanes[0] = (0 != highBits) ? (indexPlanes[0] | bit) : (indexPlanes[0] & ~bit);
+                    indexPlanes[1] = (0 != lowBits) ? (indexPlanes[1] | bit) : (indexPlanes[1] & ~bit);
+                }
+            }
+        }
+        for (int plane = 0; plane < 2; ++plane) {
+            colorHalf[4 + plane * 2] = static_cast<unsigned char>(indexPlanes[plane] >> 8);
+            colorHalf[5 + plane * 2] = static_cast<unsigned char>(indexPlanes[plane]);
+        }
+    }
+
+    int getETCPACKFormat(ETC2Format format)
+    {
+        if (ETC2Format_RGB8 == format) {
+            return ETC2PACKAGE_RGB_NO_MIPMAPS;
+        }
+        return (ETC2Format_RGB8A1 == format) ? ETC2PACKAGE_RGBA1_NO_MIPMAPS : ETC2PACKAGE_RGBA_NO_MIPMAPS;
+    }
+}
+
+ETC2Encoder::ETC2Encoder(ETC2Format format, uint32_t reuseTolerance, double maxPSNRLoss)
+    : m_format(format)
+    , m_reuseTolerance(reuseTolerance)
+    , m_maxPSNRLoss(maxPSNRLoss)
+{
+    initEncoderContext(&m_context, CODEC_ETC2, getETCPACKFormat(format), 0, SPEED_FAST, METRIC_PERCEPTUAL);
+}
+
+ETC2Encoder::~ETC2Encoder()
+{
+    freeEncoderContext(&m_context);
+}
+
+ETC2Format ETC2Encoder::getFormat() const
+{
+    return m_format;
+}
+
+uint32_t ETC2Encoder::getReuseTolerance() const
+{
+    return m_reuseTolerance;
+}
+
+double ETC2Encoder::getMaxPSNRLoss() const
+{
+    return m_maxPSNRLoss;
+}
+
+void ETC2Encoder::encode(const unsigned char* pixels, uint32_t width, uint32_t height,
+                         std::vector<unsigned char>& blocks_o) const
+{
+    const uint32_t expandedWidth = (width + 3) / 4 * 4;
+    const uint32_t expandedHeight = (height + 3) / 4 * 4;
+
+    std::vector<unsigned char> rgb;
+    std::vector<unsigned char> alpha;
+    splitImage(m_format, pixels, width, height, expandedWidth, expandedHeight, rgb, alpha);
+
+    blocks_o.resize(getCompressedImageSize(&m_context, expandedWidth, expandedHeight));
+    compressImage(&m_context, rgb.data(), alpha.empty() ? nullptr : alpha.data(), expandedWidth, expandedHeight,
+                  blocks_o.data());
+
+    if (m_maxPSNRLoss > 0.0) {
+        std::vector<unsigned char> blockPixels;
+        getImageBlockPixels(m_format, rgb, alpha, expandedWidth, expandedHeight, blockPixels);
+        repeatBlocks(blockPixels, expandedWidth / 4, blocks_o);
+    }
+}
+
+size_t ETC2Encoder::encode(const unsigned char* pixels, uint32_t width, uint32_t height, ETC2Reference& reference_io,
+                           std::vector<unsigned char>& blocks_o) const
+{
+    const uint32_t expandedWidth = (width + 3) / 4 * 4;
+    const uint32_t expandedHeight = (height + 3) / 4 * 4;
+    const uint32_t blocksPerRow = expandedWidth / 4;
+    const size_t blockCount = static_cast<size_t>(blocksPerRow) * (expandedHeight / 4);
+    const size_t pixelSize = getBlockPixelSize(m_format);
+    const size_t blockSize = GetETC2BlockSize(m_format);
+
+    std::vector<unsigned char> rgb;
+    std::vector<unsigned char> alpha;
+    splitImage(m_format, pixels, width, height, expandedWidth, expandedHeight, rgb, alpha);
+
+    // The blocks are compared as ETCPACK reads them, after the expansion to whole blocks, which
+    // takes the alpha of the blocks on the right edge from the last pixel of the image.
+    std::vector<unsigned char> blockPixels;
+    getImageBlockPixels(m_format, rgb, alpha, expandedWidth, expandedHeight, blockPixels);
+
+    const bool hasReference = (reference_io.width == width && reference_io.height == height &&
+                               reference_io.blockPixels.size() == blockPixels.size() &&
+                               reference_io.blocks.size() == blockCount * blockSize);
+    std::vector<size_t> changedBlocks;
+    for (size_t i = 0; i < blockCount; ++i) {
+        if (!hasReference || !isSameBlock(&blockPixels[i * pixelSize], &reference_io.blockPixels[i * pixelSize],
+                                          pixelSize)) {
+            changedBlocks.push_back(i);
+        }
+    }
+
+    if (changedBlocks.size() == blockCount) {
+        blocks_o.resize(getCompressedImageSize(&m_context, expandedWidth, expandedHeight));
+        compressImage(&m_context, rgb.data(), alpha.empty() ? nullptr : alpha.data(), expandedWidth, expandedHeight,
+                      blocks_o.data());
+    } else {
+        blocks_o = reference_io.blocks;
+    }
+
+    if (!changedBlocks.empty() && changedBlocks.size() < blockCount) {
+        // ETCPACK encodes every block by itself, the changed blocks are encoded as an image of their own
+        // rows of blocks, the last row filled up with the last changed block.
+        const uint32_t changedRows = static_cast<uint32_t>((changedBlocks.size() + blocksPerRow - 1) / blocksPerRow);
+        std::vector<unsigned char> changedRGB(static_cast<size_t>(expandedWidth) * changedRows * 4 * 3);
+        std::vector<unsigned char> changedAlpha(alpha.empty() ? 0 : static_cast<size_t>(expandedWidth) * changedRows * 4);
+        for (size_t i = 0; i < static_cast<size_t>(changedRows) * blocksPerRow; ++i) {
+            const size_t block = changedBlocks[std::min(i, changedBlocks.size() - 1)];
+            setBlockPixels(&blockPixels[block * pixelSize], expandedWidth, static_cast<uint32_t>(i % blocksPerRow),
+                           static_cast<uint32_t>(i / blocksPerRow), changedRGB, changedAlpha);
+        }
+
+        std::vector<unsigned char> changedCodes(getCompressedImageSize(&m_context, expandedWidth, changedRows * 4));
+        compressImage(&m_context, changedRGB.data(), changedAlpha.empty() ? nullptr : changedAlpha.data(),
+                      expandedWidth, changedRows * 4, changedCodes.data());
+        for (size_t i = 0; i < changedBlocks.size(); ++i) {
+            memcpy(&blocks_o[changedBlocks[i] * blockSize], &changedCodes[i * blockSize], blockSize);
+        }
+    }
+
+    reference_io.blocks = blocks_o;
+    if (m_maxPSNRLoss > 0.0) {
+        repeatBlocks(blockPixels, blocksPerRow, blocks_o);
+    }
+
+    // Blocks copied from the reference keep the pixels they were encoded from.
+    if (hasReference) {
+        for (size_t block : changedBlocks) {
+            memcpy(&reference_io.blockPixels[block * pixelSize], &blockPixels[block * pixelSize], pixelSize);
+        }
+    } else {
+        reference_io.width = width;
+        reference_io.height = height;
+        reference_io.blockPixels.swap(blockPixels);
+    }
+    return blockCount - changedBlocks.size();
+}
+
+bool ETC2Encoder::isSameBlock(const unsigned char* blockPixels, const unsigned char* referencePixels,
+                              size_t size) const
+{
+    if (0 == m_reuseTolerance) {
+        return 0 == memcmp(blockPixels, referencePixels, size);
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (static_cast<uint32_t>(abs(blockPixels[i] - referencePixels[i])) > m_reuseTolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ETC2Encoder::repeatBlocks(const std::vector<unsigned char>& blockPixels, uint32_t blocksPerRow,
+                               std::vector<unsigned char>& blocks_io) const
+{
+    const size_t blockSize = GetETC2BlockSize(m_format);
+    const size_t pixelSize = getBlockPixelSize(m_format);
+    const size_t blockCount = blocks_io.size() / blockSize;
+    // RGBA8 blocks are an alpha half and a color half that are traded one by one, the other formats a color half.
+    const size_t colorOffset = (ETC2Format_RGBA8 == m_format) ? 8 : 0;
+    // A block may add this part of its squared errors, what it leaves over goes to the blocks after it, so the
+    // errors of the texture grow by at most as much.
+    const double errorGrowth = pow(10.0, m_maxPSNRLoss / 10.0) - 1.0;
+    BlockError budget = { 0.0, 0.0 };
+    std::vector<unsigned char> candidate(blockSize);
+    std::vector<unsigned char> bestBlock(blockSize);
+
+    for (size_t i = 0; i < blockCount; ++i) {
+        unsigned char* block = &blocks_io[i * blockSize];
+        const unsigned char* pixels = &blockPixels[i * pixelSize];
+        BlockError error = getBlockError(m_format, block, pixels);
+        budget.color += error.color * errorGrowth;
+        budget.alpha += error.alpha * errorGrowth;
+
+        const unsigned char* neighbors[2] = { (0 != i % blocksPerRow) ? block - blockSize : nullptr,
+                                              (i >= blocksPerRow) ? block - blocksPerRow * blockSize : nullptr };
+        for (size_t half = 0; half < blockSize; half += 8) {
+            bool isRepeated = false;
+            for (const unsigned char* neighbor : neighbors) {
+                isRepeated = isRepeated || (nullptr != neighbor && 0 == memcmp(neighbor + half, block + half, 8));
+            }
+            if (isRepeated) {
+                continue;
+            }
+
+            // The whole half of a neighbor repeats 8 bytes, its base colors 4. The candidate that repeats the
+            // most and adds the least error within the budget is taken.
+            bool hasBest = false;
+            BlockError bestError = error;
+            for (int repeatedSize = 8; repeatedSize >= 4 && !hasBest; repeatedSize -= 4) {
+                if (4 == repeatedSize && colorOffset != half) {
+                    break;
+                }
+                for (const unsigned char* neighbor : neighbors) {
+                    if (nullptr == neighbor || (4 == repeatedSize && 0 == memcmp(neighbor + half, block + half, 4))) {
+                        continue;
+                    }
+                    memcpy(candidate.data(), block, blockSize);
+                    if (8 == repeatedSize) {
+                        memcpy(&candidate[half], neighbor + half, 8);
+                    } else {
+                        snapColorHalf(m_format, half, neighbor + half, pixels, candidate.data());
+                    }
+                    const BlockError candidateError = getBlockError(m_format, candidate.data(), pixels);
+                    if (candidateError.color - error.color <= budget.color &&
+                        candidateError.alpha - error.alpha <= budget.alpha &&
+                        (!hasBest || candidateError.color + candidateError.alpha < bestError.color + bestError.alpha)) {
+                        hasBest = true;
+                        bestError = candidateError;
+                        bestBlock.swap(candidate);
+                    }
+                }
+            }
+            if (hasBest) {
+                budget.color -= bestError.color - error.color;
+                budget.alpha -= bestError.alpha - error.alpha;
+                error = bestError;
+                memcpy(block, bestBlock.data(), blockSize);
+            }
+        }
+    }
+}
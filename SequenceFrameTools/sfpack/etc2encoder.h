@@ -0,0 +1,79 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef SFPACK_ETC2ENCODER_H_
+#define SFPACK_ETC2ENCODER_H_
+
+#include "etc2decoder.h"
+#include "etcpack.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+// The frame of a sequence encoded before the next one, with the pixels every block was encoded from.
+// Start a sequence with an empty reference.
+struct ETC2Reference {
+    uint32_t width;
+    uint32_t height;
+    // the pixels of each block as ETCPACK reads them, block by block: 48 bytes RGB and 16 bytes alpha
+    // for the formats with alpha
+    std::vector<unsigned char> blockPixels;
+    std::vector<unsigned char> blocks;
+};
+
+// Encodes images with the encoder of ETCPACK (etcpack.cxx), the way "etcpack -c etc2 -f <format>"
+// does with its default fast speed and perceptual metric, but from pixels in memory instead of the
+// image files etcpack reads and writes. An encoder keeps its settings in its own ETCPACK context,
+// several threads can encode with it at the same time.
+class ETC2Encoder
+{
+public:
+
+    // Frames of a sequence take the blocks of the frame before whose pixels differ by at most
+    // reuseTolerance in every channel. With 0 only identical blocks are taken, those encode to the
+    // same bits again, so the textures are the same as encoded one by one.
+    //
+    // With a maxPSNRLoss above 0 dB the blocks ETCPACK chose are traded for blocks that repeat the
+    // bytes of the block on the left or above, which the compressors of the package find as matches.
+    // A block takes the alpha or color half of a neighbor, or the base colors of the neighbor's color
+    // half with pixel indices chosen for its own pixels. The weighted PSNR of the texture, as
+    // calculateWeightedPSNR of ETCPACK gives it with the perceptual weights, and the PSNR of the
+    // alpha lose at most maxPSNRLoss.
+    ETC2Encoder(ETC2Format format, uint32_t reuseTolerance, double maxPSNRLoss);
+    ~ETC2Encoder();
+
+    ETC2Format getFormat() const;
+    uint32_t getReuseTolerance() const;
+    double getMaxPSNRLoss() const;
+
+    // Encode RGBA8 pixels of width x height, row by row from the top, into the 4x4 blocks of the
+    // texture, row by row.
+    void encode(const unsigned char* pixels, uint32_t width, uint32_t height,
+                std::vector<unsigned char>& blocks_o) const;
+
+    // Encode the next frame of a sequence: blocks that match the block of reference_io at the same
+    // place are copied instead of encoded. The reference is updated to the frame, the blocks copied
+    // keep the pixels they were encoded from, so the differences do not add up over the frames. The
+    // reference keeps the blocks of ETCPACK, before they are traded for the PSNR loss, so a frame is
+    // encoded the same whatever frame came before. Returns the number of blocks copied.
+    size_t encode(const unsigned char* pixels, uint32_t width, uint32_t height, ETC2Reference& reference_io,
+                  std::vector<unsigned char>& blocks_o) const;
+
+private:
+
+    ETC2Encoder(const ETC2Encoder&);
+    ETC2Encoder& operator=(const ETC2Encoder&);
+
+    bool isSameBlock(const unsigned char* blockPixels, const unsigned char* referencePixels, size_t size) const;
+    // Trade the blocks of a texture for blocks that repeat their neighbors, see maxPSNRLoss. blockPixels
+    // holds the pixels of every block the way the reference keeps them.
+    void repeatBlocks(const std::vector<unsigned char>& blockPixels, uint32_t blocksPerRow,
+                      std::vector<unsigned char>& blocks_io) const;
+
+    ETC2Format m_format;
+    uint32_t m_reuseTolerance;
+    double m_maxPSNRLoss;
+    EncoderContext m_context;
+};
+
+#endif // SFPACK_ETC2ENCODER_H_
@@ -0,0 +1,225 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "framecache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined (_WIN32)
+#include <direct.h>
+#endif
+
+#include <atomic>
+#include <random>
+
+#include "xxhash.h"
+
+namespace
+{
+    // Raise the version when the encoder or the compressors give other output for the same input, the
+    // entries of the earlier packers are not found then.
+    const uint16_t FrameCacheVersion = 1;
+    const size_t FrameCacheHeaderSize = 40;
+    const uint64_t FrameCacheKeySeeds[2] = { 0, 0x9e3779b97f4a7c15ull };
+
+    template <typename T>
+    void writeValue(unsigned char* data, size_t offset, T value)
+    {
+        memcpy(data + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T readValue(const unsigned char* data, size_t offset)
+    {
+        T value;
+        memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+
+    // temporary files of the threads of a packer
+    std::atomic<uint32_t> temporaryFileCount(0);
+
+    // create the directory unless it exists, its parent has to exist
+    int makeDirectory(const std::string& path)
+    {
+#if defined (_WIN32)
+        int ret = _mkdir(path.c_str());
+#else
+        int ret = mkdir(path.c_str(), 0777);
+#endif
+        if (0 == ret) {
+            return 0;
+        }
+        if (EEXIST != errno) {
+            return errno;
+        }
+
+        struct stat status;
+        if (0 != stat(path.c_str(), &status)) {
+            return errno;
+        }
+        return (0 != (status.st_mode & S_IFDIR)) ? 0 : ENOTDIR;
+    }
+}
+
+FrameCacheKeyBuilder::FrameCacheKeyBuilder()
+{
+    for (int i = 0; i < 2; ++i) {
+        m_states[i] = XXH64_createState();
+        XXH64_reset(m_states[i], FrameCacheKeySeeds[i]);
+    }
+}
+
+FrameCacheKeyBuilder::~FrameCacheKeyBuilder()
+{
+    for (int i = 0; i < 2; ++i) {
+        XXH64_freeState(m_states[i]);
+    }
+}
+
+void FrameCacheKeyBuilder::add(const void* data, size_t size)
+{
+    for (int i = 0; i < 2; ++i) {
+        XXH64_update(m_states[i], data, size);
+    }
+}
+
+void FrameCacheKeyBuilder::add(uint32_t value)
+{
+    add(&value, sizeof(value));
+}
+
+void FrameCacheKeyBuilder::add(const FrameCacheKey& key)
+{
+    add(&key.low, sizeof(key.low));
+    add(&key.high, sizeof(key.high));
+}
+
+FrameCacheKey FrameCacheKeyBuilder::getKey() const
+{
+    const FrameCacheKey key = { XXH64_digest(m_states[0]), XXH64_digest(m_states[1]) };
+    return key;
+}
+
+FrameCache::FrameCache()
+    : m_temporaryId(0)
+{
+}
+
+FrameCache::~FrameCache()
+{
+}
+
+int FrameCache::open(const std::string& directory)
+{
+    m_directory.clear();
+    if (directory.empty()) {
+        return 0;
+    }
+
+    int ret = makeDirectory(directory);
+    if (0 != ret) {
+        return ret;
+    }
+
+    m_directory = directory;
+    if ('/' != m_directory.back() && '\\' != m_directory.back()) {
+        m_directory += '/';
+    }
+    std::random_device random;
+    m_temporaryId = (static_cast<uint64_t>(random()) << 32) | random();
+    return 0;
+}
+
+bool FrameCache::isOpen() const
+{
+    return !m_directory.empty();
+}
+
+bool FrameCache::load(const FrameCacheKey& key, uint32_t* fields_o, size_t fieldCount,
+                      std::vector<unsigned char>& data_o) const
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    FILE* file = fopen(getEntryPath(key).c_str(), "rb");
+    if (nullptr == file) {
+        return false;
+    }
+
+    unsigned char header[FrameCacheHeaderSize];
+    bool isValid = (fread(header, sizeof(header), 1, file) == 1 && 0 == memcmp(header, "SFPC", 4) &&
+                    readValue<uint16_t>(header, 4) == FrameCacheVersion &&
+                    readValue<uint16_t>(header, 6) == fieldCount &&
+                    readValue<uint64_t>(header, 8) == key.low && readValue<uint64_t>(header, 16) == key.high);
+    if (isValid) {
+        const uint64_t dataSize = readValue<uint64_t>(header, 24);
+        data_o.resize(static_cast<size_t>(dataSize));
+        isValid = (fread(fields_o, sizeof(uint32_t), fieldCount, file) == fieldCount &&
+                   (data_o.empty() || fread(data_o.data(), data_o.size(), 1, file) == 1) &&
+                   XXH64(data_o.data(), data_o.size(), 0) == readValue<uint64_t>(header, 32));
+    }
+    fclose(file);
+    return isValid;
+}
+
+int FrameCache::store(const FrameCacheKey& key, const uint32_t* fields, size_t fieldCount,
+                      const std::vector<unsigned char>& data) const
+{
+    if (!isOpen() || fieldCount > UINT16_MAX) {
+        return EINVAL;
+    }
+
+    const std::string fileName = getEntryPath(key);
+    char suffix[40];
+    snprintf(suffix, sizeof(suffix), ".%016llx.%u.part", static_cast<unsigned long long>(m_temporaryId),
+             temporaryFileCount++);
+    const std::string temporaryFileName = fileName + suffix;
+
+    FILE* file = fopen(temporaryFileName.c_str(), "wb");
+    if (nullptr == file) {
+        return errno;
+    }
+
+    unsigned char header[FrameCacheHeaderSize];
+    memcpy(header, "SFPC", 4);
+    writeValue<uint16_t>(header, 4, FrameCacheVersion);
+    writeValue<uint16_t>(header, 6, static_cast<uint16_t>(fieldCount));
+    writeValue<uint64_t>(header, 8, key.low);
+    writeValue<uint64_t>(header, 16, key.high);
+    writeValue<uint64_t>(header, 24, data.size());
+    writeValue<uint64_t>(header, 32, XXH64(data.data(), data.size(), 0));
+
+    int ret = 0;
+    if (fwrite(header, sizeof(header), 1, file) != 1 || fwrite(fields, sizeof(uint32_t), fieldCount, file) != fieldCount ||
+        (!data.empty() && fwrite(data.data(), data.size(), 1, file) != 1)) {
+        ret = errno;
+    }
+    if (0 != fclose(file) && 0 == ret) {
+        ret = errno;
+    }
+
+    // An entry of another packer may have been written meanwhile, it has the same content.
+    if (0 == ret) {
+        remove(fileName.c_str());
+        if (0 != rename(temporaryFileName.c_str(), fileName.c_str())) {
+            ret = errno;
+        }
+    }
+    if (0 != ret) {
+        remove(temporaryFileName.c_str());
+    }
+    return ret;
+}
+
+std::string FrameCache::getEntryPath(const FrameCacheKey& key) const
+{
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx%016llx.sfc", static_cast<unsigned long long>(key.high),
+             static_cast<unsigned long long>(key.low));
+    return m_directory + name;
+}
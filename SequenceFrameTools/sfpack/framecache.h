@@ -0,0 +1,78 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef SFPACK_FRAMECACHE_H_
+#define SFPACK_FRAMECACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+struct XXH64_state_s;
+
+// hash of everything a cache entry was made from
+struct FrameCacheKey {
+    uint64_t low;
+    uint64_t high;
+};
+
+// Builds a cache key from the data an entry depends on, in the order it is added.
+class FrameCacheKeyBuilder
+{
+public:
+
+    FrameCacheKeyBuilder();
+    ~FrameCacheKeyBuilder();
+
+    void add(const void* data, size_t size);
+    void add(uint32_t value);
+    void add(const FrameCacheKey& key);
+    FrameCacheKey getKey() const;
+
+private:
+
+    FrameCacheKeyBuilder(const FrameCacheKeyBuilder&);
+    FrameCacheKeyBuilder& operator=(const FrameCacheKeyBuilder&);
+
+    // two XXH64 hashes with different seeds, 128 bits keep collisions out of caches of any size
+    XXH64_state_s* m_states[2];
+};
+
+// Keeps the textures and payloads of packed frames as files in a directory, named by the key of the
+// source pixels and settings they were made from, so that packing a sequence again only encodes and
+// compresses the frames that changed. An entry is a few 32 bit fields and a block of data. Entries
+// are written to a temporary file and renamed, several threads and packers can share a directory;
+// an entry that is missing, truncated or from another version of the packer is not found.
+class FrameCache
+{
+public:
+
+    FrameCache();
+    ~FrameCache();
+
+    // use the directory and create it when it is missing, an empty directory leaves the cache off; returns 0
+    // or an error, the cache stays off then
+    int open(const std::string& directory);
+    bool isOpen() const;
+
+    // Read the entry of key: fieldCount fields into fields_o and its data into data_o. Returns false when
+    // there is no such entry.
+    bool load(const FrameCacheKey& key, uint32_t* fields_o, size_t fieldCount, std::vector<unsigned char>& data_o) const;
+    // write the entry of key, returns 0 or an error
+    int store(const FrameCacheKey& key, const uint32_t* fields, size_t fieldCount,
+              const std::vector<unsigned char>& data) const;
+
+private:
+
+    FrameCache(const FrameCache&);
+    FrameCache& operator=(const FrameCache&);
+
+    std::string getEntryPath(const FrameCacheKey& key) const;
+
+    std::string m_directory;
+    // makes the temporary file names of this packer unique
+    uint64_t m_temporaryId;
+};
+
+#endif // SFPACK_FRAMECACHE_H_
@@ -0,0 +1,327 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "frameimage.h"
+
+#include <png.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace
+{
+    // fixed point precision of the resampling weights, that of Pillow for 8 bit channels
+    const int PrecisionBits = 32 - 8 - 2;
+    const double BicubicSupport = 2.0;
+
+    // Pillow's bicubic filter, a = -0.5
+    double bicubicFilter(double x)
+    {
+        const double a = -0.5;
+        x = fabs(x);
+        if (x < 1.0) {
+            return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+        }
+        if (x < 2.0) {
+            return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+        }
+        return 0.0;
+    }
+
+    // The weights of every output pixel along one axis: the first input pixel and the fixed point
+    // weights of ksize input pixels from there, of which count are used.
+    struct ResampleWeights {
+        int ksize;
+        std::vector<int> first;
+        std::vector<int> count;
+        std::vector<int> weights;
+    };
+
+    void computeWeights(uint32_t inSize, uint32_t outSize, ResampleWeights& weights_o)
+    {
+        const double scale = static_cast<double>(inSize) / outSize;
+        const double filterScale = std::max(scale, 1.0);
+        const double support = BicubicSupport * filterScale;
+        const int ksize = static_cast<int>(ceil(support)) * 2 + 1;
+
+        weights_o.ksize = ksize;
+        weights_o.first.resize(outSize);
+        weights_o.count.resize(outSize);
+        weights_o.weights.assign(static_cast<size_t>(outSize) * ksize, 0);
+
+        std::vector<double> k(ksize);
+        for (uint32_t xx = 0; xx < outSize; ++xx) {
+            const double center = (xx + 0.5) * scale;
+            const double ss = 1.0 / filterScale;
+            int xmin = static_cast<int>(center - support + 0.5);
+            if (xmin < 0) {
+                xmin = 0;
+            }
+            int xmax = static_cast<int>(center + support + 0.5);
+            if (xmax > static_cast<int>(inSize)) {
+                xmax = static_cast<int>(inSize);
+            }
+            xmax -= xmin;
+
+            double ww = 0.0;
+            for (int x = 0; x < xmax; ++x) {
+                k[x] = bicubicFilter((x + xmin - center + 0.5) * ss);
+                ww += k[x];
+            }
+            int* weights = &weights_o.weights[static_cast<size_t>(xx) * ksize];
+            for (int x = 0; x < xmax; ++x) {
+                const double w = (0.0 != ww) ? k[x] / ww : k[x];
+                weights[x] = (w < 0.0) ? static_cast<int>(-0.5 + w * (1 << PrecisionBits))
+                                       : static_cast<int>(0.5 + w * (1 << PrecisionBits));
+            }
+            weights_o.first[xx] = xmin;
+            weights_o.count[xx] = xmax;
+        }
+    }
+
+    unsigned char clip8(int value)
+    {
+        return static_cast<unsigned char>(std::min(std::max(value >> PrecisionBits, 0), 255));
+    }
+
+    // MULDIV255 of Pillow, the RGBA to RGBa conversion
+    unsigned char premultiply(unsigned int value, unsigned int alpha)
+    {
+        const unsigned int product = value * alpha + 128;
+        return static_cast<unsigned char>(((product >> 8) + product) >> 8);
+    }
+
+    void premultiplyImage(std::vector<unsigned char>& pixels)
+    {
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            const unsigned int alpha = pixels[i + 3];
+            pixels[i + 0] = premultiply(pixels[i + 0], alpha);
+            pixels[i + 1] = premultiply(pixels[i + 1], alpha);
+            pixels[i + 2] = premultiply(pixels[i + 2], alpha);
+        }
+    }
+
+    // the RGBa to RGBA conversion of Pillow
+    void unpremultiplyImage(std::vector<unsigned char>& pixels)
+    {
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            const unsigned int alpha = pixels[i + 3];
+            if (0 != alpha && 255 != alpha) {
+                for (int c = 0; c < 3; ++c) {
+                    pixels[i + c] = static_cast<unsigned char>(std::min(255u, 255u * pixels[i + c] / alpha));
+                }
+            }
+        }
+    }
+
+    void resampleHorizontal(const std::vector<unsigned char>& in, uint32_t inWidth, uint32_t height,
+                            uint32_t outWidth, std::vector<unsigned char>& out_o)
+    {
+        ResampleWeights weights;
+        computeWeights(inWidth, outWidth, weights);
+        out_o.resize(static_cast<size_t>(outWidth) * height * 4);
+
+        for (uint32_t y = 0; y < height; ++y) {
+            const unsigned char* row = &in[static_cast<size_t>(y) * inWidth * 4];
+            unsigned char* outRow = &out_o[static_cast<size_t>(y) * outWidth * 4];
+            for (uint32_t x = 0; x < outWidth; ++x) {
+                const int* k = &weights.weights[static_cast<size_t>(x) * weights.ksize];
+                const unsigned char* pixel = row + static_cast<size_t>(weights.first[x]) * 4;
+                for (int c = 0; c < 4; ++c) {
+                    int sum = 1 << (PrecisionBits - 1);
+                    for (int i = 0; i < weights.count[x]; ++i) {
+                        sum += pixel[i * 4 + c] * k[i];
+                    }
+                    outRow[x * 4 + c] = clip8(sum);
+                }
+            }
+        }
+    }
+
+    void resampleVertical(const std::vector<unsigned char>& in, uint32_t width, uint32_t inHeight,
+                          uint32_t outHeight, std::vector<unsigned char>& out_o)
+    {
+        ResampleWeights weights;
+        computeWeights(inHeight, outHeight, weights);
+        out_o.resize(static_cast<size_t>(width) * outHeight * 4);
+
+        // The sums of a whole output row are kept, so the input is read row by row.
+        const size_t rowBytes = static_cast<size_t>(width) * 4;
+        std::vector<int> sums(rowBytes);
+        for (uint32_t y = 0; y < outHeight; ++y) {
+            const int* k = &weights.weights[static_cast<size_t>(y) * weights.ksize];
+            std::fill(sums.begin(), sums.end(), 1 << (PrecisionBits - 1));
+            for (int i = 0; i < weights.count[y]; ++i) {
+                const unsigned char* row = &in[(static_cast<size_t>(weights.first[y]) + i) * rowBytes];
+                for (size_t x = 0; x < rowBytes; ++x) {
+                    sums[x] += row[x] * k[i];
+                }
+            }
+            unsigned char* outRow = &out_o[static_cast<size_t>(y) * rowBytes];
+            for (size_t x = 0; x < rowBytes; ++x) {
+                outRow[x] = clip8(sums[x]);
+            }
+        }
+    }
+
+    void resizeNearest(const FrameImage& image, uint32_t width, uint32_t height, FrameImage& image_o)
+    {
+        const double xScale = static_cast<double>(image.width) / width;
+        const double yScale = static_cast<double>(image.height) / height;
+        for (uint32_t y = 0; y < height; ++y) {
+            const uint32_t sourceY = std::min(static_cast<uint32_t>((y + 0.5) * yScale), image.height - 1);
+            for (uint32_t x = 0; x < width; ++x) {
+                const uint32_t sourceX = std::min(static_cast<uint32_t>((x + 0.5) * xScale), image.width - 1);
+                memcpy(&image_o.pixels[(static_cast<size_t>(y) * width + x) * 4],
+                       &image.pixels[(static_cast<size_t>(sourceY) * image.width + sourceX) * 4], 4);
+            }
+        }
+    }
+}
+
+int LoadPNGImage(const char* fileName, FrameImage& image_o)
+{
+    FILE* file = fopen(fileName, "rb");
+    if (nullptr == file) {
+        return -1;
+    }
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info = (nullptr != png) ? png_create_info_struct(png) : nullptr;
+    if (nullptr == info) {
+        png_destroy_read_struct(&png, nullptr, nullptr);
+        fclose(file);
+        return -1;
+    }
+
+    std::vector<png_bytep> rows;
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(file);
+        return -1;
+    }
+
+    png_init_io(png, file);
+    png_read_info(png, info);
+
+    const png_byte colorType = png_get_color_type(png, info);
+    image_o.width = png_get_image_width(png, info);
+    image_o.height = png_get_image_height(png, info);
+    image_o.hasAlpha = (0 != (colorType & PNG_COLOR_MASK_ALPHA)) || (0 != png_get_valid(png, info, PNG_INFO_tRNS));
+    image_o.isPalette = (PNG_COLOR_TYPE_PALETTE == colorType);
+
+    // Like Pillow: no gamma correction, 16 bit channels keep their high byte.
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_gray_to_rgb(png);
+    png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    image_o.pixels.resize(static_cast<size_t>(image_o.width) * image_o.height * 4);
+    rows.resize(image_o.height);
+    for (uint32_t y = 0; y < image_o.height; ++y) {
+        rows[y] = &image_o.pixels[static_cast<size_t>(y) * image_o.width * 4];
+    }
+    png_read_image(png, rows.data());
+    png_read_end(png, nullptr);
+
+    png_destroy_read_struct(&png, &info, nullptr);
+    fclose(file);
+    return 0;
+}
+
+void ResizeImage(const FrameImage& image, uint32_t width, uint32_t height, FrameImage& image_o)
+{
+    image_o.hasAlpha = image.hasAlpha;
+    image_o.isPalette = image.isPalette;
+    if (width == image.width && height == image.height) {
+        image_o.width = width;
+        image_o.height = height;
+        image_o.pixels = image.pixels;
+        return;
+    }
+
+    image_o.pixels.resize(static_cast<size_t>(width) * height * 4);
+    if (image.isPalette) {
+        resizeNearest(image, width, height, image_o);
+        image_o.width = width;
+        image_o.height = height;
+        return;
+    }
+
+    std::vector<unsigned char> source(image.pixels);
+    if (image.hasAlpha) {
+        premultiplyImage(source);
+    }
+
+    // Pillow resamples the rows first, then the columns, and skips an axis of the same size.
+    uint32_t sourceWidth = image.width;
+    std::vector<unsigned char> rows;
+    if (width != image.width) {
+        resampleHorizontal(source, image.width, image.height, width, rows);
+        sourceWidth = width;
+    } else {
+        rows.swap(source);
+    }
+    if (height != image.height) {
+        resampleVertical(rows, sourceWidth, image.height, height, image_o.pixels);
+    } else {
+        image_o.pixels.swap(rows);
+    }
+
+    if (image.hasAlpha) {
+        unpremultiplyImage(image_o.pixels);
+    }
+    image_o.width = width;
+    image_o.height = height;
+}
+
+void FlipImage(FrameImage& image)
+{
+    const size_t rowBytes = static_cast<size_t>(image.width) * 4;
+    for (uint32_t y = 0; y < image.height / 2; ++y) {
+        std::swap_ranges(image.pixels.begin() + y * rowBytes, image.pixels.begin() + (y + 1) * rowBytes,
+                         image.pixels.begin() + (image.height - 1 - y) * rowBytes);
+    }
+}
+
+FrameAlpha GetFrameAlpha(const FrameImage& image)
+{
+    if (!image.hasAlpha) {
+        return FrameAlpha_Opaque;
+    }
+
+    FrameAlpha alpha = FrameAlpha_Opaque;
+    for (size_t i = 3; i < image.pixels.size(); i += 4) {
+        if (0 == image.pixels[i]) {
+            alpha = FrameAlpha_Binary;
+        } else if (255 != image.pixels[i]) {
+            return FrameAlpha_Translucent;
+        }
+    }
+    return alpha;
+}
+
+bool GetVisibleRect(const FrameImage& image, uint32_t& left_o, uint32_t& top_o, uint32_t& right_o,
+                    uint32_t& bottom_o)
+{
+    left_o = image.width;
+    top_o = image.height;
+    right_o = 0;
+    bottom_o = 0;
+    for (uint32_t y = 0; y < image.height; ++y) {
+        const unsigned char* row = &image.pixels[static_cast<size_t>(y) * image.width * 4];
+        for (uint32_t x = 0; x < image.width; ++x) {
+            if (0 != row[x * 4 + 3]) {
+                left_o = std::min(left_o, x);
+                right_o = std::max(right_o, x + 1);
+                top_o = std::min(top_o, y);
+                bottom_o = y + 1;
+            }
+        }
+    }
+    return left_o < right_o;
+}
@@ -0,0 +1,49 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef SFPACK_FRAMEIMAGE_H_
+#define SFPACK_FRAMEIMAGE_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+// Source frames of the packer. The images are prepared the way TexturePacker.py prepared them with
+// Pillow, so that both tools hand the same pixels to ETCPACK.
+
+struct FrameImage {
+    uint32_t width;
+    uint32_t height;
+    // RGBA8 pixels, row by row from the top
+    std::vector<unsigned char> pixels;
+    // the source has an alpha channel or a transparent color, otherwise alpha is 255
+    bool hasAlpha;
+    // the source is a palette image, Pillow resizes those with the nearest pixel
+    bool isPalette;
+};
+
+// Read a PNG file of any color type and bit depth into RGBA8 pixels.
+int LoadPNGImage(const char* fileName, FrameImage& image_o);
+
+// Resize like Pillow's Image.resize with its default bicubic filter: separable, in fixed point and on
+// premultiplied color when the image has alpha. An image of the size already is copied.
+void ResizeImage(const FrameImage& image, uint32_t width, uint32_t height, FrameImage& image_o);
+
+// Turn the image upside down, like Pillow's ImageOps.flip.
+void FlipImage(FrameImage& image);
+
+enum FrameAlpha {
+    // every pixel is opaque
+    FrameAlpha_Opaque,
+    // every pixel is opaque or transparent
+    FrameAlpha_Binary,
+    // some pixel is translucent
+    FrameAlpha_Translucent
+};
+
+FrameAlpha GetFrameAlpha(const FrameImage& image);
+
+// Bounding rectangle of the pixels with non-zero alpha, in pixels. Returns false when there are none.
+bool GetVisibleRect(const FrameImage& image, uint32_t& left_o, uint32_t& top_o, uint32_t& right_o,
+                    uint32_t& bottom_o);
+
+#endif // SFPACK_FRAMEIMAGE_H_
@@ -0,0 +1,312 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#include "packagewriter.h"
+
+#include "xxhash.h"
+
+#include <string.h>
+
+namespace
+{
+    const char PackageMagic[4] = { 'S', 'F', 'P', 'K' };
+    const uint16_t PackageVersion = 2;
+    const uint16_t HeaderSize = 80;
+    // packages with several tracks append the track count and the track table offset to the header
+    const uint16_t TrackHeaderSize = 96;
+    const size_t TrackEntrySize = 16;
+    const size_t IndexEntrySize = 32;
+    // seed of the second payload hash of streamed packages
+    const uint64_t SecondPayloadHashSeed = 0x9e3779b97f4a7c15ull;
+
+    uint64_t alignOffset(uint64_t offset, uint32_t alignment)
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    void appendLittleEndian(std::vector<unsigned char>& data, uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i) {
+            data.push_back(static_cast<unsigned char>(value >> (8 * i)));
+        }
+    }
+
+    int seekFile(FILE* file, uint64_t offset, int origin)
+    {
+#if defined (_WIN32)
+        return _fseeki64(file, static_cast<__int64>(offset), origin);
+#else
+        return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+    }
+
+    bool isSameRect(const TexturePackageFrame& entry, const TextureBlockRect& rect)
+    {
+        return entry.trimX == rect.x && entry.trimY == rect.y && entry.trimWidth == rect.width &&
+               entry.trimHeight == rect.height;
+    }
+}
+
+PackageWriter::PackageWriter()
+    : m_file(nullptr)
+    , m_layout(PackageLayout_Indexed)
+    , m_alignment(1)
+    , m_dataOffset(0)
+{
+}
+
+PackageWriter::~PackageWriter()
+{
+    if (nullptr != m_file) {
+        fclose(m_file);
+    }
+}
+
+int PackageWriter::open(const char* fileName, PackageLayout layout, uint32_t textureNumber,
+                        const std::vector<TexturePackageTrack>& tracks, uint32_t textureFormat, uint32_t codec,
+                        uint32_t alignment, const std::vector<unsigned char>& dictionary)
+{
+    if (tracks.empty()) {
+        return -1;
+    }
+
+    // Duplicate frames of indexed packages are compared with the payload written before, so the file
+    // is read as well.
+    const bool isStreamed = (PackageLayout_Streamed == layout);
+    m_file = fopen(fileName, isStreamed ? "wb" : "w+b");
+    if (nullptr == m_file) {
+        return -1;
+    }
+    m_layout = layout;
+    m_alignment = alignment;
+
+    // The indexes of streamed packages follow the data, the readers find them from the end of the file.
+    const bool hasTrackTable = (tracks.size() > 1);
+    const uint16_t headerSize = hasTrackTable ? TrackHeaderSize : HeaderSize;
+    const uint64_t trackTableOffset = hasTrackTable ? headerSize : 0;
+    const uint64_t indexOffset = headerSize + (hasTrackTable ? TrackEntrySize * tracks.size() : 0);
+    const uint64_t dictionaryOffset = indexOffset + (isStreamed ? 0 : IndexEntrySize * textureNumber * tracks.size());
+    m_dataOffset = alignOffset(dictionaryOffset + dictionary.size(), alignment);
+
+    m_tracks.resize(tracks.size());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        Track& track = m_tracks[i];
+        track.indexOffset = isStreamed ? UINT64_MAX : indexOffset + IndexEntrySize * textureNumber * i;
+        track.index.resize(textureNumber);
+        track.addedFrames.assign(textureNumber, false);
+        track.addedFrameCount = 0;
+        if (isStreamed) {
+            track.secondPayloadHashes.resize(textureNumber);
+        }
+    }
+
+    std::vector<unsigned char> header(PackageMagic, PackageMagic + sizeof(PackageMagic));
+    appendLittleEndian(header, PackageVersion, 2);
+    appendLittleEndian(header, headerSize, 2);
+    appendLittleEndian(header, textureNumber, 4);
+    appendLittleEndian(header, tracks[0].textureWidth, 4);
+    appendLittleEndian(header, tracks[0].textureHeight, 4);
+    appendLittleEndian(header, textureFormat, 4);
+    appendLittleEndian(header, codec, 4);
+    appendLittleEndian(header, alignment, 4);
+    appendLittleEndian(header, m_tracks[0].indexOffset, 8);
+    appendLittleEndian(header, m_dataOffset, 8);
+    appendLittleEndian(header, isStreamed ? TexturePackageFlag_IndexAtEnd : 0, 4);
+    appendLittleEndian(header, IndexEntrySize, 4);
+    appendLittleEndian(header, 0, 8);
+    appendLittleEndian(header, dictionaryOffset, 8);
+    appendLittleEndian(header, dictionary.size(), 4);
+    appendLittleEndian(header, 0, 4);
+    if (hasTrackTable) {
+        appendLittleEndian(header, tracks.size(), 4);
+        appendLittleEndian(header, 0, 4);
+        appendLittleEndian(header, trackTableOffset, 8);
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            appendLittleEndian(header, tracks[i].textureWidth, 4);
+            appendLittleEndian(header, tracks[i].textureHeight, 4);
+            appendLittleEndian(header, m_tracks[i].indexOffset, 8);
+        }
+    }
+    // index placeholders of indexed packages, filled in by close
+    header.resize(static_cast<size_t>(dictionaryOffset), 0);
+    header.insert(header.end(), dictionary.begin(), dictionary.end());
+    header.resize(static_cast<size_t>(m_dataOffset), 0);
+
+    return writeBytes(header.data(), header.size());
+}
+
+int PackageWriter::addFrame(uint32_t track, uint32_t frameIndex, std::vector<unsigned char>& payload, uint32_t codec,
+                            uint16_t flags, uint32_t decodedSize, const TextureBlockRect& trimRect)
+{
+    if (nullptr == m_file || track >= m_tracks.size()) {
+        return -1;
+    }
+    Track& packageTrack = m_tracks[track];
+    const bool isStreamed = (PackageLayout_Streamed == m_layout);
+    if (frameIndex >= packageTrack.index.size() || packageTrack.addedFrames[frameIndex] ||
+        (!isStreamed && frameIndex != packageTrack.addedFrameCount)) {
+        return -1;
+    }
+    packageTrack.addedFrames[frameIndex] = true;
+    ++packageTrack.addedFrameCount;
+
+    TexturePackageFrame entry;
+    entry.offset = 0;
+    entry.size = static_cast<uint32_t>(payload.size());
+    entry.decodedSize = decodedSize;
+    entry.codec = static_cast<uint16_t>(codec);
+    entry.flags = flags;
+    entry.reference = frameIndex;
+    entry.trimX = static_cast<uint16_t>(trimRect.x);
+    entry.trimY = static_cast<uint16_t>(trimRect.y);
+    entry.trimWidth = static_cast<uint16_t>(trimRect.width);
+    entry.trimHeight = static_cast<uint16_t>(trimRect.height);
+
+    // Trimmed frames with the same blocks are the same frame only at the same position. Streamed frames
+    // may refer to a later frame here, close turns that one into the duplicate.
+    const uint64_t hash = XXH64(payload.data(), payload.size(), 0);
+    const uint64_t secondHash = isStreamed ? XXH64(payload.data(), payload.size(), SecondPayloadHashSeed) : 0;
+    auto candidates = packageTrack.payloadHashes.equal_range(hash);
+    for (auto candidate = candidates.first; candidate != candidates.second; ++candidate) {
+        const TexturePackageFrame& original = packageTrack.index[candidate->second];
+        if (original.size == payload.size() && original.codec == entry.codec && isSameRect(original, trimRect) &&
+            (isStreamed ? packageTrack.secondPayloadHashes[candidate->second] == secondHash
+                        : isSamePayload(packageTrack, original, payload))) {
+            entry.size = 0;
+            entry.flags = TexturePackageFrameFlag_Duplicate;
+            entry.reference = candidate->second;
+            packageTrack.index[frameIndex] = entry;
+            return 0;
+        }
+    }
+    packageTrack.payloadHashes.insert(std::make_pair(hash, frameIndex));
+    if (isStreamed) {
+        packageTrack.secondPayloadHashes[frameIndex] = secondHash;
+    }
+
+    if (0 == track || isStreamed) {
+        int ret = writePayload(payload, entry);
+        packageTrack.index[frameIndex] = entry;
+        return ret;
+    }
+
+    packageTrack.index[frameIndex] = entry;
+    PendingFrame pendingFrame;
+    pendingFrame.payload.swap(payload);
+    pendingFrame.entry = entry;
+    packageTrack.pendingFrames.push_back(std::move(pendingFrame));
+    return 0;
+}
+
+int PackageWriter::close()
+{
+    if (nullptr == m_file) {
+        return -1;
+    }
+
+    int ret = 0;
+    for (Track& track : m_tracks) {
+        if (track.addedFrameCount != track.index.size()) {
+            ret = -1;
+        }
+        for (PendingFrame& pendingFrame : track.pendingFrames) {
+            if (0 == ret) {
+                ret = writePayload(pendingFrame.payload, track.index[pendingFrame.entry.reference]);
+            }
+        }
+        track.pendingFrames.clear();
+        resolveDuplicates(track);
+    }
+
+    for (const Track& track : m_tracks) {
+        std::vector<unsigned char> index;
+        for (const TexturePackageFrame& entry : track.index) {
+            appendLittleEndian(index, entry.offset, 8);
+            appendLittleEndian(index, entry.size, 4);
+            appendLittleEndian(index, entry.decodedSize, 4);
+            appendLittleEndian(index, entry.codec, 2);
+            appendLittleEndian(index, entry.flags, 2);
+            appendLittleEndian(index, entry.reference, 4);
+            appendLittleEndian(index, entry.trimX, 2);
+            appendLittleEndian(index, entry.trimY, 2);
+            appendLittleEndian(index, entry.trimWidth, 2);
+            appendLittleEndian(index, entry.trimHeight, 2);
+        }
+        if (0 == ret && PackageLayout_Indexed == m_layout && 0 != seekFile(m_file, track.indexOffset, SEEK_SET)) {
+            ret = -1;
+        }
+        if (0 == ret) {
+            ret = writeBytes(index.data(), index.size());
+        }
+    }
+
+    if (0 != fclose(m_file) && 0 == ret) {
+        ret = -1;
+    }
+    m_file = nullptr;
+    return ret;
+}
+
+int PackageWriter::writeBytes(const void* data, size_t size)
+{
+    return (fwrite(data, 1, size, m_file) == size) ? 0 : -1;
+}
+
+int PackageWriter::writePayload(const std::vector<unsigned char>& payload, TexturePackageFrame& entry_io)
+{
+    entry_io.offset = m_dataOffset;
+    entry_io.size = static_cast<uint32_t>(payload.size());
+
+    // Padding keeps the next frame aligned.
+    const uint64_t paddedOffset = alignOffset(m_dataOffset + payload.size(), m_alignment);
+    std::vector<unsigned char> padding(static_cast<size_t>(paddedOffset - m_dataOffset - payload.size()), 0);
+    int ret = writeBytes(payload.data(), payload.size());
+    if (0 == ret) {
+        ret = writeBytes(padding.data(), padding.size());
+    }
+    m_dataOffset = paddedOffset;
+    return ret;
+}
+
+bool PackageWriter::isSamePayload(const Track& track, const TexturePackageFrame& entry,
+                                  const std::vector<unsigned char>& payload)
+{
+    for (const PendingFrame& pendingFrame : track.pendingFrames) {
+        if (pendingFrame.entry.reference == entry.reference) {
+            return pendingFrame.payload == payload;
+        }
+    }
+
+    // The frame is in the file already, read it back and return to the end for the next frame.
+    std::vector<unsigned char> written(payload.size());
+    bool isSame = (0 == seekFile(m_file, entry.offset, SEEK_SET)) &&
+                  (fread(written.data(), 1, written.size(), m_file) == written.size()) && (written == payload);
+    if (0 != seekFile(m_file, 0, SEEK_END)) {
+        isSame = false;
+    }
+    return isSame;
+}
+
+void PackageWriter::resolveDuplicates(Track& track)
+{
+    // The readers take duplicates of earlier frames only. The first frame that shows a payload gets its
+    // entry, the others refer to that frame.
+    std::vector<uint32_t> firstFrames(track.index.size(), UINT32_MAX);
+    for (uint32_t i = 0; i < track.index.size(); ++i) {
+        TexturePackageFrame& entry = track.index[i];
+        const bool isDuplicate = (0 != (entry.flags & TexturePackageFrameFlag_Duplicate));
+        const uint32_t writtenFrame = isDuplicate ? entry.reference : i;
+        uint32_t& firstFrame = firstFrames[writtenFrame];
+        if (UINT32_MAX == firstFrame) {
+            firstFrame = i;
+            if (isDuplicate) {
+                entry = track.index[writtenFrame];
+                entry.reference = i;
+            }
+        } else {
+            entry.offset = 0;
+            entry.size = 0;
+            entry.flags = TexturePackageFrameFlag_Duplicate;
+            entry.reference = firstFrame;
+        }
+    }
+}
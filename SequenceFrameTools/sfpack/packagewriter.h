@@ -0,0 +1,83 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+#ifndef SFPACK_PACKAGEWRITER_H_
+#define SFPACK_PACKAGEWRITER_H_
+
+#include "texturepackage.h"
+#include "textureregion.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <vector>
+
+enum PackageLayout {
+    // The layout of TexturePacker.py: the header, the track table, an index per track, the dictionary and
+    // the frame data, track by track. The frames of track 0 are written as they are added, those of the
+    // other tracks are kept until close, which writes them and fills in the indexes.
+    PackageLayout_Indexed,
+    // Written in one pass without seeking, the file may be a pipe: the header, the track table and the
+    // dictionary, the frames of all tracks as they are added, then the indexes
+    // (TexturePackageFlag_IndexAtEnd). Only the index entries are kept.
+    PackageLayout_Streamed
+};
+
+// Writes a version 2 texture package.
+class PackageWriter
+{
+public:
+
+    PackageWriter();
+    ~PackageWriter();
+
+    // Create the package. The tracks give the texture size of every resolution, largest first, their
+    // index offsets are ignored. The codec of the header is the one of the dictionary. Every frame
+    // payload starts at a multiple of alignment.
+    int open(const char* fileName, PackageLayout layout, uint32_t textureNumber,
+             const std::vector<TexturePackageTrack>& tracks, uint32_t textureFormat, uint32_t codec, uint32_t alignment,
+             const std::vector<unsigned char>& dictionary);
+    // Add frame frameIndex of a track, its payload is compressed with codec. The frames of a track are
+    // added in order to indexed packages and in any order to streamed ones. A frame with the same codec,
+    // payload and trim rectangle as a frame added before is recorded as a duplicate, of the first of them
+    // in the sequence.
+    int addFrame(uint32_t track, uint32_t frameIndex, std::vector<unsigned char>& payload, uint32_t codec,
+                 uint16_t flags, uint32_t decodedSize, const TextureBlockRect& trimRect);
+    // write the kept frames and the indexes and close the file, every frame must have been added
+    int close();
+
+private:
+
+    PackageWriter(const PackageWriter&);
+    PackageWriter& operator=(const PackageWriter&);
+
+    struct PendingFrame {
+        std::vector<unsigned char> payload;
+        TexturePackageFrame entry;
+    };
+
+    struct Track {
+        uint64_t indexOffset;
+        std::vector<TexturePackageFrame> index;
+        std::vector<bool> addedFrames;
+        uint32_t addedFrameCount;
+        // frames of the track with the hash of their payload
+        std::multimap<uint64_t, uint32_t> payloadHashes;
+        // Streamed payloads are not read back, a second hash with another seed tells them apart.
+        std::vector<uint64_t> secondPayloadHashes;
+        std::vector<PendingFrame> pendingFrames;
+    };
+
+    int writeBytes(const void* data, size_t size);
+    int writePayload(const std::vector<unsigned char>& payload, TexturePackageFrame& entry_io);
+    bool isSamePayload(const Track& track, const TexturePackageFrame& entry, const std::vector<unsigned char>& payload);
+    void resolveDuplicates(Track& track);
+
+    FILE* m_file;
+    PackageLayout m_layout;
+    uint32_t m_alignment;
+    uint64_t m_dataOffset;
+    std::vector<Track> m_tracks;
+};
+
+#endif // SFPACK_PACKAGEWRITER_H_
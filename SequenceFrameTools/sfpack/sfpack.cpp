@@ -0,0 +1,853 @@
+// Copyright 2022-2023 by Rightware. All rights reserved.
+
+// Packs a PNG sequence into texture packages in one process, the native counterpart of TexturePacker.py.
+//
+// Usage: sfpack [-t threads] [-r tolerance] [-q loss] [-c cache] [-l stream] [-b budget] [-f format] count width
+//               height [codecs [stripes [planar [divisors]]]]
+//
+// The arguments after the options are those of TexturePacker.py, the packages are the same: frame_000000.png
+// and on in the current directory are resized, flipped, encoded with ETCPACK, trimmed, split into stripes
+// and planes and compressed, and <format suffix><codec suffix> is written for every codec, for example
+// _ETC2_RGBA8.lz4. The frames are worked on by -t threads, all of the cores by default, in memory, without
+// the intermediate TGA, PKM and compressed files of the script.
+//
+// Blocks that did not change since the frame before are not encoded again. -r takes blocks that differ by up
+// to tolerance in every channel as well, the packages are smaller and faster to pack but no longer the same.
+//
+// -q trades up to loss dB of the PSNR of every texture for blocks that repeat the bytes of their neighbors,
+// which the codecs compress to matches, see ETC2Encoder. The packages get smaller and decode faster.
+//
+// -c keeps the ETC2 textures and compressed payloads of the frames in the cache directory, keyed by the source
+// pixels and the settings. Packing the sequence again only encodes and compresses the frames that changed and
+// writes the packages from the cache for the others.
+//
+// -l stream writes every frame as soon as it is packed, in the order the threads finish them, and the indexes
+// at the end of the packages (TexturePackageFlag_IndexAtEnd). The packages are written in one pass without
+// seeking, to pipes as well, and only the frames being packed are held in memory. Plugins older than the flag
+// do not read such packages.
+//
+// The texture format follows the alpha of the frames like in the script, -f RGBA8, RGBA1 or RGB packs them in
+// that format instead, for example an opaque sequence as RGBA8 to compare its RGB package against.
+//
+// The codec auto picks the codec and level of every frame of every track: the frame is compressed with each
+// of TunedCodecs, the decoders of the plugin time the payloads on this machine and the smallest one that
+// decodes within -b budget milliseconds, 8 by default, is kept. The codec of the frame is in its index entry.
+// The choice follows the timing, auto packages differ from run to run and their payloads are not cached.
+
+#include "compressor.h"
+#include "decodetimer.h"
+#include "etc2encoder.h"
+#include "framecache.h"
+#include "frameimage.h"
+#include "packagewriter.h"
+
+#include "texturepackage.h"
+#include "textureregion.h"
+#include "workerpool.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct PackageCodec {
+        const char* name;
+        // codec of the frames and the header, of the header only when the codec is tuned
+        uint32_t codec;
+        const char* suffix;
+        uint32_t alignment;
+        // every frame takes the smallest of TunedCodecs within the decode budget
+        bool isTuned;
+    };
+
+    // "none" frames start on a page boundary, the plugin uploads them straight from the mapped package.
+    const PackageCodec PackageCodecs[] = {
+        { "lz4", TexturePackageCodec_LZ4, ".lz4", 1, false },
+        { "zlib", TexturePackageCodec_ZLIB, ".zlib", 1, false },
+        { "none", TexturePackageCodec_None, ".raw", 4096, false },
+        { "lz4block", TexturePackageCodec_LZ4Block, ".lz4b", 1, false },
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+        { "zstd", TexturePackageCodec_ZSTD, ".zst", 1, false },
+#endif
+        { "auto", TexturePackageCodec_LZ4Block, ".auto", 1, true },
+    };
+
+    struct TunedCodec {
+        uint32_t codec;
+        int level;
+    };
+
+    // The candidates of tuned frames. LZ4 blocks decode faster than LZ4 frames of the same ratio. The zstd
+    // frames have no dictionary, the package has none for them.
+    const TunedCodec TunedCodecs[] = {
+        { TexturePackageCodec_None, 0 },
+        // the fast LZ4 compressor, then LZ4HC at its default and highest level
+        { TexturePackageCodec_LZ4Block, 1 },
+        { TexturePackageCodec_LZ4Block, 9 },
+        { TexturePackageCodec_LZ4Block, 12 },
+        { TexturePackageCodec_ZLIB, 6 },
+        { TexturePackageCodec_ZLIB, 9 },
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+        { TexturePackageCodec_ZSTD, 3 },
+        { TexturePackageCodec_ZSTD, 19 },
+#endif
+    };
+
+    // codec ids the statistics count frames of
+    const uint32_t PackageCodecIdCount = TexturePackageCodec_ZSTD + 1;
+
+    struct PackageFormat {
+        ETC2Format format;
+        const char* suffix;
+        // Kanzi graphics format
+        uint32_t graphicsFormat;
+    };
+
+    const PackageFormat PackageFormatRGBA8 = { ETC2Format_RGBA8, "_ETC2_RGBA8", 34 };
+    const PackageFormat PackageFormatRGBA1 = { ETC2Format_RGB8A1, "_ETC2_RGBA1", 32 };
+    const PackageFormat PackageFormatRGB = { ETC2Format_RGB8, "_ETC2_RGB", 30 };
+
+    // the format of a -f argument, nullptr for an unknown name
+    const PackageFormat* findPackageFormat(const char* name)
+    {
+        const PackageFormat* const formats[] = { &PackageFormatRGBA8, &PackageFormatRGBA1, &PackageFormatRGB };
+        for (const PackageFormat* format : formats) {
+            if (0 == strcmp(name, format->suffix + strlen("_ETC2_"))) {
+                return format;
+            }
+        }
+        return nullptr;
+    }
+
+    // frames the zstd dictionary is trained on, spread over the sequence
+    const size_t ZSTDTrainingFrameCount = 64;
+
+    // A thread packs a run of frames in order, each frame takes the blocks of the frame before that did not
+    // change. The first frame of a run is encoded whole, so the packages do not depend on the thread count.
+    const uint32_t FrameRunLength = 8;
+
+    // milliseconds a tuned frame may take to decode
+    const double DefaultDecodeBudget = 8.0;
+
+    struct PackOptions {
+        uint32_t textureNumber;
+        std::vector<const PackageCodec*> codecs;
+        uint32_t stripeCount;
+        bool isPlanar;
+        std::vector<TexturePackageTrack> tracks;
+        // key of the zstd dictionary, the zstd payloads depend on it
+        FrameCacheKey dictionaryKey;
+        // milliseconds, see TunedCodecs
+        double decodeBudget;
+    };
+
+    struct PackStatistics {
+        PackStatistics()
+            : reusedBlocks(0)
+            , cachedTextures(0)
+            , failedCacheWrites(0)
+        {
+            for (std::atomic<uint32_t>& frames : tunedFrames) {
+                frames = 0;
+            }
+        }
+
+        // blocks taken from the frame before
+        std::atomic<uint64_t> reusedBlocks;
+        // textures of tracks that were not encoded, their payloads or the texture came from the cache
+        std::atomic<uint32_t> cachedTextures;
+        std::atomic<uint32_t> failedCacheWrites;
+        // tuned frames of every codec id
+        std::atomic<uint32_t> tunedFrames[PackageCodecIdCount];
+    };
+
+    // a frame of a track packed for one codec
+    struct PackedFrame {
+        std::vector<unsigned char> payload;
+        uint32_t codec;
+        uint16_t flags;
+        uint32_t decodedSize;
+        TextureBlockRect trimRect;
+    };
+
+    std::string getFrameName(uint32_t index)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%06u.png", index);
+        return name;
+    }
+
+    int loadFrame(uint32_t index, FrameImage& image_o)
+    {
+        const std::string fileName = getFrameName(index);
+        int ret = LoadPNGImage(fileName.c_str(), image_o);
+        if (0 != ret) {
+            fprintf(stderr, "%s: cannot read image (%d)\n", fileName.c_str(), ret);
+        }
+        return ret;
+    }
+
+    // The texture format follows the alpha of the whole sequence, like detectTextureFormat of the script.
+    int detectTextureFormat(uint32_t textureNumber, WorkerPool& workerPool, const PackageFormat*& format_o)
+    {
+        std::atomic<bool> isTranslucent(false);
+        std::atomic<bool> isOpaque(true);
+        int ret = workerPool.run(textureNumber, [&](size_t index) {
+            if (isTranslucent) {
+                return 0;
+            }
+            FrameImage image;
+            int frameResult = loadFrame(static_cast<uint32_t>(index), image);
+            if (0 == frameResult) {
+                const FrameAlpha alpha = GetFrameAlpha(image);
+                if (FrameAlpha_Translucent == alpha) {
+                    isTranslucent = true;
+                } else if (FrameAlpha_Binary == alpha) {
+                    isOpaque = false;
+                }
+            }
+            return frameResult;
+        });
+
+        format_o = isTranslucent ? &PackageFormatRGBA8 : (isOpaque ? &PackageFormatRGB : &PackageFormatRGBA1);
+        return ret;
+    }
+
+    // Resize and flip a frame to a track, the way the script prepared the image for etcpack.
+    void prepareTrackImage(const FrameImage& image, const TexturePackageTrack& track, FrameImage& image_o)
+    {
+        ResizeImage(image, track.textureWidth, track.textureHeight, image_o);
+        FlipImage(image_o);
+    }
+
+    // Blocks around the visible pixels of the flipped image, like findTrimRect of the script.
+    TextureBlockRect findTrimRect(const FrameImage& image, const PackageFormat& format)
+    {
+        const TextureBlockRect fullRect = { 0, 0, (image.width + 3) / 4, (image.height + 3) / 4 };
+        uint32_t left = 0;
+        uint32_t top = 0;
+        uint32_t right = 0;
+        uint32_t bottom = 0;
+        if (&PackageFormatRGB == &format) {
+            return fullRect;
+        }
+        if (!GetVisibleRect(image, left, top, right, bottom)) {
+            // Nothing is visible, keep one transparent block.
+            const TextureBlockRect emptyRect = { 0, 0, 1, 1 };
+            return emptyRect;
+        }
+
+        const TextureBlockRect rect = { left / 4, top / 4, (right + 3) / 4 - left / 4, (bottom + 3) / 4 - top / 4 };
+        return rect;
+    }
+
+    void trimTexture(const std::vector<unsigned char>& texture, const TextureBlockRect& rect, size_t textureBlockWidth,
+                     size_t blockSize, std::vector<unsigned char>& trimmed_o)
+    {
+        const size_t rowSize = rect.width * blockSize;
+        trimmed_o.resize(rowSize * rect.height);
+        for (uint32_t row = 0; row < rect.height; ++row) {
+            memcpy(&trimmed_o[row * rowSize], &texture[((rect.y + row) * textureBlockWidth + rect.x) * blockSize],
+                   rowSize);
+        }
+    }
+
+    // Put the 8 byte alpha halves of all RGBA8 blocks before their color halves.
+    void deinterleavePlanes(const unsigned char* blocks, size_t size, std::vector<unsigned char>& planes_o)
+    {
+        const size_t blockCount = size / 16;
+        planes_o.resize(size);
+        for (size_t i = 0; i < blockCount; ++i) {
+            memcpy(&planes_o[i * 8], blocks + i * 16, 8);
+            memcpy(&planes_o[(blockCount + i) * 8], blocks + i * 16 + 8, 8);
+        }
+    }
+
+    int compressFrame(uint32_t codec, int level, const void* dictionary, bool isPlanar, const unsigned char* data,
+                      size_t size, std::vector<unsigned char>& compressed_o)
+    {
+        Compressor& compressor = Compressor::getThreadCompressor();
+        if (!isPlanar) {
+            return compressor.compress(codec, level, dictionary, data, size, compressed_o);
+        }
+
+        std::vector<unsigned char> planes;
+        deinterleavePlanes(data, size, planes);
+        return compressor.compress(codec, level, dictionary, planes.data(), planes.size(), compressed_o);
+    }
+
+    // The payload starts with the stripe count, then the compressed and decoded size of every stripe.
+    int compressStripes(uint32_t codec, int level, const void* dictionary, bool isPlanar,
+                        const std::vector<unsigned char>& blocks, size_t rowSize, uint32_t stripeCount,
+                        std::vector<unsigned char>& payload_o)
+    {
+        const size_t blockRows = blocks.size() / rowSize;
+        const size_t stripeRows = (blockRows + stripeCount - 1) / stripeCount;
+        std::vector<unsigned char> sizes;
+        std::vector<unsigned char> data;
+        std::vector<unsigned char> stripe;
+        uint32_t count = 0;
+        for (size_t row = 0; row < blockRows; row += stripeRows) {
+            const size_t decodedSize = std::min(stripeRows, blockRows - row) * rowSize;
+            int ret = compressFrame(codec, level, dictionary, isPlanar, &blocks[row * rowSize], decodedSize, stripe);
+            if (0 != ret) {
+                return ret;
+            }
+            const uint32_t stripeSizes[2] = { static_cast<uint32_t>(stripe.size()), static_cast<uint32_t>(decodedSize) };
+            for (uint32_t value : stripeSizes) {
+                for (int i = 0; i < 4; ++i) {
+                    sizes.push_back(static_cast<unsigned char>(value >> (8 * i)));
+                }
+            }
+            data.insert(data.end(), stripe.begin(), stripe.end());
+            ++count;
+        }
+
+        payload_o.clear();
+        for (int i = 0; i < 4; ++i) {
+            payload_o.push_back(static_cast<unsigned char>(count >> (8 * i)));
+        }
+        payload_o.insert(payload_o.end(), sizes.begin(), sizes.end());
+        payload_o.insert(payload_o.end(), data.begin(), data.end());
+        return 0;
+    }
+
+    FrameCacheKey getSourceKey(const FrameImage& image)
+    {
+        FrameCacheKeyBuilder builder;
+        builder.add(image.width);
+        builder.add(image.height);
+        builder.add((image.hasAlpha ? 1u : 0u) | (image.isPalette ? 2u : 0u));
+        builder.add(image.pixels.data(), image.pixels.size());
+        return builder.getKey();
+    }
+
+    // The texture of a track depends on the source pixels, the size of the track, the format and the PSNR
+    // loss, ETCPACK encodes every package with the same settings.
+    FrameCacheKey getTextureKey(const FrameCacheKey& sourceKey, const TexturePackageTrack& track,
+                                const PackageFormat& format, const ETC2Encoder& encoder)
+    {
+        FrameCacheKeyBuilder builder;
+        builder.add(sourceKey);
+        builder.add(track.textureWidth);
+        builder.add(track.textureHeight);
+        builder.add(static_cast<uint32_t>(format.format));
+        if (encoder.getMaxPSNRLoss() > 0.0) {
+            const double maxPSNRLoss = encoder.getMaxPSNRLoss();
+            builder.add(&maxPSNRLoss, sizeof(maxPSNRLoss));
+        }
+        return builder.getKey();
+    }
+
+    FrameCacheKey getPayloadKey(const FrameCacheKey& textureKey, const PackOptions& options, const PackageCodec& codec)
+    {
+        FrameCacheKeyBuilder builder;
+        builder.add(textureKey);
+        builder.add(codec.codec);
+        builder.add(options.stripeCount);
+        builder.add(options.isPlanar ? 1u : 0u);
+        if (TexturePackageCodec_ZSTD == codec.codec) {
+            builder.add(options.dictionaryKey);
+        }
+        return builder.getKey();
+    }
+
+    // Get the ETC2 texture of a track and the blocks around its visible pixels from the cache, or encode it
+    // and keep it there.
+    void getTrackTexture(const FrameImage& image, const TexturePackageTrack& track, const PackageFormat& format,
+                         const ETC2Encoder& encoder, const FrameCache& cache, const FrameCacheKey& key,
+                         ETC2Reference& reference_io, PackStatistics& statistics_io, std::vector<unsigned char>& texture_o,
+                         TextureBlockRect& trimRect_o)
+    {
+        const size_t textureSize = static_cast<size_t>((track.textureWidth + 3) / 4) * ((track.textureHeight + 3) / 4) *
+                                   GetETC2BlockSize(format.format);
+        uint32_t fields[4];
+        if (cache.load(key, fields, 4, texture_o) && texture_o.size() == textureSize) {
+            const TextureBlockRect trimRect = { fields[0], fields[1], fields[2], fields[3] };
+            trimRect_o = trimRect;
+            // The reference is no longer the frame before, the next frame is encoded whole.
+            reference_io = ETC2Reference();
+            ++statistics_io.cachedTextures;
+            return;
+        }
+
+        FrameImage trackImage;
+        prepareTrackImage(image, track, trackImage);
+        statistics_io.reusedBlocks += encoder.encode(trackImage.pixels.data(), trackImage.width, trackImage.height,
+                                                     reference_io, texture_o);
+        trimRect_o = findTrimRect(trackImage, format);
+        if (cache.isOpen()) {
+            const uint32_t trimFields[4] = { trimRect_o.x, trimRect_o.y, trimRect_o.width, trimRect_o.height };
+            if (0 != cache.store(key, trimFields, 4, texture_o)) {
+                ++statistics_io.failedCacheWrites;
+            }
+        }
+    }
+
+    // Payloads of uncompressed and tuned frames are not kept in the cache, the first are the texture itself and
+    // the second follow the timing.
+    bool isCachedCodec(const PackageCodec& codec)
+    {
+        return TexturePackageCodec_None != codec.codec && !codec.isTuned;
+    }
+
+    // Compress the texture of a track for a codec, trimmedTexture holds the blocks of trimRect.
+    int packTrackFrame(uint32_t codec, int level, const void* dictionary, const PackOptions& options,
+                       const std::vector<unsigned char>& texture, const std::vector<unsigned char>& trimmedTexture,
+                       const TextureBlockRect& fullRect, const TextureBlockRect& trimRect, size_t blockSize,
+                       PackedFrame& packedFrame_o)
+    {
+        packedFrame_o.codec = codec;
+        packedFrame_o.flags = TexturePackageFrameFlag_Key;
+
+        // Uncompressed frames are uploaded from the package as they are, they keep the whole texture.
+        if (TexturePackageCodec_None == codec) {
+            packedFrame_o.payload = texture;
+            packedFrame_o.decodedSize = static_cast<uint32_t>(texture.size());
+            packedFrame_o.trimRect = fullRect;
+            return 0;
+        }
+
+        int ret = 0;
+        if (options.stripeCount > 1) {
+            packedFrame_o.flags |= TexturePackageFrameFlag_Striped;
+            ret = compressStripes(codec, level, dictionary, options.isPlanar, trimmedTexture,
+                                  trimRect.width * blockSize, options.stripeCount, packedFrame_o.payload);
+        } else {
+            ret = compressFrame(codec, level, dictionary, options.isPlanar, trimmedTexture.data(),
+                                trimmedTexture.size(), packedFrame_o.payload);
+        }
+        if (options.isPlanar) {
+            packedFrame_o.flags |= TexturePackageFrameFlag_Planar;
+        }
+        if (trimRect.x != fullRect.x || trimRect.y != fullRect.y || trimRect.width != fullRect.width ||
+            trimRect.height != fullRect.height) {
+            packedFrame_o.flags |= TexturePackageFrameFlag_Trimmed;
+        }
+        packedFrame_o.decodedSize = static_cast<uint32_t>(trimmedTexture.size());
+        packedFrame_o.trimRect = trimRect;
+        return ret;
+    }
+
+    // Pack the texture of a track with every one of TunedCodecs and keep the smallest payload that decodes
+    // within the budget. The uncompressed texture always does, it is not decoded.
+    int tuneTrackFrame(const PackOptions& options, const std::vector<unsigned char>& texture,
+                       const std::vector<unsigned char>& trimmedTexture, const TextureBlockRect& fullRect,
+                       const TextureBlockRect& trimRect, size_t blockSize, PackStatistics& statistics_io,
+                       PackedFrame& packedFrame_o)
+    {
+        PackedFrame candidate;
+        packedFrame_o.payload.clear();
+        for (const TunedCodec& tunedCodec : TunedCodecs) {
+            int ret = packTrackFrame(tunedCodec.codec, tunedCodec.level, nullptr, options, texture, trimmedTexture,
+                                     fullRect, trimRect, blockSize, candidate);
+            if (0 != ret) {
+                return ret;
+            }
+            if (!packedFrame_o.payload.empty() && candidate.payload.size() >= packedFrame_o.payload.size()) {
+                continue;
+            }
+
+            double decodeTime = 0.0;
+            ret = MeasureFrameDecodeTime(candidate.codec, candidate.flags, candidate.payload, candidate.decodedSize,
+                                         decodeTime);
+            if (0 != ret) {
+                return ret;
+            }
+            if (decodeTime <= options.decodeBudget) {
+                std::swap(packedFrame_o, candidate);
+            }
+        }
+        ++statistics_io.tunedFrames[packedFrame_o.codec];
+        return 0;
+    }
+
+    // Pack a frame into every track and codec, packedFrames_o holds the codecs of track 0, then of track 1.
+    // references_io holds the frame before for every track. Payloads found in the cache are not compressed
+    // again, a track whose payloads are all there is not encoded either.
+    int packFrame(uint32_t index, const PackOptions& options, const PackageFormat& format, const ETC2Encoder& encoder,
+                  const void* dictionary, const FrameCache& cache, std::vector<ETC2Reference>& references_io,
+                  PackStatistics& statistics_io, std::vector<PackedFrame>& packedFrames_o)
+    {
+        FrameImage image;
+        int ret = loadFrame(index, image);
+        if (0 != ret) {
+            return ret;
+        }
+
+        const size_t blockSize = GetETC2BlockSize(format.format);
+        packedFrames_o.resize(options.tracks.size() * options.codecs.size());
+        std::vector<unsigned char> texture;
+        std::vector<unsigned char> trimmedTexture;
+        std::vector<FrameCacheKey> payloadKeys(options.codecs.size());
+        std::vector<bool> isCached(options.codecs.size(), false);
+        const FrameCacheKey sourceKey = cache.isOpen() ? getSourceKey(image) : FrameCacheKey();
+        for (size_t track = 0; track < options.tracks.size(); ++track) {
+            const TexturePackageTrack& packageTrack = options.tracks[track];
+            const FrameCacheKey textureKey = getTextureKey(sourceKey, packageTrack, format, encoder);
+            bool needsTexture = false;
+            for (size_t codecIndex = 0; codecIndex < options.codecs.size(); ++codecIndex) {
+                const PackageCodec& codec = *options.codecs[codecIndex];
+                PackedFrame& packedFrame = packedFrames_o[track * options.codecs.size() + codecIndex];
+                uint32_t fields[6];
+                isCached[codecIndex] = (isCachedCodec(codec) && cache.isOpen());
+                if (isCached[codecIndex]) {
+                    payloadKeys[codecIndex] = getPayloadKey(textureKey, options, codec);
+                    isCached[codecIndex] = cache.load(payloadKeys[codecIndex], fields, 6, packedFrame.payload);
+                }
+                if (isCached[codecIndex]) {
+                    const TextureBlockRect trimRect = { fields[2], fields[3], fields[4], fields[5] };
+                    packedFrame.codec = codec.codec;
+                    packedFrame.flags = static_cast<uint16_t>(fields[0]);
+                    packedFrame.decodedSize = fields[1];
+                    packedFrame.trimRect = trimRect;
+                } else {
+                    needsTexture = true;
+                }
+            }
+            if (!needsTexture) {
+                references_io[track] = ETC2Reference();
+                ++statistics_io.cachedTextures;
+                continue;
+            }
+
+            TextureBlockRect trimRect;
+            getTrackTexture(image, packageTrack, format, encoder, cache, textureKey, references_io[track],
+                            statistics_io, texture, trimRect);
+            const TextureBlockRect fullRect = { 0, 0, (packageTrack.textureWidth + 3) / 4,
+                                                (packageTrack.textureHeight + 3) / 4 };
+            trimTexture(texture, trimRect, fullRect.width, blockSize, trimmedTexture);
+
+            for (size_t codecIndex = 0; codecIndex < options.codecs.size(); ++codecIndex) {
+                const PackageCodec& codec = *options.codecs[codecIndex];
+                PackedFrame& packedFrame = packedFrames_o[track * options.codecs.size() + codecIndex];
+                const void* codecDictionary = (TexturePackageCodec_ZSTD == codec.codec) ? dictionary : nullptr;
+                if (isCached[codecIndex]) {
+                    continue;
+                }
+
+                if (codec.isTuned) {
+                    ret = tuneTrackFrame(options, texture, trimmedTexture, fullRect, trimRect, blockSize, statistics_io,
+                                         packedFrame);
+                } else {
+                    ret = packTrackFrame(codec.codec, Compressor::getDefaultLevel(codec.codec), codecDictionary,
+                                         options, texture, trimmedTexture, fullRect, trimRect, blockSize, packedFrame);
+                }
+                if (0 != ret) {
+                    fprintf(stderr, "%s: %s compression failed (%d)\n", getFrameName(index).c_str(), codec.name, ret);
+                    return ret;
+                }
+
+                if (cache.isOpen() && isCachedCodec(codec)) {
+                    const uint32_t fields[6] = { packedFrame.flags, packedFrame.decodedSize, trimRect.x, trimRect.y,
+                                                 trimRect.width, trimRect.height };
+                    if (0 != cache.store(payloadKeys[codecIndex], fields, 6, packedFrame.payload)) {
+                        ++statistics_io.failedCacheWrites;
+                    }
+                }
+            }
+        }
+        return 0;
+    }
+
+    // Add a packed frame to the package of every codec.
+    int addPackedFrame(uint32_t index, const PackOptions& options, std::vector<PackedFrame>& packedFrames,
+                       std::vector<PackageWriter>& writers)
+    {
+        int ret = 0;
+        for (size_t track = 0; track < options.tracks.size() && 0 == ret; ++track) {
+            for (size_t codec = 0; codec < options.codecs.size() && 0 == ret; ++codec) {
+                PackedFrame& packedFrame = packedFrames[track * options.codecs.size() + codec];
+                ret = writers[codec].addFrame(static_cast<uint32_t>(track), index, packedFrame.payload,
+                                              packedFrame.codec, packedFrame.flags, packedFrame.decodedSize,
+                                              packedFrame.trimRect);
+            }
+        }
+        return ret;
+    }
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    // Train the zstd dictionary on the whole track 0 textures of frames spread over the sequence.
+    int trainDictionary(const PackOptions& options, const PackageFormat& format, const ETC2Encoder& encoder,
+                        const FrameCache& cache, WorkerPool& workerPool, std::vector<unsigned char>& dictionary_o)
+    {
+        const size_t step = std::max<size_t>(1, options.textureNumber / ZSTDTrainingFrameCount);
+        std::vector<std::vector<unsigned char> > samples((options.textureNumber + step - 1) / step);
+        int ret = workerPool.run(samples.size(), [&](size_t index) {
+            FrameImage image;
+            int frameResult = loadFrame(static_cast<uint32_t>(index * step), image);
+            if (0 == frameResult) {
+                const FrameCacheKey key =
+                    cache.isOpen() ? getTextureKey(getSourceKey(image), options.tracks[0], format, encoder)
+                                   : FrameCacheKey();
+                ETC2Reference reference = ETC2Reference();
+                PackStatistics statistics;
+                TextureBlockRect trimRect;
+                getTrackTexture(image, options.tracks[0], format, encoder, cache, key, reference, statistics,
+                                samples[index], trimRect);
+            }
+            return frameResult;
+        });
+        if (0 != ret) {
+            return ret;
+        }
+
+        dictionary_o = Compressor::trainDictionary(samples);
+        if (dictionary_o.empty()) {
+            printf("no dictionary, the zstd frames are compressed without one\n");
+        }
+        return 0;
+    }
+#endif
+
+    bool parseCodecs(const char* names, std::vector<const PackageCodec*>& codecs_o)
+    {
+        std::string list(names);
+        size_t start = 0;
+        while (start <= list.size()) {
+            const size_t end = std::min(list.find(',', start), list.size());
+            const std::string name = list.substr(start, end - start);
+            const PackageCodec* codec = nullptr;
+            for (const PackageCodec& packageCodec : PackageCodecs) {
+                if (name == packageCodec.name) {
+                    codec = &packageCodec;
+                }
+            }
+            if (nullptr == codec) {
+                fprintf(stderr, "unknown codec %s\n", name.c_str());
+                return false;
+            }
+            codecs_o.push_back(codec);
+            start = end + 1;
+        }
+        return true;
+    }
+
+    // Track 0 has the size of the package, every divisor adds a track of that fraction of it.
+    void parseTracks(const char* divisors, uint32_t width, uint32_t height, std::vector<TexturePackageTrack>& tracks_o)
+    {
+        const TexturePackageTrack firstTrack = { width, height, 0 };
+        tracks_o.push_back(firstTrack);
+        if (nullptr == divisors) {
+            return;
+        }
+
+        const char* divisor = divisors;
+        while ('\0' != *divisor) {
+            const uint32_t value = static_cast<uint32_t>(std::max(1, atoi(divisor)));
+            const TexturePackageTrack track = { std::max(4u, width / value), std::max(4u, height / value), 0 };
+            tracks_o.push_back(track);
+            divisor += strcspn(divisor, ",");
+            if (',' == *divisor) {
+                ++divisor;
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t reuseTolerance = 0;
+    double maxPSNRLoss = 0.0;
+    const char* cacheDirectory = "";
+    PackageLayout layout = PackageLayout_Indexed;
+    double decodeBudget = DefaultDecodeBudget;
+    const char* formatName = "";
+    int firstArgument = 1;
+    while (firstArgument + 1 < argc) {
+        if (0 == strcmp(argv[firstArgument], "-t")) {
+            threadCount = static_cast<unsigned int>(std::max(1, atoi(argv[firstArgument + 1])));
+        } else if (0 == strcmp(argv[firstArgument], "-r")) {
+            reuseTolerance = static_cast<uint32_t>(std::max(0, atoi(argv[firstArgument + 1])));
+        } else if (0 == strcmp(argv[firstArgument], "-q")) {
+            maxPSNRLoss = std::max(0.0, atof(argv[firstArgument + 1]));
+        } else if (0 == strcmp(argv[firstArgument], "-c")) {
+            cacheDirectory = argv[firstArgument + 1];
+        } else if (0 == strcmp(argv[firstArgument], "-l")) {
+            layout = (0 == strcmp(argv[firstArgument + 1], "stream")) ? PackageLayout_Streamed : PackageLayout_Indexed;
+        } else if (0 == strcmp(argv[firstArgument], "-b")) {
+            decodeBudget = std::max(0.0, atof(argv[firstArgument + 1]));
+        } else if (0 == strcmp(argv[firstArgument], "-f")) {
+            formatName = argv[firstArgument + 1];
+        } else {
+            break;
+        }
+        firstArgument += 2;
+    }
+
+    const int argumentCount = argc - firstArgument;
+    if (argumentCount < 3 || argumentCount > 7) {
+        fprintf(stderr, "usage: sfpack [-t threads] [-r tolerance] [-q loss] [-c cache] [-l stream] [-b budget] "
+                        "[-f format] count width height [codecs [stripes [planar [divisors]]]]\n");
+        return 1;
+    }
+
+    const char* const* arguments = argv + firstArgument;
+    PackOptions options;
+    options.textureNumber = static_cast<uint32_t>(std::max(0, atoi(arguments[0])));
+    const uint32_t width = static_cast<uint32_t>(std::max(0, atoi(arguments[1])));
+    const uint32_t height = static_cast<uint32_t>(std::max(0, atoi(arguments[2])));
+    options.stripeCount = (argumentCount > 4) ? static_cast<uint32_t>(std::max(1, atoi(arguments[4]))) : 1;
+    options.isPlanar = (argumentCount > 5) && (0 == strcmp(arguments[5], "planar"));
+    options.decodeBudget = decodeBudget;
+    if (!parseCodecs((argumentCount > 3) ? arguments[3] : "lz4,zlib", options.codecs)) {
+        return 1;
+    }
+    parseTracks((argumentCount > 6) ? arguments[6] : nullptr, width, height, options.tracks);
+    if (0 == options.textureNumber || 0 == width || 0 == height) {
+        fprintf(stderr, "the package needs frames and a size\n");
+        return 1;
+    }
+
+    const PackageFormat* forcedFormat = nullptr;
+    if ('\0' != *formatName) {
+        forcedFormat = findPackageFormat(formatName);
+        if (nullptr == forcedFormat) {
+            fprintf(stderr, "unknown texture format %s\n", formatName);
+            return 1;
+        }
+    }
+
+    WorkerPool workerPool(threadCount);
+    const PackageFormat* format = nullptr;
+    if (0 != detectTextureFormat(options.textureNumber, workerPool, format)) {
+        return 1;
+    }
+    // A forced format may drop the alpha the frames have, the detected one is shown to tell.
+    if (nullptr != forcedFormat && forcedFormat != format) {
+        printf("the frames are %s, packed as %s\n", format->suffix + 1, forcedFormat->suffix + 1);
+        format = forcedFormat;
+    }
+    // Planes split the alpha and color halves of RGBA8 blocks, the other formats have no alpha half.
+    options.isPlanar = options.isPlanar && (&PackageFormatRGBA8 == format);
+    const ETC2Encoder encoder(format->format, reuseTolerance, maxPSNRLoss);
+    printf("%u frames %ux%u in %zu tracks, %s, %u threads\n", options.textureNumber, width, height,
+           options.tracks.size(), format->suffix + 1, threadCount);
+
+    // With a tolerance the texture of a frame depends on the frames before, not only on its own pixels.
+    FrameCache cache;
+    if ('\0' != *cacheDirectory && 0 != reuseTolerance) {
+        printf("the cache is not used with -r\n");
+    } else {
+        int ret = cache.open(cacheDirectory);
+        if (0 != ret) {
+            fprintf(stderr, "%s: cannot use the cache directory (%d)\n", cacheDirectory, ret);
+            return 1;
+        }
+    }
+
+    std::vector<unsigned char> dictionary;
+    void* compressionDictionary = nullptr;
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    for (const PackageCodec* codec : options.codecs) {
+        if (TexturePackageCodec_ZSTD == codec->codec && nullptr == compressionDictionary) {
+            if (0 != trainDictionary(options, *format, encoder, cache, workerPool, dictionary)) {
+                return 1;
+            }
+            if (!dictionary.empty()) {
+                compressionDictionary = Compressor::createDictionary(dictionary);
+            }
+            FrameCacheKeyBuilder dictionaryKey;
+            dictionaryKey.add(dictionary.data(), dictionary.size());
+            options.dictionaryKey = dictionaryKey.getKey();
+        }
+    }
+#endif
+
+    std::vector<PackageWriter> writers(options.codecs.size());
+    int ret = 0;
+    for (size_t i = 0; i < options.codecs.size() && 0 == ret; ++i) {
+        const PackageCodec& codec = *options.codecs[i];
+        const std::string fileName = std::string(format->suffix) + codec.suffix;
+        const std::vector<unsigned char> noDictionary;
+        ret = writers[i].open(fileName.c_str(), layout, options.textureNumber, options.tracks,
+                              format->graphicsFormat, codec.codec, codec.alignment,
+                              (TexturePackageCodec_ZSTD == codec.codec) ? dictionary : noDictionary);
+        if (0 != ret) {
+            fprintf(stderr, "%s: cannot write package\n", fileName.c_str());
+        }
+    }
+
+    // Streamed packages take every frame as soon as it is packed, a thread holds only the frame it packs.
+    // Indexed ones are packed in batches of runs, which are written in order while the next batch waits.
+    const bool isStreamed = (PackageLayout_Streamed == layout);
+    const uint32_t batchSize = isStreamed ? options.textureNumber : threadCount * 2 * FrameRunLength;
+    std::vector<std::vector<PackedFrame> > packedFrames(isStreamed ? 0 : batchSize);
+    std::mutex writerLock;
+    PackStatistics statistics;
+    for (uint32_t first = 0; first < options.textureNumber && 0 == ret; first += batchSize) {
+        const uint32_t count = std::min(batchSize, options.textureNumber - first);
+        ret = workerPool.run((count + FrameRunLength - 1) / FrameRunLength, [&](size_t run) {
+            std::vector<ETC2Reference> references(options.tracks.size());
+            std::vector<PackedFrame> streamedFrame;
+            const uint32_t runFirst = static_cast<uint32_t>(run) * FrameRunLength;
+            const uint32_t runEnd = std::min(runFirst + FrameRunLength, count);
+            for (uint32_t index = runFirst; index < runEnd; ++index) {
+                std::vector<PackedFrame>& packedFrame = isStreamed ? streamedFrame : packedFrames[index];
+                int frameResult = packFrame(first + index, options, *format, encoder, compressionDictionary, cache,
+                                            references, statistics, packedFrame);
+                if (0 == frameResult && isStreamed) {
+                    std::lock_guard<std::mutex> lock(writerLock);
+                    frameResult = addPackedFrame(first + index, options, packedFrame, writers);
+                }
+                if (0 != frameResult) {
+                    return frameResult;
+                }
+            }
+            return 0;
+        });
+
+        for (uint32_t frame = 0; frame < count && !isStreamed && 0 == ret; ++frame) {
+            ret = addPackedFrame(first + frame, options, packedFrames[frame], writers);
+        }
+        printf("packed %u of %u frames\n", first + count, options.textureNumber);
+    }
+
+    if (0 == ret) {
+        printf("%llu blocks taken from the frame before\n",
+               static_cast<unsigned long long>(statistics.reusedBlocks.load()));
+    }
+    for (const PackageCodec* codec : options.codecs) {
+        if (0 == ret && codec->isTuned) {
+            printf("%s%s: frames within %.2f ms:", format->suffix, codec->suffix, options.decodeBudget);
+            for (const PackageCodec& packageCodec : PackageCodecs) {
+                if (!packageCodec.isTuned && packageCodec.codec < PackageCodecIdCount) {
+                    printf(" %u %s", statistics.tunedFrames[packageCodec.codec].load(), packageCodec.name);
+                }
+            }
+            printf("\n");
+        }
+    }
+    if (0 == ret && cache.isOpen()) {
+        printf("%u of %zu textures taken from the cache\n", statistics.cachedTextures.load(),
+               options.textureNumber * options.tracks.size());
+        if (0 != statistics.failedCacheWrites) {
+            printf("%u cache entries could not be written to %s\n", statistics.failedCacheWrites.load(), cacheDirectory);
+        }
+    }
+
+    for (size_t i = 0; i < writers.size() && 0 == ret; ++i) {
+        ret = writers[i].close();
+        if (0 != ret) {
+            fprintf(stderr, "%s%s: cannot write package\n", format->suffix, options.codecs[i]->suffix);
+        }
+    }
+
+#if SEQUENCEFRAMEPLUGIN_ZSTD
+    if (nullptr != compressionDictionary) {
+        Compressor::freeDictionary(compressionDictionary);
+    }
+#endif
+
+    return (0 == ret) ? 0 : 1;
+}